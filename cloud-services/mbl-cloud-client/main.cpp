@@ -17,11 +17,10 @@
 
 #include "application_init.h"
 #include "log.h"
+#include "log_trace.h"
 #include "MblCloudClient.h"
 #include "signals.h"
 
-#include "mbed-trace/mbed_trace.h"
-
 #include <cerrno>
 #include <cstdio>
 #include <unistd.h>
@@ -74,6 +73,10 @@ int main()
 
     const MblError run_err = MblCloudClient::run();
 
-    tr_info("Exiting application");
+    {
+        MblLogErrorScope log_error(run_err);
+        tr_info("Exiting application");
+    }
+    log_shutdown();
     return (run_err == Error::ShutdownRequested)? 0 : 1;
 }
@@ -0,0 +1,183 @@
+/*
+ * Copyright (c) 2020 Arm Limited and Contributors. All rights reserved.
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ * Licensed under the Apache License, Version 2.0 (the License); you may
+ * not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an AS IS BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef MblBoundedQueue_h_
+#define MblBoundedQueue_h_
+
+#include <atomic>
+#include <cassert>
+#include <cstddef>
+#include <memory>
+#include <stdint.h>
+
+namespace mbl {
+
+/**
+ * A bounded, lock-free, multi-producer multi-consumer FIFO queue (Dmitry
+ * Vyukov's bounded MPMC queue).
+ *
+ * Each cell carries a sequence number that tells producers and consumers
+ * whether the cell is free or full for the current lap around the ring, so
+ * pushing and popping each need a single CAS on a shared position counter.
+ * Items are filled and drained in place via callbacks so that large items
+ * don't have to be copied through a temporary.
+ *
+ * The capacity is rounded up to a power of two.
+ */
+template <typename T>
+class MblBoundedQueue
+{
+public:
+    explicit MblBoundedQueue(size_t capacity)
+        : mask_(round_up_to_power_of_two(capacity) - 1)
+        , cells_(new Cell[mask_ + 1])
+        , enqueue_pos_(0)
+        , dequeue_pos_(0)
+    {
+        for (size_t i = 0; i <= mask_; ++i) {
+            cells_[i].sequence.store(i, std::memory_order_relaxed);
+        }
+    }
+
+    /**
+     * Try to push an item, filling it in place with fill(T&).
+     *
+     * @return false if the queue is full.
+     */
+    template <typename Fill>
+    bool try_push_with(Fill fill)
+    {
+        Cell* cell;
+        size_t pos = enqueue_pos_.load(std::memory_order_relaxed);
+        for (;;) {
+            cell = &cells_[pos & mask_];
+            const size_t seq = cell->sequence.load(std::memory_order_acquire);
+            const intptr_t diff = static_cast<intptr_t>(seq) - static_cast<intptr_t>(pos);
+            if (diff == 0) {
+                if (enqueue_pos_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                    break;
+                }
+            }
+            else if (diff < 0) {
+                return false;
+            }
+            else {
+                pos = enqueue_pos_.load(std::memory_order_relaxed);
+            }
+        }
+
+        fill(cell->data);
+        cell->sequence.store(pos + 1, std::memory_order_release);
+        return true;
+    }
+
+    bool try_push(const T& item)
+    {
+        return try_push_with([&item](T& slot) { slot = item; });
+    }
+
+    /**
+     * Try to pop the oldest item, handing it to drain(T&) in place.
+     *
+     * @return false if the queue is empty.
+     */
+    template <typename Drain>
+    bool try_pop_with(Drain drain)
+    {
+        Cell* cell;
+        size_t pos = dequeue_pos_.load(std::memory_order_relaxed);
+        for (;;) {
+            cell = &cells_[pos & mask_];
+            const size_t seq = cell->sequence.load(std::memory_order_acquire);
+            const intptr_t diff = static_cast<intptr_t>(seq) - static_cast<intptr_t>(pos + 1);
+            if (diff == 0) {
+                if (dequeue_pos_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                    break;
+                }
+            }
+            else if (diff < 0) {
+                return false;
+            }
+            else {
+                pos = dequeue_pos_.load(std::memory_order_relaxed);
+            }
+        }
+
+        drain(cell->data);
+        cell->sequence.store(pos + mask_ + 1, std::memory_order_release);
+        return true;
+    }
+
+    bool try_pop(T& item)
+    {
+        return try_pop_with([&item](T& slot) { item = slot; });
+    }
+
+    /**
+     * Whether the oldest cell has been published yet. Only a snapshot: other
+     * threads may push or pop immediately afterwards.
+     */
+    bool empty() const
+    {
+        const size_t pos = dequeue_pos_.load(std::memory_order_acquire);
+        const size_t seq = cells_[pos & mask_].sequence.load(std::memory_order_acquire);
+        return static_cast<intptr_t>(seq) - static_cast<intptr_t>(pos + 1) < 0;
+    }
+
+    size_t capacity() const
+    {
+        return mask_ + 1;
+    }
+
+private:
+    static const size_t cache_line_size = 64;
+
+    struct Cell
+    {
+        std::atomic<size_t> sequence;
+        T data;
+    };
+
+    static size_t round_up_to_power_of_two(const size_t n)
+    {
+        assert(n > 0);
+        size_t ret = 1;
+        while (ret < n) {
+            ret <<= 1;
+        }
+        return ret;
+    }
+
+    // No copying
+    MblBoundedQueue(const MblBoundedQueue&);
+    MblBoundedQueue& operator=(const MblBoundedQueue&);
+
+    const size_t mask_;
+    const std::unique_ptr<Cell[]> cells_;
+
+    // Keep the producer and consumer positions on separate cache lines so
+    // that producers and consumers don't keep stealing each other's line.
+    char pad0_[cache_line_size];
+    std::atomic<size_t> enqueue_pos_;
+    char pad1_[cache_line_size - sizeof(std::atomic<size_t>)];
+    std::atomic<size_t> dequeue_pos_;
+    char pad2_[cache_line_size - sizeof(std::atomic<size_t>)];
+};
+
+} // namespace mbl
+
+#endif // MblBoundedQueue_h_
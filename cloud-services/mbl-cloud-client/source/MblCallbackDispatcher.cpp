@@ -0,0 +1,203 @@
+/*
+ * Copyright (c) 2020 Arm Limited and Contributors. All rights reserved.
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ * Licensed under the Apache License, Version 2.0 (the License); you may
+ * not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an AS IS BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "MblCallbackDispatcher.h"
+
+#include "log_trace.h"
+#include "metrics.h"
+#include "monotonic_time.h"
+#include "signals.h"
+
+#include <cassert>
+#include <cerrno>
+#include <cstring>
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+#define TRACE_GROUP "mbl"
+
+static mbl::metrics::Histogram g_post_us("mbl_callback_post_us");
+static mbl::metrics::Histogram g_dispatch_latency_us("mbl_callback_dispatch_latency_us");
+static mbl::metrics::Counter g_handled_inline("mbl_callback_handled_inline");
+static mbl::metrics::Counter g_post_blocked("mbl_callback_post_blocked");
+
+// How often the worker checks the queue if it can't sleep on its eventfd
+static const useconds_t g_poll_interval_us = 10000;
+
+namespace mbl {
+
+const size_t MblCallbackDispatcher::text_size;
+
+MblCallbackDispatcher::MblCallbackDispatcher(const size_t capacity, const Handler handler)
+    : handler_(handler)
+    , queue_(capacity)
+    , wake_fd_(-1)
+    , thread_()
+    , running_(false)
+    , stopping_(false)
+    , posters_waiting_(0)
+{
+    assert(handler_);
+    pthread_mutex_init(&mutex_, 0);
+    pthread_cond_init(&space_cond_, 0);
+}
+
+MblCallbackDispatcher::~MblCallbackDispatcher()
+{
+    stop();
+    pthread_cond_destroy(&space_cond_);
+    pthread_mutex_destroy(&mutex_);
+}
+
+MblError MblCallbackDispatcher::start()
+{
+    assert(!running_);
+
+    wake_fd_ = eventfd(0, EFD_CLOEXEC);
+    if (wake_fd_ == -1) {
+        tr_err("Failed to create eventfd: %s", std::strerror(errno));
+        return Error::EventLoopInitEventfd;
+    }
+
+    const int create_err = create_thread_with_signals_blocked(&thread_, &MblCallbackDispatcher::thread_main, this);
+
+    if (create_err != 0) {
+        tr_err("Failed to create callback dispatcher thread: %s", std::strerror(create_err));
+        close(wake_fd_);
+        wake_fd_ = -1;
+        return Error::DispatcherInitThreadCreate;
+    }
+
+    running_ = true;
+    return Error::None;
+}
+
+void MblCallbackDispatcher::stop()
+{
+    if (!running_) {
+        return;
+    }
+
+    stopping_ = true;
+    eventfd_write(wake_fd_, 1);
+    pthread_join(thread_, 0);
+    running_ = false;
+
+    close(wake_fd_);
+    wake_fd_ = -1;
+}
+
+void MblCallbackDispatcher::post(const uint32_t type, const int32_t arg, const char* const text)
+{
+    const int64_t start_us = get_monotonic_time_us();
+    Event event;
+    event.type = type;
+    event.arg = arg;
+    event.posted_us = start_us;
+    event.text[0] = '\0';
+    if (text) {
+        std::strncat(event.text, text, sizeof(event.text) - 1);
+    }
+
+    if (!running_.load(std::memory_order_acquire)) {
+        // No worker, so nothing else can be handling events
+        g_handled_inline.add();
+        dispatch(event);
+        g_post_us.record(static_cast<uint64_t>(get_monotonic_time_us() - start_us));
+        return;
+    }
+
+    if (!queue_.try_push(event)) {
+        // Better to hold up the caller than to lose a registration state
+        // change, or to handle it here while the worker may still be
+        // handling earlier ones. Announce that we're waiting before trying
+        // again under the mutex so that the worker can't free a slot without
+        // noticing us.
+        g_post_blocked.add();
+        posters_waiting_.fetch_add(1);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        pthread_mutex_lock(&mutex_);
+        while (!queue_.try_push(event)) {
+            pthread_cond_wait(&space_cond_, &mutex_);
+        }
+        pthread_mutex_unlock(&mutex_);
+        posters_waiting_.fetch_sub(1);
+    }
+
+    eventfd_write(wake_fd_, 1);
+    g_post_us.record(static_cast<uint64_t>(get_monotonic_time_us() - start_us));
+}
+
+void* MblCallbackDispatcher::thread_main(void* const arg)
+{
+    static_cast<MblCallbackDispatcher*>(arg)->run();
+    return 0;
+}
+
+void MblCallbackDispatcher::run()
+{
+    bool read_failed = false;
+    for (;;) {
+        Event event;
+        while (queue_.try_pop(event)) {
+            notify_blocked_posters();
+            dispatch(event);
+        }
+
+        if (stopping_) {
+            // Events posted between the drain above and stop() setting
+            // stopping_
+            while (queue_.try_pop(event)) {
+                notify_blocked_posters();
+                dispatch(event);
+            }
+            return;
+        }
+
+        // Never give up on the queue: post() would then block the mbed event
+        // loop forever once it filled. If the eventfd can't be read, poll
+        // the queue instead.
+        eventfd_t value;
+        if (eventfd_read(wake_fd_, &value) != 0 && errno != EINTR) {
+            if (!read_failed) {
+                tr_err("Callback dispatcher failed to read eventfd, polling instead: %s", std::strerror(errno));
+                read_failed = true;
+            }
+            usleep(g_poll_interval_us);
+        }
+    }
+}
+
+void MblCallbackDispatcher::dispatch(const Event& event)
+{
+    g_dispatch_latency_us.record(static_cast<uint64_t>(get_monotonic_time_us() - event.posted_us));
+    handler_(event);
+}
+
+void MblCallbackDispatcher::notify_blocked_posters()
+{
+    // Pairs with the fence in post(): either the poster sees the slot we just
+    // freed, or we see that it is waiting.
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (posters_waiting_.load(std::memory_order_relaxed) != 0) {
+        pthread_mutex_lock(&mutex_);
+        pthread_cond_broadcast(&space_cond_);
+        pthread_mutex_unlock(&mutex_);
+    }
+}
+
+} // namespace mbl
@@ -0,0 +1,131 @@
+/*
+ * Copyright (c) 2020 Arm Limited and Contributors. All rights reserved.
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ * Licensed under the Apache License, Version 2.0 (the License); you may
+ * not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an AS IS BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef MblCallbackDispatcher_h_
+#define MblCallbackDispatcher_h_
+
+#include "MblBoundedQueue.h"
+#include "MblError.h"
+
+#include <atomic>
+#include <cstddef>
+#include <pthread.h>
+#include <stdint.h>
+
+namespace mbl {
+
+/**
+ * Runs callbacks from the mbed event loop on a worker thread of their own.
+ *
+ * The mbed event loop thread also runs CoAP timers and retransmissions, so
+ * its callbacks must return quickly. A callback posts a small event record to
+ * a bounded lock-free queue and wakes the worker, which passes the events to
+ * the handler in order. The handler may block, e.g. on a mutex.
+ *
+ * If the queue is full, post() waits for the worker to make room rather than
+ * losing the event or handling it out of order, so the handler must never
+ * wait for a thread that posts. Only if the worker isn't running does post()
+ * call the handler itself.
+ *
+ * The time each post() takes is recorded in the metric
+ * mbl_callback_post_us and the time from posting an event to handling it in
+ * mbl_callback_dispatch_latency_us.
+ */
+class MblCallbackDispatcher
+{
+public:
+    // Longest text an event carries, including the terminating null
+    static const size_t text_size = 128;
+
+    struct Event
+    {
+        // Meaning of type, arg and text is up to the handler
+        uint32_t type;
+        int32_t arg;
+        int64_t posted_us;
+        // Copied when the event is posted, so the poster can pass state that
+        // may change once it returns. Empty if none was passed.
+        char text[text_size];
+    };
+
+    typedef void (*Handler)(const Event& event);
+
+    /**
+     * @param capacity maximum number of queued events (rounded up to a power
+     *        of two).
+     * @param handler called on the worker thread for each event.
+     */
+    MblCallbackDispatcher(size_t capacity, Handler handler);
+
+    /**
+     * Stops the worker thread (if it is running), handling all queued events
+     * first.
+     */
+    ~MblCallbackDispatcher();
+
+    /**
+     * Start the worker thread.
+     */
+    MblError start();
+
+    /**
+     * Handle all queued events and stop the worker thread. Events posted
+     * after this are handled by post() itself. Must not be called while
+     * another thread may be in post().
+     */
+    void stop();
+
+    /**
+     * Queue an event for the worker. Thread safe, and only blocks when the
+     * queue is full or the handler has to be called directly.
+     *
+     * @param text copied into the event, truncated to text_size - 1
+     *        characters. May be null.
+     */
+    void post(uint32_t type, int32_t arg, const char* text = nullptr);
+
+private:
+    // No copying
+    MblCallbackDispatcher(const MblCallbackDispatcher&);
+    MblCallbackDispatcher& operator=(const MblCallbackDispatcher&);
+
+    static void* thread_main(void* arg);
+    void run();
+    void dispatch(const Event& event);
+    void notify_blocked_posters();
+
+    const Handler handler_;
+    MblBoundedQueue<Event> queue_;
+
+    // Written by post() after each event, read by the worker to sleep until
+    // there is something to do
+    int wake_fd_;
+
+    pthread_t thread_;
+    std::atomic<bool> running_;
+    std::atomic<bool> stopping_;
+    std::atomic<unsigned> posters_waiting_;
+
+    // Used only to sleep and wake: posters wait on space_cond_ when the queue
+    // is full
+    pthread_mutex_t mutex_;
+    pthread_cond_t space_cond_;
+};
+
+} // namespace mbl
+
+#endif // MblCallbackDispatcher_h_
@@ -18,31 +18,70 @@
 #include "MblCloudClient.h"
 
 #include "MblScopedLock.h"
+#include "log.h"
+#include "log_trace.h"
+#include "metrics.h"
 #include "monotonic_time.h"
+#include "signals.h"
 #include "update_handlers.h"
 
-#include "mbed-trace/mbed_trace.h"
+#include "nanostack-event-loop/eventOS_event.h"
+#include "nanostack-event-loop/eventOS_scheduler.h"
 #include "ns-hal-pal/ns_event_loop.h"
 
 #include <cassert>
+#include <cerrno>
 #include <csignal>
+#include <cstdio>
+#include <cstring>
+#include <inttypes.h>
+#include <random>
+#include <sched.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/timerfd.h>
 #include <unistd.h>
 
 #include MBED_CLOUD_CLIENT_USER_CONFIG_FILE
 
 #define TRACE_GROUP "mbl"
 
-static volatile sig_atomic_t g_shutdown_signal = 0;
+// Most callback events from the mbed event loop that can wait for the
+// dispatcher thread before the event loop itself has to wait
+static const size_t g_callback_queue_capacity = 64;
 
 // Period between re-registrations with the LWM2M server.
 // MBED_CLOUD_CLIENT_LIFETIME is how long we should stay registered after each
 // re-registration
 static const int g_reregister_period_s = MBED_CLOUD_CLIENT_LIFETIME / 2;
 
-extern "C" void mbl_shutdown_handler(int signal)
-{
-    g_shutdown_signal = signal;
-}
+// Each re-registration period is randomly lengthened or shortened by up to
+// MBL_REREGISTER_JITTER_PERCENT percent. After a failure once registered, the
+// next update is MBL_REREGISTER_MIN_BACKOFF_S seconds later, doubling with
+// each further failure up to the period. Set with the CMake options of the
+// same names.
+#ifndef MBL_REREGISTER_JITTER_PERCENT
+#define MBL_REREGISTER_JITTER_PERCENT 10
+#endif
+
+#ifndef MBL_REREGISTER_MIN_BACKOFF_S
+#define MBL_REREGISTER_MIN_BACKOFF_S 30
+#endif
+
+static const mbl::MblReregistrationScheduler::Config g_reregister_config = {
+    g_reregister_period_s * 1000,
+    MBL_REREGISTER_JITTER_PERCENT,
+    MBL_REREGISTER_MIN_BACKOFF_S * 1000
+};
+
+// Event type of update authorizations sent to our tasklet on the mbed event
+// loop. The tasklet's init event is type 0.
+static const uint8_t g_tasklet_event_authorize = 1;
+
+static mbl::metrics::Counter g_registration_updates_sent("mbl_registration_updates_sent");
+static mbl::metrics::Counter g_registration_updates_postponed("mbl_registration_updates_postponed");
+static mbl::metrics::Counter g_registration_failures("mbl_registration_failures");
+static mbl::metrics::Histogram g_registration_update_rtt_ms("mbl_registration_update_rtt_ms");
 
 static void* get_dummy_network_interface()
 {
@@ -52,8 +91,10 @@ static void* get_dummy_network_interface()
 
 namespace mbl {
 
-MblCloudClient* MblCloudClient::s_instance = 0;
-MblMutex MblCloudClient::s_mutex;
+std::atomic<MblCloudClient*> MblCloudClient::s_instance(nullptr);
+std::atomic<unsigned> MblCloudClient::s_instance_references(0);
+MblCallbackDispatcher MblCloudClient::s_dispatcher(g_callback_queue_capacity, &MblCloudClient::handle_callback_event);
+int8_t MblCloudClient::s_tasklet_id = -1;
 
 
 MblCloudClient::InstanceScoper::InstanceScoper()
@@ -65,23 +106,50 @@ MblCloudClient::InstanceScoper::InstanceScoper()
 MblCloudClient::InstanceScoper::~InstanceScoper()
 {
     assert(s_instance);
-    delete s_instance;
+    delete s_instance.load();
+}
+
+MblCloudClient::InstanceReference::InstanceReference()
+    : instance_(acquire_instance())
+{
+}
+
+MblCloudClient::InstanceReference::~InstanceReference()
+{
+    s_instance_references.fetch_sub(1, std::memory_order_release);
+}
+
+MblCloudClient* MblCloudClient::InstanceReference::acquire_instance()
+{
+    // Sequentially consistent with the destructor's store of 0 to s_instance
+    // and load of s_instance_references: either the destructor sees this
+    // reference and waits for it, or we see 0
+    s_instance_references.fetch_add(1);
+    return s_instance.load();
 }
 
 MblCloudClient::MblCloudClient()
     : cloud_client_(new MbedCloudClient)
     , state_(State_Unregistered)
+    , reregister_error_(Error::None)
+    , epoll_fd_(-1)
+    , reregister_timer_fd_(-1)
+    , state_event_fd_(-1)
+    , reregister_mutex_("mbl_reregister")
+    , reregister_scheduler_(g_reregister_config, std::random_device()())
+    , cloud_connect_resource_broker_(*this)
 {
 }
 
 MblCloudClient::~MblCloudClient()
 {
     // 1. Set s_instance to 0 so that callbacks no longer try to access this
-    // object
-    {
-        MblScopedLock l(s_mutex);
-        assert(s_instance);
-        s_instance = 0;
+    // object, then wait for those already using it to finish. They only hold
+    // their references briefly, so yielding is enough.
+    assert(s_instance == this);
+    s_instance = nullptr;
+    while (s_instance_references.load() != 0) {
+        sched_yield();
     }
 
     // 2. Close and delete the MbedCloudClient. This must be done before
@@ -94,62 +162,366 @@ MblCloudClient::~MblCloudClient()
     // 3. Stop the mbed event loop thread (which was started in
     // MbedCloudClient's ctor).
     ns_event_loop_thread_stop();
+
+    // 4. Stop the callback dispatcher now that nothing can post to it. Events
+    // still queued are handled, but find s_instance is 0.
+    s_dispatcher.stop();
+
+    // 5. Close the event loop's file descriptors. The callbacks can no longer
+    // post to state_event_fd_ because s_instance is 0.
+    if (epoll_fd_ != -1) {
+        close(epoll_fd_);
+    }
+    if (reregister_timer_fd_ != -1) {
+        close(reregister_timer_fd_);
+    }
+    if (state_event_fd_ != -1) {
+        close(state_event_fd_);
+    }
 }
 
 MblError MblCloudClient::run()
 {
     InstanceScoper scoper;
-    assert(s_instance);
+    MblCloudClient* const instance = s_instance;
+    assert(instance);
+
+    // The event loop's fds must exist before the mbed event loop can call our
+    // handlers, so set them up before cloud_client_setup().
+    const MblError loop_err = instance->event_loop_init();
+    if (loop_err != Error::None) {
+        return loop_err;
+    }
+
+    // Before any registration callback can refresh the schedule
+    const MblError timer_err = instance->start_reregister_timer();
+    if (timer_err != Error::None) {
+        return timer_err;
+    }
 
-    s_instance->register_handlers();
-    s_instance->add_resources();
+    const MblError dispatcher_err = s_dispatcher.start();
+    if (dispatcher_err != Error::None) {
+        return dispatcher_err;
+    }
+
+    instance->register_handlers();
+    const MblError tasklet_err = instance->tasklet_init();
+    if (tasklet_err != Error::None) {
+        return tasklet_err;
+    }
+    instance->add_resources();
 
-    const MblError ccs_err = s_instance->cloud_client_setup();
+    const MblError ccs_err = instance->cloud_client_setup();
     if (ccs_err != Error::None) {
         return ccs_err;
     }
 
-    const MblError ccrb_init = s_instance->cloud_connect_resource_broker_.Init();
+    const MblError ccrb_init = instance->cloud_connect_resource_broker_.Init();
     if(Error::None != ccrb_init) {
+        MblLogErrorScope log_error(ccrb_init);
         tr_error("Init cloud_connect_resource_broker_ failed with error %s", MblError_to_str(ccrb_init));
     }
+    else {
+        const MblError notify_err = instance->add_notification_fd();
+        if (notify_err != Error::None) {
+            return notify_err;
+        }
+    }
 
-    time_t next_registration_s = get_monotonic_time_s() + g_reregister_period_s;
+    // Sleep until a signal arrives, the registration state changes, it's time
+    // to update our registration or to check a firmware download's progress.
+    // Nothing wakes us up otherwise.
+    const int signal_fd = signals_get_fd();
+    const int notification_fd = instance->cloud_connect_resource_broker_.GetNotificationFd();
+    const int download_check_fd = update_handlers::get_download_check_fd();
     for (;;) {
-        if (g_shutdown_signal) {
-            tr_warn("Recieved signal \"%s\", shutting down", strsignal(g_shutdown_signal));
-            return Error::ShutdownRequested;
+        struct epoll_event events[4];
+        const int num_events = epoll_wait(instance->epoll_fd_, events, 4, -1);
+        if (num_events == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            tr_err("epoll_wait failed: %s", std::strerror(errno));
+            return Error::EventLoopWait;
         }
 
-        {
-            MblScopedLock l(s_mutex);
-            if (s_instance->state_ == State_Unregistered) {
-                return Error::DeviceUnregistered;
+        for (int i = 0; i < num_events; ++i) {
+            const int fd = events[i].data.fd;
+            MblError err = Error::None;
+            if (fd == signal_fd) {
+                err = instance->handle_signal_event();
+            }
+            else if (fd == instance->state_event_fd_) {
+                err = instance->handle_state_event();
+            }
+            else if (fd == instance->reregister_timer_fd_) {
+                err = instance->handle_reregister_timer_event();
+            }
+            else if (fd == notification_fd) {
+                instance->cloud_connect_resource_broker_.HandleNotificationTimer();
+            }
+            else if (fd == download_check_fd) {
+                update_handlers::check_download_progress();
+            }
+            if (err != Error::None) {
+                return err;
             }
         }
+    }
+
+    return Error::Unknown;
+}
+
+MblError MblCloudClient::event_loop_init()
+{
+    epoll_fd_ = epoll_create1(EPOLL_CLOEXEC);
+    if (epoll_fd_ == -1) {
+        tr_err("Failed to create epoll instance: %s", std::strerror(errno));
+        return Error::EventLoopInitEpoll;
+    }
+
+    reregister_timer_fd_ = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    if (reregister_timer_fd_ == -1) {
+        tr_err("Failed to create timerfd: %s", std::strerror(errno));
+        return Error::EventLoopInitTimerfd;
+    }
 
-        const time_t time_s = get_monotonic_time_s();
-        if (time_s >= next_registration_s) {
-            tr_debug("Updating registration with LWM2M server");
-            s_instance->cloud_client_->register_update();
-            next_registration_s = time_s + g_reregister_period_s;
+    state_event_fd_ = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (state_event_fd_ == -1) {
+        tr_err("Failed to create eventfd: %s", std::strerror(errno));
+        return Error::EventLoopInitEventfd;
+    }
+
+    const MblError download_err = update_handlers::download_check_init();
+    if (download_err != Error::None) {
+        return download_err;
+    }
+
+    const int fds[] = {
+        signals_get_fd(), reregister_timer_fd_, state_event_fd_, update_handlers::get_download_check_fd()};
+    for (const int fd : fds) {
+        struct epoll_event event;
+        std::memset(&event, 0, sizeof(event));
+        event.events = EPOLLIN;
+        event.data.fd = fd;
+        if (epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, fd, &event) != 0) {
+            tr_err("Failed to add fd to epoll instance: %s", std::strerror(errno));
+            return Error::EventLoopInitEpoll;
         }
+    }
 
-        sleep(1);
+    return Error::None;
+}
+
+MblError MblCloudClient::add_notification_fd()
+{
+    struct epoll_event event;
+    std::memset(&event, 0, sizeof(event));
+    event.events = EPOLLIN;
+    event.data.fd = cloud_connect_resource_broker_.GetNotificationFd();
+    if (epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, event.data.fd, &event) != 0) {
+        tr_err("Failed to add notification timerfd to epoll instance: %s", std::strerror(errno));
+        return Error::EventLoopInitEpoll;
     }
+    return Error::None;
+}
 
-    return Error::Unknown;
+MblError MblCloudClient::start_reregister_timer()
+{
+    MblScopedLock lock(reregister_mutex_);
+    reregister_scheduler_.start(get_monotonic_time_ms());
+    return arm_reregister_timer();
+}
+
+MblError MblCloudClient::arm_reregister_timer()
+{
+    // An absolute expiry time, so that it doesn't matter how long ago the
+    // scheduler worked it out
+    const int64_t next_ms = reregister_scheduler_.next_ms();
+    struct itimerspec spec;
+    std::memset(&spec, 0, sizeof(spec));
+    spec.it_value.tv_sec = static_cast<time_t>(next_ms / 1000);
+    spec.it_value.tv_nsec = static_cast<long>(next_ms % 1000) * 1000000;
+    if (timerfd_settime(reregister_timer_fd_, TFD_TIMER_ABSTIME, &spec, 0) != 0) {
+        tr_err("Failed to arm re-registration timer: %s", std::strerror(errno));
+        return Error::EventLoopInitTimerfd;
+    }
+    return Error::None;
+}
+
+MblError MblCloudClient::handle_signal_event()
+{
+    for (;;) {
+        const int signal = signals_read();
+        switch (signal) {
+            case 0:
+                return Error::None;
+
+            case SIGHUP:
+                log_request_reopen();
+                log_trace::load_levels_file();
+                break;
+
+            case SIGUSR1:
+                update_handlers::check_download_progress();
+                metrics::log_all();
+                cloud_connect_resource_broker_.LogApplicationFootprints();
+                break;
+
+            default:
+                tr_warn("Received signal \"%s\", shutting down", strsignal(signal));
+                return Error::ShutdownRequested;
+        }
+    }
+}
+
+MblError MblCloudClient::handle_state_event()
+{
+    eventfd_t value;
+    eventfd_read(state_event_fd_, &value);
+
+    const MblError reregister_err = reregister_error_.load(std::memory_order_acquire);
+    if (reregister_err != Error::None) {
+        return reregister_err;
+    }
+    if (state_.load(std::memory_order_acquire) == State_Unregistered) {
+        return Error::DeviceUnregistered;
+    }
+    return Error::None;
+}
+
+MblError MblCloudClient::handle_reregister_timer_event()
+{
+    uint64_t expirations;
+    if (read(reregister_timer_fd_, &expirations, sizeof(expirations)) != sizeof(expirations)) {
+        return Error::None;
+    }
+
+    bool send_update = false;
+    MblError err = Error::None;
+    {
+        MblScopedLock lock(reregister_mutex_);
+        send_update = reregister_scheduler_.send_update(get_monotonic_time_ms());
+        err = arm_reregister_timer();
+    }
+
+    if (send_update) {
+        tr_debug("Updating registration with LWM2M server");
+        g_registration_updates_sent.add();
+        cloud_client_->register_update();
+    }
+    return err;
+}
+
+void MblCloudClient::set_state(const State state)
+{
+    // Must be called with an InstanceReference so that state_event_fd_ can't
+    // be closed underneath us.
+    if (state_.exchange(state, std::memory_order_acq_rel) != state) {
+        eventfd_write(state_event_fd_, 1);
+    }
+}
+
+void MblCloudClient::registration_refreshed()
+{
+    MblReregistrationScheduler::Refresh refresh;
+    MblError arm_err = Error::None;
+    {
+        MblScopedLock lock(reregister_mutex_);
+        refresh = reregister_scheduler_.refreshed(get_monotonic_time_ms());
+        arm_err = arm_reregister_timer();
+    }
+    if (arm_err != Error::None) {
+        reregister_timer_failed(arm_err);
+    }
+
+    if (refresh.round_trip_ms >= 0) {
+        g_registration_update_rtt_ms.record(static_cast<uint64_t>(refresh.round_trip_ms));
+        tr_info("Registration updated in %" PRId64 " ms", refresh.round_trip_ms);
+    }
+    if (refresh.postponed_update) {
+        g_registration_updates_postponed.add();
+    }
+}
+
+void MblCloudClient::registration_failed()
+{
+    unsigned failures = 0;
+    bool registered = false;
+    int64_t retry_in_ms = 0;
+    MblError arm_err = Error::None;
+    {
+        MblScopedLock lock(reregister_mutex_);
+        const int64_t now_ms = get_monotonic_time_ms();
+        reregister_scheduler_.failed(now_ms);
+        arm_err = arm_reregister_timer();
+        failures = reregister_scheduler_.consecutive_failures();
+        registered = reregister_scheduler_.registered();
+        retry_in_ms = reregister_scheduler_.next_ms() - now_ms;
+    }
+
+    g_registration_failures.add();
+    if (registered) {
+        tr_warn("Registration failed %u time(s) in a row, next update in %" PRId64 " s", failures, retry_in_ms / 1000);
+    }
+    else {
+        // There is no registration to update yet
+        tr_warn("Registration failed %u time(s) in a row before the client registered", failures);
+    }
+    if (arm_err != Error::None) {
+        reregister_timer_failed(arm_err);
+    }
+}
+
+void MblCloudClient::reregister_timer_failed(const MblError err)
+{
+    // Must be called with an InstanceReference, like set_state(). Without
+    // the timer no registration update would ever be sent again, so make the
+    // event loop give up as it does when the timer fails there.
+    reregister_error_.store(err, std::memory_order_release);
+    eventfd_write(state_event_fd_, 1);
+}
+
+void MblCloudClient::SendResourceValues(const std::vector<ResourceValue>& values)
+{
+    // Called on the event loop thread, once per notification tick.
+    // Application resources are not yet published to MbedCloudClient as M2M
+    // objects, so there is nothing to set these values on yet.
+    for (const ResourceValue& value : values) {
+        tr_debug(
+            "Resource /%u/%u/%u changed to \"%s\"",
+            static_cast<unsigned>(ResourcePathObjectId(value.path)),
+            static_cast<unsigned>(ResourcePathInstanceId(value.path)),
+            static_cast<unsigned>(ResourcePathResourceId(value.path)),
+            value.value.c_str());
+    }
 }
 
 void MblCloudClient::register_handlers()
 {
     cloud_client_->on_registered(&MblCloudClient::handle_client_registered);
+    cloud_client_->on_registration_updated(&MblCloudClient::handle_client_registration_updated);
     cloud_client_->on_unregistered(&MblCloudClient::handle_client_unregistered);
     cloud_client_->on_error(&MblCloudClient::handle_error);
     cloud_client_->set_update_progress_handler(&update_handlers::handle_download_progress);
     cloud_client_->set_update_authorize_handler(&handle_authorize);
 }
 
+MblError MblCloudClient::tasklet_init()
+{
+    // The mbed event loop thread was started by MbedCloudClient's ctor, so
+    // hold its scheduler mutex while adding the tasklet
+    eventOS_scheduler_mutex_wait();
+    s_tasklet_id = eventOS_event_handler_create(&MblCloudClient::handle_tasklet_event, 0);
+    eventOS_scheduler_mutex_release();
+
+    if (s_tasklet_id < 0) {
+        tr_err("Failed to create mbed event loop tasklet");
+        return Error::EventLoopInitTasklet;
+    }
+    return Error::None;
+}
+
 void MblCloudClient::add_resources()
 {
     M2MObjectList objs;
@@ -158,10 +530,7 @@ void MblCloudClient::add_resources()
 
 MblError MblCloudClient::cloud_client_setup()
 {
-    {
-        MblScopedLock l(s_mutex);
-        state_ = State_CalledRegister;
-    }
+    state_.store(State_CalledRegister, std::memory_order_release);
 
     const bool setup_ok = cloud_client_->setup(get_dummy_network_interface());
     if (!setup_ok) {
@@ -174,73 +543,175 @@ MblError MblCloudClient::cloud_client_setup()
 
 void MblCloudClient::handle_client_registered()
 {
-    // Called by the mbed event loop - *s_instance can be destroyed whenever
-    // s_mutex isn't locked.
+    // Called by the mbed event loop, which must get back to its CoAP timers
+    // and retransmissions: only queue the event. The endpoint info belongs to
+    // the event loop, so copy it into the event here.
+    char endpoint_text[MblCallbackDispatcher::text_size] = "";
+    {
+        const InstanceReference instance;
+        const ConnectorClientEndpointInfo* const endpoint =
+            instance.get() ? instance.get()->cloud_client_->endpoint_info() : nullptr;
+        if (endpoint) {
+            std::snprintf(
+                endpoint_text,
+                sizeof(endpoint_text),
+                "%s\n%s",
+                endpoint->endpoint_name.c_str(),
+                endpoint->internal_endpoint_name.c_str());
+        }
+    }
+    s_dispatcher.post(CallbackEvent_Registered, 0, endpoint_text);
+}
 
-    tr_info("Client registered");
+void MblCloudClient::handle_client_registration_updated()
+{
+    s_dispatcher.post(CallbackEvent_RegistrationUpdated, 0);
+}
+
+void MblCloudClient::handle_client_unregistered()
+{
+    s_dispatcher.post(CallbackEvent_Unregistered, 0);
+}
 
-    MblScopedLock l(s_mutex);
+void MblCloudClient::handle_error(const int cloud_client_code)
+{
+    // The event loop rewrites the description on its next error, so copy it
+    // into the event here
+    const InstanceReference instance;
+    s_dispatcher.post(
+        CallbackEvent_Error,
+        cloud_client_code,
+        instance.get() ? instance.get()->cloud_client_->error_description() : nullptr);
+}
+
+void MblCloudClient::handle_authorize(const int32_t request)
+{
+    s_dispatcher.post(CallbackEvent_Authorize, request);
+}
+
+void MblCloudClient::handle_callback_event(const MblCallbackDispatcher::Event& event)
+{
+    switch (event.type) {
+        case CallbackEvent_Registered: client_registered(event.text); break;
+        case CallbackEvent_RegistrationUpdated: client_registration_updated(); break;
+        case CallbackEvent_Unregistered: client_unregistered(); break;
+        case CallbackEvent_Error: client_error(event.arg, event.text); break;
+        case CallbackEvent_Authorize: authorize(event.arg); break;
+        default: assert(false);
+    }
+}
+
+void MblCloudClient::client_registered(const char* const endpoint)
+{
+    // Called by the callback dispatcher - *s_instance can be destroyed
+    // whenever there is no InstanceReference to it.
+
+    tr_info("Client registered");
 
-    if (!s_instance) {
+    const InstanceReference instance;
+    if (!instance.get()) {
         return;
     }
 
-    s_instance->state_ = State_Registered;
+    instance.get()->set_state(State_Registered);
+    instance.get()->registration_refreshed();
 
-    const ConnectorClientEndpointInfo* const endpoint = s_instance->cloud_client_->endpoint_info();
-    if (endpoint) {
-        tr_info("Endpoint Name: %s", endpoint->endpoint_name.c_str());
-        tr_info("Device Id: %s", endpoint->internal_endpoint_name.c_str());
+    // "<endpoint name>\n<device id>", or empty
+    const char* const newline = std::strchr(endpoint, '\n');
+    if (newline) {
+        tr_info("Endpoint Name: %.*s", static_cast<int>(newline - endpoint), endpoint);
+        tr_info("Device Id: %s", newline + 1);
     }
     else {
         tr_warn("Failed to get endpoint info");
     }
 }
 
-void MblCloudClient::handle_client_unregistered()
+void MblCloudClient::client_registration_updated()
+{
+    // Called by the callback dispatcher - *s_instance can be destroyed
+    // whenever there is no InstanceReference to it.
+
+    const InstanceReference instance;
+    if (instance.get()) {
+        instance.get()->registration_refreshed();
+    }
+}
+
+void MblCloudClient::client_unregistered()
 {
-    // Called by the mbed event loop - *s_instance can be destroyed whenever
-    // s_mutex isn't locked.
+    // Called by the callback dispatcher - *s_instance can be destroyed
+    // whenever there is no InstanceReference to it.
 
     {
-        MblScopedLock l(s_mutex);
-        if (!s_instance) {
+        const InstanceReference instance;
+        if (!instance.get()) {
             return;
         }
-        s_instance->state_ = State_Unregistered;
+        instance.get()->set_state(State_Unregistered);
     }
     tr_warn("Client unregistered");
 }
 
-void MblCloudClient::handle_error(const int cloud_client_code)
+void MblCloudClient::client_error(const int cloud_client_code, const char* const description)
 {
-    // Called by the mbed event loop - *s_instance can be destroyed whenever
-    // s_mutex isn't locked.
+    // Called by the callback dispatcher - *s_instance can be destroyed
+    // whenever there is no InstanceReference to it.
 
     const MblError mbl_code = CloudClientError_to_MblError(static_cast<MbedCloudClient::Error>(cloud_client_code));
+    MblLogErrorScope log_error(mbl_code);
     tr_err("Error occurred : %s", MblError_to_str(mbl_code));
     tr_err("Error code : %d", mbl_code);
 
-    MblScopedLock l(s_mutex);
-    if (s_instance) {
-        tr_err("Error details : %s",s_instance->cloud_client_->error_description());
+    // Copied from the event loop when the error happened
+    if (description[0] != '\0') {
+        tr_err("Error details : %s", description);
     }
     else {
         tr_err("Error details : Failed to obtain error description");
     }
+
+    // Connect errors mean registering or updating the registration failed
+    const InstanceReference instance;
+    if (instance.get() && mbl_code >= Error::ConnectAlreadyExists && mbl_code <= Error::ConnectorFailedToStoreCredentials) {
+        instance.get()->registration_failed();
+    }
 }
 
-void MblCloudClient::handle_authorize(const int32_t request)
+void MblCloudClient::authorize(const int32_t request)
 {
-    // Called by the mbed event loop - *s_instance can be destroyed whenever
-    // s_mutex isn't locked.
+    // Called by the callback dispatcher - *s_instance can be destroyed
+    // whenever there is no InstanceReference to it.
 
-    if (update_handlers::handle_authorize(request)) {
-        MblScopedLock l(s_mutex);
+    if (!update_handlers::handle_authorize(request)) {
+        return;
+    }
 
-        if (s_instance) {
-            s_instance->cloud_client_->update_authorize(request);
-        }
+    // MbedCloudClient isn't thread safe, so send the authorization back to
+    // the mbed event loop. eventOS_event_send() may be called from any
+    // thread and never waits for the event loop.
+    arm_event_t event;
+    std::memset(&event, 0, sizeof(event));
+    event.receiver = s_tasklet_id;
+    event.sender = s_tasklet_id;
+    event.event_type = g_tasklet_event_authorize;
+    event.event_data = static_cast<uint32_t>(request);
+    event.priority = ARM_LIB_MED_PRIORITY_EVENT;
+    if (eventOS_event_send(&event) != 0) {
+        tr_err("Failed to send update authorization (%" PRId32 ") to the mbed event loop", request);
+    }
+}
+
+void MblCloudClient::handle_tasklet_event(arm_event_s* const event)
+{
+    // Called by the mbed event loop
+    if (event->event_type != g_tasklet_event_authorize) {
+        return;
+    }
+
+    const InstanceReference instance;
+    if (instance.get()) {
+        instance.get()->cloud_client_->update_authorize(static_cast<int32_t>(event->event_data));
     }
 }
 
@@ -20,17 +20,21 @@
 
 #include "mbed-cloud-client/MbedCloudClient.h"
 
+#include "MblCallbackDispatcher.h"
 #include "MblError.h"
 #include "MblMutex.h"
+#include "MblReregistrationScheduler.h"
 #include "cloud-connect-resource-broker/MblCloudConnectResourceBroker.h"
 
+#include <atomic>
 #include <stdint.h>
+#include <vector>
 
-extern "C" void mbl_shutdown_handler(int signal);
+struct arm_event_s;
 
 namespace mbl {
 
-class MblCloudClient {
+class MblCloudClient : private MblCloudConnectCloudClientInterface {
 
 public:
     static MblError run();
@@ -43,31 +47,125 @@ private:
         State_Registered
     };
 
+    // Events queued by the mbed event loop callbacks for s_dispatcher
+    enum CallbackEvent
+    {
+        CallbackEvent_Registered,
+        CallbackEvent_RegistrationUpdated,
+        CallbackEvent_Unregistered,
+        CallbackEvent_Error,
+        CallbackEvent_Authorize
+    };
+
     struct InstanceScoper
     {
         InstanceScoper();
         ~InstanceScoper();
     };
 
+    // A reference to s_instance for threads other than the main thread. While
+    // one exists, s_instance can't be destroyed; get() is 0 if it already has
+    // been (or is being) destroyed. The destructor sets s_instance to 0, then
+    // waits for the references to go away, like an RCU grace period.
+    class InstanceReference
+    {
+    public:
+        InstanceReference();
+        ~InstanceReference();
+
+        MblCloudClient* get() const { return instance_; }
+
+    private:
+        // No copying
+        InstanceReference(const InstanceReference& other);
+        InstanceReference& operator=(const InstanceReference& other);
+
+        static MblCloudClient* acquire_instance();
+
+        MblCloudClient* const instance_;
+    };
+
     // Only InstanceScoper can create or destroy objects
     MblCloudClient();
-    ~MblCloudClient();
+    ~MblCloudClient() override;
 
     // No copying
     MblCloudClient(const MblCloudClient& other);
     MblCloudClient& operator=(const MblCloudClient& other);
 
+    // MblCloudConnectCloudClientInterface: values from the resource broker
+    void SendResourceValues(const std::vector<ResourceValue>& values) override;
+
     void register_handlers();
+    MblError tasklet_init();
     void add_resources();
     MblError cloud_client_setup();
 
+    // Event loop helpers used by run()
+    MblError event_loop_init();
+    MblError start_reregister_timer();
+    // Set reregister_timer_fd_ to expire at reregister_scheduler_.next_ms().
+    // Must be called with reregister_mutex_ locked.
+    MblError arm_reregister_timer();
+    MblError handle_signal_event();
+    MblError handle_state_event();
+    MblError handle_reregister_timer_event();
+    MblError add_notification_fd();
+    // Change the registration state, waking the event loop if it changed.
+    // Safe to call from any thread.
+    void set_state(State state);
+    // Tell reregister_scheduler_ that the registration was refreshed or that
+    // refreshing it failed, and re-arm the timer. Safe to call from any thread.
+    // If the timer can't be re-armed, run() returns the error.
+    void registration_refreshed();
+    void registration_failed();
+    void reregister_timer_failed(MblError err);
+
+    // Callbacks from the mbed event loop, which post events to s_dispatcher
     static void handle_client_registered();
+    static void handle_client_registration_updated();
     static void handle_client_unregistered();
     static void handle_error(int error_code);
     static void handle_authorize(int32_t request);
 
+    // Handling of those events on the dispatcher thread
+    static void handle_callback_event(const MblCallbackDispatcher::Event& event);
+    static void client_registered(const char* endpoint);
+    static void client_registration_updated();
+    static void client_unregistered();
+    static void client_error(int error_code, const char* description);
+    static void authorize(int32_t request);
+
+    // Events sent back to our tasklet on the mbed event loop, for
+    // MbedCloudClient calls that must be made on that thread
+    static void handle_tasklet_event(arm_event_s* event);
+
     MbedCloudClient* cloud_client_;
-    State state_;
+
+    // Written by the callback dispatcher with release semantics and read by
+    // the event loop in run() with acquire semantics, so neither waits for
+    // the other
+    std::atomic<State> state_;
+
+    // Error re-arming reregister_timer_fd_ from the callback dispatcher, for
+    // the event loop to return. Published like state_.
+    std::atomic<MblError> reregister_error_;
+
+    // File descriptors for the event loop in run(). state_event_fd_ is an
+    // eventfd written by the callback dispatcher whenever state_ or
+    // reregister_error_ changes;
+    // reregister_timer_fd_ is a timerfd that expires when it's time to update
+    // our registration with the LWM2M server. The resource
+    // broker's notification timerfd is added once the broker is running.
+    int epoll_fd_;
+    int reregister_timer_fd_;
+    int state_event_fd_;
+
+    // Decides when reregister_timer_fd_ expires. Used by the event loop when
+    // the timer expires and by the callback dispatcher when the registration
+    // is refreshed or fails, so guarded by reregister_mutex_.
+    MblMutex reregister_mutex_;
+    MblReregistrationScheduler reregister_scheduler_;
 
     // Mbl Cloud Connect Resource Broker
     // - Parse resource definition JSON file that received from an application as part of the RegisterResources request.
@@ -78,8 +176,10 @@ private:
     // - Perform multiplexing and de-multiplexing of messages between MbedCloudClient and applications.    
     MblCloudConnectResourceBroker cloud_connect_resource_broker_;
 
-    static MblCloudClient* s_instance;
-    static MblMutex s_mutex;
+    static std::atomic<MblCloudClient*> s_instance;
+    static std::atomic<unsigned> s_instance_references;
+    static MblCallbackDispatcher s_dispatcher;
+    static int8_t s_tasklet_id;
 };
 
 } // namespace mbl
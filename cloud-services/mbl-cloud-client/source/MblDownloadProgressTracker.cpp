@@ -0,0 +1,175 @@
+/*
+ * Copyright (c) 2020 Arm Limited and Contributors. All rights reserved.
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ * Licensed under the Apache License, Version 2.0 (the License); you may
+ * not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an AS IS BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "MblDownloadProgressTracker.h"
+
+namespace mbl {
+
+const int64_t MblDownloadProgressTracker::rate_window_ms;
+
+MblDownloadProgressTracker::MblDownloadProgressTracker(const Config& config)
+    : config_(config)
+    , active_(false)
+    , total_(0)
+    , start_ms_(0)
+    , last_update_ms_(0)
+    , last_log_ms_(0)
+    , last_log_percent_(0)
+    , stall_reported_(false)
+    , first_sample_(0)
+    , num_samples_(0)
+{
+}
+
+MblDownloadProgressTracker::Status MblDownloadProgressTracker::update(
+    const uint32_t progress,
+    const uint32_t total,
+    const int64_t now_ms)
+{
+    Status status = Status();
+    status.progress = progress;
+    status.total = total;
+    status.eta_s = -1;
+
+    // Progress going backwards or a different total means a new download
+    const bool went_backwards = num_samples_ != 0 && progress < newest_sample().progress;
+    if (!active_ || total != total_ || went_backwards) {
+        start(total, now_ms);
+        status.started = true;
+    }
+    else if (now_ms - last_update_ms_ > static_cast<int64_t>(config_.stall_ms)) {
+        status.stalled_ms = now_ms - last_update_ms_;
+        status.stall_started = !stall_reported_;
+    }
+    last_update_ms_ = now_ms;
+    stall_reported_ = false;
+
+    add_sample(progress, now_ms);
+
+    status.completed = (progress >= total);
+    set_percent_and_eta(status, now_ms);
+
+    status.should_log = status.started || status.completed || status.stalled_ms != 0 ||
+                        status.percent >= last_log_percent_ + config_.step_percent ||
+                        now_ms - last_log_ms_ >= static_cast<int64_t>(config_.step_ms);
+    if (status.should_log) {
+        last_log_ms_ = now_ms;
+        last_log_percent_ = status.percent;
+    }
+
+    if (status.completed) {
+        active_ = false;
+    }
+    return status;
+}
+
+bool MblDownloadProgressTracker::check(const int64_t now_ms, Status& status)
+{
+    if (!active_) {
+        return false;
+    }
+
+    status = Status();
+    status.progress = newest_sample().progress;
+    status.total = total_;
+    status.eta_s = -1;
+
+    drop_old_samples(now_ms);
+    set_percent_and_eta(status, now_ms);
+
+    if (now_ms - last_update_ms_ > static_cast<int64_t>(config_.stall_ms)) {
+        status.stalled_ms = now_ms - last_update_ms_;
+        status.stall_started = !stall_reported_;
+        status.should_log = status.stall_started || now_ms - last_log_ms_ >= static_cast<int64_t>(config_.step_ms);
+        stall_reported_ = true;
+    }
+    if (status.should_log) {
+        last_log_ms_ = now_ms;
+    }
+    return true;
+}
+
+void MblDownloadProgressTracker::start(const uint32_t total, const int64_t now_ms)
+{
+    active_ = true;
+    total_ = total;
+    start_ms_ = now_ms;
+    last_log_ms_ = now_ms;
+    last_log_percent_ = 0;
+    stall_reported_ = false;
+    first_sample_ = 0;
+    num_samples_ = 0;
+}
+
+void MblDownloadProgressTracker::drop_old_samples(const int64_t now_ms)
+{
+    // Keep at least one sample so that there is something to measure from
+    // after a stall
+    while (num_samples_ > 1 && now_ms - samples_[first_sample_].time_ms > rate_window_ms) {
+        first_sample_ = (first_sample_ + 1) % max_samples;
+        --num_samples_;
+    }
+}
+
+void MblDownloadProgressTracker::add_sample(const uint32_t progress, const int64_t now_ms)
+{
+    drop_old_samples(now_ms);
+    if (num_samples_ == max_samples) {
+        first_sample_ = (first_sample_ + 1) % max_samples;
+        --num_samples_;
+    }
+
+    Sample& sample = samples_[(first_sample_ + num_samples_) % max_samples];
+    sample.time_ms = now_ms;
+    sample.progress = progress;
+    ++num_samples_;
+}
+
+const MblDownloadProgressTracker::Sample& MblDownloadProgressTracker::newest_sample() const
+{
+    return samples_[(first_sample_ + num_samples_ - 1) % max_samples];
+}
+
+uint64_t MblDownloadProgressTracker::window_rate(const int64_t now_ms) const
+{
+    if (num_samples_ < 2) {
+        return 0;
+    }
+
+    // Measured up to now rather than to the newest sample, so that the rate
+    // falls while no progress arrives
+    const Sample& oldest = samples_[first_sample_];
+    const Sample& newest = newest_sample();
+    const int64_t elapsed_ms = now_ms - oldest.time_ms;
+    if (elapsed_ms <= 0) {
+        return 0;
+    }
+    return static_cast<uint64_t>(newest.progress - oldest.progress) * 1000 / static_cast<uint64_t>(elapsed_ms);
+}
+
+void MblDownloadProgressTracker::set_percent_and_eta(Status& status, const int64_t now_ms) const
+{
+    status.percent =
+        (status.total == 0) ? 100 : static_cast<unsigned>(status.progress * 100ULL / status.total);
+    status.elapsed_ms = now_ms - start_ms_;
+    status.bytes_per_second = window_rate(now_ms);
+    if (status.bytes_per_second != 0 && !status.completed) {
+        status.eta_s = static_cast<int64_t>((status.total - status.progress) / status.bytes_per_second);
+    }
+}
+
+} // namespace mbl
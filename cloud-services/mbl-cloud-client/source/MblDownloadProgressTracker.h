@@ -0,0 +1,142 @@
+/*
+ * Copyright (c) 2020 Arm Limited and Contributors. All rights reserved.
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ * Licensed under the Apache License, Version 2.0 (the License); you may
+ * not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an AS IS BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef MblDownloadProgressTracker_h_
+#define MblDownloadProgressTracker_h_
+
+#include <cstddef>
+#include <stdint.h>
+
+namespace mbl {
+
+/**
+ * Tracks the progress of a firmware download.
+ *
+ * Keeps a sliding window of recent progress samples to estimate the current
+ * download rate and the time remaining, and decides when progress is worth
+ * logging: every step_percent percent, at least every step_ms while data is
+ * arriving, and when the download completes. Also notices when no progress
+ * was reported for a while, so that a stalled download can be told apart
+ * from a slow one. Between progress updates, check() re-evaluates the rate
+ * against the current time, so that it decays to 0 and a stall is noticed
+ * while it lasts.
+ *
+ * Not thread safe.
+ */
+class MblDownloadProgressTracker
+{
+public:
+    struct Config
+    {
+        // Log progress each time it has advanced by this many percent
+        uint32_t step_percent;
+        // Log progress at least this often (in milliseconds) while it changes
+        uint32_t step_ms;
+        // A gap between progress updates longer than this (in milliseconds)
+        // is reported as a stall
+        uint32_t stall_ms;
+    };
+
+    struct Status
+    {
+        // Whether this update started a new download
+        bool started;
+        // Whether this update should be logged
+        bool should_log;
+        // Whether the download is complete
+        bool completed;
+        uint32_t progress;
+        uint32_t total;
+        unsigned percent;
+        // Download rate over the sliding window, or 0 if not known yet
+        uint64_t bytes_per_second;
+        // Estimated time to completion, or -1 if not known yet
+        int64_t eta_s;
+        // From update(): if the download had stalled before this update, for
+        // how long. From check(): how long the download has been stalled.
+        // Otherwise 0.
+        int64_t stalled_ms;
+        // Whether this is the first call to notice the current stall
+        bool stall_started;
+        // Time since the download started
+        int64_t elapsed_ms;
+    };
+
+    // Length of the sliding window used to estimate the rate
+    static const int64_t rate_window_ms = 10000;
+
+    explicit MblDownloadProgressTracker(const Config& config);
+
+    /**
+     * Record a progress update.
+     *
+     * @param progress bytes downloaded so far.
+     * @param total size of the download in bytes.
+     * @param now_ms current CLOCK_MONOTONIC time in milliseconds.
+     */
+    Status update(uint32_t progress, uint32_t total, int64_t now_ms);
+
+    /**
+     * Re-evaluate the rate, the estimated time remaining and whether the
+     * download has stalled, without a progress update. should_log is set
+     * when a stall is first noticed and then every step_ms while it lasts.
+     *
+     * @param now_ms current CLOCK_MONOTONIC time in milliseconds.
+     * @return false if no download is in progress.
+     */
+    bool check(int64_t now_ms, Status& status);
+
+private:
+    struct Sample
+    {
+        int64_t time_ms;
+        uint32_t progress;
+    };
+
+    static const size_t max_samples = 128;
+
+    // No copying
+    MblDownloadProgressTracker(const MblDownloadProgressTracker&);
+    MblDownloadProgressTracker& operator=(const MblDownloadProgressTracker&);
+
+    void start(uint32_t total, int64_t now_ms);
+    void drop_old_samples(int64_t now_ms);
+    void add_sample(uint32_t progress, int64_t now_ms);
+    const Sample& newest_sample() const;
+    uint64_t window_rate(int64_t now_ms) const;
+    void set_percent_and_eta(Status& status, int64_t now_ms) const;
+
+    const Config config_;
+
+    bool active_;
+    uint32_t total_;
+    int64_t start_ms_;
+    int64_t last_update_ms_;
+    int64_t last_log_ms_;
+    unsigned last_log_percent_;
+    // Whether check() has already noticed the current stall
+    bool stall_reported_;
+
+    // Ring buffer of samples within the rate window, oldest first
+    Sample samples_[max_samples];
+    size_t first_sample_;
+    size_t num_samples_;
+};
+
+} // namespace mbl
+
+#endif // MblDownloadProgressTracker_h_
@@ -29,6 +29,15 @@ const char* MblError_to_str(const MblError error)
         case Error::SignalsInitSigaction: return "Failed to register signal handler";
         case Error::DeviceUnregistered: return "Device became unregistered";
         case Error::ShutdownRequested: return "Shutdown requested";
+        case Error::SignalsInitSigprocmask: return "Failed to block signals";
+        case Error::SignalsInitSignalfd: return "Failed to create signalfd";
+        case Error::EventLoopInitEpoll: return "Failed to create epoll instance";
+        case Error::EventLoopInitTimerfd: return "Failed to create timerfd";
+        case Error::EventLoopInitEventfd: return "Failed to create eventfd";
+        case Error::EventLoopWait: return "Failed to wait for events";
+        case Error::LogInitThreadCreate: return "Failed to create log writer thread";
+        case Error::DispatcherInitThreadCreate: return "Failed to create callback dispatcher thread";
+        case Error::EventLoopInitTasklet: return "Failed to create mbed event loop tasklet";
 
         case Error::ConnectAlreadyExists: return "ConnectAlreadyExists";
         case Error::ConnectBootstrapFailed: return "ConnectBootstrapFailed";
@@ -70,6 +79,20 @@ const char* MblError_to_str(const MblError error)
         case Error::EnrollmentErrorBase: return "EnrollmentErrorBase";
         case Error::EnrollmentErrorEnd: return "EnrollmentErrorEnd";
 
+        case Error::CCRBInvalidResourcePath: return "Invalid LwM2M resource path";
+        case Error::CCRBResourceAlreadyExists: return "LwM2M resource already registered";
+        case Error::CCRBApplicationAlreadyExists: return "Application already registered";
+        case Error::CCRBApplicationNotFound: return "Application not registered";
+        case Error::CCRBInvalidJson: return "Invalid JSON";
+        case Error::CCRBInvalidResourceDefinition: return "Invalid resource definition";
+        case Error::CCRBResourceNotFound: return "LwM2M resource not registered";
+        case Error::CCRBAccessDenied: return "LwM2M resource registered by another application";
+        case Error::CCRBIpcInitFailed: return "Failed to initialize resource broker IPC";
+        case Error::CCRBValueStoreFailed: return "Failed to create resource value store";
+        case Error::CCRBValueStoreBusy: return "Resource value store slot is being written continuously";
+        case Error::CCRBQuotaExceeded: return "Application exceeded its resource broker memory quota";
+        case Error::CCRBValueTooLong: return "LwM2M resource value too long";
+
     }
     return "Unrecognized error code";
 }
@@ -31,6 +31,15 @@ enum Type {
     SignalsInitSigaction                  = 0x0004,
     DeviceUnregistered                    = 0x0005,
     ShutdownRequested                     = 0x0006,
+    SignalsInitSigprocmask                = 0x0007,
+    SignalsInitSignalfd                   = 0x0008,
+    EventLoopInitEpoll                    = 0x0009,
+    EventLoopInitTimerfd                  = 0x000a,
+    EventLoopInitEventfd                  = 0x000b,
+    EventLoopWait                         = 0x000c,
+    LogInitThreadCreate                   = 0x000d,
+    DispatcherInitThreadCreate            = 0x000e,
+    EventLoopInitTasklet                  = 0x000f,
 
     ConnectAlreadyExists                  = 0x0100,
     ConnectBootstrapFailed                = 0x0101,
@@ -70,7 +79,21 @@ enum Type {
     UpdateErrorConnection                 = 0x0213,
 
     EnrollmentErrorBase                   = 0x0300,
-    EnrollmentErrorEnd                    = 0x0301
+    EnrollmentErrorEnd                    = 0x0301,
+
+    CCRBInvalidResourcePath               = 0x0400,
+    CCRBResourceAlreadyExists             = 0x0401,
+    CCRBApplicationAlreadyExists          = 0x0402,
+    CCRBApplicationNotFound               = 0x0403,
+    CCRBInvalidJson                       = 0x0404,
+    CCRBInvalidResourceDefinition         = 0x0405,
+    CCRBResourceNotFound                  = 0x0406,
+    CCRBAccessDenied                      = 0x0407,
+    CCRBIpcInitFailed                     = 0x0408,
+    CCRBValueStoreFailed                  = 0x0409,
+    CCRBValueStoreBusy                    = 0x040a,
+    CCRBQuotaExceeded                     = 0x040b,
+    CCRBValueTooLong                      = 0x040c
 
 };
 } // namespace Error
@@ -0,0 +1,171 @@
+/*
+ * Copyright (c) 2020 Arm Limited and Contributors. All rights reserved.
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ * Licensed under the Apache License, Version 2.0 (the License); you may
+ * not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an AS IS BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "MblFutexMutex.h"
+
+#include <algorithm>
+#include <cassert>
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+static_assert(sizeof(std::atomic<int>) == sizeof(int), "futexes need a plain int");
+
+static void futex_wait(std::atomic<int>& futex, const int expected)
+{
+    syscall(SYS_futex, reinterpret_cast<int*>(&futex), FUTEX_WAIT_PRIVATE, expected, nullptr, nullptr, 0);
+}
+
+static void futex_wake_one(std::atomic<int>& futex)
+{
+    syscall(SYS_futex, reinterpret_cast<int*>(&futex), FUTEX_WAKE_PRIVATE, 1, nullptr, nullptr, 0);
+}
+
+// Tell the CPU we're in a spin loop, so it can save power or let the other
+// hardware thread run
+static inline void cpu_relax()
+{
+#if defined(__aarch64__) || defined(__arm__)
+    __asm__ __volatile__("yield" ::: "memory");
+#elif defined(__i386__) || defined(__x86_64__)
+    __builtin_ia32_pause();
+#else
+    __asm__ __volatile__("" ::: "memory");
+#endif
+}
+
+static bool can_spin()
+{
+    // Spinning on one CPU only delays the thread holding the mutex
+    static const bool spin = sysconf(_SC_NPROCESSORS_ONLN) > 1;
+    return spin;
+}
+
+static pid_t get_thread_id()
+{
+    // gettid is a system call, so only make it once per thread
+    thread_local static const pid_t tid = static_cast<pid_t>(syscall(SYS_gettid));
+    return tid;
+}
+
+namespace mbl {
+
+MblFutexMutex::MblFutexMutex(const bool recursive)
+    : state_(State_Unlocked)
+    , spins_(0)
+    , recursive_(recursive)
+    , owner_(0)
+    , depth_(0)
+{
+}
+
+void MblFutexMutex::lock()
+{
+    if (recursive_ && lock_again()) {
+        return;
+    }
+
+    int expected = State_Unlocked;
+    if (!state_.compare_exchange_strong(expected, State_Locked, std::memory_order_acquire)) {
+        lock_contended();
+    }
+    locked();
+}
+
+bool MblFutexMutex::try_lock()
+{
+    if (recursive_ && lock_again()) {
+        return true;
+    }
+
+    int expected = State_Unlocked;
+    if (!state_.compare_exchange_strong(expected, State_Locked, std::memory_order_acquire)) {
+        return false;
+    }
+    locked();
+    return true;
+}
+
+void MblFutexMutex::unlock()
+{
+    if (recursive_) {
+        assert(owner_.load(std::memory_order_relaxed) == get_thread_id());
+        if (--depth_ > 0) {
+            return;
+        }
+        owner_.store(0, std::memory_order_relaxed);
+    }
+
+    if (state_.exchange(State_Unlocked, std::memory_order_release) == State_LockedWithWaiters) {
+        futex_wake_one(state_);
+    }
+}
+
+bool MblFutexMutex::lock_again()
+{
+    // Only this thread can have stored its own ID
+    if (owner_.load(std::memory_order_relaxed) != get_thread_id()) {
+        return false;
+    }
+    ++depth_;
+    return true;
+}
+
+void MblFutexMutex::lock_contended()
+{
+    // Allow twice the recent average, so that the average can grow
+    const int limit =
+        can_spin() ? std::min(2 * spins_.load(std::memory_order_relaxed) + 10, static_cast<int>(max_spins)) : 0;
+    for (int spin = 0; spin < limit; ++spin) {
+        cpu_relax();
+        // Only try the CAS when it could succeed, so that spinners don't
+        // keep taking the cache line from the holder
+        int expected = State_Unlocked;
+        if (state_.load(std::memory_order_relaxed) == State_Unlocked &&
+            state_.compare_exchange_weak(expected, State_Locked, std::memory_order_acquire))
+        {
+            update_spins(spin);
+            return;
+        }
+    }
+
+    // Mark the mutex as having waiters, so that unlock() wakes one, and sleep
+    // until it is unlocked. The mutex stays marked after we get it, since
+    // other threads may still be waiting.
+    while (state_.exchange(State_LockedWithWaiters, std::memory_order_acquire) != State_Unlocked) {
+        futex_wait(state_, State_LockedWithWaiters);
+    }
+    if (limit > 0) {
+        update_spins(limit);
+    }
+}
+
+void MblFutexMutex::update_spins(const int spins)
+{
+    const int average = spins_.load(std::memory_order_relaxed);
+    spins_.store(average + (spins - average) / 8, std::memory_order_relaxed);
+}
+
+void MblFutexMutex::locked()
+{
+    if (recursive_) {
+        owner_.store(get_thread_id(), std::memory_order_relaxed);
+        depth_ = 1;
+    }
+}
+
+} // namespace mbl
@@ -0,0 +1,91 @@
+/*
+ * Copyright (c) 2020 Arm Limited and Contributors. All rights reserved.
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ * Licensed under the Apache License, Version 2.0 (the License); you may
+ * not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an AS IS BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef MblFutexMutex_h_
+#define MblFutexMutex_h_
+
+#include <atomic>
+#include <sys/types.h>
+
+namespace mbl {
+
+/**
+ * A mutex that spins briefly before sleeping on a futex.
+ *
+ * Locking an unlocked mutex is one compare-and-swap and unlocking it with no
+ * waiters is one exchange, with no system calls. A thread that finds the
+ * mutex locked spins for a while first, since the critical sections it is
+ * used for are usually much shorter than a trip to the kernel. The number of
+ * spins adapts to how many recently got the mutex, up to max_spins, and there
+ * is no spinning on a single CPU system. After that, the thread sleeps on a
+ * futex until the mutex is unlocked (the mutex from Ulrich Drepper's
+ * "Futexes Are Tricky").
+ *
+ * MblMutex uses this instead of a pthread mutex when built with
+ * MBL_MUTEX_IMPL=futex.
+ */
+class MblFutexMutex
+{
+public:
+    static const int max_spins = 100;
+
+    /**
+     * @param recursive whether the thread holding the mutex may lock it
+     *        again.
+     */
+    explicit MblFutexMutex(bool recursive = false);
+
+    void lock();
+    void unlock();
+    bool try_lock();
+
+private:
+    enum State
+    {
+        State_Unlocked = 0,
+        State_Locked = 1,
+        // Locked, and threads may be sleeping on the futex
+        State_LockedWithWaiters = 2
+    };
+
+    // No copying
+    MblFutexMutex(const MblFutexMutex&);
+    MblFutexMutex& operator=(const MblFutexMutex&);
+
+    // Recursive locking by the holder, or false
+    bool lock_again();
+
+    void lock_contended();
+    void locked();
+    void update_spins(int spins);
+
+    std::atomic<int> state_;
+
+    // Moving average of the spins it took to get the mutex. Only updated by
+    // the thread holding the mutex, but read by any.
+    std::atomic<int> spins_;
+
+    // Only for recursive mutexes: the holder's thread ID (or 0), and how many
+    // times it has locked the mutex
+    const bool recursive_;
+    std::atomic<pid_t> owner_;
+    unsigned depth_;
+};
+
+} // namespace mbl
+
+#endif // MblFutexMutex_h_
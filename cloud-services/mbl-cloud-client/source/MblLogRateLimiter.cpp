@@ -0,0 +1,178 @@
+/*
+ * Copyright (c) 2020 Arm Limited and Contributors. All rights reserved.
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ * Licensed under the Apache License, Version 2.0 (the License); you may
+ * not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an AS IS BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "MblLogRateLimiter.h"
+
+#include <algorithm>
+#include <cinttypes>
+#include <cstdio>
+#include <cstring>
+
+namespace mbl {
+
+const size_t MblLogRateLimiter::max_summary_text_length;
+
+MblLogRateLimiter::MblLogRateLimiter(const Config& config)
+    : config_(config)
+{
+    for (RepeatSlot& slot : repeat_slots_) {
+        slot.in_use = false;
+        slot.repeats = 0;
+    }
+    for (Bucket& bucket : buckets_) {
+        bucket.milli_tokens = static_cast<uint64_t>(config_.burst) * 1000;
+        bucket.last_refill_ms = 0;
+        bucket.dropped = 0;
+        bucket.first_drop_ms = 0;
+    }
+}
+
+uint64_t MblLogRateLimiter::fingerprint(const void* const data, const size_t length, const uint64_t seed)
+{
+    // 64 bit FNV-1a
+    const uint8_t* const bytes = static_cast<const uint8_t*>(data);
+    uint64_t hash = seed;
+    for (size_t i = 0; i < length; ++i) {
+        hash ^= bytes[i];
+        hash *= 0x100000001b3ULL;
+    }
+    return hash;
+}
+
+int64_t MblLogRateLimiter::next_deadline_ms() const
+{
+    int64_t deadline = -1;
+    for (const RepeatSlot& slot : repeat_slots_) {
+        if (slot.in_use && slot.repeats != 0 && (deadline == -1 || slot.window_end_ms < deadline)) {
+            deadline = slot.window_end_ms;
+        }
+    }
+    for (const Bucket& bucket : buckets_) {
+        const int64_t report_ms = bucket.first_drop_ms + 1000;
+        if (bucket.dropped != 0 && (deadline == -1 || report_ms < deadline)) {
+            deadline = report_ms;
+        }
+    }
+    return deadline;
+}
+
+MblLogRateLimiter::RepeatSlot& MblLogRateLimiter::find_repeat_slot(const uint64_t fingerprint, const int64_t now_ms)
+{
+    // Prefer the slot already tracking this fingerprint, then a free or
+    // expired slot, then the oldest slot that hasn't seen any repeats (so
+    // that a stream of unique lines doesn't push out the lines that really
+    // are repeating), then the oldest slot.
+    RepeatSlot* free_slot = 0;
+    RepeatSlot* oldest_unrepeated_slot = 0;
+    RepeatSlot* oldest_slot = 0;
+    for (RepeatSlot& slot : repeat_slots_) {
+        if (!slot.in_use || now_ms >= slot.window_end_ms) {
+            if (slot.in_use && slot.fingerprint == fingerprint) {
+                return slot;
+            }
+            if (!free_slot) {
+                free_slot = &slot;
+            }
+            continue;
+        }
+        if (slot.fingerprint == fingerprint) {
+            return slot;
+        }
+        const bool older_unrepeated =
+            !oldest_unrepeated_slot || slot.window_end_ms < oldest_unrepeated_slot->window_end_ms;
+        if (slot.repeats == 0 && older_unrepeated) {
+            oldest_unrepeated_slot = &slot;
+        }
+        if (!oldest_slot || slot.window_end_ms < oldest_slot->window_end_ms) {
+            oldest_slot = &slot;
+        }
+    }
+
+    if (free_slot) {
+        return *free_slot;
+    }
+    return oldest_unrepeated_slot ? *oldest_unrepeated_slot : *oldest_slot;
+}
+
+void MblLogRateLimiter::start_repeat_window(
+    RepeatSlot& slot,
+    const uint64_t fingerprint,
+    const char* const text,
+    const size_t text_length,
+    const int64_t now_ms)
+{
+    slot.in_use = true;
+    slot.fingerprint = fingerprint;
+    slot.window_end_ms = now_ms + config_.repeat_window_ms;
+    slot.repeats = 0;
+    slot.text_length = std::min(text_length, max_summary_text_length);
+    std::memcpy(slot.text, text, slot.text_length);
+    slot.text[slot.text_length] = '\0';
+}
+
+bool MblLogRateLimiter::take_token(const log_trace::Group group, const int64_t now_ms)
+{
+    if (config_.lines_per_second == 0) {
+        return true;
+    }
+
+    Bucket& bucket = buckets_[group];
+    const uint64_t max_milli_tokens = static_cast<uint64_t>(config_.burst) * 1000;
+    if (now_ms > bucket.last_refill_ms) {
+        const uint64_t elapsed_ms = static_cast<uint64_t>(now_ms - bucket.last_refill_ms);
+        bucket.milli_tokens =
+            std::min(max_milli_tokens, bucket.milli_tokens + elapsed_ms * config_.lines_per_second);
+        bucket.last_refill_ms = now_ms;
+    }
+
+    if (bucket.milli_tokens < 1000) {
+        if (bucket.dropped == 0) {
+            bucket.first_drop_ms = now_ms;
+        }
+        ++bucket.dropped;
+        return false;
+    }
+    bucket.milli_tokens -= 1000;
+    return true;
+}
+
+void MblLogRateLimiter::format_repeat_summary(const RepeatSlot& slot, char* const buffer, const size_t size)
+{
+    std::snprintf(
+        buffer,
+        size,
+        "Suppressed %" PRIu64 " repeats of \"%s%s\"",
+        slot.repeats,
+        slot.text,
+        slot.text_length == max_summary_text_length ? "..." : "");
+}
+
+void MblLogRateLimiter::format_drop_summary(
+    const log_trace::Group group,
+    const uint64_t dropped,
+    char* const buffer,
+    const size_t size)
+{
+    std::snprintf(
+        buffer,
+        size,
+        "%" PRIu64 " log lines from trace group \"%s\" dropped by rate limiting",
+        dropped,
+        log_trace::group_name(group));
+}
+
+} // namespace mbl
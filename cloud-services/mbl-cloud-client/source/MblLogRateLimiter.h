@@ -0,0 +1,207 @@
+/*
+ * Copyright (c) 2020 Arm Limited and Contributors. All rights reserved.
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ * Licensed under the Apache License, Version 2.0 (the License); you may
+ * not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an AS IS BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef MblLogRateLimiter_h_
+#define MblLogRateLimiter_h_
+
+#include "log_trace.h"
+
+#include <cstddef>
+#include <stdint.h>
+
+namespace mbl {
+
+/**
+ * Decides which log lines are written during bursts of logging.
+ *
+ * Two filters are applied:
+ *
+ * 1. Repeat suppression: the first line with a given fingerprint is written;
+ *    further lines with the same fingerprint within the repeat window are
+ *    only counted. When the window ends a single "repeated N times" summary
+ *    is reported instead.
+ * 2. Rate limiting: each trace group has a token bucket. A line that passes
+ *    the repeat filter takes a token; lines for which there is no token are
+ *    dropped and reported as a count.
+ *
+ * Not thread safe: intended to be used only by the log writer thread.
+ */
+class MblLogRateLimiter
+{
+public:
+    struct Config
+    {
+        // Sustained lines per second per trace group, or 0 for no limit
+        uint32_t lines_per_second;
+        // Lines a trace group may log in a burst before it is limited
+        uint32_t burst;
+        // How long to suppress repeats of a line for, or 0 to never
+        // suppress repeats
+        uint32_t repeat_window_ms;
+    };
+
+    // Longest line text kept for repeat summaries. Longer lines are truncated
+    // in summaries.
+    static const size_t max_summary_text_length = 120;
+
+    explicit MblLogRateLimiter(const Config& config);
+
+    /**
+     * Compute the fingerprint of some data. Pass a previous fingerprint as
+     * seed to extend it with more data.
+     */
+    static uint64_t fingerprint(const void* data, size_t length, uint64_t seed = fingerprint_seed);
+
+    /**
+     * Decide whether a line should be written.
+     *
+     * @param fingerprint fingerprint of the line's contents, excluding
+     *        anything (like a timestamp) that differs between repeats.
+     * @param group the line's trace group.
+     * @param text the line's text, used for repeat summaries.
+     * @param text_length length of text.
+     * @param now_ms current CLOCK_MONOTONIC time in milliseconds.
+     * @param report called as report(const char* message) for any summaries
+     *        that have to be written before this line.
+     * @return true if the line should be written.
+     */
+    template <typename Report>
+    bool admit(
+        uint64_t fingerprint,
+        log_trace::Group group,
+        const char* text,
+        size_t text_length,
+        int64_t now_ms,
+        Report report);
+
+    /**
+     * Report summaries for repeat windows that have ended and for lines
+     * dropped by rate limiting.
+     *
+     * @param report called as report(const char* message) for each summary.
+     */
+    template <typename Report>
+    void expire(int64_t now_ms, Report report);
+
+    /**
+     * Time at which expire() next has something to report, or -1 if there is
+     * nothing pending.
+     */
+    int64_t next_deadline_ms() const;
+
+private:
+    static const uint64_t fingerprint_seed = 0xcbf29ce484222325ULL;
+    static const size_t num_repeat_slots = 32;
+
+    struct RepeatSlot
+    {
+        bool in_use;
+        uint64_t fingerprint;
+        int64_t window_end_ms;
+        uint64_t repeats;
+        size_t text_length;
+        char text[max_summary_text_length + 1];
+    };
+
+    struct Bucket
+    {
+        // Tokens are counted in thousandths so that refilling by elapsed
+        // milliseconds needs no division.
+        uint64_t milli_tokens;
+        int64_t last_refill_ms;
+        uint64_t dropped;
+        int64_t first_drop_ms;
+    };
+
+    // No copying
+    MblLogRateLimiter(const MblLogRateLimiter&);
+    MblLogRateLimiter& operator=(const MblLogRateLimiter&);
+
+    RepeatSlot& find_repeat_slot(uint64_t fingerprint, int64_t now_ms);
+    void start_repeat_window(
+        RepeatSlot& slot,
+        uint64_t fingerprint,
+        const char* text,
+        size_t text_length,
+        int64_t now_ms);
+    bool take_token(log_trace::Group group, int64_t now_ms);
+
+    static void format_repeat_summary(const RepeatSlot& slot, char* buffer, size_t size);
+    static void format_drop_summary(log_trace::Group group, uint64_t dropped, char* buffer, size_t size);
+
+    const Config config_;
+    RepeatSlot repeat_slots_[num_repeat_slots];
+    Bucket buckets_[log_trace::Group_Count];
+};
+
+template <typename Report>
+bool MblLogRateLimiter::admit(
+    const uint64_t fingerprint,
+    const log_trace::Group group,
+    const char* const text,
+    const size_t text_length,
+    const int64_t now_ms,
+    Report report)
+{
+    char summary[max_summary_text_length + 64];
+
+    if (config_.repeat_window_ms != 0) {
+        RepeatSlot& slot = find_repeat_slot(fingerprint, now_ms);
+        if (slot.in_use && slot.fingerprint == fingerprint && now_ms < slot.window_end_ms) {
+            ++slot.repeats;
+            return false;
+        }
+        if (slot.in_use && slot.repeats != 0) {
+            // The slot is being reused before expire() got to it
+            format_repeat_summary(slot, summary, sizeof(summary));
+            report(static_cast<const char*>(summary));
+        }
+        start_repeat_window(slot, fingerprint, text, text_length, now_ms);
+    }
+
+    return take_token(group, now_ms);
+}
+
+template <typename Report>
+void MblLogRateLimiter::expire(const int64_t now_ms, Report report)
+{
+    char summary[max_summary_text_length + 64];
+
+    for (RepeatSlot& slot : repeat_slots_) {
+        if (slot.in_use && now_ms >= slot.window_end_ms) {
+            if (slot.repeats != 0) {
+                format_repeat_summary(slot, summary, sizeof(summary));
+                report(static_cast<const char*>(summary));
+            }
+            slot.in_use = false;
+        }
+    }
+
+    for (size_t i = 0; i < log_trace::Group_Count; ++i) {
+        Bucket& bucket = buckets_[i];
+        // Report drops at most once a second per group
+        if (bucket.dropped != 0 && now_ms - bucket.first_drop_ms >= 1000) {
+            format_drop_summary(static_cast<log_trace::Group>(i), bucket.dropped, summary, sizeof(summary));
+            report(static_cast<const char*>(summary));
+            bucket.dropped = 0;
+        }
+    }
+}
+
+} // namespace mbl
+
+#endif // MblLogRateLimiter_h_
@@ -0,0 +1,784 @@
+/*
+ * Copyright (c) 2020 Arm Limited and Contributors. All rights reserved.
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ * Licensed under the Apache License, Version 2.0 (the License); you may
+ * not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an AS IS BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "MblLogWriter.h"
+
+#include "log_time_prefix.h"
+#include "monotonic_time.h"
+#include "signals.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cerrno>
+#include <cinttypes>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+#include <fcntl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#ifdef MBL_LOG_JOURNALD
+#include <sys/uio.h>
+#include <syslog.h>
+#include <systemd/sd-journal.h>
+#endif
+
+// Lines are collected into a buffer of this size and written with a single
+// write(2) call.
+static const size_t g_batch_size = 64 * 1024;
+
+static int64_t get_realtime_us()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    return static_cast<int64_t>(ts.tv_sec) * 1000000 + ts.tv_nsec / 1000;
+}
+
+// Local time's offset from UTC in seconds at the given time
+static int32_t get_utc_offset_s(const int64_t time_s)
+{
+    const time_t when = static_cast<time_t>(time_s);
+    struct tm time_info;
+    if (!localtime_r(&when, &time_info)) {
+        return 0;
+    }
+    return static_cast<int32_t>(time_info.tm_gmtoff);
+}
+
+// Map the level name in an mbed-trace header to its TRACE_LEVEL_* value, or
+// 0 if it isn't one
+static uint8_t header_level(const char* const level)
+{
+    if (std::strncmp(level, "ERR ", 4) == 0) {
+        return TRACE_LEVEL_ERROR;
+    }
+    if (std::strncmp(level, "WARN", 4) == 0) {
+        return TRACE_LEVEL_WARN;
+    }
+    if (std::strncmp(level, "INFO", 4) == 0) {
+        return TRACE_LEVEL_INFO;
+    }
+    if (std::strncmp(level, "DBG ", 4) == 0) {
+        return TRACE_LEVEL_DEBUG;
+    }
+    return 0;
+}
+
+/**
+ * Find the "[LEVL][grp ]: " header that mbed-trace puts after the time prefix
+ * of a line.
+ *
+ * @param header_offset set to the offset of the header, or 0 if there is none.
+ * @param level set to the line's TRACE_LEVEL_* value, or 0 if it has none.
+ * @return the line's trace group.
+ */
+static mbl::log_trace::Group parse_line_group(
+    const char* const line,
+    const size_t length,
+    size_t& header_offset,
+    uint8_t& level)
+{
+    header_offset = 0;
+    level = 0;
+    const char* const end = line + length;
+    const char* const header = static_cast<const char*>(std::memchr(line, '[', length));
+    if (!header || end - header < 9 || header[5] != ']' || header[6] != '[') {
+        return mbl::log_trace::Group_Other;
+    }
+
+    const char* const group_start = header + 7;
+    const char* group_end = static_cast<const char*>(std::memchr(group_start, ']', static_cast<size_t>(end - group_start)));
+    if (!group_end) {
+        return mbl::log_trace::Group_Other;
+    }
+    header_offset = static_cast<size_t>(header - line);
+    level = header_level(header + 1);
+
+    // Group names are padded with spaces to 4 characters
+    char group[32];
+    while (group_end > group_start && group_end[-1] == ' ') {
+        --group_end;
+    }
+    const size_t group_length = std::min(static_cast<size_t>(group_end - group_start), sizeof(group) - 1);
+    std::memcpy(group, group_start, group_length);
+    group[group_length] = '\0';
+    return mbl::log_trace::group_from_name(group);
+}
+
+static pid_t get_thread_id()
+{
+    // gettid is a system call, so only make it once per thread
+    thread_local static const pid_t tid = static_cast<pid_t>(syscall(SYS_gettid));
+    return tid;
+}
+
+#ifdef MBL_LOG_JOURNALD
+// Map an mbed-trace level name to a syslog priority
+static int journal_priority(const char* const level)
+{
+    if (std::strncmp(level, "ERR", 3) == 0) {
+        return LOG_ERR;
+    }
+    if (std::strncmp(level, "WARN", 4) == 0) {
+        return LOG_WARNING;
+    }
+    if (std::strncmp(level, "DBG", 3) == 0) {
+        return LOG_DEBUG;
+    }
+    return LOG_INFO;
+}
+
+/**
+ * Send a message to journald. level and group may be empty if the line
+ * didn't have them.
+ */
+static void send_to_journal(
+    const char* const level,
+    const char* const group,
+    const char* const message,
+    const size_t message_length,
+    const mbl::MblError error,
+    const pid_t tid)
+{
+    char message_field[sizeof("MESSAGE=") + mbl::MblLogWriter::max_line_length];
+    char priority_field[16];
+    char group_field[64];
+    char level_field[32];
+    char tid_field[32];
+    char error_field[32];
+    char error_name_field[128];
+
+    struct iovec fields[8];
+    size_t num_fields = 0;
+    const auto add_field = [&fields, &num_fields](char* const field, const int length, const size_t size) {
+        if (length > 0) {
+            fields[num_fields].iov_base = field;
+            fields[num_fields].iov_len = std::min(static_cast<size_t>(length), size - 1);
+            ++num_fields;
+        }
+    };
+
+    add_field(
+        message_field,
+        std::snprintf(
+            message_field, sizeof(message_field), "MESSAGE=%.*s", static_cast<int>(message_length), message),
+        sizeof(message_field));
+    add_field(
+        priority_field,
+        std::snprintf(priority_field, sizeof(priority_field), "PRIORITY=%d", journal_priority(level)),
+        sizeof(priority_field));
+    if (*group) {
+        add_field(
+            group_field,
+            std::snprintf(group_field, sizeof(group_field), "TRACE_GROUP=%s", group),
+            sizeof(group_field));
+    }
+    if (*level) {
+        add_field(
+            level_field,
+            std::snprintf(level_field, sizeof(level_field), "MBL_LOG_LEVEL=%s", level),
+            sizeof(level_field));
+    }
+    add_field(tid_field, std::snprintf(tid_field, sizeof(tid_field), "TID=%d", tid), sizeof(tid_field));
+    if (error != mbl::Error::None) {
+        add_field(
+            error_field,
+            std::snprintf(error_field, sizeof(error_field), "MBL_ERROR=0x%04x", static_cast<unsigned>(error)),
+            sizeof(error_field));
+        add_field(
+            error_name_field,
+            std::snprintf(
+                error_name_field, sizeof(error_name_field), "MBL_ERROR_NAME=%s", mbl::MblError_to_str(error)),
+            sizeof(error_name_field));
+    }
+
+    static char identifier_field[] = "SYSLOG_IDENTIFIER=mbl-cloud-client";
+    fields[num_fields].iov_base = identifier_field;
+    fields[num_fields].iov_len = sizeof(identifier_field) - 1;
+    ++num_fields;
+
+    // Nowhere to report failures
+    sd_journal_sendv(fields, static_cast<int>(num_fields));
+}
+#endif // MBL_LOG_JOURNALD
+
+namespace mbl {
+
+MblLogWriter::MblLogWriter(
+    const char* const path,
+    const size_t capacity,
+    const OverflowPolicy policy,
+    const Format format,
+    const MblLogRateLimiter::Config& rate_limit)
+    : path_(path)
+    , policy_(policy)
+    , format_(format)
+    , queue_(capacity)
+    , fd_(-1)
+    , batch_(new char[g_batch_size])
+    , batch_length_(0)
+    , dropped_reported_(0)
+    , rate_limiter_(rate_limit)
+    , last_time_us_(0)
+    , formats_written_()
+    , utc_offset_s_(0)
+    , utc_offset_checked_s_(0)
+    , thread_()
+    , thread_running_(false)
+    , need_reopen_(false)
+    , stopping_(false)
+    , writer_waiting_(false)
+    , producers_waiting_(0)
+    , dropped_(0)
+{
+    pthread_mutex_init(&mutex_, 0);
+
+    // The writer sleeps with a CLOCK_MONOTONIC timeout while rate limiter
+    // summaries are pending
+    pthread_condattr_t data_cond_attr;
+    pthread_condattr_init(&data_cond_attr);
+    pthread_condattr_setclock(&data_cond_attr, CLOCK_MONOTONIC);
+    pthread_cond_init(&data_cond_, &data_cond_attr);
+    pthread_condattr_destroy(&data_cond_attr);
+    pthread_cond_init(&space_cond_, 0);
+
+#ifndef MBL_LOG_JOURNALD
+    assert(format_ != Format_Journald);
+#endif
+}
+
+MblLogWriter::~MblLogWriter()
+{
+    stop();
+    if (fd_ != -1) {
+        close(fd_);
+    }
+    pthread_cond_destroy(&space_cond_);
+    pthread_cond_destroy(&data_cond_);
+    pthread_mutex_destroy(&mutex_);
+}
+
+MblError MblLogWriter::start()
+{
+    assert(!thread_running_);
+
+    if (format_ != Format_Journald && !open_file()) {
+        std::perror("MblLogWriter::start: open");
+        return Error::LogInitFopen;
+    }
+
+    const int create_err = create_thread_with_signals_blocked(&thread_, &MblLogWriter::thread_main, this);
+
+    if (create_err != 0) {
+        std::fprintf(stderr, "MblLogWriter::start: pthread_create: %s\n", std::strerror(create_err));
+        return Error::LogInitThreadCreate;
+    }
+
+    thread_running_ = true;
+    return Error::None;
+}
+
+void MblLogWriter::stop()
+{
+    if (!thread_running_) {
+        return;
+    }
+
+    stopping_ = true;
+
+    pthread_mutex_lock(&mutex_);
+    pthread_cond_signal(&data_cond_);
+    pthread_cond_broadcast(&space_cond_);
+    pthread_mutex_unlock(&mutex_);
+
+    pthread_join(thread_, 0);
+    thread_running_ = false;
+}
+
+void MblLogWriter::write_line(const char* const str, const MblError error)
+{
+    size_t length = std::strlen(str);
+    if (length > max_line_length) {
+        length = max_line_length;
+    }
+
+    // Binary log records carry their own timestamps
+    const int64_t time_us = (format_ == Format_Binary) ? get_realtime_us() : 0;
+    const pid_t tid = (format_ == Format_Journald) ? get_thread_id() : 0;
+
+    push([str, length, time_us, error, tid](Entry& entry) {
+        entry.site = 0;
+        entry.time_us = time_us;
+        entry.error = error;
+        entry.tid = tid;
+        std::memcpy(entry.data, str, length);
+        entry.length = static_cast<uint16_t>(length);
+    });
+}
+
+void MblLogWriter::write_trace(
+    const log_binary::Site& site,
+    const uint8_t* const args,
+    const size_t args_length)
+{
+    assert(format_ == Format_Binary);
+    assert(args_length <= max_line_length);
+
+    const int64_t time_us = get_realtime_us();
+    push([&site, args, args_length, time_us](Entry& entry) {
+        entry.site = &site;
+        entry.time_us = time_us;
+        entry.error = Error::None;
+        entry.tid = 0;
+        std::memcpy(entry.data, args, args_length);
+        entry.length = static_cast<uint16_t>(args_length);
+    });
+}
+
+template <typename Fill>
+void MblLogWriter::push(Fill fill)
+{
+    if (stopping_.load(std::memory_order_relaxed)) {
+        return;
+    }
+
+    while (!queue_.try_push_with(fill)) {
+        if (policy_ == OverflowPolicy_DropOldest) {
+            if (queue_.try_pop_with([](Entry&) {})) {
+                dropped_.fetch_add(1, std::memory_order_relaxed);
+            }
+            continue;
+        }
+
+        // OverflowPolicy_Block. Announce that we're waiting before trying
+        // again under the mutex so that the writer can't free a slot without
+        // noticing us.
+        producers_waiting_.fetch_add(1);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        pthread_mutex_lock(&mutex_);
+        bool pushed;
+        while (!(pushed = queue_.try_push_with(fill)) && !stopping_) {
+            pthread_cond_wait(&space_cond_, &mutex_);
+        }
+        pthread_mutex_unlock(&mutex_);
+        producers_waiting_.fetch_sub(1);
+
+        if (!pushed) {
+            dropped_.fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+        break;
+    }
+
+    // Pairs with the fence in run(): either we see that the writer is about to
+    // sleep, or the writer sees our entry.
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (writer_waiting_.load(std::memory_order_relaxed)) {
+        pthread_mutex_lock(&mutex_);
+        pthread_cond_signal(&data_cond_);
+        pthread_mutex_unlock(&mutex_);
+    }
+}
+
+void MblLogWriter::request_reopen()
+{
+    need_reopen_ = true;
+}
+
+uint64_t MblLogWriter::dropped_count() const
+{
+    return dropped_.load(std::memory_order_relaxed);
+}
+
+void* MblLogWriter::thread_main(void* const arg)
+{
+    static_cast<MblLogWriter*>(arg)->run();
+    return 0;
+}
+
+void MblLogWriter::run()
+{
+    for (;;) {
+        reopen_if_needed();
+
+        while (queue_.try_pop_with([this](Entry& entry) {
+            if (admit_entry(entry, get_monotonic_time_ms())) {
+                append_entry(entry);
+            }
+        })) {
+            notify_blocked_producers();
+        }
+
+        rate_limiter_.expire(get_monotonic_time_ms(), [this](const char* const summary) {
+            append_notice("INFO", summary);
+        });
+
+        const uint64_t dropped = dropped_.load(std::memory_order_relaxed);
+        if (dropped != dropped_reported_) {
+            char message[80];
+            std::snprintf(
+                message,
+                sizeof(message),
+                "%" PRIu64 " log lines dropped because the log queue was full",
+                dropped - dropped_reported_);
+            append_notice("WARN", message);
+            dropped_reported_ = dropped;
+        }
+
+        flush_batch();
+
+        if (stopping_ && queue_.empty()) {
+            return;
+        }
+
+        wait_for_entries();
+    }
+}
+
+void MblLogWriter::wait_for_entries()
+{
+    const int64_t deadline_ms = rate_limiter_.next_deadline_ms();
+    struct timespec deadline;
+    deadline.tv_sec = static_cast<time_t>(deadline_ms / 1000);
+    deadline.tv_nsec = static_cast<long>(deadline_ms % 1000) * 1000000;
+
+    pthread_mutex_lock(&mutex_);
+    writer_waiting_ = true;
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    while (queue_.empty() && !stopping_) {
+        if (deadline_ms == -1) {
+            pthread_cond_wait(&data_cond_, &mutex_);
+        }
+        else if (pthread_cond_timedwait(&data_cond_, &mutex_, &deadline) == ETIMEDOUT) {
+            break;
+        }
+    }
+    writer_waiting_ = false;
+    pthread_mutex_unlock(&mutex_);
+}
+
+bool MblLogWriter::admit_entry(const Entry& entry, const int64_t now_ms)
+{
+    const auto report = [this](const char* const summary) { append_notice("INFO", summary); };
+
+    if (entry.site) {
+        // Binary trace: the site and its arguments identify the message
+        const uint64_t site_fingerprint = MblLogRateLimiter::fingerprint(&entry.site, sizeof(entry.site));
+        return rate_limiter_.admit(
+            MblLogRateLimiter::fingerprint(entry.data, entry.length, site_fingerprint),
+            log_trace::group_from_name(entry.site->group),
+            entry.site->format,
+            std::strlen(entry.site->format),
+            now_ms,
+            report);
+    }
+
+    size_t header_offset;
+    uint8_t level;
+    const log_trace::Group group = parse_line_group(entry.data, entry.length, header_offset, level);
+
+    // mbed-trace lets through the most verbose level of any group, so lines
+    // from groups without a level of their own (i.e. the mbed-cloud-client
+    // libraries) are filtered against the "other" level here
+    if (group == log_trace::Group_Other && level != 0 && !log_trace::enabled(group, level)) {
+        return false;
+    }
+
+    // Leave the time prefix out of the fingerprint
+    const char* const text = entry.data + header_offset;
+    const size_t text_length = entry.length - header_offset;
+    return rate_limiter_.admit(
+        MblLogRateLimiter::fingerprint(text, text_length), group, text, text_length, now_ms, report);
+}
+
+void MblLogWriter::reopen_if_needed()
+{
+    // Like the old fopen-per-line behaviour, keep trying to open the file if
+    // it couldn't be opened before.
+    const bool reopen_requested = need_reopen_.exchange(false);
+    if (format_ == Format_Journald || (fd_ != -1 && !reopen_requested)) {
+        return;
+    }
+
+    // The batch was encoded for the old file, so write it out first
+    flush_batch();
+    if (fd_ != -1) {
+        close(fd_);
+        fd_ = -1;
+    }
+    if (open_file()) {
+        // We can't use mbed-trace to log here because it would just queue the
+        // line back to us
+        append_notice("INFO", "Log file reopened");
+    }
+}
+
+bool MblLogWriter::open_file()
+{
+    assert(fd_ == -1);
+    assert(batch_length_ == 0);
+    fd_ = open(path_, O_WRONLY | O_APPEND | O_CREAT | O_CLOEXEC, 0666);
+    if (fd_ == -1) {
+        return false;
+    }
+    if (format_ == Format_Binary) {
+        append_binary_header();
+    }
+    return true;
+}
+
+void MblLogWriter::append_entry(const Entry& entry)
+{
+    if (format_ == Format_Journald) {
+        send_line_to_journal(entry);
+        return;
+    }
+
+    if (format_ == Format_Text) {
+        append_to_batch(entry.data, entry.length);
+        append_to_batch("\n", 1);
+        return;
+    }
+
+    if (!entry.site) {
+        append_binary_text(entry.time_us, entry.data, entry.length);
+        return;
+    }
+
+    append_utc_offset_if_changed(entry.time_us);
+
+    const uint32_t id = entry.site->id.load(std::memory_order_acquire);
+    if (id >= formats_written_.size()) {
+        formats_written_.resize(id + 1, false);
+    }
+    if (!formats_written_[id]) {
+        append_binary_format(*entry.site, id);
+        formats_written_[id] = true;
+    }
+
+    uint8_t header[1 + 10];
+    header[0] = log_binary::RecordType_Trace;
+    const size_t header_length = 1 + log_binary::encode_varint(header + 1, id);
+    append_to_batch(header, header_length);
+    append_time_delta(entry.time_us);
+    append_to_batch(entry.data, entry.length);
+}
+
+void MblLogWriter::append_binary_header()
+{
+    const int64_t now_us = get_realtime_us();
+    const int64_t now_s = now_us / 1000000;
+    const int32_t utc_offset_s = get_utc_offset_s(now_s);
+
+    uint8_t header[4 + 1 + 8 + 4];
+    std::memcpy(header, "MBLB", 4);
+    header[4] = log_binary::file_format_version;
+    for (size_t i = 0; i < 8; ++i) {
+        header[5 + i] = static_cast<uint8_t>(static_cast<uint64_t>(now_us) >> (8 * i));
+    }
+    for (size_t i = 0; i < 4; ++i) {
+        header[13 + i] = static_cast<uint8_t>(static_cast<uint32_t>(utc_offset_s) >> (8 * i));
+    }
+    append_to_batch(header, sizeof(header));
+
+    last_time_us_ = now_us;
+    formats_written_.clear();
+    utc_offset_s_ = utc_offset_s;
+    utc_offset_checked_s_ = now_s;
+}
+
+void MblLogWriter::append_binary_format(const log_binary::Site& site, const uint32_t id)
+{
+    const char* const signature = site.signature.load(std::memory_order_relaxed);
+    const char* const strings[] = {site.group, site.format, signature ? signature : ""};
+
+    uint8_t header[1 + 10 + 1];
+    size_t header_length = 0;
+    header[header_length++] = log_binary::RecordType_Format;
+    header_length += log_binary::encode_varint(header + header_length, id);
+    header[header_length++] = site.level;
+    append_to_batch(header, header_length);
+
+    for (const char* const str : strings) {
+        const size_t length = std::strlen(str);
+        uint8_t length_buf[10];
+        append_to_batch(length_buf, log_binary::encode_varint(length_buf, length));
+        append_to_batch(str, length);
+    }
+}
+
+void MblLogWriter::append_binary_text(const int64_t time_us, const char* const text, const size_t length)
+{
+    append_utc_offset_if_changed(time_us);
+
+    const uint8_t type = log_binary::RecordType_Text;
+    append_to_batch(&type, 1);
+    append_time_delta(time_us);
+    uint8_t length_buf[10];
+    append_to_batch(length_buf, log_binary::encode_varint(length_buf, length));
+    append_to_batch(text, length);
+}
+
+void MblLogWriter::append_time_delta(const int64_t time_us)
+{
+    uint8_t delta[10];
+    append_to_batch(delta, log_binary::encode_svarint(delta, time_us - last_time_us_));
+    last_time_us_ = time_us;
+}
+
+void MblLogWriter::append_utc_offset_if_changed(const int64_t time_us)
+{
+    // The offset only changes on a whole second (usually for daylight saving
+    // time), so look it up once for each second that has records
+    const int64_t time_s = time_us / 1000000;
+    if (time_s == utc_offset_checked_s_) {
+        return;
+    }
+    utc_offset_checked_s_ = time_s;
+
+    const int32_t utc_offset_s = get_utc_offset_s(time_s);
+    if (utc_offset_s == utc_offset_s_) {
+        return;
+    }
+    utc_offset_s_ = utc_offset_s;
+
+    uint8_t record[1 + 10];
+    record[0] = log_binary::RecordType_UtcOffset;
+    const size_t record_length = 1 + log_binary::encode_svarint(record + 1, utc_offset_s);
+    append_to_batch(record, record_length);
+}
+
+void MblLogWriter::send_line_to_journal(const Entry& entry)
+{
+#ifdef MBL_LOG_JOURNALD
+    // Split mbed-trace's "[LEVL][grp ]: message" format into fields. The time
+    // prefix is left out in journald mode; journald records the time itself.
+    char level[5] = "";
+    char group[max_line_length + 1] = "";
+    const char* message = entry.data;
+    size_t message_length = entry.length;
+
+    const char* const end = entry.data + entry.length;
+    const char* const group_start = entry.data + 6;
+    if (entry.length > 6 && entry.data[0] == '[' && entry.data[5] == ']' && entry.data[6] == '[') {
+        const char* const group_end = static_cast<const char*>(
+            std::memchr(group_start + 1, ']', static_cast<size_t>(end - group_start - 1)));
+        if (group_end && end - group_end >= 3 && group_end[1] == ':' && group_end[2] == ' ') {
+            std::memcpy(level, entry.data + 1, 4);
+            size_t group_length = static_cast<size_t>(group_end - group_start - 1);
+            std::memcpy(group, group_start + 1, group_length);
+            // Both are padded with spaces to 4 characters
+            while (group_length > 0 && group[group_length - 1] == ' ') {
+                group[--group_length] = '\0';
+            }
+            for (size_t i = 4; i > 0 && level[i - 1] == ' '; --i) {
+                level[i - 1] = '\0';
+            }
+            message = group_end + 3;
+            message_length = static_cast<size_t>(end - message);
+        }
+    }
+
+    send_to_journal(level, group, message, message_length, entry.error, entry.tid);
+#else
+    static_cast<void>(entry);
+#endif
+}
+
+void MblLogWriter::append_to_batch(const void* const data, const size_t length)
+{
+    if (batch_length_ + length > g_batch_size) {
+        flush_batch();
+    }
+    assert(length <= g_batch_size);
+    std::memcpy(batch_.get() + batch_length_, data, length);
+    batch_length_ += length;
+}
+
+void MblLogWriter::append_notice(const char* const level, const char* const message)
+{
+    char line[max_line_length + 1];
+
+    if (format_ == Format_Journald) {
+#ifdef MBL_LOG_JOURNALD
+        send_to_journal(level, "mbl", message, std::strlen(message), Error::None, get_thread_id());
+#endif
+        return;
+    }
+
+    if (format_ == Format_Binary) {
+        const int length = std::snprintf(line, sizeof(line), "[%-4s][mbl ]: %s", level, message);
+        if (length > 0) {
+            append_binary_text(
+                get_realtime_us(), line, std::min(static_cast<size_t>(length), sizeof(line) - 1));
+        }
+        return;
+    }
+
+    char prefix[log_time_prefix_buffer_size];
+    const int length = std::snprintf(
+        line,
+        sizeof(line),
+        "%s[%-4s][mbl ]: %s\n",
+        make_time_prefix(prefix, sizeof(prefix)),
+        level,
+        message);
+    if (length > 0) {
+        append_to_batch(line, std::min(static_cast<size_t>(length), sizeof(line) - 1));
+    }
+}
+
+void MblLogWriter::flush_batch()
+{
+    if (batch_length_ == 0) {
+        return;
+    }
+
+    if (fd_ == -1) {
+        batch_length_ = 0;
+        return;
+    }
+
+    size_t written = 0;
+    while (written < batch_length_) {
+        const ssize_t ret = write(fd_, batch_.get() + written, batch_length_ - written);
+        if (ret == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            // Nowhere to report the error; drop the rest of the batch.
+            break;
+        }
+        written += static_cast<size_t>(ret);
+    }
+    batch_length_ = 0;
+}
+
+void MblLogWriter::notify_blocked_producers()
+{
+    // Pairs with the fence in write_line(): either the producer sees the slot
+    // we just freed, or we see that it is waiting.
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (producers_waiting_.load(std::memory_order_relaxed) != 0) {
+        pthread_mutex_lock(&mutex_);
+        pthread_cond_broadcast(&space_cond_);
+        pthread_mutex_unlock(&mutex_);
+    }
+}
+
+} // namespace mbl
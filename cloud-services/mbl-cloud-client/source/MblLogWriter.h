@@ -0,0 +1,215 @@
+/*
+ * Copyright (c) 2020 Arm Limited and Contributors. All rights reserved.
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ * Licensed under the Apache License, Version 2.0 (the License); you may
+ * not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an AS IS BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef MblLogWriter_h_
+#define MblLogWriter_h_
+
+#include "MblBoundedQueue.h"
+#include "MblError.h"
+#include "MblLogRateLimiter.h"
+#include "log_binary.h"
+
+#include <atomic>
+#include <memory>
+#include <pthread.h>
+#include <stdint.h>
+#include <sys/types.h>
+#include <vector>
+
+namespace mbl {
+
+/**
+ * Asynchronous log file writer.
+ *
+ * Producers (the mbed-trace print handler) copy each line into a bounded
+ * lock-free queue and return immediately. A background thread drains the
+ * queue and appends the lines to the log file in large write(2) calls, so a
+ * slow storage device no longer stalls the threads that log.
+ *
+ * The log file is either a text file or a binary log (see log_binary.h).
+ * Alternatively, lines can be sent to the systemd journal instead of a file.
+ *
+ * Repeated lines and bursts from a single trace group are filtered by the
+ * writer thread (see MblLogRateLimiter) so that error storms don't turn into
+ * unbounded I/O.
+ */
+class MblLogWriter
+{
+public:
+    /**
+     * What write_line() does when the queue is full.
+     */
+    enum OverflowPolicy
+    {
+        // Discard the oldest queued line to make room. Never blocks.
+        OverflowPolicy_DropOldest,
+        // Wait for the writer thread to make room.
+        OverflowPolicy_Block
+    };
+
+    enum Format
+    {
+        Format_Text,
+        Format_Binary,
+        // Send each line to journald with its trace group, level, MblError
+        // code and thread as separate fields. The path is ignored. Only
+        // available when built with MBL_LOG_JOURNALD.
+        Format_Journald
+    };
+
+    // Longest line (excluding the newline) that will be written. Longer lines
+    // are truncated.
+    static const size_t max_line_length = 511;
+
+    /**
+     * @param path log file to append to (unused for Format_Journald).
+     * @param capacity maximum number of queued lines (rounded up to a power of
+     *        two).
+     * @param policy what to do when the queue is full.
+     * @param format whether to write a text or binary log file or send lines
+     *        to journald.
+     * @param rate_limit repeat suppression and rate limiting settings.
+     */
+    MblLogWriter(
+        const char* path,
+        size_t capacity,
+        OverflowPolicy policy,
+        Format format,
+        const MblLogRateLimiter::Config& rate_limit);
+
+    /**
+     * Stops the writer thread (if it is running), writing out all queued
+     * lines first.
+     */
+    ~MblLogWriter();
+
+    /**
+     * Open the log file and start the writer thread.
+     */
+    MblError start();
+
+    /**
+     * Write out all queued lines and stop the writer thread. Lines written
+     * after this are dropped.
+     */
+    void stop();
+
+    /**
+     * Queue a line (without a trailing newline) to be written to the log
+     * file. Thread safe.
+     *
+     * @param error the error being reported by this line, if any. Only
+     *        recorded by Format_Journald.
+     */
+    void write_line(const char* str, MblError error = Error::None);
+
+    /**
+     * Queue a binary trace record. Only valid for Format_Binary writers.
+     * Thread safe.
+     */
+    void write_trace(const log_binary::Site& site, const uint8_t* args, size_t args_length);
+
+    /**
+     * Reopen the log file before the next write. Safe to call from any
+     * thread. Does nothing for Format_Journald.
+     */
+    void request_reopen();
+
+    /**
+     * Number of lines discarded because the queue was full.
+     */
+    uint64_t dropped_count() const;
+
+private:
+    // A queued text line, or (for binary logs) a trace record's encoded
+    // arguments if site is non-null. error and tid are only filled in for
+    // Format_Journald.
+    struct Entry
+    {
+        const log_binary::Site* site;
+        int64_t time_us;
+        MblError error;
+        pid_t tid;
+        uint16_t length;
+        char data[max_line_length + 1];
+    };
+
+    // No copying
+    MblLogWriter(const MblLogWriter&);
+    MblLogWriter& operator=(const MblLogWriter&);
+
+    static void* thread_main(void* arg);
+    void run();
+
+    template <typename Fill>
+    void push(Fill fill);
+
+    void reopen_if_needed();
+    bool admit_entry(const Entry& entry, int64_t now_ms);
+    void wait_for_entries();
+    bool open_file();
+    void append_entry(const Entry& entry);
+    void append_to_batch(const void* data, size_t length);
+    void append_notice(const char* level, const char* message);
+    void append_binary_header();
+    void append_binary_format(const log_binary::Site& site, uint32_t id);
+    void append_binary_text(int64_t time_us, const char* text, size_t length);
+    void append_time_delta(int64_t time_us);
+    void append_utc_offset_if_changed(int64_t time_us);
+    void send_line_to_journal(const Entry& entry);
+    void flush_batch();
+    void notify_blocked_producers();
+
+    const char* const path_;
+    const OverflowPolicy policy_;
+    const Format format_;
+    MblBoundedQueue<Entry> queue_;
+
+    // Only accessed by the writer thread once it is running
+    int fd_;
+    const std::unique_ptr<char[]> batch_;
+    size_t batch_length_;
+    uint64_t dropped_reported_;
+    MblLogRateLimiter rate_limiter_;
+
+    // Binary log state for the current file: time of the previous record,
+    // which format IDs have been written already, and the UTC offset last
+    // written with the second in which it was last checked.
+    int64_t last_time_us_;
+    std::vector<bool> formats_written_;
+    int32_t utc_offset_s_;
+    int64_t utc_offset_checked_s_;
+
+    pthread_t thread_;
+    bool thread_running_;
+
+    std::atomic<bool> need_reopen_;
+    std::atomic<bool> stopping_;
+    std::atomic<bool> writer_waiting_;
+    std::atomic<unsigned> producers_waiting_;
+    std::atomic<uint64_t> dropped_;
+
+    // Used only to sleep and wake: the writer waits on data_cond_ when the
+    // queue is empty and blocked producers wait on space_cond_ when it is full.
+    pthread_mutex_t mutex_;
+    pthread_cond_t data_cond_;
+    pthread_cond_t space_cond_;
+};
+
+} // namespace mbl
+
+#endif // MblLogWriter_h_
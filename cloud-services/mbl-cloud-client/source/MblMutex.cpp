@@ -19,15 +19,283 @@
 
 #include <cassert>
 
+#ifdef MBL_MUTEX_PROFILING
+#include "log_trace.h"
+#include "metrics.h"
+
+#include <cinttypes>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+#include <pthread.h>
+
+#define TRACE_GROUP "mbl"
+#endif
+
 namespace mbl {
 
-MblMutex::MblMutex()
+// The underlying mutex, without profiling
+#ifdef MBL_MUTEX_FUTEX
+static void raw_lock(MblFutexMutex& mutex)
+{
+    mutex.lock();
+}
+
+static void raw_unlock(MblFutexMutex& mutex)
+{
+    mutex.unlock();
+}
+
+static bool raw_try_lock(MblFutexMutex& mutex)
+{
+    return mutex.try_lock();
+}
+#else
+static void raw_lock(pthread_mutex_t& mutex)
+{
+    const int ret = pthread_mutex_lock(&mutex);
+    assert(ret == 0);
+    (void)ret;
+}
+
+static void raw_unlock(pthread_mutex_t& mutex)
+{
+    const int ret = pthread_mutex_unlock(&mutex);
+    assert(ret == 0);
+    (void)ret;
+}
+
+static bool raw_try_lock(pthread_mutex_t& mutex)
+{
+    return pthread_mutex_trylock(&mutex) == 0;
+}
+#endif
+
+#ifdef MBL_MUTEX_PROFILING
+
+// Where a mutex was locked from
+struct MblMutexCallSite
+{
+    const char* file;
+    int line;
+
+    std::atomic<uint64_t> acquisitions;
+    // Times this site waited for the mutex
+    std::atomic<uint64_t> waits;
+    // Times other sites waited for the mutex while this one held it
+    std::atomic<uint64_t> waits_caused;
+    std::atomic<uint64_t> max_hold_ns;
+};
+
+// Statistics shared by all mutexes of one name
+class MblMutexProfile
+{
+public:
+    static const size_t max_sites = 16;
+
+    MblMutexProfile() : name(0), acquisitions(0), contended(0), site_count_(0) {}
+
+    // Find or add the entry for a call site. Sites beyond max_sites share
+    // one entry.
+    MblMutexCallSite* find_site(const char* file, int line);
+
+    void log() const;
+
+    const char* name;
+    std::atomic<uint64_t> acquisitions;
+    std::atomic<uint64_t> contended;
+    metrics::Histogram wait_ns;
+    metrics::Histogram hold_ns;
+
+private:
+    MblMutexCallSite sites_[max_sites + 1];
+    std::atomic<size_t> site_count_;
+};
+
+// Profiles are never freed, so that mutexes can come and go. Profiles
+// beyond g_max_profiles share the last one.
+static const size_t g_max_profiles = 32;
+static std::atomic<size_t> g_profile_count(0);
+
+// Mutexes with static storage duration are constructed during static
+// initialization, possibly before anything in this file, so the profiles are
+// created on first use
+static MblMutexProfile* get_profiles()
+{
+    static MblMutexProfile profiles[g_max_profiles + 1];
+    return profiles;
+}
+
+// Protects adding profiles and call sites. A plain pthread mutex, so that it
+// isn't profiled itself and can be used during static initialization.
+static pthread_mutex_t g_profiles_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+static uint64_t get_monotonic_time_ns()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return static_cast<uint64_t>(ts.tv_sec) * 1000000000 + static_cast<uint64_t>(ts.tv_nsec);
+}
+
+static MblMutexProfile* find_profile(const char* const name)
+{
+    MblMutexProfile* const profiles = get_profiles();
+    pthread_mutex_lock(&g_profiles_mutex);
+    const size_t count = g_profile_count.load(std::memory_order_relaxed);
+    MblMutexProfile* profile = 0;
+    for (size_t i = 0; i < count && !profile; ++i) {
+        if (std::strcmp(profiles[i].name, name) == 0) {
+            profile = &profiles[i];
+        }
+    }
+    if (!profile) {
+        profile = &profiles[count < g_max_profiles ? count : g_max_profiles];
+        if (count < g_max_profiles) {
+            profile->name = name;
+            g_profile_count.store(count + 1, std::memory_order_release);
+        }
+        else {
+            profile->name = "other";
+        }
+    }
+    pthread_mutex_unlock(&g_profiles_mutex);
+    return profile;
+}
+
+static bool same_site(const MblMutexCallSite& site, const char* const file, const int line)
+{
+    // __builtin_FILE() strings are usually merged, but needn't be
+    return site.line == line && (site.file == file || std::strcmp(site.file, file) == 0);
+}
+
+MblMutexCallSite* MblMutexProfile::find_site(const char* const file, const int line)
+{
+    const size_t count = site_count_.load(std::memory_order_acquire);
+    for (size_t i = 0; i < count; ++i) {
+        if (same_site(sites_[i], file, line)) {
+            return &sites_[i];
+        }
+    }
+
+    pthread_mutex_lock(&g_profiles_mutex);
+    MblMutexCallSite* site = 0;
+    const size_t locked_count = site_count_.load(std::memory_order_relaxed);
+    for (size_t i = count; i < locked_count && !site; ++i) {
+        if (same_site(sites_[i], file, line)) {
+            site = &sites_[i];
+        }
+    }
+    if (!site) {
+        site = &sites_[locked_count < max_sites ? locked_count : max_sites];
+        if (locked_count < max_sites) {
+            site->file = file;
+            site->line = line;
+            site_count_.store(locked_count + 1, std::memory_order_release);
+        }
+        else {
+            site->file = "other";
+            site->line = 0;
+        }
+    }
+    pthread_mutex_unlock(&g_profiles_mutex);
+    return site;
+}
+
+void MblMutexProfile::log() const
 {
+    tr_info(
+        "Mutex %s: %" PRIu64 " acquisitions, %" PRIu64 " contended",
+        name,
+        acquisitions.load(std::memory_order_relaxed),
+        contended.load(std::memory_order_relaxed));
+
+    char histogram_name[96];
+    std::snprintf(histogram_name, sizeof(histogram_name), "mutex_%s_wait_ns", name);
+    wait_ns.log_as(histogram_name);
+    std::snprintf(histogram_name, sizeof(histogram_name), "mutex_%s_hold_ns", name);
+    hold_ns.log_as(histogram_name);
+
+    const size_t count = site_count_.load(std::memory_order_acquire);
+    for (size_t i = 0; i <= max_sites; ++i) {
+        const MblMutexCallSite& site = sites_[i];
+        if (i >= count && (i < max_sites || site.acquisitions == 0)) {
+            continue;
+        }
+        tr_info(
+            "Mutex %s locked at %s:%d: %" PRIu64 " acquisitions, waited %" PRIu64 " times, "
+            "kept others waiting %" PRIu64 " times, longest hold %" PRIu64 " ns",
+            name,
+            site.file,
+            site.line,
+            site.acquisitions.load(std::memory_order_relaxed),
+            site.waits.load(std::memory_order_relaxed),
+            site.waits_caused.load(std::memory_order_relaxed),
+            site.max_hold_ns.load(std::memory_order_relaxed));
+    }
+}
+
+// Logs all mutex profiles with the other metrics
+class MblMutexProfiles : public metrics::Metric
+{
+public:
+    MblMutexProfiles() : Metric("mutex_profiles") {}
+
+    void log() const override
+    {
+        const MblMutexProfile* const profiles = get_profiles();
+        const size_t count = g_profile_count.load(std::memory_order_acquire);
+        for (size_t i = 0; i < count; ++i) {
+            profiles[i].log();
+        }
+        if (profiles[g_max_profiles].acquisitions != 0) {
+            profiles[g_max_profiles].log();
+        }
+    }
+};
+
+static MblMutexProfiles g_mutex_profiles;
+
+#endif // MBL_MUTEX_PROFILING
+
+#ifdef MBL_MUTEX_FUTEX
+
+MblMutex::MblMutex(const char* const name, const Type type)
+    : mutex_(type == Type_Recursive)
+#ifdef MBL_MUTEX_PROFILING
+    , profile_(find_profile(name))
+    , depth_(0)
+    , locked_ns_(0)
+    , owner_site_(0)
+#endif
+{
+#ifndef MBL_MUTEX_PROFILING
+    (void)name;
+#endif
+}
+
+MblMutex::~MblMutex()
+{
+}
+
+#else // MBL_MUTEX_FUTEX
+
+MblMutex::MblMutex(const char* const name, const Type type)
+#ifdef MBL_MUTEX_PROFILING
+    : profile_(find_profile(name))
+    , depth_(0)
+    , locked_ns_(0)
+    , owner_site_(0)
+#endif
+{
+#ifndef MBL_MUTEX_PROFILING
+    (void)name;
+#endif
     pthread_mutexattr_t attr;
     pthread_mutexattr_init(&attr);
-    pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_NORMAL);
+    pthread_mutexattr_settype(&attr, (type == Type_Recursive) ? PTHREAD_MUTEX_RECURSIVE : PTHREAD_MUTEX_NORMAL);
     const int ret = pthread_mutex_init(&mutex_, &attr);
     assert(ret == 0);
+    pthread_mutexattr_destroy(&attr);
 }
 
 MblMutex::~MblMutex()
@@ -36,22 +304,79 @@ MblMutex::~MblMutex()
     assert(ret == 0);
 }
 
+#endif // MBL_MUTEX_FUTEX
+
+#ifdef MBL_MUTEX_PROFILING
+
+void MblMutex::lock(const char* const file, const int line)
+{
+    MblMutexCallSite* const site = profile_->find_site(file, line);
+    if (!raw_try_lock(mutex_)) {
+        const uint64_t wait_start_ns = get_monotonic_time_ns();
+        MblMutexCallSite* const owner = owner_site_.load(std::memory_order_relaxed);
+        if (owner) {
+            owner->waits_caused.fetch_add(1, std::memory_order_relaxed);
+        }
+        raw_lock(mutex_);
+        profile_->contended.fetch_add(1, std::memory_order_relaxed);
+        profile_->wait_ns.record(get_monotonic_time_ns() - wait_start_ns);
+        site->waits.fetch_add(1, std::memory_order_relaxed);
+    }
+    locked(site);
+}
+
+bool MblMutex::try_lock(const char* const file, const int line)
+{
+    if (!raw_try_lock(mutex_)) {
+        return false;
+    }
+    locked(profile_->find_site(file, line));
+    return true;
+}
+
+void MblMutex::locked(MblMutexCallSite* const site)
+{
+    profile_->acquisitions.fetch_add(1, std::memory_order_relaxed);
+    site->acquisitions.fetch_add(1, std::memory_order_relaxed);
+    if (depth_++ == 0) {
+        locked_ns_ = get_monotonic_time_ns();
+        owner_site_.store(site, std::memory_order_relaxed);
+    }
+}
+
+void MblMutex::unlock()
+{
+    assert(depth_ > 0);
+    if (--depth_ == 0) {
+        const uint64_t hold_ns = get_monotonic_time_ns() - locked_ns_;
+        profile_->hold_ns.record(hold_ns);
+        MblMutexCallSite* const site = owner_site_.load(std::memory_order_relaxed);
+        uint64_t max = site->max_hold_ns.load(std::memory_order_relaxed);
+        while (hold_ns > max && !site->max_hold_ns.compare_exchange_weak(max, hold_ns, std::memory_order_relaxed)) {
+        }
+        owner_site_.store(0, std::memory_order_relaxed);
+    }
+
+    raw_unlock(mutex_);
+}
+
+#else // MBL_MUTEX_PROFILING
+
 void MblMutex::lock()
 {
-    const int ret = pthread_mutex_lock(&mutex_);
-    assert(ret == 0);
+    raw_lock(mutex_);
 }
 
 void MblMutex::unlock()
 {
-    const int ret = pthread_mutex_unlock(&mutex_);
-    assert(ret == 0);
+    raw_unlock(mutex_);
 }
 
 bool MblMutex::try_lock()
 {
-    const int ret = pthread_mutex_trylock(&mutex_);
-    return ret == 0;
+    return raw_try_lock(mutex_);
 }
 
+#endif // MBL_MUTEX_PROFILING
+
 } // namespace mbl
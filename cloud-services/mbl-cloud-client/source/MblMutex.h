@@ -18,29 +18,87 @@
 #ifndef MblMutex_h_
 #define MblMutex_h_
 
+#ifdef MBL_MUTEX_FUTEX
+#include "MblFutexMutex.h"
+#else
 #include <pthread.h>
+#endif
+
+#ifdef MBL_MUTEX_PROFILING
+#include <atomic>
+#include <stdint.h>
+#endif
 
 namespace mbl {
 
+#ifdef MBL_MUTEX_PROFILING
+class MblMutexProfile;
+struct MblMutexCallSite;
+#endif
+
 /**
- * A non-recursive mutex based on pthread_mutex_t
+ * A named mutex.
+ *
+ * When built with MBL_MUTEX_PROFILING, each lock() records the call site
+ * that took the mutex, whether it had to wait, how long it waited and how
+ * long the mutex was then held. Mutexes with the same name share one set of
+ * statistics, which is written to the log with the other metrics on SIGUSR1.
+ * Without MBL_MUTEX_PROFILING the name is ignored.
+ *
+ * MblMutex is a pthread mutex, or an MblFutexMutex when built with
+ * MBL_MUTEX_IMPL=futex.
  */
 class MblMutex
 {
 public:
-    MblMutex();
+    enum Type
+    {
+        Type_Normal,
+        // May be locked again by the thread that holds it
+        Type_Recursive
+    };
+
+    /**
+     * @param name identifies the mutex in contention profiles. Must have
+     *        static storage duration, e.g. a string literal.
+     */
+    explicit MblMutex(const char* name, Type type = Type_Normal);
     ~MblMutex();
 
+#ifdef MBL_MUTEX_PROFILING
+    // The call site defaults to the caller's
+    void lock(const char* file = __builtin_FILE(), int line = __builtin_LINE());
+    void unlock();
+    bool try_lock(const char* file = __builtin_FILE(), int line = __builtin_LINE());
+#else
     void lock();
     void unlock();
     bool try_lock();
+#endif
 
 private:
     // No copying
     MblMutex(const MblMutex&);
     MblMutex& operator=(const MblMutex&);
 
+#ifdef MBL_MUTEX_FUTEX
+    MblFutexMutex mutex_;
+#else
     pthread_mutex_t mutex_;
+#endif
+
+#ifdef MBL_MUTEX_PROFILING
+    void locked(MblMutexCallSite* site);
+
+    MblMutexProfile* const profile_;
+
+    // Only accessed by the thread holding the mutex
+    unsigned depth_;
+    uint64_t locked_ns_;
+
+    // Read by threads waiting for the mutex, to see who they are waiting for
+    std::atomic<MblMutexCallSite*> owner_site_;
+#endif
 };
 
 } // namespace mbl
@@ -0,0 +1,111 @@
+/*
+ * Copyright (c) 2020 Arm Limited and Contributors. All rights reserved.
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ * Licensed under the Apache License, Version 2.0 (the License); you may
+ * not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an AS IS BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "MblReregistrationScheduler.h"
+
+#include <algorithm>
+#include <limits>
+
+namespace mbl {
+
+// More jitter than this could let a lengthened period outlast the
+// registration lifetime
+static const uint32_t g_max_jitter_percent = 50;
+
+MblReregistrationScheduler::MblReregistrationScheduler(const Config& config, const uint32_t seed)
+    : config_(config)
+    , random_(seed)
+    , registered_(false)
+    , update_in_flight_(false)
+    , update_sent_ms_(0)
+    , next_ms_(0)
+    , consecutive_failures_(0)
+{
+}
+
+void MblReregistrationScheduler::start(const int64_t now_ms)
+{
+    next_ms_ = now_ms + jitter(config_.period_ms);
+}
+
+bool MblReregistrationScheduler::send_update(const int64_t now_ms)
+{
+    // The registration may have been refreshed since the caller's timer was
+    // set, in which case the update is no longer due
+    if (now_ms < next_ms_) {
+        return false;
+    }
+
+    // Nothing to update until the client has registered
+    if (!registered_) {
+        next_ms_ = now_ms + jitter(config_.period_ms);
+        return false;
+    }
+
+    // If an earlier update got neither a response nor an error, this one
+    // replaces it. Try again after another period if this one is lost too.
+    update_in_flight_ = true;
+    update_sent_ms_ = now_ms;
+    next_ms_ = now_ms + jitter(config_.period_ms);
+    return true;
+}
+
+MblReregistrationScheduler::Refresh MblReregistrationScheduler::refreshed(const int64_t now_ms)
+{
+    Refresh refresh = Refresh();
+    refresh.round_trip_ms = update_in_flight_ ? now_ms - update_sent_ms_ : -1;
+    refresh.postponed_update = registered_ && !update_in_flight_;
+
+    registered_ = true;
+    update_in_flight_ = false;
+    consecutive_failures_ = 0;
+    next_ms_ = now_ms + jitter(config_.period_ms);
+    return refresh;
+}
+
+void MblReregistrationScheduler::failed(const int64_t now_ms)
+{
+    update_in_flight_ = false;
+    if (consecutive_failures_ < std::numeric_limits<unsigned>::max()) {
+        ++consecutive_failures_;
+    }
+
+    // Updates can only retry an existing registration. Until the client has
+    // registered, send_update() keeps postponing them.
+    if (registered_) {
+        next_ms_ = now_ms + jitter(backoff_ms());
+    }
+}
+
+int64_t MblReregistrationScheduler::jitter(const int64_t delay_ms)
+{
+    const uint32_t percent = std::min(config_.jitter_percent, g_max_jitter_percent);
+    const int64_t span_ms = delay_ms * percent / 100;
+    std::uniform_int_distribution<int64_t> offset_ms(-span_ms, span_ms);
+    return std::max<int64_t>(delay_ms + offset_ms(random_), 1);
+}
+
+int64_t MblReregistrationScheduler::backoff_ms() const
+{
+    // Double the delay with each failure after the first, without letting
+    // the shift overflow
+    const unsigned doublings = std::min(consecutive_failures_ - 1, 31u);
+    const uint64_t delay_ms = static_cast<uint64_t>(config_.min_backoff_ms) << doublings;
+    return static_cast<int64_t>(std::min<uint64_t>(delay_ms, config_.period_ms));
+}
+
+} // namespace mbl
@@ -0,0 +1,133 @@
+/*
+ * Copyright (c) 2020 Arm Limited and Contributors. All rights reserved.
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ * Licensed under the Apache License, Version 2.0 (the License); you may
+ * not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an AS IS BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef MblReregistrationScheduler_h_
+#define MblReregistrationScheduler_h_
+
+#include <random>
+#include <stdint.h>
+
+namespace mbl {
+
+/**
+ * Decides when to update our registration with the LWM2M server.
+ *
+ * Updates are due a period after the registration was last refreshed, where
+ * each period is lengthened or shortened at random by up to jitter_percent
+ * percent so that devices which registered together (e.g. after a power cut)
+ * don't keep updating in lockstep. Any refresh counts, including a full
+ * registration or an update sent by MbedCloudClient itself, so an update is
+ * only sent when nothing else has refreshed the registration for a period.
+ * After a failure, the next attempt waits min_backoff_ms, doubling with each
+ * further failure up to the period.
+ *
+ * Not thread safe.
+ */
+class MblReregistrationScheduler
+{
+public:
+    struct Config
+    {
+        // Time between refreshes of the registration in milliseconds, before
+        // jitter
+        uint32_t period_ms;
+        // Randomly lengthen or shorten each delay by up to this many percent
+        // (at most 50)
+        uint32_t jitter_percent;
+        // Delay before the first retry after a failure in milliseconds
+        uint32_t min_backoff_ms;
+    };
+
+    struct Refresh
+    {
+        // Time between sending the update and this refresh, or -1 if the
+        // refresh wasn't a response to an update from send_update()
+        int64_t round_trip_ms;
+        // Whether the refresh postponed a scheduled update
+        bool postponed_update;
+    };
+
+    /**
+     * @param config timing of updates.
+     * @param seed seed for the jitter. Should differ between devices.
+     */
+    MblReregistrationScheduler(const Config& config, uint32_t seed);
+
+    /**
+     * Start scheduling. The first update is due a period from now, but is
+     * postponed until the client has registered.
+     *
+     * @param now_ms current CLOCK_MONOTONIC time in milliseconds.
+     */
+    void start(int64_t now_ms);
+
+    /**
+     * Check whether an update should be sent now, and if so record that it
+     * is being sent. If not, next_ms() has moved on.
+     *
+     * @param now_ms current CLOCK_MONOTONIC time in milliseconds.
+     * @return true if the caller should send a registration update.
+     */
+    bool send_update(int64_t now_ms);
+
+    /**
+     * Record that the client registered or that a registration update
+     * succeeded.
+     *
+     * @param now_ms current CLOCK_MONOTONIC time in milliseconds.
+     */
+    Refresh refreshed(int64_t now_ms);
+
+    /**
+     * Record that registering or updating the registration failed. Once the
+     * client has registered, the next update is brought forward to a backoff
+     * delay; before that, failures are only counted.
+     *
+     * @param now_ms current CLOCK_MONOTONIC time in milliseconds.
+     */
+    void failed(int64_t now_ms);
+
+    // CLOCK_MONOTONIC time in milliseconds at which to call send_update()
+    int64_t next_ms() const { return next_ms_; }
+
+    // Failures since the registration was last refreshed
+    unsigned consecutive_failures() const { return consecutive_failures_; }
+
+    // Whether the client has registered since start()
+    bool registered() const { return registered_; }
+
+private:
+    // No copying
+    MblReregistrationScheduler(const MblReregistrationScheduler&);
+    MblReregistrationScheduler& operator=(const MblReregistrationScheduler&);
+
+    int64_t jitter(int64_t delay_ms);
+    int64_t backoff_ms() const;
+
+    const Config config_;
+    std::minstd_rand random_;
+
+    bool registered_;
+    bool update_in_flight_;
+    int64_t update_sent_ms_;
+    int64_t next_ms_;
+    unsigned consecutive_failures_;
+};
+
+} // namespace mbl
+
+#endif // MblReregistrationScheduler_h_
@@ -21,11 +21,19 @@
 
 namespace mbl {
 
+#ifdef MBL_MUTEX_PROFILING
+MblScopedLock::MblScopedLock(MblMutex& mutex, const char* const file, const int line)
+    : mutex_(mutex)
+{
+    mutex_.lock(file, line);
+}
+#else
 MblScopedLock::MblScopedLock(MblMutex& mutex)
     : mutex_(mutex)
 {
     mutex_.lock();
 }
+#endif
 
 MblScopedLock::~MblScopedLock()
 {
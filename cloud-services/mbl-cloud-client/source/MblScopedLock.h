@@ -32,7 +32,15 @@ public:
      * Create a scoped lock for the given mutex. The mutex will be locked until
      * this object's destructor has run.
      */
+#ifdef MBL_MUTEX_PROFILING
+    // The call site recorded by the mutex's profile defaults to the caller's
+    explicit MblScopedLock(
+        MblMutex& mutex,
+        const char* file = __builtin_FILE(),
+        int line = __builtin_LINE());
+#else
     explicit MblScopedLock(MblMutex& mutex);
+#endif
 
     /**
      * Destructor - unlocks the mutex.
@@ -17,9 +17,9 @@
 // ----------------------------------------------------------------------------
 
 #include "application_init.h"
+#include "log_trace.h"
 
 #include "factory-configurator-client/factory_configurator_client.h"
-#include "mbed-trace/mbed_trace.h"
 
 #define TRACE_GROUP "mbl"
 
@@ -0,0 +1,147 @@
+/*
+ * Copyright (c) 2020 Arm Limited and Contributors. All rights reserved.
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ * Licensed under the Apache License, Version 2.0 (the License); you may
+ * not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an AS IS BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include "MblArena.h"
+
+#include <algorithm>
+#include <cstdlib>
+
+namespace mbl {
+
+const size_t MblArena::no_quota;
+
+// Sizes of the blocks taken from the heap, including their header. Each
+// block is twice the size of the one before, up to the maximum, so that an
+// arena has few blocks to free. A bigger allocation gets a block of its own.
+static const size_t g_min_block_size = 4096;
+static const size_t g_max_block_size = 16 * 1024;
+
+static const size_t g_max_align = alignof(std::max_align_t);
+
+// Padded so that a block's data is aligned like malloc()'s
+const size_t MblArena::header_size = (sizeof(Block) + g_max_align - 1) & ~(g_max_align - 1);
+
+MblArena::MblArena(const size_t quota)
+    : quota_(quota)
+    , footprint_(0)
+    , blocks_(nullptr)
+    , next_(0)
+    , end_(0)
+{
+}
+
+MblArena::~MblArena()
+{
+    Release();
+}
+
+uintptr_t MblArena::FitInCurrentBlock(const size_t size, const size_t align) const
+{
+    if (!blocks_) {
+        return 0;
+    }
+    const uintptr_t start = (next_ + align - 1) & ~static_cast<uintptr_t>(align - 1);
+    if (start > end_ || end_ - start < size) {
+        return 0;
+    }
+    return start;
+}
+
+size_t MblArena::NewBlockSize(const size_t size) const
+{
+    // Block data is aligned to g_max_align, so the allocation needs no
+    // padding at the start of a new block
+    const size_t needed = header_size + size;
+    if (needed > g_max_block_size) {
+        return needed;
+    }
+
+    size_t block_size = blocks_ ? std::min(blocks_->size * 2, g_max_block_size) : g_min_block_size;
+    // Don't let the block size use up the quota before the allocations do
+    if (quota_ != no_quota && block_size > quota_ - footprint_) {
+        block_size = quota_ - footprint_;
+    }
+    return std::max(block_size, needed);
+}
+
+bool MblArena::CanAllocate(const size_t size, const size_t align) const
+{
+    assert(align != 0 && (align & (align - 1)) == 0 && align <= g_max_align);
+
+    if (FitInCurrentBlock(size, align)) {
+        return true;
+    }
+    return quota_ == no_quota || NewBlockSize(size) <= quota_ - footprint_;
+}
+
+void* MblArena::Allocate(const size_t size, const size_t align)
+{
+    if (!CanAllocate(size, align)) {
+        return nullptr;
+    }
+
+    uintptr_t start = FitInCurrentBlock(size, align);
+    if (!start) {
+        const size_t block_size = NewBlockSize(size);
+        Block* const block = static_cast<Block*>(std::malloc(block_size));
+        if (!block) {
+            return nullptr;
+        }
+        block->size = block_size;
+        footprint_ += block_size;
+
+        start = reinterpret_cast<uintptr_t>(block) + header_size;
+        const uintptr_t block_end = reinterpret_cast<uintptr_t>(block) + block_size;
+        if (block_size > g_max_block_size && blocks_) {
+            // A block of its own: keep allocating from the current block,
+            // which probably has more room left
+            block->next = blocks_->next;
+            blocks_->next = block;
+            return reinterpret_cast<void*>(start);
+        }
+        block->next = blocks_;
+        blocks_ = block;
+        end_ = block_end;
+    }
+
+    next_ = start + size;
+    return reinterpret_cast<void*>(start);
+}
+
+bool MblArena::Charge(const size_t size)
+{
+    if (quota_ != no_quota && size > quota_ - footprint_) {
+        return false;
+    }
+    footprint_ += size;
+    return true;
+}
+
+void MblArena::Release()
+{
+    while (blocks_) {
+        Block* const next = blocks_->next;
+        std::free(blocks_);
+        blocks_ = next;
+    }
+    footprint_ = 0;
+    next_ = 0;
+    end_ = 0;
+}
+
+} // namespace mbl
@@ -0,0 +1,178 @@
+/*
+ * Copyright (c) 2020 Arm Limited and Contributors. All rights reserved.
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ * Licensed under the Apache License, Version 2.0 (the License); you may
+ * not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an AS IS BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#ifndef MblArena_h_
+#define MblArena_h_
+
+#include <cassert>
+#include <cstddef>
+#include <new>
+#include <stdint.h>
+#include <type_traits>
+
+namespace mbl {
+
+/*! \file MblArena.h
+ *  \brief MblArena.
+ *  Bump allocator with a memory quota, for state that is all freed at once.
+ *
+ *  Memory is taken from the heap in blocks and handed out in order. Nothing
+ *  is freed until the arena is destroyed or Release() is called, which frees
+ *  whole blocks without visiting the objects in them. The quota bounds the
+ *  total size of the blocks, so it includes any memory that containers
+ *  abandon in the arena when they grow.
+ *
+ *  Not thread safe.
+ */
+class MblArena {
+
+public:
+
+    static const size_t no_quota = SIZE_MAX;
+
+    explicit MblArena(size_t quota = no_quota);
+    ~MblArena();
+
+    /**
+     * @return memory for size bytes aligned to align (a power of two no
+     *         bigger than alignof(std::max_align_t)), or nullptr if that would
+     *         take the arena over its quota.
+     */
+    void* Allocate(size_t size, size_t align);
+
+    /**
+     * @return whether Allocate() with the same arguments would succeed.
+     */
+    bool CanAllocate(size_t size, size_t align) const;
+
+    /**
+     * Count memory kept elsewhere on the heap for the arena's owner against
+     * the quota, until Release().
+     *
+     * @return false, counting nothing, if that would take the arena over its
+     *         quota.
+     */
+    bool Charge(size_t size);
+
+    /**
+     * Free everything allocated from the arena.
+     */
+    void Release();
+
+    /**
+     * @return the memory taken from the heap and charged with Charge(),
+     *         which counts against the quota.
+     */
+    size_t GetFootprint() const { return footprint_; }
+
+    size_t GetQuota() const { return quota_; }
+
+private:
+
+    struct Block
+    {
+        Block* next;
+        size_t size;
+    };
+
+    // Where an allocation would go in the current block, or 0 if it doesn't
+    // fit there
+    uintptr_t FitInCurrentBlock(size_t size, size_t align) const;
+
+    // Size of the block needed for an allocation that doesn't fit in the
+    // current one
+    size_t NewBlockSize(size_t size) const;
+
+    static const size_t header_size;
+
+    const size_t quota_;
+    size_t footprint_;
+    // Most recently allocated block first
+    Block* blocks_;
+    uintptr_t next_;
+    uintptr_t end_;
+
+    // No copying or moving (see https://github.com/isocpp/CppCoreGuidelines/blob/master/CppCoreGuidelines.md#cdefop-default-operations)
+    MblArena(const MblArena&) = delete;
+    MblArena & operator = (const MblArena&) = delete;
+    MblArena(MblArena&&) = delete;
+    MblArena& operator = (MblArena&&) = delete;
+};
+
+/**
+ * Standard allocator that allocates from an MblArena, so that standard
+ * containers can keep their contents in one. Deallocation does nothing.
+ *
+ * The arena's quota isn't checked here: a container using this allocator
+ * must check MblArena::CanAllocate() before anything that allocates, for
+ * example by calling reserve() itself. An allocation that fails anyway
+ * throws std::bad_alloc, like any other standard allocator, rather than
+ * handing the container a null pointer.
+ */
+template <typename T>
+class MblArenaAllocator {
+
+public:
+
+    typedef T value_type;
+    // Moving or swapping containers moves their storage, which stays in its
+    // arena
+    typedef std::true_type propagate_on_container_move_assignment;
+    typedef std::true_type propagate_on_container_swap;
+
+    // An allocator that can't allocate, for containers that stay empty
+    MblArenaAllocator() : arena_(nullptr) {}
+    explicit MblArenaAllocator(MblArena* const arena) : arena_(arena) {}
+
+    template <typename U>
+    MblArenaAllocator(const MblArenaAllocator<U>& other) : arena_(other.GetArena()) {}
+
+    T* allocate(const size_t n)
+    {
+        assert(arena_);
+        void* const p = arena_ ? arena_->Allocate(n * sizeof(T), alignof(T)) : nullptr;
+        if (!p) {
+            throw std::bad_alloc();
+        }
+        return static_cast<T*>(p);
+    }
+
+    void deallocate(T* /*p*/, size_t /*n*/) {}
+
+    MblArena* GetArena() const { return arena_; }
+
+private:
+
+    MblArena* arena_;
+};
+
+template <typename T, typename U>
+bool operator == (const MblArenaAllocator<T>& a, const MblArenaAllocator<U>& b)
+{
+    return a.GetArena() == b.GetArena();
+}
+
+template <typename T, typename U>
+bool operator != (const MblArenaAllocator<T>& a, const MblArenaAllocator<U>& b)
+{
+    return a.GetArena() != b.GetArena();
+}
+
+} // namespace mbl
+
+#endif // MblArena_h_
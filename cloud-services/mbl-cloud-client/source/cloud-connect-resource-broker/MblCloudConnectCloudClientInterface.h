@@ -0,0 +1,64 @@
+/*
+ * Copyright (c) 2020 Arm Limited and Contributors. All rights reserved.
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ * Licensed under the Apache License, Version 2.0 (the License); you may
+ * not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an AS IS BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#ifndef MblCloudConnectCloudClientInterface_h_
+#define MblCloudConnectCloudClientInterface_h_
+
+#include "MblCloudConnectResourceDatabase.h"
+
+#include <string>
+#include <vector>
+
+namespace mbl {
+
+struct ResourceValue
+{
+    ResourcePath path;
+    std::string value;
+};
+
+/*! \file MblCloudConnectCloudClientInterface.h
+ *  \brief MblCloudConnectCloudClientInterface.
+ *  The resource broker's view of the cloud client: where resource value
+ *  changes made by applications are sent. Implemented on top of
+ *  MbedCloudClient by MblCloudClient, and by stand-ins for benchmarks.
+*/
+class MblCloudConnectCloudClientInterface {
+
+public:
+
+    MblCloudConnectCloudClientInterface() = default;
+    virtual ~MblCloudConnectCloudClientInterface() = default;
+
+    // Send changed resource values to the cloud. Called on the mbl-cloud-client
+    // event loop thread when the notification timer fires, with every value
+    // that became due by then (at most one per resource).
+    virtual void SendResourceValues(const std::vector<ResourceValue>& values) = 0;
+
+private:
+
+    // No copying or moving (see https://github.com/isocpp/CppCoreGuidelines/blob/master/CppCoreGuidelines.md#cdefop-default-operations)
+    MblCloudConnectCloudClientInterface(const MblCloudConnectCloudClientInterface&) = delete;
+    MblCloudConnectCloudClientInterface & operator = (const MblCloudConnectCloudClientInterface&) = delete;
+    MblCloudConnectCloudClientInterface(MblCloudConnectCloudClientInterface&&) = delete;
+    MblCloudConnectCloudClientInterface& operator = (MblCloudConnectCloudClientInterface&&) = delete;
+};
+
+} // namespace mbl
+
+#endif // MblCloudConnectCloudClientInterface_h_
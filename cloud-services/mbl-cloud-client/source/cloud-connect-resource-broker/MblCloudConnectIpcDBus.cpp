@@ -16,14 +16,43 @@
  */
 
 #include "MblCloudConnectIpcDBus.h"
+#include "MblCloudConnectLanes.h"
+#include "MblCloudConnectResourceBroker.h"
+#include "MblScopedLock.h"
 
-#include "mbed-trace/mbed_trace.h"
+#include "log_trace.h"
+#include "monotonic_time.h"
+#include "signals.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
 
 #define TRACE_GROUP "CCRB-IPCDBUS"
 
 namespace mbl {
 
-MblCloudConnectIpcDBus::MblCloudConnectIpcDBus()
+static const char* const g_service_name = "com.mbed.Cloud";
+static const char* const g_object_path = "/com/mbed/Cloud/Connect1";
+static const char* const g_interface_name = "com.mbed.Cloud.Connect1";
+
+MblCloudConnectIpcDBus::MblCloudConnectIpcDBus(MblCloudConnectResourceBroker& broker)
+    : broker_(broker)
+    , event_(nullptr)
+    , bus_(nullptr)
+    , vtable_slot_(nullptr)
+    , name_owner_changed_slot_(nullptr)
+    , wakeup_source_(nullptr)
+    , wakeup_fd_(-1)
+    , thread_()
+    , thread_running_(false)
+    , running_(false)
+    , notifications_mutex_("ccrb_dbus_notifications")
 {
     tr_info("MblCloudConnectIpcDBus::MblCloudConnectIpcDBus");
 }
@@ -31,12 +60,645 @@ MblCloudConnectIpcDBus::MblCloudConnectIpcDBus()
 MblCloudConnectIpcDBus::~MblCloudConnectIpcDBus()
 {
     tr_debug("MblCloudConnectIpcDBus::~MblCloudConnectIpcDBus");
+    Terminate();
 }
 
 MblError MblCloudConnectIpcDBus::Init()
 {
     tr_debug("MblCloudConnectIpcDBus::Init");
+    assert(!thread_running_);
+
+    // The method table must outlive the bus object registration
+    static const sd_bus_vtable vtable[] = {
+        SD_BUS_VTABLE_START(0),
+        SD_BUS_METHOD("RegisterResources", "s", "u", &HandleRegisterResources, SD_BUS_VTABLE_UNPRIVILEGED),
+        SD_BUS_METHOD("DeregisterResources", "", "u", &HandleDeregisterResources, SD_BUS_VTABLE_UNPRIVILEGED),
+        SD_BUS_METHOD("SetResourceValue", "ss", "u", &HandleSetResourceValue, SD_BUS_VTABLE_UNPRIVILEGED),
+        SD_BUS_METHOD("OpenValueStore", "", "uah", &HandleOpenValueStore, SD_BUS_VTABLE_UNPRIVILEGED),
+        SD_BUS_METHOD(
+            "RegisterResourceDefinitions",
+            "as",
+            "uau",
+            &HandleRegisterResourceDefinitions,
+            SD_BUS_VTABLE_UNPRIVILEGED),
+        SD_BUS_METHOD("SetResourceValues", "a(ss)", "uau", &HandleSetResourceValues, SD_BUS_VTABLE_UNPRIVILEGED),
+        SD_BUS_SIGNAL("ResourcesUpdated", "a(ss)", 0),
+        SD_BUS_VTABLE_END
+    };
+
+    wakeup_fd_ = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (wakeup_fd_ == -1) {
+        tr_error("Failed to create eventfd: %s", std::strerror(errno));
+        Cleanup();
+        return Error::CCRBIpcInitFailed;
+    }
+
+    int r = sd_event_new(&event_);
+    if (r < 0) {
+        tr_error("sd_event_new failed: %s", std::strerror(-r));
+        Cleanup();
+        return Error::CCRBIpcInitFailed;
+    }
+
+    r = sd_bus_open_system(&bus_);
+    if (r < 0) {
+        tr_error("Failed to connect to the system bus: %s", std::strerror(-r));
+        Cleanup();
+        return Error::CCRBIpcInitFailed;
+    }
+
+    r = sd_bus_add_object_vtable(bus_, &vtable_slot_, g_object_path, g_interface_name, vtable, this);
+    if (r < 0) {
+        tr_error("Failed to add D-Bus object: %s", std::strerror(-r));
+        Cleanup();
+        return Error::CCRBIpcInitFailed;
+    }
+
+    // Applications that disconnect from the bus are deregistered
+    r = sd_bus_match_signal(
+        bus_,
+        &name_owner_changed_slot_,
+        "org.freedesktop.DBus",
+        "/org/freedesktop/DBus",
+        "org.freedesktop.DBus",
+        "NameOwnerChanged",
+        &HandleNameOwnerChanged,
+        this);
+    if (r < 0) {
+        tr_error("Failed to add D-Bus match: %s", std::strerror(-r));
+        Cleanup();
+        return Error::CCRBIpcInitFailed;
+    }
+
+    r = sd_bus_request_name(bus_, g_service_name, 0);
+    if (r < 0) {
+        tr_error("Failed to acquire D-Bus name \"%s\": %s", g_service_name, std::strerror(-r));
+        Cleanup();
+        return Error::CCRBIpcInitFailed;
+    }
+
+    r = sd_bus_attach_event(bus_, event_, 0);
+    if (r < 0) {
+        tr_error("Failed to attach the bus to the event loop: %s", std::strerror(-r));
+        Cleanup();
+        return Error::CCRBIpcInitFailed;
+    }
+
+    r = sd_event_add_io(event_, &wakeup_source_, wakeup_fd_, EPOLLIN, &HandleWakeup, this);
+    if (r < 0) {
+        tr_error("Failed to add eventfd to the event loop: %s", std::strerror(-r));
+        Cleanup();
+        return Error::CCRBIpcInitFailed;
+    }
+
+    // Send cloud requests before handling more queued method calls
+    r = sd_event_source_set_priority(wakeup_source_, SD_EVENT_PRIORITY_IMPORTANT);
+    if (r < 0) {
+        tr_error("Failed to set eventfd priority: %s", std::strerror(-r));
+        Cleanup();
+        return Error::CCRBIpcInitFailed;
+    }
+
+    const int create_err = create_thread_with_signals_blocked(&thread_, &MblCloudConnectIpcDBus::ThreadMain, this);
+
+    if (create_err != 0) {
+        tr_error("Failed to create D-Bus thread: %s", std::strerror(create_err));
+        Cleanup();
+        return Error::CCRBIpcInitFailed;
+    }
+
+    thread_running_ = true;
+    running_ = true;
     return Error::None;
 }
 
+MblError MblCloudConnectIpcDBus::Terminate()
+{
+    tr_debug("MblCloudConnectIpcDBus::Terminate");
+    if (!thread_running_) {
+        return Error::None;
+    }
+
+    running_ = false;
+    Wakeup();
+    pthread_join(thread_, 0);
+    thread_running_ = false;
+
+    Cleanup();
+    return Error::None;
+}
+
+MblError MblCloudConnectIpcDBus::NotifyResourceUpdated(
+    const StringHandle app_name,
+    const ResourcePath path,
+    const std::string& value)
+{
+    // Dropped if the event loop isn't running: nothing would send it
+    if (!running_.load(std::memory_order_relaxed)) {
+        return Error::None;
+    }
+
+    bool first = false;
+    {
+        MblScopedLock l(notifications_mutex_);
+        if (connected_app_names_.count(app_name) == 0) {
+            return Error::None;
+        }
+        first = pending_notifications_.empty();
+        pending_notifications_.push_back(Notification{app_name, path, value, get_monotonic_time_us()});
+    }
+
+    // The event loop sends everything that is pending when it wakes, so only
+    // the first of a burst of notifications has to wake it
+    if (first) {
+        Wakeup();
+    }
+    return Error::None;
+}
+
+MblError MblCloudConnectIpcDBus::NotifyResourcesUpdated(
+    const StringHandle app_name,
+    const std::vector<ResourceValue>& values)
+{
+    if (!running_.load(std::memory_order_relaxed) || values.empty()) {
+        return Error::None;
+    }
+
+    const int64_t created_us = get_monotonic_time_us();
+    bool first = false;
+    {
+        MblScopedLock l(notifications_mutex_);
+        if (connected_app_names_.count(app_name) == 0) {
+            return Error::None;
+        }
+        first = pending_notifications_.empty();
+        for (const ResourceValue& value : values) {
+            pending_notifications_.push_back(Notification{app_name, value.path, value.value, created_us});
+        }
+    }
+
+    if (first) {
+        Wakeup();
+    }
+    return Error::None;
+}
+
+void* MblCloudConnectIpcDBus::ThreadMain(void* const arg)
+{
+    MblCloudConnectIpcDBus* const self = static_cast<MblCloudConnectIpcDBus*>(arg);
+
+    const int r = sd_event_loop(self->event_);
+    if (r < 0) {
+        tr_error("D-Bus event loop failed: %s", std::strerror(-r));
+    }
+
+    // Send any replies and signals still queued in the bus
+    sd_bus_flush(self->bus_);
+    return 0;
+}
+
+int MblCloudConnectIpcDBus::GetSender(sd_bus_message* const m, StringHandle& sender)
+{
+    const char* const name = sd_bus_message_get_sender(m);
+    const size_t length = std::strlen(name);
+
+    // Only this thread adds and removes names, so a name found connected
+    // stays so until this returns
+    sender = MblStringPool::Find(name, length);
+    if (sender != MblStringPool::invalid_handle) {
+        MblScopedLock l(notifications_mutex_);
+        if (connected_app_names_.count(sender) != 0) {
+            return 0;
+        }
+    }
+
+    // A new application: check its user's connections
+    sd_bus_creds* creds = nullptr;
+    uid_t uid = 0;
+    int r = sd_bus_query_sender_creds(m, SD_BUS_CREDS_EUID, &creds);
+    if (r >= 0) {
+        r = sd_bus_creds_get_euid(creds, &uid);
+    }
+    sd_bus_creds_unref(creds);
+    if (r < 0) {
+        tr_error("Failed to get credentials of \"%s\": %s", name, std::strerror(-r));
+        return r;
+    }
+    unsigned& uid_connections = connections_by_uid_[uid];
+    if (uid_connections >= MBL_CLOUD_CONNECT_MAX_CONNECTIONS_PER_UID) {
+        tr_error(
+            "Refusing requests from \"%s\": uid %u already has %u connections",
+            name,
+            static_cast<unsigned>(uid),
+            uid_connections);
+        return -EUSERS;
+    }
+
+    // Released when the application disconnects from the bus
+    sender = MblStringPool::Acquire(name, length);
+    if (sender == MblStringPool::invalid_handle) {
+        if (uid_connections == 0) {
+            connections_by_uid_.erase(uid);
+        }
+        return -ENOMEM;
+    }
+    ++uid_connections;
+    MblScopedLock l(notifications_mutex_);
+    connected_app_names_.emplace(sender, uid);
+    return 0;
+}
+
+// Reply to a request with its status, recording the time since received_us
+// in the lane's latency histogram
+static int reply_with_status(
+    sd_bus_message* const m,
+    const Lane lane,
+    const int64_t received_us,
+    const MblError status)
+{
+    const int r = sd_bus_reply_method_return(m, "u", static_cast<uint32_t>(status));
+    if (r >= 0) {
+        RecordLaneLatency(lane, get_monotonic_time_us() - received_us);
+    }
+    return r;
+}
+
+int MblCloudConnectIpcDBus::HandleRegisterResources(
+    sd_bus_message* const m,
+    void* const userdata,
+    sd_bus_error* const /*ret_error*/)
+{
+    MblCloudConnectIpcDBus* const self = static_cast<MblCloudConnectIpcDBus*>(userdata);
+    const int64_t received_us = get_monotonic_time_us();
+
+    // Read in place: json points into the message
+    const char* json = nullptr;
+    const int r = sd_bus_message_read(m, "s", &json);
+    if (r < 0) {
+        tr_error("Failed to read RegisterResources request: %s", std::strerror(-r));
+        return r;
+    }
+
+    StringHandle sender = MblStringPool::invalid_handle;
+    const int sender_r = self->GetSender(m, sender);
+    if (sender_r < 0) {
+        return sender_r;
+    }
+
+    const MblError status = self->broker_.RegisterResources(*self, sender, json, std::strlen(json));
+    return reply_with_status(m, Lane_Registration, received_us, status);
+}
+
+int MblCloudConnectIpcDBus::HandleDeregisterResources(
+    sd_bus_message* const m,
+    void* const userdata,
+    sd_bus_error* const /*ret_error*/)
+{
+    MblCloudConnectIpcDBus* const self = static_cast<MblCloudConnectIpcDBus*>(userdata);
+    const int64_t received_us = get_monotonic_time_us();
+
+    StringHandle sender = MblStringPool::invalid_handle;
+    const int sender_r = self->GetSender(m, sender);
+    if (sender_r < 0) {
+        return sender_r;
+    }
+
+    const MblError status = self->broker_.DeregisterResources(sender);
+    return reply_with_status(m, Lane_Registration, received_us, status);
+}
+
+int MblCloudConnectIpcDBus::HandleSetResourceValue(
+    sd_bus_message* const m,
+    void* const userdata,
+    sd_bus_error* const /*ret_error*/)
+{
+    MblCloudConnectIpcDBus* const self = static_cast<MblCloudConnectIpcDBus*>(userdata);
+    const int64_t received_us = get_monotonic_time_us();
+
+    const char* path = nullptr;
+    const char* value = nullptr;
+    const int r = sd_bus_message_read(m, "ss", &path, &value);
+    if (r < 0) {
+        tr_error("Failed to read SetResourceValue request: %s", std::strerror(-r));
+        return r;
+    }
+
+    StringHandle sender = MblStringPool::invalid_handle;
+    const int sender_r = self->GetSender(m, sender);
+    if (sender_r < 0) {
+        return sender_r;
+    }
+
+    const MblError status = self->broker_.SetResourceValue(sender, path, value);
+    return reply_with_status(m, Lane_Telemetry, received_us, status);
+}
+
+int MblCloudConnectIpcDBus::HandleOpenValueStore(
+    sd_bus_message* const m,
+    void* const userdata,
+    sd_bus_error* const /*ret_error*/)
+{
+    MblCloudConnectIpcDBus* const self = static_cast<MblCloudConnectIpcDBus*>(userdata);
+    const int64_t received_us = get_monotonic_time_us();
+
+    StringHandle sender = MblStringPool::invalid_handle;
+    const int sender_r = self->GetSender(m, sender);
+    if (sender_r < 0) {
+        return sender_r;
+    }
+
+    int fd = -1;
+    const MblError status = self->broker_.OpenValueStore(sender, fd);
+
+    // D-Bus can't carry an invalid fd, so failure is an empty array. The
+    // reply gets its own copy of the fd.
+    const int r = sd_bus_reply_method_return(
+        m, "uah", static_cast<uint32_t>(status), (fd == -1) ? 0 : 1, fd);
+    if (fd != -1) {
+        close(fd);
+    }
+    if (r >= 0) {
+        RecordLaneLatency(Lane_Registration, get_monotonic_time_us() - received_us);
+    }
+    return r;
+}
+
+// Reply to a batch request with its status and one status per item, like
+// reply_with_status()
+static int reply_with_statuses(
+    sd_bus_message* const m,
+    const Lane lane,
+    const int64_t received_us,
+    const MblError status,
+    const std::vector<MblError>& statuses,
+    std::vector<uint32_t>& status_values)
+{
+    status_values.resize(statuses.size());
+    for (size_t i = 0; i < statuses.size(); ++i) {
+        status_values[i] = static_cast<uint32_t>(statuses[i]);
+    }
+
+    sd_bus_message* reply = nullptr;
+    int r = sd_bus_message_new_method_return(m, &reply);
+    if (r >= 0) {
+        r = sd_bus_message_append(reply, "u", static_cast<uint32_t>(status));
+    }
+    if (r >= 0) {
+        r = sd_bus_message_append_array(reply, 'u', status_values.data(), status_values.size() * sizeof(uint32_t));
+    }
+    if (r >= 0) {
+        r = sd_bus_send(nullptr, reply, nullptr);
+    }
+    sd_bus_message_unref(reply);
+    if (r >= 0) {
+        RecordLaneLatency(lane, get_monotonic_time_us() - received_us);
+    }
+    return r;
+}
+
+int MblCloudConnectIpcDBus::HandleRegisterResourceDefinitions(
+    sd_bus_message* const m,
+    void* const userdata,
+    sd_bus_error* const /*ret_error*/)
+{
+    MblCloudConnectIpcDBus* const self = static_cast<MblCloudConnectIpcDBus*>(userdata);
+    const int64_t received_us = get_monotonic_time_us();
+
+    // Read in place: the definitions point into the message
+    self->request_definitions_.clear();
+    int r = sd_bus_message_enter_container(m, 'a', "s");
+    while (r > 0) {
+        const char* json = nullptr;
+        r = sd_bus_message_read(m, "s", &json);
+        if (r > 0) {
+            self->request_definitions_.push_back(json);
+        }
+    }
+    if (r >= 0) {
+        r = sd_bus_message_exit_container(m);
+    }
+    if (r < 0) {
+        tr_error("Failed to read RegisterResourceDefinitions request: %s", std::strerror(-r));
+        return r;
+    }
+
+    StringHandle sender = MblStringPool::invalid_handle;
+    const int sender_r = self->GetSender(m, sender);
+    if (sender_r < 0) {
+        return sender_r;
+    }
+
+    const MblError status = self->broker_.RegisterResourceDefinitions(
+        *self, sender, self->request_definitions_, self->reply_statuses_);
+    return reply_with_statuses(m, Lane_Registration, received_us, status, self->reply_statuses_, self->reply_status_values_);
+}
+
+int MblCloudConnectIpcDBus::HandleSetResourceValues(
+    sd_bus_message* const m,
+    void* const userdata,
+    sd_bus_error* const /*ret_error*/)
+{
+    MblCloudConnectIpcDBus* const self = static_cast<MblCloudConnectIpcDBus*>(userdata);
+    const int64_t received_us = get_monotonic_time_us();
+
+    self->request_values_.clear();
+    int r = sd_bus_message_enter_container(m, 'a', "(ss)");
+    while (r > 0) {
+        ResourcePathValue path_value{nullptr, nullptr};
+        r = sd_bus_message_read(m, "(ss)", &path_value.path, &path_value.value);
+        if (r > 0) {
+            self->request_values_.push_back(path_value);
+        }
+    }
+    if (r >= 0) {
+        r = sd_bus_message_exit_container(m);
+    }
+    if (r < 0) {
+        tr_error("Failed to read SetResourceValues request: %s", std::strerror(-r));
+        return r;
+    }
+
+    StringHandle sender = MblStringPool::invalid_handle;
+    const int sender_r = self->GetSender(m, sender);
+    if (sender_r < 0) {
+        return sender_r;
+    }
+
+    const MblError status = self->broker_.SetResourceValues(sender, self->request_values_, self->reply_statuses_);
+    return reply_with_statuses(m, Lane_Telemetry, received_us, status, self->reply_statuses_, self->reply_status_values_);
+}
+
+int MblCloudConnectIpcDBus::HandleNameOwnerChanged(
+    sd_bus_message* const m,
+    void* const userdata,
+    sd_bus_error* const /*ret_error*/)
+{
+    MblCloudConnectIpcDBus* const self = static_cast<MblCloudConnectIpcDBus*>(userdata);
+
+    const char* name = nullptr;
+    const char* old_owner = nullptr;
+    const char* new_owner = nullptr;
+    const int r = sd_bus_message_read(m, "sss", &name, &old_owner, &new_owner);
+    if (r < 0) {
+        tr_error("Failed to read NameOwnerChanged signal: %s", std::strerror(-r));
+        return 0;
+    }
+
+    // A unique name that loses its owner is a client that disconnected. If
+    // the name isn't connected the client never sent a request.
+    if (name[0] != ':' || new_owner[0] != '\0') {
+        return 0;
+    }
+    const StringHandle app_name = MblStringPool::Find(name, std::strlen(name));
+    if (app_name == MblStringPool::invalid_handle) {
+        return 0;
+    }
+    uid_t uid = 0;
+    {
+        MblScopedLock l(self->notifications_mutex_);
+        const auto it = self->connected_app_names_.find(app_name);
+        if (it == self->connected_app_names_.end()) {
+            return 0;
+        }
+        uid = it->second;
+    }
+
+    self->broker_.ApplicationDisconnected(app_name);
+
+    const auto uid_it = self->connections_by_uid_.find(uid);
+    assert(uid_it != self->connections_by_uid_.end() && uid_it->second > 0);
+    if (--uid_it->second == 0) {
+        self->connections_by_uid_.erase(uid_it);
+    }
+
+    // Its queued notifications must not reach whoever the handle goes to next
+    {
+        MblScopedLock l(self->notifications_mutex_);
+        self->connected_app_names_.erase(app_name);
+        self->pending_notifications_.erase(
+            std::remove_if(
+                self->pending_notifications_.begin(),
+                self->pending_notifications_.end(),
+                [app_name](const Notification& n) { return n.app_name == app_name; }),
+            self->pending_notifications_.end());
+    }
+    MblStringPool::Release(app_name);
+    return 0;
+}
+
+int MblCloudConnectIpcDBus::HandleWakeup(
+    sd_event_source* const /*s*/,
+    const int fd,
+    const uint32_t /*revents*/,
+    void* const userdata)
+{
+    MblCloudConnectIpcDBus* const self = static_cast<MblCloudConnectIpcDBus*>(userdata);
+
+    eventfd_t value = 0;
+    eventfd_read(fd, &value);
+
+    self->SendNotifications();
+    if (!self->running_.load()) {
+        sd_event_exit(self->event_, 0);
+    }
+    return 0;
+}
+
+void MblCloudConnectIpcDBus::Wakeup()
+{
+    if (eventfd_write(wakeup_fd_, 1) != 0) {
+        tr_error("Failed to wake the D-Bus thread: %s", std::strerror(errno));
+    }
+}
+
+void MblCloudConnectIpcDBus::SendNotifications()
+{
+    sending_notifications_.clear();
+    {
+        MblScopedLock l(notifications_mutex_);
+        sending_notifications_.swap(pending_notifications_);
+    }
+    if (sending_notifications_.empty()) {
+        return;
+    }
+
+    // One ResourcesUpdated signal per application, in the order the updates
+    // were made
+    std::stable_sort(
+        sending_notifications_.begin(),
+        sending_notifications_.end(),
+        [](const Notification& a, const Notification& b) { return a.app_name < b.app_name; });
+
+    auto begin = sending_notifications_.begin();
+    while (begin != sending_notifications_.end()) {
+        const StringHandle app_name = begin->app_name;
+        auto end = begin;
+        while (end != sending_notifications_.end() && end->app_name == app_name) {
+            ++end;
+        }
+
+        sd_bus_message* signal = nullptr;
+        int r = sd_bus_message_new_signal(bus_, &signal, g_object_path, g_interface_name, "ResourcesUpdated");
+        if (r >= 0) {
+            r = sd_bus_message_set_destination(signal, MblStringPool::Get(app_name));
+        }
+        if (r >= 0) {
+            r = sd_bus_message_open_container(signal, 'a', "(ss)");
+        }
+        for (auto it = begin; r >= 0 && it != end; ++it) {
+            char path[24];
+            std::snprintf(
+                path,
+                sizeof(path),
+                "/%u/%u/%u",
+                static_cast<unsigned>(ResourcePathObjectId(it->path)),
+                static_cast<unsigned>(ResourcePathInstanceId(it->path)),
+                static_cast<unsigned>(ResourcePathResourceId(it->path)));
+            r = sd_bus_message_append(signal, "(ss)", path, it->value.c_str());
+        }
+        if (r >= 0) {
+            r = sd_bus_message_close_container(signal);
+        }
+        if (r >= 0) {
+            r = sd_bus_send(bus_, signal, nullptr);
+        }
+        if (r >= 0) {
+            RecordLaneLatency(Lane_Control, get_monotonic_time_us() - begin->created_us);
+        }
+        if (r < 0) {
+            tr_error(
+                "Failed to send %zu resource updates to \"%s\": %s",
+                static_cast<size_t>(end - begin),
+                MblStringPool::Get(app_name),
+                std::strerror(-r));
+        }
+        sd_bus_message_unref(signal);
+
+        begin = end;
+    }
+}
+
+void MblCloudConnectIpcDBus::Cleanup()
+{
+    wakeup_source_ = sd_event_source_unref(wakeup_source_);
+    name_owner_changed_slot_ = sd_bus_slot_unref(name_owner_changed_slot_);
+    vtable_slot_ = sd_bus_slot_unref(vtable_slot_);
+    if (bus_) {
+        sd_bus_detach_event(bus_);
+        bus_ = sd_bus_flush_close_unref(bus_);
+    }
+    event_ = sd_event_unref(event_);
+
+    // The names aren't released: the broker may still refer to them
+    {
+        MblScopedLock l(notifications_mutex_);
+        connected_app_names_.clear();
+    }
+    connections_by_uid_.clear();
+    if (wakeup_fd_ != -1) {
+        close(wakeup_fd_);
+        wakeup_fd_ = -1;
+    }
+}
+
 } // namespace mbl
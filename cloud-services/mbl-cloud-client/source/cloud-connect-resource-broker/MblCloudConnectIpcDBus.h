@@ -20,22 +20,141 @@
 #define MblCloudConnectIpcDBus_h_
 
 #include "MblCloudConnectIpcInterface.h"
+#include "MblMutex.h"
+
+#include <systemd/sd-bus.h>
+#include <systemd/sd-event.h>
+
+#include <atomic>
+#include <pthread.h>
+#include <string>
+#include <sys/types.h>
+#include <unordered_map>
+#include <vector>
 
 namespace mbl {
 
+class MblCloudConnectResourceBroker;
+
 /*! \file MblCloudConnectIpcDBus.h
  *  \brief MblCloudConnectIpcDBus.
  *  This class provides an implementation for D-Bus IPC mechanism
+ *
+ *  The broker is published on the system bus as service "com.mbed.Cloud",
+ *  object "/com/mbed/Cloud/Connect1", interface "com.mbed.Cloud.Connect1":
+ *
+ *  - RegisterResources(s json) -> (u status)
+ *  - DeregisterResources() -> (u status)
+ *  - SetResourceValue(s path, s value) -> (u status)
+ *  - OpenValueStore() -> (u status, ah store), where store holds the value
+ *    store's memfd on success and is empty otherwise
+ *  - RegisterResourceDefinitions(as jsons) -> (u status, au statuses)
+ *  - SetResourceValues(a(ss) path_values) -> (u status, au statuses)
+ *  - signal ResourcesUpdated(a(ss) path_values), sent to one application
+ *
+ *  status is an MblError value. The batch methods also return one status
+ *  per item, in request order. Applications are identified by their unique
+ *  bus name, and are deregistered when they disconnect from the bus. Each
+ *  user (uid) may have at most MBL_CLOUD_CONNECT_MAX_CONNECTIONS_PER_UID
+ *  connections that have sent requests; requests from further connections
+ *  fail.
+ *
+ *  All D-Bus traffic is handled by an sd-event loop on a thread of its own,
+ *  so requests never wait for the mbed event loop.
  */
 class MblCloudConnectIpcDBus: public MblCloudConnectIpcInterface {
 
 public:
 
-    MblCloudConnectIpcDBus();
+    explicit MblCloudConnectIpcDBus(MblCloudConnectResourceBroker& broker);
     ~MblCloudConnectIpcDBus() override;
 
     // Implementation of init()
     MblError Init() override;
+
+    MblError Terminate() override;
+
+    MblError NotifyResourceUpdated(
+        StringHandle app_name,
+        ResourcePath path,
+        const std::string& value) override;
+
+    MblError NotifyResourcesUpdated(
+        StringHandle app_name,
+        const std::vector<ResourceValue>& values) override;
+
+private:
+
+    struct Notification
+    {
+        StringHandle app_name;
+        ResourcePath path;
+        std::string value;
+        int64_t created_us;
+    };
+
+    static void* ThreadMain(void* arg);
+
+    // sd-bus and sd-event callbacks. userdata is the MblCloudConnectIpcDBus.
+    static int HandleRegisterResources(sd_bus_message* m, void* userdata, sd_bus_error* ret_error);
+    static int HandleDeregisterResources(sd_bus_message* m, void* userdata, sd_bus_error* ret_error);
+    static int HandleSetResourceValue(sd_bus_message* m, void* userdata, sd_bus_error* ret_error);
+    static int HandleOpenValueStore(sd_bus_message* m, void* userdata, sd_bus_error* ret_error);
+    static int HandleRegisterResourceDefinitions(sd_bus_message* m, void* userdata, sd_bus_error* ret_error);
+    static int HandleSetResourceValues(sd_bus_message* m, void* userdata, sd_bus_error* ret_error);
+    static int HandleNameOwnerChanged(sd_bus_message* m, void* userdata, sd_bus_error* ret_error);
+    static int HandleWakeup(sd_event_source* s, int fd, uint32_t revents, void* userdata);
+
+    // Get the handle of the unique name of the application that sent a
+    // request, acquiring it for the application's first request. Failing
+    // (the pool is full, or the user has too many connections) makes sd-bus
+    // send an error reply. Called on the event loop thread.
+    int GetSender(sd_bus_message* m, StringHandle& sender);
+
+    void Wakeup();
+    void SendNotifications();
+    void Cleanup();
+
+    MblCloudConnectResourceBroker& broker_;
+
+    sd_event* event_;
+    sd_bus* bus_;
+    sd_bus_slot* vtable_slot_;
+    sd_bus_slot* name_owner_changed_slot_;
+    sd_event_source* wakeup_source_;
+
+    // eventfd that wakes the event loop to send notifications or to stop
+    int wakeup_fd_;
+
+    pthread_t thread_;
+    bool thread_running_;
+    // True between a successful Init() and Terminate()
+    std::atomic<bool> running_;
+
+    // Notifications waiting to be sent by the event loop thread. Sending
+    // them all at once lets notifications for the same application share
+    // one signal.
+    MblMutex notifications_mutex_;
+    std::vector<Notification> pending_notifications_;
+    // Unique names, and uids, of the applications that have sent requests
+    // and are still connected. Notifications for any other name are dropped:
+    // the name is released when its application disconnects, and its handle
+    // may then be reused for another name. Only changed by the event loop
+    // thread.
+    std::unordered_map<StringHandle, uid_t> connected_app_names_;
+    // Only used by the event loop thread; kept to reuse their memory
+    std::vector<Notification> sending_notifications_;
+    std::unordered_map<uid_t, unsigned> connections_by_uid_;
+    std::vector<const char*> request_definitions_;
+    std::vector<ResourcePathValue> request_values_;
+    std::vector<MblError> reply_statuses_;
+    std::vector<uint32_t> reply_status_values_;
+
+    // No copying or moving (see https://github.com/isocpp/CppCoreGuidelines/blob/master/CppCoreGuidelines.md#cdefop-default-operations)
+    MblCloudConnectIpcDBus(const MblCloudConnectIpcDBus&) = delete;
+    MblCloudConnectIpcDBus & operator = (const MblCloudConnectIpcDBus&) = delete;
+    MblCloudConnectIpcDBus(MblCloudConnectIpcDBus&&) = delete;
+    MblCloudConnectIpcDBus& operator = (MblCloudConnectIpcDBus&&) = delete;
 };
 
 } // namespace mbl
@@ -20,9 +20,29 @@
 #define MblCloudConnectIpcInterface_h_
 
 #include "MblError.h"
+#include "MblCloudConnectCloudClientInterface.h"
+#include "MblCloudConnectResourceDatabase.h"
+
+#include <string>
+#include <vector>
+
+// Most applications one user may have connected through each IPC backend at
+// once, so that one user can't multiply its memory quota by connecting many
+// times. Set with the CMake option of the same name.
+#ifndef MBL_CLOUD_CONNECT_MAX_CONNECTIONS_PER_UID
+#define MBL_CLOUD_CONNECT_MAX_CONNECTIONS_PER_UID 16
+#endif
 
 namespace mbl {
 
+// One item of a request to set several resource values. Both strings are
+// NUL-terminated and belong to the request.
+struct ResourcePathValue
+{
+    const char* path;
+    const char* value;
+};
+
 /*! \file MblCloudConnectIpcInterface.h
  *  \brief MblCloudConnectIpcInterface.
  *  This class provides an interface for all IPC mechanisms to allow applications to register their own LwM2M resources 
@@ -36,8 +56,25 @@ public:
     virtual ~MblCloudConnectIpcInterface() = default;
     
     // Init API skeleton (needed as we are not using exceptions and we can't check for errors from a constructor).
+    // Starts handling requests from applications, which are passed to the resource broker.
     virtual MblError Init() = 0;
 
+    // Stop handling requests. Once this returns the resource broker is no longer called.
+    virtual MblError Terminate() = 0;
+
+    // Tell an application that the cloud changed the value of one of its resources.
+    // Thread safe. Notifications may be delivered asynchronously, batched with others.
+    virtual MblError NotifyResourceUpdated(
+        StringHandle app_name,
+        ResourcePath path,
+        const std::string& value) = 0;
+
+    // Like NotifyResourceUpdated() for several of an application's resources
+    // at once.
+    virtual MblError NotifyResourcesUpdated(
+        StringHandle app_name,
+        const std::vector<ResourceValue>& values) = 0;
+
 private:
 
     // No copying or moving (see https://github.com/isocpp/CppCoreGuidelines/blob/master/CppCoreGuidelines.md#cdefop-default-operations)
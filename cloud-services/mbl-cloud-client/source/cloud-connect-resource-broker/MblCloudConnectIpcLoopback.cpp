@@ -0,0 +1,106 @@
+/*
+ * Copyright (c) 2020 Arm Limited and Contributors. All rights reserved.
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ * Licensed under the Apache License, Version 2.0 (the License); you may
+ * not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an AS IS BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include "MblCloudConnectIpcLoopback.h"
+#include "MblCloudConnectResourceBroker.h"
+
+#include "log_trace.h"
+
+#define TRACE_GROUP "CCRB-IPCLOOP"
+
+namespace mbl {
+
+MblCloudConnectIpcLoopback::MblCloudConnectIpcLoopback(
+    MblCloudConnectResourceBroker& broker,
+    Listener& listener)
+    : broker_(broker)
+    , listener_(listener)
+{
+    tr_debug("MblCloudConnectIpcLoopback::MblCloudConnectIpcLoopback");
+}
+
+MblError MblCloudConnectIpcLoopback::Init()
+{
+    return Error::None;
+}
+
+MblError MblCloudConnectIpcLoopback::Terminate()
+{
+    return Error::None;
+}
+
+MblError MblCloudConnectIpcLoopback::NotifyResourceUpdated(
+    const StringHandle app_name,
+    const ResourcePath path,
+    const std::string& value)
+{
+    listener_.ResourcesUpdated(app_name, std::vector<ResourceValue>{ResourceValue{path, value}});
+    return Error::None;
+}
+
+MblError MblCloudConnectIpcLoopback::NotifyResourcesUpdated(
+    const StringHandle app_name,
+    const std::vector<ResourceValue>& values)
+{
+    listener_.ResourcesUpdated(app_name, values);
+    return Error::None;
+}
+
+MblError MblCloudConnectIpcLoopback::RegisterResources(
+    const StringHandle app_name,
+    const char* const json,
+    const size_t length)
+{
+    return broker_.RegisterResources(*this, app_name, json, length);
+}
+
+MblError MblCloudConnectIpcLoopback::RegisterResourceDefinitions(
+    const StringHandle app_name,
+    const std::vector<const char*>& definitions,
+    std::vector<MblError>& statuses)
+{
+    return broker_.RegisterResourceDefinitions(*this, app_name, definitions, statuses);
+}
+
+MblError MblCloudConnectIpcLoopback::DeregisterResources(const StringHandle app_name)
+{
+    return broker_.DeregisterResources(app_name);
+}
+
+MblError MblCloudConnectIpcLoopback::SetResourceValue(
+    const StringHandle app_name,
+    const char* const path,
+    const char* const value)
+{
+    return broker_.SetResourceValue(app_name, path, value);
+}
+
+MblError MblCloudConnectIpcLoopback::SetResourceValues(
+    const StringHandle app_name,
+    const std::vector<ResourcePathValue>& values,
+    std::vector<MblError>& statuses)
+{
+    return broker_.SetResourceValues(app_name, values, statuses);
+}
+
+void MblCloudConnectIpcLoopback::Disconnect(const StringHandle app_name)
+{
+    broker_.ApplicationDisconnected(app_name);
+}
+
+} // namespace mbl
@@ -0,0 +1,127 @@
+/*
+ * Copyright (c) 2020 Arm Limited and Contributors. All rights reserved.
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ * Licensed under the Apache License, Version 2.0 (the License); you may
+ * not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an AS IS BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#ifndef MblCloudConnectIpcLoopback_h_
+#define MblCloudConnectIpcLoopback_h_
+
+#include "MblCloudConnectIpcInterface.h"
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+namespace mbl {
+
+class MblCloudConnectResourceBroker;
+
+/*! \file MblCloudConnectIpcLoopback.h
+ *  \brief MblCloudConnectIpcLoopback.
+ *  An IPC backend for applications in the same process, with no transport
+ *  in between, so that the broker itself can be measured and tested without
+ *  D-Bus or containers.
+ *
+ *  Applications call the request methods below directly and get the
+ *  broker's status back. Different applications may call them concurrently,
+ *  but each application's requests (including Disconnect()) must come from
+ *  one thread at a time, as the other backends handle them: the broker
+ *  relies on an application not deregistering while one of its requests is
+ *  being handled. Notifications are passed to a Listener on the thread that
+ *  caused them.
+ *
+ *  The broker doesn't start this backend (it isn't in
+ *  MBL_CLOUD_CONNECT_IPC_BACKENDS): whoever creates it owns it, and must
+ *  keep it until its applications are deregistered.
+ */
+class MblCloudConnectIpcLoopback: public MblCloudConnectIpcInterface {
+
+public:
+
+    // Receives the notifications for the loopback's applications
+    class Listener {
+
+    public:
+
+        Listener() = default;
+        virtual ~Listener() = default;
+
+        // The cloud changed values of an application's resources. Called
+        // concurrently from any thread that calls into the broker.
+        virtual void ResourcesUpdated(StringHandle app_name, const std::vector<ResourceValue>& values) = 0;
+
+    private:
+
+        // No copying or moving (see https://github.com/isocpp/CppCoreGuidelines/blob/master/CppCoreGuidelines.md#cdefop-default-operations)
+        Listener(const Listener&) = delete;
+        Listener & operator = (const Listener&) = delete;
+        Listener(Listener&&) = delete;
+        Listener& operator = (Listener&&) = delete;
+    };
+
+    MblCloudConnectIpcLoopback(MblCloudConnectResourceBroker& broker, Listener& listener);
+
+    MblError Init() override;
+
+    MblError Terminate() override;
+
+    MblError NotifyResourceUpdated(
+        StringHandle app_name,
+        ResourcePath path,
+        const std::string& value) override;
+
+    MblError NotifyResourcesUpdated(
+        StringHandle app_name,
+        const std::vector<ResourceValue>& values) override;
+
+    // Requests from applications, as the other backends would make them (see
+    // MblCloudConnectResourceBroker.h). app_name is any name unique to the
+    // application. Calls for one application must not overlap.
+
+    MblError RegisterResources(StringHandle app_name, const char* json, size_t length);
+
+    MblError RegisterResourceDefinitions(
+        StringHandle app_name,
+        const std::vector<const char*>& definitions,
+        std::vector<MblError>& statuses);
+
+    MblError DeregisterResources(StringHandle app_name);
+
+    MblError SetResourceValue(StringHandle app_name, const char* path, const char* value);
+
+    MblError SetResourceValues(
+        StringHandle app_name,
+        const std::vector<ResourcePathValue>& values,
+        std::vector<MblError>& statuses);
+
+    // The application has gone away
+    void Disconnect(StringHandle app_name);
+
+private:
+
+    MblCloudConnectResourceBroker& broker_;
+    Listener& listener_;
+
+    // No copying or moving (see https://github.com/isocpp/CppCoreGuidelines/blob/master/CppCoreGuidelines.md#cdefop-default-operations)
+    MblCloudConnectIpcLoopback(const MblCloudConnectIpcLoopback&) = delete;
+    MblCloudConnectIpcLoopback & operator = (const MblCloudConnectIpcLoopback&) = delete;
+    MblCloudConnectIpcLoopback(MblCloudConnectIpcLoopback&&) = delete;
+    MblCloudConnectIpcLoopback& operator = (MblCloudConnectIpcLoopback&&) = delete;
+};
+
+} // namespace mbl
+
+#endif // MblCloudConnectIpcLoopback_h_
@@ -0,0 +1,942 @@
+/*
+ * Copyright (c) 2020 Arm Limited and Contributors. All rights reserved.
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ * Licensed under the Apache License, Version 2.0 (the License); you may
+ * not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an AS IS BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "MblCloudConnectIpcUnixSocket.h"
+#include "MblCloudConnectIpcUnixSocketProtocol.h"
+#include "MblCloudConnectResourceBroker.h"
+#include "MblScopedLock.h"
+
+#include "log_trace.h"
+#include "monotonic_time.h"
+#include "signals.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <grp.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#define TRACE_GROUP "CCRB-IPCSOCK"
+
+// Permissions of the socket file, which decide who may connect. Set with the
+// CMake options of the same names. An empty group leaves the socket owned by
+// mbl-cloud-client's own group.
+#ifndef MBL_CLOUD_CONNECT_SOCKET_MODE
+#define MBL_CLOUD_CONNECT_SOCKET_MODE 0660
+#endif
+
+#ifndef MBL_CLOUD_CONNECT_SOCKET_GROUP
+#define MBL_CLOUD_CONNECT_SOCKET_GROUP ""
+#endif
+
+namespace mbl {
+
+using namespace ccrb_socket_protocol;
+
+// Messages read from one connection before serving the others
+static const size_t g_max_messages_per_wakeup = 32;
+
+static uint32_t read_u32(const uint8_t* const data)
+{
+    uint32_t value = 0;
+    std::memcpy(&value, data, sizeof(value));
+    return value;
+}
+
+static void append_u32(std::vector<uint8_t>& message, const uint32_t value)
+{
+    const uint8_t* const bytes = reinterpret_cast<const uint8_t*>(&value);
+    message.insert(message.end(), bytes, bytes + sizeof(value));
+}
+
+static void append_string(std::vector<uint8_t>& message, const char* const str, const size_t length)
+{
+    append_u32(message, static_cast<uint32_t>(length + 1));
+    message.insert(message.end(), str, str + length + 1);
+}
+
+// Look up a group's gid without the static buffer of getgrnam()
+static bool lookup_group(const char* const name, gid_t& gid)
+{
+    long buffer_size = sysconf(_SC_GETGR_R_SIZE_MAX);
+    if (buffer_size <= 0) {
+        buffer_size = 16384;
+    }
+    std::vector<char> buffer(static_cast<size_t>(buffer_size));
+
+    struct group entry;
+    struct group* result = 0;
+    const int err = getgrnam_r(name, &entry, buffer.data(), buffer.size(), &result);
+    if (err != 0 || !result) {
+        tr_error("Failed to look up group \"%s\": %s", name, err != 0 ? std::strerror(err) : "no such group");
+        return false;
+    }
+    gid = result->gr_gid;
+    return true;
+}
+
+// Read a string field in place. str points into the message.
+static bool read_string(const uint8_t*& pos, const uint8_t* const end, const char*& str, size_t& length)
+{
+    if (end - pos < 4) {
+        return false;
+    }
+    const uint32_t size = read_u32(pos);
+    pos += 4;
+    if (size == 0 || size > static_cast<size_t>(end - pos) || pos[size - 1] != '\0') {
+        return false;
+    }
+    str = reinterpret_cast<const char*>(pos);
+    length = size - 1;
+    pos += size;
+    return true;
+}
+
+// Send one message, with a descriptor as SCM_RIGHTS if pass_fd isn't -1
+static ssize_t send_message(const int fd, const uint8_t* const message, const size_t length, const int pass_fd)
+{
+    if (pass_fd == -1) {
+        return send(fd, message, length, MSG_DONTWAIT | MSG_NOSIGNAL);
+    }
+
+    struct iovec iov;
+    iov.iov_base = const_cast<uint8_t*>(message);
+    iov.iov_len = length;
+
+    union
+    {
+        char buffer[CMSG_SPACE(sizeof(int))];
+        struct cmsghdr align;
+    } control;
+    std::memset(&control, 0, sizeof(control));
+
+    struct msghdr msg;
+    std::memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control.buffer;
+    msg.msg_controllen = sizeof(control.buffer);
+
+    struct cmsghdr* const cmsg = CMSG_FIRSTHDR(&msg);
+    cmsg->cmsg_level = SOL_SOCKET;
+    cmsg->cmsg_type = SCM_RIGHTS;
+    cmsg->cmsg_len = CMSG_LEN(sizeof(int));
+    std::memcpy(CMSG_DATA(cmsg), &pass_fd, sizeof(int));
+
+    return sendmsg(fd, &msg, MSG_DONTWAIT | MSG_NOSIGNAL);
+}
+
+MblCloudConnectIpcUnixSocket::MblCloudConnectIpcUnixSocket(
+    MblCloudConnectResourceBroker& broker,
+    const std::string& socket_path)
+    : broker_(broker)
+    , socket_path_(socket_path)
+    , listen_fd_(-1)
+    , epoll_fd_(-1)
+    , wakeup_fd_(-1)
+    , thread_()
+    , thread_running_(false)
+    , running_(false)
+    , connections_()
+    , fds_by_app_name_()
+    , connections_by_uid_()
+    , connection_count_(0)
+    , receive_buffer_(max_message_size)
+    , notifications_mutex_("ccrb_socket_notifications")
+    , notifications_pending_(false)
+{
+    tr_debug("MblCloudConnectIpcUnixSocket::MblCloudConnectIpcUnixSocket");
+}
+
+MblCloudConnectIpcUnixSocket::~MblCloudConnectIpcUnixSocket()
+{
+    tr_debug("MblCloudConnectIpcUnixSocket::~MblCloudConnectIpcUnixSocket");
+    Terminate();
+}
+
+MblError MblCloudConnectIpcUnixSocket::Init()
+{
+    tr_debug("MblCloudConnectIpcUnixSocket::Init");
+    assert(!thread_running_);
+
+    struct sockaddr_un address;
+    std::memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    if (socket_path_.size() >= sizeof(address.sun_path)) {
+        tr_error("Socket path \"%s\" is too long", socket_path_.c_str());
+        return Error::CCRBIpcInitFailed;
+    }
+    std::memcpy(address.sun_path, socket_path_.c_str(), socket_path_.size() + 1);
+
+    listen_fd_ = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (listen_fd_ == -1) {
+        tr_error("Failed to create socket: %s", std::strerror(errno));
+        Cleanup();
+        return Error::CCRBIpcInitFailed;
+    }
+
+    // Remove the socket left behind by a previous run
+    unlink(socket_path_.c_str());
+    if (bind(listen_fd_, reinterpret_cast<const struct sockaddr*>(&address), sizeof(address)) != 0) {
+        tr_error("Failed to bind socket to \"%s\": %s", socket_path_.c_str(), std::strerror(errno));
+        Cleanup();
+        return Error::CCRBIpcInitFailed;
+    }
+
+    // Nobody can connect until listen(), so set who may before that rather
+    // than leave it to the umask
+    const char* const group = MBL_CLOUD_CONNECT_SOCKET_GROUP;
+    if (group[0] != '\0') {
+        gid_t gid = 0;
+        if (!lookup_group(group, gid)) {
+            Cleanup();
+            return Error::CCRBIpcInitFailed;
+        }
+        if (chown(socket_path_.c_str(), static_cast<uid_t>(-1), gid) != 0) {
+            tr_error("Failed to set group of \"%s\" to \"%s\": %s", socket_path_.c_str(), group, std::strerror(errno));
+            Cleanup();
+            return Error::CCRBIpcInitFailed;
+        }
+    }
+    if (chmod(socket_path_.c_str(), MBL_CLOUD_CONNECT_SOCKET_MODE) != 0) {
+        tr_error("Failed to set mode of \"%s\": %s", socket_path_.c_str(), std::strerror(errno));
+        Cleanup();
+        return Error::CCRBIpcInitFailed;
+    }
+    if (listen(listen_fd_, SOMAXCONN) != 0) {
+        tr_error("Failed to listen on \"%s\": %s", socket_path_.c_str(), std::strerror(errno));
+        Cleanup();
+        return Error::CCRBIpcInitFailed;
+    }
+
+    epoll_fd_ = epoll_create1(EPOLL_CLOEXEC);
+    if (epoll_fd_ == -1) {
+        tr_error("Failed to create epoll instance: %s", std::strerror(errno));
+        Cleanup();
+        return Error::CCRBIpcInitFailed;
+    }
+
+    wakeup_fd_ = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (wakeup_fd_ == -1) {
+        tr_error("Failed to create eventfd: %s", std::strerror(errno));
+        Cleanup();
+        return Error::CCRBIpcInitFailed;
+    }
+
+    const int fds[] = {listen_fd_, wakeup_fd_};
+    for (const int fd : fds) {
+        struct epoll_event event;
+        std::memset(&event, 0, sizeof(event));
+        event.events = EPOLLIN;
+        event.data.fd = fd;
+        if (epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, fd, &event) != 0) {
+            tr_error("Failed to add fd to epoll instance: %s", std::strerror(errno));
+            Cleanup();
+            return Error::CCRBIpcInitFailed;
+        }
+    }
+
+    const int create_err = create_thread_with_signals_blocked(&thread_, &MblCloudConnectIpcUnixSocket::ThreadMain, this);
+
+    if (create_err != 0) {
+        tr_error("Failed to create socket thread: %s", std::strerror(create_err));
+        Cleanup();
+        return Error::CCRBIpcInitFailed;
+    }
+
+    thread_running_ = true;
+    running_ = true;
+    tr_info("Listening for applications on \"%s\"", socket_path_.c_str());
+    return Error::None;
+}
+
+MblError MblCloudConnectIpcUnixSocket::Terminate()
+{
+    tr_debug("MblCloudConnectIpcUnixSocket::Terminate");
+    if (!thread_running_) {
+        return Error::None;
+    }
+
+    running_ = false;
+    if (eventfd_write(wakeup_fd_, 1) != 0) {
+        tr_error("Failed to wake the socket thread: %s", std::strerror(errno));
+    }
+    pthread_join(thread_, 0);
+    thread_running_ = false;
+
+    Cleanup();
+    return Error::None;
+}
+
+MblError MblCloudConnectIpcUnixSocket::NotifyResourceUpdated(
+    const StringHandle app_name,
+    const ResourcePath path,
+    const std::string& value)
+{
+    // Dropped if the epoll loop isn't running: nothing would send it
+    if (!running_.load(std::memory_order_relaxed)) {
+        return Error::None;
+    }
+
+    bool first = false;
+    {
+        MblScopedLock l(notifications_mutex_);
+        if (connected_app_names_.count(app_name) == 0) {
+            return Error::None;
+        }
+        first = pending_notifications_.empty();
+        pending_notifications_.push_back(Notification{app_name, path, value, get_monotonic_time_us()});
+        notifications_pending_.store(true, std::memory_order_relaxed);
+    }
+
+    // The epoll loop sends everything that is pending when it wakes, so only
+    // the first of a burst of notifications has to wake it
+    if (first && eventfd_write(wakeup_fd_, 1) != 0) {
+        tr_error("Failed to wake the socket thread: %s", std::strerror(errno));
+    }
+    return Error::None;
+}
+
+MblError MblCloudConnectIpcUnixSocket::NotifyResourcesUpdated(
+    const StringHandle app_name,
+    const std::vector<ResourceValue>& values)
+{
+    if (!running_.load(std::memory_order_relaxed) || values.empty()) {
+        return Error::None;
+    }
+
+    const int64_t created_us = get_monotonic_time_us();
+    bool first = false;
+    {
+        MblScopedLock l(notifications_mutex_);
+        if (connected_app_names_.count(app_name) == 0) {
+            return Error::None;
+        }
+        first = pending_notifications_.empty();
+        for (const ResourceValue& value : values) {
+            pending_notifications_.push_back(Notification{app_name, value.path, value.value, created_us});
+        }
+        notifications_pending_.store(true, std::memory_order_relaxed);
+    }
+
+    if (first && eventfd_write(wakeup_fd_, 1) != 0) {
+        tr_error("Failed to wake the socket thread: %s", std::strerror(errno));
+    }
+    return Error::None;
+}
+
+void* MblCloudConnectIpcUnixSocket::ThreadMain(void* const arg)
+{
+    static_cast<MblCloudConnectIpcUnixSocket*>(arg)->Run();
+    return 0;
+}
+
+void MblCloudConnectIpcUnixSocket::Run()
+{
+    for (;;) {
+        struct epoll_event events[16];
+        const int num_events = epoll_wait(epoll_fd_, events, 16, -1);
+        if (num_events == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            tr_error("epoll_wait failed: %s", std::strerror(errno));
+            return;
+        }
+
+        // Cloud requests and new connections first, then application
+        // requests
+        for (int i = 0; i < num_events; ++i) {
+            const int fd = events[i].data.fd;
+            if (fd == wakeup_fd_) {
+                eventfd_t value = 0;
+                eventfd_read(wakeup_fd_, &value);
+                SendNotifications();
+                if (!running_.load()) {
+                    return;
+                }
+            }
+            else if (fd == listen_fd_) {
+                Accept();
+            }
+        }
+
+        for (int i = 0; i < num_events; ++i) {
+            const int fd = events[i].data.fd;
+            if (fd == wakeup_fd_ || fd == listen_fd_) {
+                continue;
+            }
+
+            // The connection may have been closed while handling an earlier
+            // event
+            const auto it = connections_.find(fd);
+            if (it == connections_.end()) {
+                continue;
+            }
+            Connection& connection = *it->second;
+            if (events[i].events & EPOLLOUT) {
+                HandleWritable(connection);
+            }
+            if (connections_.count(fd) &&
+                (events[i].events & (EPOLLHUP | EPOLLERR) ||
+                 ((events[i].events & EPOLLIN) && !connection.reading_paused)))
+            {
+                HandleReadable(connection);
+            }
+        }
+    }
+}
+
+void MblCloudConnectIpcUnixSocket::Accept()
+{
+    for (;;) {
+        const int fd = accept4(listen_fd_, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (fd == -1) {
+            if (errno != EAGAIN && errno != EINTR) {
+                tr_error("accept failed: %s", std::strerror(errno));
+            }
+            return;
+        }
+
+        struct ucred credentials;
+        socklen_t credentials_length = sizeof(credentials);
+        if (getsockopt(fd, SOL_SOCKET, SO_PEERCRED, &credentials, &credentials_length) != 0) {
+            tr_error("Failed to get peer credentials: %s", std::strerror(errno));
+            close(fd);
+            continue;
+        }
+
+        unsigned& uid_connections = connections_by_uid_[credentials.uid];
+        if (uid_connections >= MBL_CLOUD_CONNECT_MAX_CONNECTIONS_PER_UID) {
+            tr_error(
+                "Refusing connection from pid %d: uid %u already has %u connections",
+                static_cast<int>(credentials.pid),
+                static_cast<unsigned>(credentials.uid),
+                uid_connections);
+            close(fd);
+            continue;
+        }
+
+        // Released when the connection closes: these names are never reused
+        const StringHandle app_name = MblStringPool::Acquire(
+            "unix:" + std::to_string(credentials.pid) + "." + std::to_string(++connection_count_));
+        if (app_name == MblStringPool::invalid_handle) {
+            close(fd);
+            continue;
+        }
+
+        struct epoll_event event;
+        std::memset(&event, 0, sizeof(event));
+        event.events = EPOLLIN;
+        event.data.fd = fd;
+        if (epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, fd, &event) != 0) {
+            tr_error("Failed to add connection to epoll instance: %s", std::strerror(errno));
+            MblStringPool::Release(app_name);
+            close(fd);
+            continue;
+        }
+
+        std::unique_ptr<Connection> connection(new Connection());
+        connection->fd = fd;
+        connection->uid = credentials.uid;
+        connection->queued_count = 0;
+        connection->reading_paused = false;
+        connection->epoll_events = EPOLLIN;
+        connection->app_name = app_name;
+
+        tr_info(
+            "Application \"%s\" connected (uid %u)",
+            MblStringPool::Get(connection->app_name),
+            static_cast<unsigned>(credentials.uid));
+        fds_by_app_name_[connection->app_name] = fd;
+        {
+            MblScopedLock l(notifications_mutex_);
+            connected_app_names_.insert(connection->app_name);
+        }
+        connections_[fd] = std::move(connection);
+        ++uid_connections;
+    }
+}
+
+void MblCloudConnectIpcUnixSocket::HandleReadable(Connection& connection)
+{
+    const int fd = connection.fd;
+    for (size_t i = 0; i < g_max_messages_per_wakeup; ++i) {
+        // MSG_TRUNC makes recv return the full length of a message that
+        // didn't fit
+        const ssize_t length =
+            recv(fd, receive_buffer_.data(), receive_buffer_.size(), MSG_DONTWAIT | MSG_TRUNC);
+        if (length == -1) {
+            if (errno == EAGAIN || errno == EINTR) {
+                return;
+            }
+            tr_error("recv from \"%s\" failed: %s", MblStringPool::Get(connection.app_name), std::strerror(errno));
+            Close(fd);
+            return;
+        }
+        if (length == 0) {
+            Close(fd);
+            return;
+        }
+        if (static_cast<size_t>(length) > receive_buffer_.size()) {
+            tr_error(
+                "Message of %zd bytes from \"%s\" is too long",
+                length,
+                MblStringPool::Get(connection.app_name));
+            Close(fd);
+            return;
+        }
+        if (!HandleMessage(connection, receive_buffer_.data(), static_cast<size_t>(length), get_monotonic_time_us())) {
+            Close(fd);
+            return;
+        }
+
+        // Don't make a cloud request wait for the rest of this
+        // application's requests
+        if (notifications_pending_.load(std::memory_order_relaxed)) {
+            SendNotifications();
+            if (!connections_.count(fd)) {
+                return;
+            }
+        }
+        if (connection.reading_paused) {
+            return;
+        }
+    }
+}
+
+bool MblCloudConnectIpcUnixSocket::HandleMessage(
+    Connection& connection,
+    const uint8_t* const message,
+    const size_t length,
+    const int64_t received_us)
+{
+    if (length < header_size) {
+        tr_error("Message from \"%s\" is too short", MblStringPool::Get(connection.app_name));
+        return false;
+    }
+
+    const uint8_t type = message[0];
+    const uint32_t id = read_u32(message + 1);
+    const uint8_t* pos = message + header_size;
+    const uint8_t* const end = message + length;
+
+    MblError status = Error::None;
+    const std::vector<MblError>* statuses = nullptr;
+    int pass_fd = -1;
+    Lane lane = Lane_Registration;
+    bool valid = false;
+    switch (type) {
+        case Type_RegisterResources:
+        {
+            const char* json = nullptr;
+            size_t json_length = 0;
+            valid = read_string(pos, end, json, json_length) && pos == end;
+            if (valid) {
+                status = broker_.RegisterResources(*this, connection.app_name, json, json_length);
+            }
+            break;
+        }
+
+        case Type_DeregisterResources:
+            valid = (pos == end);
+            if (valid) {
+                status = broker_.DeregisterResources(connection.app_name);
+            }
+            break;
+
+        case Type_SetResourceValue:
+        {
+            const char* path = nullptr;
+            const char* value = nullptr;
+            size_t path_length = 0;
+            size_t value_length = 0;
+            valid = read_string(pos, end, path, path_length) &&
+                    read_string(pos, end, value, value_length) &&
+                    pos == end;
+            if (valid) {
+                status = broker_.SetResourceValue(connection.app_name, path, value);
+            }
+            lane = Lane_Telemetry;
+            break;
+        }
+
+        case Type_OpenValueStore:
+            valid = (pos == end);
+            if (valid) {
+                status = broker_.OpenValueStore(connection.app_name, pass_fd);
+            }
+            break;
+
+        case Type_RegisterResourceDefinitions:
+        {
+            // Strings are read in place: they point into the receive buffer
+            request_definitions_.clear();
+            valid = (end - pos >= 4);
+            const uint32_t count = valid ? read_u32(pos) : 0;
+            pos += valid ? 4 : 0;
+            for (uint32_t i = 0; valid && i < count; ++i) {
+                const char* json = nullptr;
+                size_t json_length = 0;
+                valid = read_string(pos, end, json, json_length);
+                request_definitions_.push_back(json);
+            }
+            valid = valid && pos == end;
+            if (valid) {
+                status = broker_.RegisterResourceDefinitions(
+                    *this, connection.app_name, request_definitions_, reply_statuses_);
+                statuses = &reply_statuses_;
+            }
+            break;
+        }
+
+        case Type_SetResourceValues:
+        {
+            request_values_.clear();
+            valid = (end - pos >= 4);
+            const uint32_t count = valid ? read_u32(pos) : 0;
+            pos += valid ? 4 : 0;
+            for (uint32_t i = 0; valid && i < count; ++i) {
+                ResourcePathValue path_value{nullptr, nullptr};
+                size_t path_length = 0;
+                size_t value_length = 0;
+                valid = read_string(pos, end, path_value.path, path_length) &&
+                        read_string(pos, end, path_value.value, value_length);
+                request_values_.push_back(path_value);
+            }
+            valid = valid && pos == end;
+            if (valid) {
+                status = broker_.SetResourceValues(connection.app_name, request_values_, reply_statuses_);
+                statuses = &reply_statuses_;
+            }
+            lane = Lane_Telemetry;
+            break;
+        }
+
+        default:
+            break;
+    }
+
+    if (!valid) {
+        tr_error(
+            "Invalid message of type 0x%02x from \"%s\"",
+            static_cast<unsigned>(type),
+            MblStringPool::Get(connection.app_name));
+        return false;
+    }
+
+    const bool sent = SendReply(connection, lane, id, status, statuses, pass_fd, received_us);
+    if (pass_fd != -1) {
+        close(pass_fd);
+    }
+    return sent;
+}
+
+bool MblCloudConnectIpcUnixSocket::SendReply(
+    Connection& connection,
+    const Lane lane,
+    const uint32_t id,
+    const MblError status,
+    const std::vector<MblError>* const statuses,
+    const int pass_fd,
+    const int64_t received_us)
+{
+    reply_buffer_.clear();
+    reply_buffer_.push_back(Type_Reply);
+    append_u32(reply_buffer_, id);
+    append_u32(reply_buffer_, static_cast<uint32_t>(status));
+    if (statuses) {
+        append_u32(reply_buffer_, static_cast<uint32_t>(statuses->size()));
+        for (const MblError item_status : *statuses) {
+            append_u32(reply_buffer_, static_cast<uint32_t>(item_status));
+        }
+    }
+    return Send(connection, lane, reply_buffer_.data(), reply_buffer_.size(), pass_fd, received_us);
+}
+
+bool MblCloudConnectIpcUnixSocket::Send(
+    Connection& connection,
+    const Lane lane,
+    const uint8_t* const message,
+    const size_t length,
+    const int pass_fd,
+    const int64_t created_us)
+{
+    // Messages are sent highest priority lane first, so this one can go
+    // straight away unless a message in its lane or a higher one is waiting
+    bool waiting = false;
+    for (int l = 0; l <= lane; ++l) {
+        waiting = waiting || !connection.out_queues[l].empty();
+    }
+    if (!waiting) {
+        const ssize_t sent = send_message(connection.fd, message, length, pass_fd);
+        if (sent == static_cast<ssize_t>(length)) {
+            RecordLaneLatency(lane, get_monotonic_time_us() - created_us);
+            return true;
+        }
+        if (sent != -1 || errno != EAGAIN) {
+            tr_error("send to \"%s\" failed: %s", MblStringPool::Get(connection.app_name), std::strerror(errno));
+            return false;
+        }
+    }
+
+    std::deque<OutMessage>& queue = connection.out_queues[lane];
+    if (queue.size() >= GetLaneDepthLimit(lane)) {
+        tr_error(
+            "\"%s\" is not reading its messages: %s lane is full",
+            MblStringPool::Get(connection.app_name),
+            Lane_to_str(lane));
+        return false;
+    }
+
+    OutMessage out_message{std::vector<uint8_t>(message, message + length), -1, created_us};
+    if (pass_fd != -1) {
+        out_message.fd = fcntl(pass_fd, F_DUPFD_CLOEXEC, 0);
+        if (out_message.fd == -1) {
+            tr_error("Failed to duplicate fd for \"%s\": %s", MblStringPool::Get(connection.app_name), std::strerror(errno));
+            return false;
+        }
+    }
+    queue.push_back(std::move(out_message));
+    ++connection.queued_count;
+
+    // Replies only queue up because of requests, so stop reading requests
+    // until the application reads its replies. Cloud requests can't wait.
+    if (lane != Lane_Control && queue.size() >= GetLaneDepthLimit(lane)) {
+        connection.reading_paused = true;
+    }
+    UpdateEpollEvents(connection);
+    return true;
+}
+
+void MblCloudConnectIpcUnixSocket::HandleWritable(Connection& connection)
+{
+    for (int l = 0; l < Lane_Count; ++l) {
+        const Lane lane = static_cast<Lane>(l);
+        std::deque<OutMessage>& queue = connection.out_queues[lane];
+        while (!queue.empty()) {
+            OutMessage& message = queue.front();
+            const ssize_t sent = send_message(connection.fd, message.data.data(), message.data.size(), message.fd);
+            if (sent == -1 && errno == EAGAIN) {
+                UpdateEpollEvents(connection);
+                return;
+            }
+            if (sent != static_cast<ssize_t>(message.data.size())) {
+                tr_error("send to \"%s\" failed: %s", MblStringPool::Get(connection.app_name), std::strerror(errno));
+                Close(connection.fd);
+                return;
+            }
+            RecordLaneLatency(lane, get_monotonic_time_us() - message.created_us);
+            if (message.fd != -1) {
+                close(message.fd);
+            }
+            queue.pop_front();
+            --connection.queued_count;
+        }
+    }
+
+    // Everything has been sent, so every lane has room again
+    connection.reading_paused = false;
+    UpdateEpollEvents(connection);
+}
+
+void MblCloudConnectIpcUnixSocket::UpdateEpollEvents(Connection& connection)
+{
+    const uint32_t events =
+        (connection.reading_paused ? 0u : static_cast<uint32_t>(EPOLLIN)) |
+        (connection.queued_count ? static_cast<uint32_t>(EPOLLOUT) : 0u);
+    if (events == connection.epoll_events) {
+        return;
+    }
+
+    struct epoll_event event;
+    std::memset(&event, 0, sizeof(event));
+    event.events = events;
+    event.data.fd = connection.fd;
+    epoll_ctl(epoll_fd_, EPOLL_CTL_MOD, connection.fd, &event);
+    connection.epoll_events = events;
+}
+
+void MblCloudConnectIpcUnixSocket::Close(const int fd)
+{
+    const auto it = connections_.find(fd);
+    assert(it != connections_.end());
+
+    const StringHandle app_name = it->second->app_name;
+    tr_info("Application \"%s\" disconnected", MblStringPool::Get(app_name));
+    broker_.ApplicationDisconnected(app_name);
+
+    // Drop the application's notifications before its name can be reused
+    {
+        MblScopedLock l(notifications_mutex_);
+        connected_app_names_.erase(app_name);
+        pending_notifications_.erase(
+            std::remove_if(
+                pending_notifications_.begin(),
+                pending_notifications_.end(),
+                [app_name](const Notification& n) { return n.app_name == app_name; }),
+            pending_notifications_.end());
+    }
+    fds_by_app_name_.erase(app_name);
+    const auto uid_it = connections_by_uid_.find(it->second->uid);
+    assert(uid_it != connections_by_uid_.end() && uid_it->second > 0);
+    if (--uid_it->second == 0) {
+        connections_by_uid_.erase(uid_it);
+    }
+    epoll_ctl(epoll_fd_, EPOLL_CTL_DEL, fd, nullptr);
+    close(fd);
+    for (const std::deque<OutMessage>& queue : it->second->out_queues) {
+        for (const OutMessage& message : queue) {
+            if (message.fd != -1) {
+                close(message.fd);
+            }
+        }
+    }
+    connections_.erase(it);
+    MblStringPool::Release(app_name);
+}
+
+void MblCloudConnectIpcUnixSocket::SendNotifications()
+{
+    sending_notifications_.clear();
+    {
+        MblScopedLock l(notifications_mutex_);
+        sending_notifications_.swap(pending_notifications_);
+        notifications_pending_.store(false, std::memory_order_relaxed);
+    }
+    if (sending_notifications_.empty()) {
+        return;
+    }
+
+    // One ResourcesUpdated message per application (or more if they don't
+    // fit in one), in the order the updates were made
+    std::stable_sort(
+        sending_notifications_.begin(),
+        sending_notifications_.end(),
+        [](const Notification& a, const Notification& b) { return a.app_name < b.app_name; });
+
+    // A member so that its memory is reused: a message can be as large as
+    // max_message_size, and this runs between application requests
+    std::vector<uint8_t>& message = notification_buffer_;
+    auto begin = sending_notifications_.begin();
+    while (begin != sending_notifications_.end()) {
+        const StringHandle app_name = begin->app_name;
+        auto end = begin;
+        while (end != sending_notifications_.end() && end->app_name == app_name) {
+            ++end;
+        }
+
+        const auto fd_it = fds_by_app_name_.find(app_name);
+        if (fd_it == fds_by_app_name_.end()) {
+            // Disconnected since the update was made
+            begin = end;
+            continue;
+        }
+        const int fd = fd_it->second;
+
+        // Latency is measured from the earliest update in the message
+        auto it = begin;
+        while (it != end) {
+            message.clear();
+            message.push_back(Type_ResourcesUpdated);
+            append_u32(message, 0);
+            const size_t count_offset = message.size();
+            append_u32(message, 0);
+
+            uint32_t count = 0;
+            const int64_t created_us = it->created_us;
+            for (; it != end; ++it) {
+                char path[24];
+                const int path_length = std::snprintf(
+                    path,
+                    sizeof(path),
+                    "/%u/%u/%u",
+                    static_cast<unsigned>(ResourcePathObjectId(it->path)),
+                    static_cast<unsigned>(ResourcePathInstanceId(it->path)),
+                    static_cast<unsigned>(ResourcePathResourceId(it->path)));
+                const size_t item_size = 4 + static_cast<size_t>(path_length) + 1 + 4 + it->value.size() + 1;
+                if (message.size() + item_size > max_message_size) {
+                    if (count == 0) {
+                        tr_error("Update of %s for \"%s\" is too long to send", path, MblStringPool::Get(app_name));
+                        ++it;
+                    }
+                    break;
+                }
+                append_string(message, path, static_cast<size_t>(path_length));
+                append_string(message, it->value.c_str(), it->value.size());
+                ++count;
+            }
+            if (count == 0) {
+                continue;
+            }
+
+            std::memcpy(&message[count_offset], &count, sizeof(count));
+            if (!Send(*connections_[fd], Lane_Control, message.data(), message.size(), -1, created_us)) {
+                Close(fd);
+                break;
+            }
+        }
+
+        begin = end;
+    }
+}
+
+void MblCloudConnectIpcUnixSocket::Cleanup()
+{
+    for (const auto& connection : connections_) {
+        close(connection.first);
+        for (const std::deque<OutMessage>& queue : connection.second->out_queues) {
+            for (const OutMessage& message : queue) {
+                if (message.fd != -1) {
+                    close(message.fd);
+                }
+            }
+        }
+    }
+    // The names aren't released: the broker may still refer to them
+    connections_.clear();
+    fds_by_app_name_.clear();
+    connections_by_uid_.clear();
+    {
+        MblScopedLock l(notifications_mutex_);
+        connected_app_names_.clear();
+    }
+
+    if (listen_fd_ != -1) {
+        close(listen_fd_);
+        listen_fd_ = -1;
+        unlink(socket_path_.c_str());
+    }
+    if (epoll_fd_ != -1) {
+        close(epoll_fd_);
+        epoll_fd_ = -1;
+    }
+    if (wakeup_fd_ != -1) {
+        close(wakeup_fd_);
+        wakeup_fd_ = -1;
+    }
+}
+
+} // namespace mbl
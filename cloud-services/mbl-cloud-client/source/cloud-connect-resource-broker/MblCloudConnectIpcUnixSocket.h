@@ -0,0 +1,196 @@
+/*
+ * Copyright (c) 2020 Arm Limited and Contributors. All rights reserved.
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ * Licensed under the Apache License, Version 2.0 (the License); you may
+ * not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an AS IS BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#ifndef MblCloudConnectIpcUnixSocket_h_
+#define MblCloudConnectIpcUnixSocket_h_
+
+#include "MblCloudConnectIpcInterface.h"
+#include "MblCloudConnectLanes.h"
+#include "MblMutex.h"
+
+#include <atomic>
+#include <deque>
+#include <memory>
+#include <pthread.h>
+#include <string>
+#include <sys/types.h>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+namespace mbl {
+
+class MblCloudConnectResourceBroker;
+
+/*! \file MblCloudConnectIpcUnixSocket.h
+ *  \brief MblCloudConnectIpcUnixSocket.
+ *  This class provides an implementation for a Unix socket IPC mechanism.
+ *
+ *  Applications connect to a SOCK_SEQPACKET socket and exchange the compact
+ *  binary messages described in MblCloudConnectIpcUnixSocketProtocol.h. Unlike
+ *  D-Bus there is no daemon in between, so each request costs one message
+ *  each way. Connections are served by an epoll loop on a thread of its own.
+ *
+ *  Each connection is a separate application, named "unix:<pid>.<n>" from
+ *  the peer's SO_PEERCRED credentials. Its resources are deregistered when
+ *  it disconnects. Each user (uid) may have at most
+ *  MBL_CLOUD_CONNECT_MAX_CONNECTIONS_PER_UID connections.
+ *
+ *  Who may connect is decided by the socket file's permissions, which are set
+ *  to MBL_CLOUD_CONNECT_SOCKET_MODE and MBL_CLOUD_CONNECT_SOCKET_GROUP before
+ *  the socket starts listening. What a connection may then do is checked by
+ *  the broker, as for D-Bus.
+ *
+ *  Messages that can't be sent straight away wait in one queue per priority
+ *  lane (see MblCloudConnectLanes.h). Cloud requests are also sent between
+ *  an application's requests rather than after all of them. When a request
+ *  lane is full, the broker stops reading from the connection until the
+ *  application reads its replies.
+ */
+class MblCloudConnectIpcUnixSocket: public MblCloudConnectIpcInterface {
+
+public:
+
+    MblCloudConnectIpcUnixSocket(MblCloudConnectResourceBroker& broker, const std::string& socket_path);
+    ~MblCloudConnectIpcUnixSocket() override;
+
+    MblError Init() override;
+
+    MblError Terminate() override;
+
+    MblError NotifyResourceUpdated(
+        StringHandle app_name,
+        ResourcePath path,
+        const std::string& value) override;
+
+    MblError NotifyResourcesUpdated(
+        StringHandle app_name,
+        const std::vector<ResourceValue>& values) override;
+
+private:
+
+    struct OutMessage
+    {
+        std::vector<uint8_t> data;
+        // Descriptor to pass with the message, owned by the queue, or -1
+        int fd;
+        // When the message's request arrived, or its notification was made
+        int64_t created_us;
+    };
+
+    struct Connection
+    {
+        int fd;
+        uid_t uid;
+        StringHandle app_name;
+        // Messages that didn't fit in the socket buffer, oldest first, by lane
+        std::deque<OutMessage> out_queues[Lane_Count];
+        size_t queued_count;
+        // Not reading requests because a request lane is full
+        bool reading_paused;
+        // Events currently registered with epoll
+        uint32_t epoll_events;
+    };
+
+    struct Notification
+    {
+        StringHandle app_name;
+        ResourcePath path;
+        std::string value;
+        int64_t created_us;
+    };
+
+    static void* ThreadMain(void* arg);
+
+    void Run();
+    void Accept();
+    void HandleReadable(Connection& connection);
+    void HandleWritable(Connection& connection);
+    bool HandleMessage(Connection& connection, const uint8_t* message, size_t length, int64_t received_us);
+    // pass_fd is a descriptor to send along with the message, or -1. It is
+    // not closed.
+    bool Send(
+        Connection& connection,
+        Lane lane,
+        const uint8_t* message,
+        size_t length,
+        int pass_fd,
+        int64_t created_us);
+    // statuses are the per-item statuses of a batch request, or nullptr
+    bool SendReply(
+        Connection& connection,
+        Lane lane,
+        uint32_t id,
+        MblError status,
+        const std::vector<MblError>* statuses,
+        int pass_fd,
+        int64_t received_us);
+    void UpdateEpollEvents(Connection& connection);
+    void Close(int fd);
+    void SendNotifications();
+    void Cleanup();
+
+    MblCloudConnectResourceBroker& broker_;
+    const std::string socket_path_;
+
+    int listen_fd_;
+    int epoll_fd_;
+    // eventfd that wakes the epoll loop to send notifications or to stop
+    int wakeup_fd_;
+
+    pthread_t thread_;
+    bool thread_running_;
+    // True between a successful Init() and Terminate()
+    std::atomic<bool> running_;
+
+    // Only used by the epoll loop thread
+    std::unordered_map<int, std::unique_ptr<Connection>> connections_;
+    std::unordered_map<StringHandle, int> fds_by_app_name_;
+    std::unordered_map<uid_t, unsigned> connections_by_uid_;
+    uint64_t connection_count_;
+    std::vector<uint8_t> receive_buffer_;
+
+    // Notifications waiting to be sent by the epoll loop thread. All pending
+    // notifications for an application are sent in one message.
+    MblMutex notifications_mutex_;
+    std::vector<Notification> pending_notifications_;
+    // Names of the connected applications. Notifications for any other name
+    // are dropped: the name is released when its application disconnects,
+    // and its handle may then be reused for another connection.
+    std::unordered_set<StringHandle> connected_app_names_;
+    // pending_notifications_ isn't empty. Lets the epoll loop thread check
+    // for cloud requests between application requests without locking.
+    std::atomic<bool> notifications_pending_;
+    // Only used by the epoll loop thread; kept to reuse its memory
+    std::vector<Notification> sending_notifications_;
+    std::vector<const char*> request_definitions_;
+    std::vector<ResourcePathValue> request_values_;
+    std::vector<MblError> reply_statuses_;
+    std::vector<uint8_t> reply_buffer_;
+    std::vector<uint8_t> notification_buffer_;
+
+    // No copying or moving (see https://github.com/isocpp/CppCoreGuidelines/blob/master/CppCoreGuidelines.md#cdefop-default-operations)
+    MblCloudConnectIpcUnixSocket(const MblCloudConnectIpcUnixSocket&) = delete;
+    MblCloudConnectIpcUnixSocket & operator = (const MblCloudConnectIpcUnixSocket&) = delete;
+    MblCloudConnectIpcUnixSocket(MblCloudConnectIpcUnixSocket&&) = delete;
+    MblCloudConnectIpcUnixSocket& operator = (MblCloudConnectIpcUnixSocket&&) = delete;
+};
+
+} // namespace mbl
+
+#endif // MblCloudConnectIpcUnixSocket_h_
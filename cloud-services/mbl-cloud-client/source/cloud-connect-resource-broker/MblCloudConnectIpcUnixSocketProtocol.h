@@ -0,0 +1,92 @@
+/*
+ * Copyright (c) 2020 Arm Limited and Contributors. All rights reserved.
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ * Licensed under the Apache License, Version 2.0 (the License); you may
+ * not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an AS IS BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#ifndef MblCloudConnectIpcUnixSocketProtocol_h_
+#define MblCloudConnectIpcUnixSocketProtocol_h_
+
+#include <cstddef>
+#include <stdint.h>
+
+namespace mbl {
+
+/*! \file MblCloudConnectIpcUnixSocketProtocol.h
+ *  \brief Wire format of the resource broker's Unix socket IPC.
+ *
+ *  Applications connect to a SOCK_SEQPACKET Unix socket, so every message
+ *  arrives whole. Integers are in host byte order (both ends are on the same
+ *  machine). A message is:
+ *
+ *      uint8_t  type
+ *      uint32_t id      request ID chosen by the application; echoed in the
+ *                       reply. 0 in notifications.
+ *      fields...
+ *
+ *  A string field is a uint32_t length followed by that many bytes, the last
+ *  of which must be a NUL.
+ *
+ *  Requests and their fields:
+ *  - Type_RegisterResources: string json
+ *  - Type_DeregisterResources: none
+ *  - Type_SetResourceValue: string path, string value
+ *  - Type_OpenValueStore: none
+ *  - Type_RegisterResourceDefinitions: uint32_t count, then count strings
+ *    json, each registered completely or not at all
+ *  - Type_SetResourceValues: uint32_t count, then count pairs of string path
+ *    and string value
+ *
+ *  Each request gets a Type_Reply message with one uint32_t field, the
+ *  MblError status. A successful Type_OpenValueStore reply also carries the
+ *  value store's memfd as SCM_RIGHTS ancillary data (see
+ *  MblResourceValueStoreLayout.h). Replies to the batch requests
+ *  (Type_RegisterResourceDefinitions and Type_SetResourceValues) go on with
+ *  a uint32_t count and then count uint32_t statuses, one per item in
+ *  request order.
+ *
+ *  Notifications:
+ *  - Type_ResourcesUpdated: uint32_t count, then count pairs of string path
+ *    and string value.
+ *
+ *  The broker sends notifications ahead of replies, and registration replies
+ *  ahead of SetResourceValue replies, so replies can arrive in a different
+ *  order from their requests: match them by id.
+ */
+namespace ccrb_socket_protocol {
+
+enum Type
+{
+    Type_RegisterResources = 0x01,
+    Type_DeregisterResources = 0x02,
+    Type_SetResourceValue = 0x03,
+    Type_OpenValueStore = 0x04,
+    Type_RegisterResourceDefinitions = 0x05,
+    Type_SetResourceValues = 0x06,
+    Type_Reply = 0x80,
+    Type_ResourcesUpdated = 0x81
+};
+
+// Size of the type and id fields
+static const size_t header_size = 1 + 4;
+
+// Largest message either side may send. Fits the default socket send buffer.
+static const size_t max_message_size = 128 * 1024;
+
+} // namespace ccrb_socket_protocol
+
+} // namespace mbl
+
+#endif // MblCloudConnectIpcUnixSocketProtocol_h_
@@ -0,0 +1,80 @@
+/*
+ * Copyright (c) 2020 Arm Limited and Contributors. All rights reserved.
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ * Licensed under the Apache License, Version 2.0 (the License); you may
+ * not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an AS IS BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include "MblCloudConnectLanes.h"
+
+#include "metrics.h"
+
+#include <cassert>
+
+#ifndef MBL_CLOUD_CONNECT_CONTROL_LANE_DEPTH
+#define MBL_CLOUD_CONNECT_CONTROL_LANE_DEPTH 256
+#endif
+
+#ifndef MBL_CLOUD_CONNECT_REGISTRATION_LANE_DEPTH
+#define MBL_CLOUD_CONNECT_REGISTRATION_LANE_DEPTH 64
+#endif
+
+#ifndef MBL_CLOUD_CONNECT_TELEMETRY_LANE_DEPTH
+#define MBL_CLOUD_CONNECT_TELEMETRY_LANE_DEPTH 1024
+#endif
+
+static mbl::metrics::Histogram g_control_latency_us("ccrb_lane_control_latency_us");
+static mbl::metrics::Histogram g_registration_latency_us("ccrb_lane_registration_latency_us");
+static mbl::metrics::Histogram g_telemetry_latency_us("ccrb_lane_telemetry_latency_us");
+
+static mbl::metrics::Histogram* const g_lane_latency_us[] = {
+    &g_control_latency_us,
+    &g_registration_latency_us,
+    &g_telemetry_latency_us
+};
+
+static_assert(sizeof(g_lane_latency_us) / sizeof(g_lane_latency_us[0]) == mbl::Lane_Count, "One histogram per lane");
+
+namespace mbl {
+
+const char* Lane_to_str(const Lane lane)
+{
+    switch (lane) {
+        case Lane_Control: return "control";
+        case Lane_Registration: return "registration";
+        case Lane_Telemetry: return "telemetry";
+        case Lane_Count: break;
+    }
+    return "unknown";
+}
+
+size_t GetLaneDepthLimit(const Lane lane)
+{
+    switch (lane) {
+        case Lane_Control: return MBL_CLOUD_CONNECT_CONTROL_LANE_DEPTH;
+        case Lane_Registration: return MBL_CLOUD_CONNECT_REGISTRATION_LANE_DEPTH;
+        case Lane_Telemetry: return MBL_CLOUD_CONNECT_TELEMETRY_LANE_DEPTH;
+        case Lane_Count: break;
+    }
+    assert(false);
+    return 0;
+}
+
+void RecordLaneLatency(const Lane lane, const int64_t latency_us)
+{
+    assert(lane < Lane_Count);
+    g_lane_latency_us[lane]->record(latency_us > 0 ? static_cast<uint64_t>(latency_us) : 0);
+}
+
+} // namespace mbl
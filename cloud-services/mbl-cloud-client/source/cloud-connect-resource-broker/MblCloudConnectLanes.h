@@ -0,0 +1,69 @@
+/*
+ * Copyright (c) 2020 Arm Limited and Contributors. All rights reserved.
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ * Licensed under the Apache License, Version 2.0 (the License); you may
+ * not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an AS IS BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#ifndef MblCloudConnectLanes_h_
+#define MblCloudConnectLanes_h_
+
+#include <cstddef>
+#include <stdint.h>
+
+namespace mbl {
+
+/*! \file MblCloudConnectLanes.h
+ *  \brief Priority lanes for traffic between the resource broker and
+ *  applications.
+ *
+ *  The Unix socket backend queues the messages it sends to an application
+ *  in one queue per lane, and always sends from the highest priority lane
+ *  that has anything waiting. So a request from the cloud never waits behind
+ *  the replies to an application's flood of SetResourceValue calls. Each of
+ *  its lanes has its own depth limit.
+ *
+ *  The D-Bus backend has no lane queues: sd-bus sends messages in order.
+ *  Both backends record the time each message spends in the broker in a
+ *  per-lane latency histogram (ccrb_lane_<name>_latency_us).
+ */
+enum Lane
+{
+    // Cloud-initiated requests to applications, e.g. a resource value
+    // written by the cloud
+    Lane_Control,
+    // Replies to RegisterResources, DeregisterResources and OpenValueStore
+    Lane_Registration,
+    // Replies to SetResourceValue
+    Lane_Telemetry,
+    Lane_Count
+};
+
+const char* Lane_to_str(Lane lane);
+
+/**
+ * @return the most messages that may wait in a lane of one application's
+ *         queue.
+ */
+size_t GetLaneDepthLimit(Lane lane);
+
+/**
+ * Record how long a message spent in the broker, from arriving (or being
+ * created) to being sent. Thread safe.
+ */
+void RecordLaneLatency(Lane lane, int64_t latency_us);
+
+} // namespace mbl
+
+#endif // MblCloudConnectLanes_h_
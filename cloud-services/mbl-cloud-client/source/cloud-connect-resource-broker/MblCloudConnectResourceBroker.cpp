@@ -18,16 +18,87 @@
 
 #include "MblCloudConnectResourceBroker.h"
 #include "MblCloudConnectIpcDBus.h"
-#include "mbed-trace/mbed_trace.h"
+#include "MblCloudConnectIpcUnixSocket.h"
+#include "MblResourceDefinitionParser.h"
+#include "MblScopedLock.h"
+#include "log.h"
+#include "log_trace.h"
+#include "metrics.h"
 
+#include <algorithm>
 #include <cassert>
+#include <cstdlib>
+#include <cstring>
 
 #define TRACE_GROUP "CCRB"
 
+// Comma separated list of the IPC backends to start: "dbus" and/or "socket".
+// The environment variable of the same name overrides this at startup.
+#ifndef MBL_CLOUD_CONNECT_IPC_BACKENDS
+#define MBL_CLOUD_CONNECT_IPC_BACKENDS "dbus"
+#endif
+
+#ifndef MBL_CLOUD_CONNECT_SOCKET_PATH
+#define MBL_CLOUD_CONNECT_SOCKET_PATH "/run/mbl-cloud-connect.sock"
+#endif
+
+// How long a resource value change waits for others to be sent to the cloud
+// client with it, and the minimum period between sends of one resource
+// unless the LwM2M server sets its pmin
+#ifndef MBL_CLOUD_CONNECT_NOTIFY_TICK_MS
+#define MBL_CLOUD_CONNECT_NOTIFY_TICK_MS 100
+#endif
+
+#ifndef MBL_CLOUD_CONNECT_NOTIFY_PMIN_MS
+#define MBL_CLOUD_CONNECT_NOTIFY_PMIN_MS 0
+#endif
+
+// Most memory one application's registered resources may use
+#ifndef MBL_CLOUD_CONNECT_APP_QUOTA_BYTES
+#define MBL_CLOUD_CONNECT_APP_QUOTA_BYTES (1024 * 1024)
+#endif
+
+// Longest resource value that may be set, by an application or the cloud.
+// The broker keeps the latest value of each resource, so this bounds that
+// memory together with the quota.
+#ifndef MBL_CLOUD_CONNECT_MAX_VALUE_LENGTH
+#define MBL_CLOUD_CONNECT_MAX_VALUE_LENGTH 4096
+#endif
+
 namespace mbl {
 
-MblCloudConnectResourceBroker::MblCloudConnectResourceBroker() 
-    : ipc_ (std::make_unique<MblCloudConnectIpcDBus>())
+static metrics::Gauge g_app_memory_bytes("ccrb_app_memory_bytes");
+static metrics::Gauge g_app_memory_max_bytes("ccrb_app_memory_max_bytes");
+static metrics::Counter g_app_quota_exceeded("ccrb_app_quota_exceeded");
+
+static uint32_t seconds_to_ms(const uint32_t seconds)
+{
+    return static_cast<uint32_t>(std::min<uint64_t>(static_cast<uint64_t>(seconds) * 1000, UINT32_MAX));
+}
+
+// Check the length of a value the cloud sets
+static MblError check_cloud_value(const ResourcePath path, const std::string& value)
+{
+    if (value.size() > MBL_CLOUD_CONNECT_MAX_VALUE_LENGTH) {
+        tr_error(
+            "Cloud update of /%u/%u/%u failed: %zu byte value is too long",
+            static_cast<unsigned>(ResourcePathObjectId(path)),
+            static_cast<unsigned>(ResourcePathInstanceId(path)),
+            static_cast<unsigned>(ResourcePathResourceId(path)),
+            value.size());
+        return Error::CCRBValueTooLong;
+    }
+    return Error::None;
+}
+
+MblCloudConnectResourceBroker::MblCloudConnectResourceBroker(MblCloudConnectCloudClientInterface& cloud_client)
+    : mutex_("ccrb_broker")
+    , resource_db_(
+        MBL_CLOUD_CONNECT_APP_QUOTA_BYTES,
+        MblResourceAcl::bytes_per_resource + MblNotificationCoalescer::bytes_per_entry)
+    , acl_(MblResourceAcl::Build(resource_db_))
+    , value_store_count_(0)
+    , notifications_(cloud_client, MBL_CLOUD_CONNECT_NOTIFY_TICK_MS, MBL_CLOUD_CONNECT_NOTIFY_PMIN_MS)
 {
     tr_debug("MblCloudConnectResourceBroker::MblCloudConnectResourceBroker");
 }
@@ -35,18 +106,575 @@ MblCloudConnectResourceBroker::MblCloudConnectResourceBroker()
 MblCloudConnectResourceBroker::~MblCloudConnectResourceBroker()
 {
     tr_debug("MblCloudConnectResourceBroker::~MblCloudConnectResourceBroker");
+
+    // The IPC threads call into the broker, so stop them before the members
+    // they use are destroyed
+    for (const auto& ipc : ipcs_) {
+        ipc->Terminate();
+    }
 }
 
 MblError MblCloudConnectResourceBroker::Init()
+{
+    const char* backends = std::getenv("MBL_CLOUD_CONNECT_IPC_BACKENDS");
+    if (!backends || backends[0] == '\0') {
+        backends = MBL_CLOUD_CONNECT_IPC_BACKENDS;
+    }
+    return Init(backends);
+}
+
+MblError MblCloudConnectResourceBroker::Init(const char* const backends)
 {
     tr_debug("MblCloudConnectResourceBroker::Init");
+    assert(ipcs_.empty());
+
+    MblError ret = notifications_.Init();
+    if(Error::None != ret) {
+        return ret;
+    }
+
+    const char* pos = backends;
+    while (*pos != '\0') {
+        const char* const end = std::strchr(pos, ',');
+        const std::string name(pos, end ? static_cast<size_t>(end - pos) : std::strlen(pos));
+        if (name == "dbus") {
+            ipcs_.push_back(std::make_unique<MblCloudConnectIpcDBus>(*this));
+        }
+        else if (name == "socket") {
+            ipcs_.push_back(std::make_unique<MblCloudConnectIpcUnixSocket>(*this, MBL_CLOUD_CONNECT_SOCKET_PATH));
+        }
+        else {
+            tr_error("Unknown IPC backend \"%s\" in \"%s\"", name.c_str(), backends);
+            return Error::CCRBIpcInitFailed;
+        }
+        if (!end) {
+            break;
+        }
+        pos = end + 1;
+    }
+
+    for (const auto& ipc : ipcs_) {
+        ret = ipc->Init();
+        if(Error::None != ret) {
+            MblLogErrorScope log_error(ret);
+            tr_error("Init ipc failed with error %s", MblError_to_str(ret));
+            return ret;
+        }
+    }
+
+    tr_info("Started IPC backends \"%s\"", backends);
+    return Error::None;
+}
+
+MblError MblCloudConnectResourceBroker::RegisterResources(
+    MblCloudConnectIpcInterface& ipc,
+    const StringHandle app_name,
+    const char* const json,
+    const size_t length)
+{
+    tr_debug("MblCloudConnectResourceBroker::RegisterResources");
+
+    MblScopedLock l(mutex_);
+
+    MblCloudConnectResourceDatabase::AppHandle app = MblCloudConnectResourceDatabase::invalid_app;
+    MblError ret = resource_db_.AddApplication(app_name, app);
+    if(Error::None != ret) {
+        tr_error("Register resources of \"%s\" failed with error %s", MblStringPool::Get(app_name), MblError_to_str(ret));
+        return ret;
+    }
+
+    ret = AddDefinition(app, app_name, json, length);
+    if(Error::None != ret) {
+        const MblError remove_ret = resource_db_.RemoveApplication(app);
+        assert(Error::None == remove_ret);
+        (void) remove_ret;
+        return ret;
+    }
+
+    if (app_ipcs_.size() <= app) {
+        app_ipcs_.resize(app + 1);
+    }
+    app_ipcs_[app] = &ipc;
+    RebuildAcl();
+
+    tr_info(
+        "Registered %zu resources of \"%s\"",
+        resource_db_.GetResources(app).size(),
+        MblStringPool::Get(app_name));
+    return Error::None;
+}
+
+MblError MblCloudConnectResourceBroker::RegisterResourceDefinitions(
+    MblCloudConnectIpcInterface& ipc,
+    const StringHandle app_name,
+    const std::vector<const char*>& definitions,
+    std::vector<MblError>& statuses)
+{
+    tr_debug("MblCloudConnectResourceBroker::RegisterResourceDefinitions");
+
+    MblScopedLock l(mutex_);
+
+    MblCloudConnectResourceDatabase::AppHandle app = MblCloudConnectResourceDatabase::invalid_app;
+    MblError ret = resource_db_.AddApplication(app_name, app);
+    if(Error::None != ret) {
+        tr_error("Register resources of \"%s\" failed with error %s", MblStringPool::Get(app_name), MblError_to_str(ret));
+        statuses.assign(definitions.size(), ret);
+        return ret;
+    }
+
+    statuses.resize(definitions.size());
+    size_t registered = 0;
+    for (size_t i = 0; i < definitions.size(); ++i) {
+        statuses[i] = AddDefinition(app, app_name, definitions[i], std::strlen(definitions[i]));
+        if(Error::None == statuses[i]) {
+            ++registered;
+        }
+    }
+
+    if (registered == 0) {
+        const MblError remove_ret = resource_db_.RemoveApplication(app);
+        assert(Error::None == remove_ret);
+        (void) remove_ret;
+        return statuses.empty() ? Error::CCRBInvalidResourceDefinition : statuses[0];
+    }
+
+    if (app_ipcs_.size() <= app) {
+        app_ipcs_.resize(app + 1);
+    }
+    app_ipcs_[app] = &ipc;
+    RebuildAcl();
+
+    tr_info(
+        "Registered %zu resources of \"%s\" from %zu of %zu definitions",
+        resource_db_.GetResources(app).size(),
+        MblStringPool::Get(app_name),
+        registered,
+        definitions.size());
+    return Error::None;
+}
+
+MblError MblCloudConnectResourceBroker::DeregisterResources(const StringHandle app_name)
+{
+    tr_debug("MblCloudConnectResourceBroker::DeregisterResources");
+
+    MblScopedLock l(mutex_);
+
+    const MblCloudConnectResourceDatabase::AppHandle app = resource_db_.FindApplication(app_name);
+    if(MblCloudConnectResourceDatabase::invalid_app == app) {
+        tr_error("Deregister resources of \"%s\" failed: not registered", MblStringPool::Get(app_name));
+        return Error::CCRBApplicationNotFound;
+    }
+
+    tr_info("Deregistering resources of \"%s\"", MblStringPool::Get(app_name));
+    return RemoveApplication(app);
+}
+
+void MblCloudConnectResourceBroker::ApplicationDisconnected(const StringHandle app_name)
+{
+    MblScopedLock l(mutex_);
+
+    const MblCloudConnectResourceDatabase::AppHandle app = resource_db_.FindApplication(app_name);
+    if(MblCloudConnectResourceDatabase::invalid_app != app) {
+        tr_info("\"%s\" disconnected, deregistering its resources", MblStringPool::Get(app_name));
+        RemoveApplication(app);
+    }
+}
+
+MblError MblCloudConnectResourceBroker::SetResourceValue(
+    const StringHandle app_name,
+    const char* const path,
+    const char* const value)
+{
+    // No lock: an application's requests are handled one at a time on its
+    // backend's thread, so it can't deregister the resource while this
+    // request is being handled
+    const std::shared_ptr<const MblResourceAcl> acl = std::atomic_load(&acl_);
+    return SetResourceValue(*acl, acl->FindApplication(app_name), app_name, path, value);
+}
+
+MblError MblCloudConnectResourceBroker::SetResourceValues(
+    const StringHandle app_name,
+    const std::vector<ResourcePathValue>& values,
+    std::vector<MblError>& statuses)
+{
+    const std::shared_ptr<const MblResourceAcl> acl = std::atomic_load(&acl_);
+    const MblCloudConnectResourceDatabase::AppHandle app = acl->FindApplication(app_name);
+
+    statuses.resize(values.size());
+    for (size_t i = 0; i < values.size(); ++i) {
+        statuses[i] = SetResourceValue(*acl, app, app_name, values[i].path, values[i].value);
+    }
+    return Error::None;
+}
+
+MblError MblCloudConnectResourceBroker::OpenValueStore(const StringHandle app_name, int& fd)
+{
+    tr_debug("MblCloudConnectResourceBroker::OpenValueStore");
+
+    MblScopedLock l(mutex_);
+
+    const MblCloudConnectResourceDatabase::AppHandle app = resource_db_.FindApplication(app_name);
+    if(MblCloudConnectResourceDatabase::invalid_app == app) {
+        tr_error("Open value store of \"%s\" failed: not registered", MblStringPool::Get(app_name));
+        return Error::CCRBApplicationNotFound;
+    }
+
+    if (value_stores_.size() <= app) {
+        value_stores_.resize(app + 1);
+    }
+    if (!value_stores_[app]) {
+        std::shared_ptr<MblResourceValueStore> store(new MblResourceValueStore());
+        const MblError ret = store->Init(resource_db_.GetResources(app));
+        if(Error::None != ret) {
+            tr_error("Open value store of \"%s\" failed with error %s", MblStringPool::Get(app_name), MblError_to_str(ret));
+            return ret;
+        }
+        value_stores_[app] = std::move(store);
+        if (value_store_count_++ == 0) {
+            notifications_.SetPolling(true);
+        }
+        tr_info("Created value store for \"%s\"", MblStringPool::Get(app_name));
+    }
+
+    fd = value_stores_[app]->DupFd();
+    return (fd == -1) ? Error::CCRBValueStoreFailed : Error::None;
+}
 
-    assert(ipc_);
-    MblError ret = ipc_->Init();
+MblError MblCloudConnectResourceBroker::GetResourceValue(const ResourcePath path, std::string& value)
+{
+    MblError ret = CheckCloudAccess(path, MblResourceAcl::Method_Get, "Get");
     if(Error::None != ret) {
-        tr_error("Init ipc failed with error %s", MblError_to_str(ret));
+        return ret;
+    }
+
+    // Reading the store may have to wait for the application to finish
+    // writing the slot, so only look it up under mutex_
+    std::shared_ptr<MblResourceValueStore> store;
+    size_t slot = 0;
+    {
+        MblScopedLock l(mutex_);
+
+        MblCloudConnectResourceDatabase::AppHandle owner = MblCloudConnectResourceDatabase::invalid_app;
+        const ResourceDescriptor* const descriptor = resource_db_.FindResource(path, &owner);
+        if(!descriptor) {
+            return Error::CCRBResourceNotFound;
+        }
+        value = descriptor->value;
+
+        // The store has a slot for each resource, in the same order as the
+        // application's descriptors
+        if (owner < value_stores_.size() && value_stores_[owner]) {
+            store = value_stores_[owner];
+            slot = static_cast<size_t>(descriptor - resource_db_.GetResources(owner).data());
+        }
+    }
+
+    if (store) {
+        std::string written_value;
+        bool written = false;
+        ret = store->Read(slot, written_value, written);
+        if(Error::None != ret) {
+            return ret;
+        }
+        if (written) {
+            value.swap(written_value);
+        }
+    }
+    return Error::None;
+}
+
+void MblCloudConnectResourceBroker::HandleNotificationTimer()
+{
+    PollValueStores();
+    notifications_.HandleTimer();
+}
+
+void MblCloudConnectResourceBroker::PollValueStores()
+{
+    polled_stores_.clear();
+    {
+        MblScopedLock l(mutex_);
+        if (value_store_count_ == 0) {
+            return;
+        }
+        for (const auto& store : value_stores_) {
+            if (store) {
+                polled_stores_.push_back(store);
+            }
+        }
+    }
+
+    polled_values_.clear();
+    polled_counts_.clear();
+    for (const auto& store : polled_stores_) {
+        polled_counts_.push_back(store->ReadChanged(polled_values_));
+    }
+    if (polled_values_.empty()) {
+        polled_stores_.clear();
+        return;
+    }
+
+    // Drop the values of stores whose application was removed meanwhile, so
+    // that nothing is sent for its resources
+    {
+        MblScopedLock l(mutex_);
+        size_t next = 0;
+        for (size_t i = 0; i < polled_stores_.size(); ++i) {
+            const bool current = std::find(value_stores_.begin(), value_stores_.end(), polled_stores_[i]) != value_stores_.end();
+            for (size_t n = 0; n < polled_counts_[i]; ++n, ++next) {
+                if (current) {
+                    const ResourceValue& v = polled_values_[next];
+                    notifications_.Update(v.path, v.value.data(), v.value.size());
+                }
+            }
+        }
+    }
+    polled_stores_.clear();
+}
+
+MblError MblCloudConnectResourceBroker::SetNotificationPeriods(
+    const ResourcePath path,
+    const uint32_t pmin_s,
+    const uint32_t pmax_s)
+{
+    const MblError ret = CheckCloudAccess(path, MblResourceAcl::Method_Observe, "Observe");
+    if(Error::None != ret) {
+        return ret;
+    }
+
+    MblScopedLock l(mutex_);
+
+    if(!resource_db_.FindResource(path)) {
+        return Error::CCRBResourceNotFound;
+    }
+    notifications_.SetPeriods(path, seconds_to_ms(pmin_s), seconds_to_ms(pmax_s));
+    return Error::None;
+}
+
+MblError MblCloudConnectResourceBroker::ResourceUpdatedByCloud(const ResourcePath path, const std::string& value)
+{
+    MblError ret = CheckCloudAccess(path, MblResourceAcl::Method_Put, "Cloud update");
+    if(Error::None == ret) {
+        ret = check_cloud_value(path, value);
+    }
+    if(Error::None != ret) {
+        return ret;
+    }
+
+    StringHandle app_name = MblStringPool::invalid_handle;
+    MblCloudConnectIpcInterface* ipc = nullptr;
+    {
+        MblScopedLock l(mutex_);
+
+        MblCloudConnectResourceDatabase::AppHandle owner = MblCloudConnectResourceDatabase::invalid_app;
+        if(!resource_db_.FindResource(path, &owner)) {
+            tr_error(
+                "Cloud update of /%u/%u/%u failed: not registered",
+                static_cast<unsigned>(ResourcePathObjectId(path)),
+                static_cast<unsigned>(ResourcePathInstanceId(path)),
+                static_cast<unsigned>(ResourcePathResourceId(path)));
+            return Error::CCRBResourceNotFound;
+        }
+        // The application may disconnect once mutex_ is released, and its
+        // name must not be reused until the IPC backend has seen it
+        app_name = resource_db_.GetApplicationName(owner);
+        MblStringPool::AddRef(app_name);
+        ipc = app_ipcs_[owner];
+    }
+
+    const MblError notify_ret = ipc->NotifyResourceUpdated(app_name, path, value);
+    MblStringPool::Release(app_name);
+    return notify_ret;
+}
+
+MblError MblCloudConnectResourceBroker::ResourcesUpdatedByCloud(
+    const std::vector<ResourceValue>& values,
+    std::vector<MblError>& statuses)
+{
+    struct Owner
+    {
+        MblCloudConnectResourceDatabase::AppHandle app;
+        StringHandle app_name;
+        MblCloudConnectIpcInterface* ipc;
+        std::vector<ResourceValue> values;
+    };
+
+    statuses.resize(values.size());
+    for (size_t i = 0; i < values.size(); ++i) {
+        statuses[i] = CheckCloudAccess(values[i].path, MblResourceAcl::Method_Put, "Cloud update");
+        if(Error::None == statuses[i]) {
+            statuses[i] = check_cloud_value(values[i].path, values[i].value);
+        }
     }
+
+    // Usually all of the values belong to one or two applications
+    std::vector<Owner> owners;
+    {
+        MblScopedLock l(mutex_);
+
+        for (size_t i = 0; i < values.size(); ++i) {
+            if(Error::None != statuses[i]) {
+                continue;
+            }
+
+            MblCloudConnectResourceDatabase::AppHandle app = MblCloudConnectResourceDatabase::invalid_app;
+            if(!resource_db_.FindResource(values[i].path, &app)) {
+                statuses[i] = Error::CCRBResourceNotFound;
+                continue;
+            }
+            auto owner = std::find_if(
+                owners.begin(),
+                owners.end(),
+                [app](const Owner& o) { return o.app == app; });
+            if (owner == owners.end()) {
+                // Held until notified, as in ResourceUpdatedByCloud()
+                owners.push_back(Owner{app, resource_db_.GetApplicationName(app), app_ipcs_[app], {}});
+                MblStringPool::AddRef(owners.back().app_name);
+                owner = owners.end() - 1;
+            }
+            owner->values.push_back(values[i]);
+        }
+    }
+
+    for (const Owner& owner : owners) {
+        owner.ipc->NotifyResourcesUpdated(owner.app_name, owner.values);
+        MblStringPool::Release(owner.app_name);
+    }
+    return Error::None;
+}
+
+MblError MblCloudConnectResourceBroker::AddDefinition(
+    const MblCloudConnectResourceDatabase::AppHandle app,
+    const StringHandle app_name,
+    const char* const json,
+    const size_t length)
+{
+    // Resources go straight into the database as they are parsed, so undo
+    // the whole definition if any part of it is bad
+    const MblCloudConnectResourceDatabase::ResourceMark mark = resource_db_.GetResourceMark(app);
+    MblResourceDefinitionParser parser(resource_db_, app);
+    const MblError ret = parser.Parse(json, length);
+    if(Error::None != ret) {
+        MblLogErrorScope log_error(ret);
+        tr_error("Register resources of \"%s\" failed with error %s", MblStringPool::Get(app_name), MblError_to_str(ret));
+        resource_db_.RemoveResourcesSince(app, mark);
+        if(Error::CCRBQuotaExceeded == ret) {
+            g_app_quota_exceeded.add();
+        }
+    }
+    return ret;
+}
+
+MblError MblCloudConnectResourceBroker::SetResourceValue(
+    const MblResourceAcl& acl,
+    const MblCloudConnectResourceDatabase::AppHandle app,
+    const StringHandle app_name,
+    const char* const path,
+    const char* const value)
+{
+    ResourcePath resource_path = 0;
+    const MblError ret = ResourcePathFromString(path, std::strlen(path), resource_path);
+    if(Error::None != ret) {
+        tr_error("Set resource value by \"%s\" failed: invalid path \"%s\"", MblStringPool::Get(app_name), path);
+        return ret;
+    }
+
+    const MblResourceAcl::ResourceId id = acl.FindResource(resource_path);
+    if(MblResourceAcl::invalid_resource == id) {
+        tr_error("Set resource value by \"%s\" failed: %s is not registered", MblStringPool::Get(app_name), path);
+        return Error::CCRBResourceNotFound;
+    }
+    if(!acl.IsOwner(app, id)) {
+        tr_error("Set resource value by \"%s\" failed: %s belongs to another application", MblStringPool::Get(app_name), path);
+        return Error::CCRBAccessDenied;
+    }
+
+    const size_t length = strnlen(value, MBL_CLOUD_CONNECT_MAX_VALUE_LENGTH + 1);
+    if (length > MBL_CLOUD_CONNECT_MAX_VALUE_LENGTH) {
+        tr_error(
+            "Set resource value by \"%s\" failed: value of %s is longer than %u bytes",
+            MblStringPool::Get(app_name),
+            path,
+            static_cast<unsigned>(MBL_CLOUD_CONNECT_MAX_VALUE_LENGTH));
+        return Error::CCRBValueTooLong;
+    }
+
+    notifications_.Update(resource_path, value, length);
+    return Error::None;
+}
+
+MblError MblCloudConnectResourceBroker::RemoveApplication(const MblCloudConnectResourceDatabase::AppHandle app)
+{
+    if (app < value_stores_.size() && value_stores_[app]) {
+        value_stores_[app].reset();
+        if (--value_store_count_ == 0) {
+            notifications_.SetPolling(false);
+        }
+    }
+    notifications_.Remove(resource_db_.GetResources(app));
+    const MblError ret = resource_db_.RemoveApplication(app);
+    RebuildAcl();
     return ret;
 }
 
+void MblCloudConnectResourceBroker::RebuildAcl()
+{
+    std::atomic_store(&acl_, MblResourceAcl::Build(resource_db_));
+
+    size_t total = 0;
+    size_t max = 0;
+    for (MblCloudConnectResourceDatabase::AppHandle app = 0; app < resource_db_.GetApplicationLimit(); ++app) {
+        if (resource_db_.IsApplication(app)) {
+            const size_t footprint = resource_db_.GetApplicationFootprint(app);
+            total += footprint;
+            max = std::max(max, footprint);
+        }
+    }
+    g_app_memory_bytes.set(static_cast<int64_t>(total));
+    g_app_memory_max_bytes.set(static_cast<int64_t>(max));
+}
+
+void MblCloudConnectResourceBroker::LogApplicationFootprints()
+{
+    MblScopedLock l(mutex_);
+
+    for (MblCloudConnectResourceDatabase::AppHandle app = 0; app < resource_db_.GetApplicationLimit(); ++app) {
+        if (resource_db_.IsApplication(app)) {
+            tr_info(
+                "Application \"%s\": %zu resources in %zu bytes",
+                MblStringPool::Get(resource_db_.GetApplicationName(app)),
+                resource_db_.GetResources(app).size(),
+                resource_db_.GetApplicationFootprint(app));
+        }
+    }
+}
+
+MblError MblCloudConnectResourceBroker::CheckCloudAccess(
+    const ResourcePath path,
+    const uint8_t method,
+    const char* const request) const
+{
+    const std::shared_ptr<const MblResourceAcl> acl = std::atomic_load(&acl_);
+    const MblResourceAcl::ResourceId id = acl->FindResource(path);
+    if(MblResourceAcl::invalid_resource == id) {
+        tr_error(
+            "%s of /%u/%u/%u failed: not registered",
+            request,
+            static_cast<unsigned>(ResourcePathObjectId(path)),
+            static_cast<unsigned>(ResourcePathInstanceId(path)),
+            static_cast<unsigned>(ResourcePathResourceId(path)));
+        return Error::CCRBResourceNotFound;
+    }
+    if(!acl->IsAllowed(id, method)) {
+        tr_error(
+            "%s of /%u/%u/%u failed: not allowed by its resource definition",
+            request,
+            static_cast<unsigned>(ResourcePathObjectId(path)),
+            static_cast<unsigned>(ResourcePathInstanceId(path)),
+            static_cast<unsigned>(ResourcePathResourceId(path)));
+        return Error::CCRBAccessDenied;
+    }
+    return Error::None;
+}
+
 } // namespace mbl
@@ -19,9 +19,17 @@
 #ifndef MblCloudConnectResourceBroker_h_
 #define MblCloudConnectResourceBroker_h_
 
+#include "MblCloudConnectCloudClientInterface.h"
 #include "MblCloudConnectIpcInterface.h"
+#include "MblCloudConnectResourceDatabase.h"
+#include "MblMutex.h"
+#include "MblNotificationCoalescer.h"
+#include "MblResourceAcl.h"
+#include "MblResourceValueStore.h"
 
 #include  <memory>
+#include <string>
+#include <vector>
 
 namespace mbl {
 
@@ -29,16 +37,231 @@ class MblCloudConnectResourceBroker {
 
 public:
 
-    MblCloudConnectResourceBroker();
+    // Resource value changes are sent to cloud_client
+    explicit MblCloudConnectResourceBroker(MblCloudConnectCloudClientInterface& cloud_client);
     ~MblCloudConnectResourceBroker();
 
-    // Initialize
+    // Initialize: start the IPC backends selected by
+    // MBL_CLOUD_CONNECT_IPC_BACKENDS
     MblError Init();
 
+    // Initialize with a comma separated list of IPC backends, which may be
+    // empty, for example when applications connect through an
+    // MblCloudConnectIpcLoopback instead
+    MblError Init(const char* backends);
+
+    // Notification tick timerfd. The event loop must call
+    // HandleNotificationTimer() when it is readable.
+    int GetNotificationFd() const { return notifications_.GetFd(); }
+
+    // Pick up the values applications have written to their value stores,
+    // and send the resource value changes that are due to the cloud client
+    void HandleNotificationTimer();
+
+    // Log how much memory each registered application's resources use.
+    // Thread safe.
+    void LogApplicationFootprints();
+
+    // Requests from applications. These are called by the IPC backends on
+    // their own threads, and are thread safe.
+
+    /**
+     * Register an application's LwM2M resources from its resource definition
+     * JSON (see MblResourceDefinitionParser.h). Either all of the resources
+     * are added or none are.
+     *
+     * @return Error::None, Error::CCRBApplicationAlreadyExists,
+     *         Error::CCRBInvalidJson, Error::CCRBInvalidResourceDefinition,
+     *         Error::CCRBResourceAlreadyExists or Error::CCRBQuotaExceeded
+     *         (the application's resources would use too much memory).
+     *
+     * @param ipc the backend the application is connected through, which
+     *        notifications for the application are sent through.
+     */
+    MblError RegisterResources(
+        MblCloudConnectIpcInterface& ipc,
+        StringHandle app_name,
+        const char* json,
+        size_t length);
+
+    /**
+     * Register an application's LwM2M resources from several resource
+     * definitions in one request. Each definition is registered completely
+     * or not at all, independently of the others.
+     *
+     * @param statuses set to one status per definition, as
+     *        RegisterResources() would return for it.
+     * @return Error::None if any definition was registered (the application
+     *         is then registered), Error::CCRBApplicationAlreadyExists, or
+     *         the status of the first definition if none were.
+     */
+    MblError RegisterResourceDefinitions(
+        MblCloudConnectIpcInterface& ipc,
+        StringHandle app_name,
+        const std::vector<const char*>& definitions,
+        std::vector<MblError>& statuses);
+
+    /**
+     * Remove all of an application's resources.
+     *
+     * @return Error::None or Error::CCRBApplicationNotFound.
+     */
+    MblError DeregisterResources(StringHandle app_name);
+
+    /**
+     * Like DeregisterResources(), for an application that has gone away
+     * (which need not have registered anything).
+     */
+    void ApplicationDisconnected(StringHandle app_name);
+
+    /**
+     * Set the value of one of an application's resources. The value is sent
+     * to the cloud client on a later notification tick, unless another
+     * value replaces it first.
+     *
+     * @param path resource path of the form "/object/instance/resource".
+     * @return Error::None, Error::CCRBInvalidResourcePath,
+     *         Error::CCRBResourceNotFound, Error::CCRBAccessDenied or
+     *         Error::CCRBValueTooLong (longer than
+     *         MBL_CLOUD_CONNECT_MAX_VALUE_LENGTH).
+     */
+    MblError SetResourceValue(StringHandle app_name, const char* path, const char* value);
+
+    /**
+     * Set the values of several of an application's resources in one
+     * request.
+     *
+     * @param statuses set to one status per value, as SetResourceValue()
+     *        would return for it.
+     * @return Error::None.
+     */
+    MblError SetResourceValues(
+        StringHandle app_name,
+        const std::vector<ResourcePathValue>& values,
+        std::vector<MblError>& statuses);
+
+    /**
+     * Get a shared memory value store for an application's resources (see
+     * MblResourceValueStoreLayout.h). It is created on first use and lasts
+     * until the application is deregistered. Values written to it are read
+     * on each notification tick and sent like those of SetResourceValue().
+     *
+     * @param fd set to a new descriptor for the store, which the caller must
+     *        close.
+     * @return Error::None, Error::CCRBApplicationNotFound or
+     *         Error::CCRBValueStoreFailed.
+     */
+    MblError OpenValueStore(StringHandle app_name, int& fd);
+
+    // Requests from the cloud side. Each is checked against the methods the
+    // resource's definition allows.
+
+    /**
+     * Get the current value of a resource, for example to notify an
+     * observer. This is the latest value in the owner's value store if it
+     * has written one, otherwise the value in its resource definition.
+     *
+     * @return Error::None, Error::CCRBResourceNotFound,
+     *         Error::CCRBAccessDenied (no "get" operation) or
+     *         Error::CCRBValueStoreBusy.
+     */
+    MblError GetResourceValue(ResourcePath path, std::string& value);
+
+    /**
+     * Set how often changes to a resource may and must be sent (the LwM2M
+     * pmin and pmax attributes).
+     *
+     * @param pmax_s 0 for no maximum period.
+     * @return Error::None, Error::CCRBResourceNotFound or
+     *         Error::CCRBAccessDenied (not observable).
+     */
+    MblError SetNotificationPeriods(ResourcePath path, uint32_t pmin_s, uint32_t pmax_s);
+
+    /**
+     * Tell the application that owns a resource that the cloud changed its
+     * value.
+     *
+     * @return Error::None, Error::CCRBResourceNotFound,
+     *         Error::CCRBAccessDenied (no "put" operation) or
+     *         Error::CCRBValueTooLong.
+     */
+    MblError ResourceUpdatedByCloud(ResourcePath path, const std::string& value);
+
+    /**
+     * Like ResourceUpdatedByCloud() for several resources. Each owning
+     * application is told about all of its values at once.
+     *
+     * @param statuses set to one status per value, as
+     *        ResourceUpdatedByCloud() would return for it.
+     * @return Error::None.
+     */
+    MblError ResourcesUpdatedByCloud(const std::vector<ResourceValue>& values, std::vector<MblError>& statuses);
+
 private:
 
-    std::unique_ptr<MblCloudConnectIpcInterface> ipc_;
- 
+    // Remove an application and everything the broker keeps for it. Called
+    // with mutex_ held.
+    MblError RemoveApplication(MblCloudConnectResourceDatabase::AppHandle app);
+
+    // Parse one resource definition into an application's resources, or
+    // leave them unchanged on failure. Called with mutex_ held.
+    MblError AddDefinition(
+        MblCloudConnectResourceDatabase::AppHandle app,
+        StringHandle app_name,
+        const char* json,
+        size_t length);
+
+    // SetResourceValue() for an application already looked up in acl
+    MblError SetResourceValue(
+        const MblResourceAcl& acl,
+        MblCloudConnectResourceDatabase::AppHandle app,
+        StringHandle app_name,
+        const char* path,
+        const char* value);
+
+    // Replace acl_ with the access rights of resource_db_, and update the
+    // memory metrics. Called with mutex_ held.
+    void RebuildAcl();
+
+    // Check a cloud request against acl_, logging a failure
+    MblError CheckCloudAccess(ResourcePath path, uint8_t method, const char* request) const;
+
+    // Pass the values written to the value stores since the last call to
+    // notifications_. The stores are read without mutex_ held. Called on the
+    // event loop thread.
+    void PollValueStores();
+
+    std::vector<std::unique_ptr<MblCloudConnectIpcInterface>> ipcs_;
+
+    // Protects resource_db_, app_ipcs_ and value_stores_, which are used by
+    // the IPC threads
+    MblMutex mutex_;
+
+    // LwM2M resources registered by each application
+    MblCloudConnectResourceDatabase resource_db_;
+
+    // Access rights compiled from resource_db_. Replaced under mutex_ and
+    // read with std::atomic_load() without it.
+    std::shared_ptr<const MblResourceAcl> acl_;
+
+    // The backend each application is connected through, indexed by
+    // application handle
+    std::vector<MblCloudConnectIpcInterface*> app_ipcs_;
+
+    // Value store of each application that asked for one, indexed by
+    // application handle. Shared so that a store can be read without
+    // mutex_ while its application is removed.
+    std::vector<std::shared_ptr<MblResourceValueStore>> value_stores_;
+    size_t value_store_count_;
+
+    // Only used by PollValueStores(); kept to reuse their memory
+    std::vector<std::shared_ptr<MblResourceValueStore>> polled_stores_;
+    std::vector<size_t> polled_counts_;
+    std::vector<ResourceValue> polled_values_;
+
+    // Resource value changes on their way to the cloud client
+    MblNotificationCoalescer notifications_;
+
 };
 
 } // namespace mbl
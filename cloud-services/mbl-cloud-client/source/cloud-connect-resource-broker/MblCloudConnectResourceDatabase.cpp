@@ -0,0 +1,353 @@
+/*
+ * Copyright (c) 2020 Arm Limited and Contributors. All rights reserved.
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ * Licensed under the Apache License, Version 2.0 (the License); you may
+ * not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an AS IS BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include "MblCloudConnectResourceDatabase.h"
+#include "log_trace.h"
+
+#include <cassert>
+#include <cstring>
+
+#define TRACE_GROUP "CCRB"
+
+// Smallest index size. The index is kept at most half full so that probe
+// sequences stay short.
+static const size_t g_min_index_capacity = 64;
+
+// Smallest array of descriptors allocated for an application
+static const size_t g_min_resources_capacity = 8;
+
+namespace mbl {
+
+const MblCloudConnectResourceDatabase::AppHandle MblCloudConnectResourceDatabase::invalid_app;
+const ResourcePath MblCloudConnectResourceDatabase::empty_path;
+const ResourcePath MblCloudConnectResourceDatabase::deleted_path;
+
+static bool parse_id(const char*& pos, const char* const end, uint16_t& id)
+{
+    uint32_t value = 0;
+    const char* const start = pos;
+    while (pos != end && *pos >= '0' && *pos <= '9') {
+        value = value * 10 + static_cast<uint32_t>(*pos - '0');
+        if (value > UINT16_MAX) {
+            return false;
+        }
+        ++pos;
+    }
+    id = static_cast<uint16_t>(value);
+    return pos != start;
+}
+
+MblError ResourcePathFromString(const char* const str, const size_t length, ResourcePath& path)
+{
+    const char* pos = str;
+    const char* const end = str + length;
+    if (pos != end && *pos == '/') {
+        ++pos;
+    }
+
+    uint16_t ids[3];
+    for (size_t i = 0; i < 3; ++i) {
+        if (i != 0) {
+            if (pos == end || *pos != '/') {
+                return Error::CCRBInvalidResourcePath;
+            }
+            ++pos;
+        }
+        if (!parse_id(pos, end, ids[i])) {
+            return Error::CCRBInvalidResourcePath;
+        }
+    }
+    if (pos != end) {
+        return Error::CCRBInvalidResourcePath;
+    }
+
+    path = MakeResourcePath(ids[0], ids[1], ids[2]);
+    return Error::None;
+}
+
+// Make room in a vector allocated from an arena for extra more elements, so
+// that adding them won't allocate. Growth is geometric, falling back to
+// just enough when that would exceed the arena's quota.
+template <typename Vector>
+static bool reserve_in_arena(MblArena& arena, Vector& vector, const size_t extra, const size_t min_capacity)
+{
+    typedef typename Vector::value_type T;
+
+    const size_t needed = vector.size() + extra;
+    if (needed <= vector.capacity()) {
+        return true;
+    }
+    size_t capacity = (vector.capacity() < min_capacity) ? min_capacity : vector.capacity() * 2;
+    while (capacity < needed) {
+        capacity *= 2;
+    }
+    if (!arena.CanAllocate(capacity * sizeof(T), alignof(T))) {
+        capacity = needed;
+        if (!arena.CanAllocate(capacity * sizeof(T), alignof(T))) {
+            return false;
+        }
+    }
+    vector.reserve(capacity);
+    return true;
+}
+
+MblCloudConnectResourceDatabase::MblCloudConnectResourceDatabase(
+    const size_t app_quota,
+    const size_t resource_heap_bytes)
+    : app_quota_(app_quota)
+    // The index has a power of two slots and is at most half full, so it
+    // takes up to four slots per resource
+    , resource_charge_(4 * sizeof(IndexSlot) + resource_heap_bytes)
+    , apps_()
+    , index_(g_min_index_capacity)
+    , index_mask_(g_min_index_capacity - 1)
+    , resource_count_(0)
+    , deleted_count_(0)
+{
+}
+
+MblError MblCloudConnectResourceDatabase::AddApplication(const StringHandle app_name, AppHandle& app)
+{
+    if (FindApplication(app_name) != invalid_app) {
+        return Error::CCRBApplicationAlreadyExists;
+    }
+
+    size_t handle = 0;
+    while (handle < apps_.size() && apps_[handle].in_use) {
+        ++handle;
+    }
+    if (handle == apps_.size()) {
+        apps_.emplace_back();
+    }
+
+    Application& new_app = apps_[handle];
+    new_app.in_use = true;
+    new_app.name = app_name;
+    new_app.arena.reset(new MblArena(app_quota_));
+    new_app.resources = ResourceList(ResourceList::allocator_type(new_app.arena.get()));
+
+    app = static_cast<AppHandle>(handle);
+    tr_debug("Added application \"%s\" (handle %u)", MblStringPool::Get(app_name), static_cast<unsigned>(app));
+    return Error::None;
+}
+
+MblError MblCloudConnectResourceDatabase::RemoveApplication(const AppHandle app)
+{
+    if (app >= apps_.size() || !apps_[app].in_use) {
+        return Error::CCRBApplicationNotFound;
+    }
+
+    Application& old_app = apps_[app];
+    for (const ResourceDescriptor& resource : old_app.resources) {
+        const size_t slot = FindSlot(resource.path);
+        assert(index_[slot].path == resource.path);
+        index_[slot].path = deleted_path;
+        ++deleted_count_;
+    }
+    resource_count_ -= old_app.resources.size();
+
+    tr_debug(
+        "Removed application \"%s\" with %zu resources (%zu bytes)",
+        MblStringPool::Get(old_app.name),
+        old_app.resources.size(),
+        old_app.arena->GetFootprint());
+
+    // Detach the containers from the arena, then free all of their memory at
+    // once
+    old_app.in_use = false;
+    old_app.name = MblStringPool::invalid_handle;
+    old_app.resources = ResourceList();
+    old_app.arena.reset();
+    return Error::None;
+}
+
+MblCloudConnectResourceDatabase::AppHandle MblCloudConnectResourceDatabase::FindApplication(
+    const StringHandle app_name) const
+{
+    for (size_t i = 0; i < apps_.size(); ++i) {
+        if (apps_[i].in_use && apps_[i].name == app_name) {
+            return static_cast<AppHandle>(i);
+        }
+    }
+    return invalid_app;
+}
+
+StringHandle MblCloudConnectResourceDatabase::GetApplicationName(const AppHandle app) const
+{
+    assert(app < apps_.size() && apps_[app].in_use);
+    return apps_[app].name;
+}
+
+MblError MblCloudConnectResourceDatabase::AddResource(
+    const AppHandle app,
+    const ResourceDescriptor& descriptor,
+    const char* const resource_type,
+    const char* const value)
+{
+    if (app >= apps_.size() || !apps_[app].in_use) {
+        return Error::CCRBApplicationNotFound;
+    }
+    if (FindResource(descriptor.path)) {
+        return Error::CCRBResourceAlreadyExists;
+    }
+
+    // Keep the index at most half full, counting deleted slots because they
+    // lengthen probe sequences too
+    if ((resource_count_ + deleted_count_ + 1) * 2 > index_.size()) {
+        ReserveResources(resource_count_ + 1);
+    }
+
+    Application& owner = apps_[app];
+    const char* const safe_resource_type = resource_type ? resource_type : "";
+    const char* const safe_value = value ? value : "";
+    const size_t resource_type_length = std::strlen(safe_resource_type);
+    const size_t value_length = std::strlen(safe_value);
+    if (!reserve_in_arena(*owner.arena, owner.resources, 1, g_min_resources_capacity)) {
+        return Error::CCRBQuotaExceeded;
+    }
+    // Both strings in one allocation
+    char* const strings = static_cast<char*>(owner.arena->Allocate(resource_type_length + value_length + 2, 1));
+    if (!strings) {
+        return Error::CCRBQuotaExceeded;
+    }
+    if (!owner.arena->Charge(resource_charge_)) {
+        return Error::CCRBQuotaExceeded;
+    }
+    std::memcpy(strings, safe_resource_type, resource_type_length + 1);
+    std::memcpy(strings + resource_type_length + 1, safe_value, value_length + 1);
+
+    ResourceDescriptor stored = descriptor;
+    stored.resource_type = strings;
+    stored.value = strings + resource_type_length + 1;
+    owner.resources.push_back(stored);
+
+    InsertIntoIndex(descriptor.path, app, static_cast<uint32_t>(owner.resources.size() - 1));
+    ++resource_count_;
+    return Error::None;
+}
+
+const ResourceDescriptor* MblCloudConnectResourceDatabase::FindResource(
+    const ResourcePath path,
+    AppHandle* const owner) const
+{
+    const IndexSlot& slot = index_[FindSlot(path)];
+    if (slot.path != path) {
+        return nullptr;
+    }
+    if (owner) {
+        *owner = slot.app;
+    }
+    return &apps_[slot.app].resources[slot.position];
+}
+
+const MblCloudConnectResourceDatabase::ResourceList& MblCloudConnectResourceDatabase::GetResources(
+    const AppHandle app) const
+{
+    assert(app < apps_.size() && apps_[app].in_use);
+    return apps_[app].resources;
+}
+
+size_t MblCloudConnectResourceDatabase::GetApplicationFootprint(const AppHandle app) const
+{
+    assert(app < apps_.size() && apps_[app].in_use);
+    return apps_[app].arena->GetFootprint();
+}
+
+void MblCloudConnectResourceDatabase::ReserveResources(const size_t count)
+{
+    size_t capacity = g_min_index_capacity;
+    while (capacity < count * 2) {
+        capacity <<= 1;
+    }
+    // Also rehash if that gets rid of enough deleted slots
+    if (capacity > index_.size() || (resource_count_ + deleted_count_ + 1) * 2 > index_.size()) {
+        Rehash(capacity > index_.size() ? capacity : index_.size());
+    }
+}
+
+size_t MblCloudConnectResourceDatabase::FindSlot(const ResourcePath path) const
+{
+    // Linear probing. Returns the slot holding path, or the empty slot where
+    // the search ended. The index is never full so this terminates.
+    size_t slot = ResourcePathHash(path) & index_mask_;
+    while (index_[slot].path != path && index_[slot].path != empty_path) {
+        slot = (slot + 1) & index_mask_;
+    }
+    return slot;
+}
+
+void MblCloudConnectResourceDatabase::InsertIntoIndex(
+    const ResourcePath path,
+    const uint32_t app,
+    const uint32_t position)
+{
+    // Reuse the first deleted slot on the probe sequence, if any
+    size_t slot = ResourcePathHash(path) & index_mask_;
+    while (index_[slot].path != empty_path && index_[slot].path != deleted_path) {
+        assert(index_[slot].path != path);
+        slot = (slot + 1) & index_mask_;
+    }
+    if (index_[slot].path == deleted_path) {
+        --deleted_count_;
+    }
+
+    index_[slot].path = path;
+    index_[slot].app = app;
+    index_[slot].position = position;
+}
+
+void MblCloudConnectResourceDatabase::Rehash(const size_t capacity)
+{
+    assert((capacity & (capacity - 1)) == 0);
+
+    std::vector<IndexSlot> old_index(capacity);
+    old_index.swap(index_);
+    index_mask_ = capacity - 1;
+    deleted_count_ = 0;
+
+    for (const IndexSlot& slot : old_index) {
+        if (slot.path != empty_path && slot.path != deleted_path) {
+            InsertIntoIndex(slot.path, slot.app, slot.position);
+        }
+    }
+}
+
+MblCloudConnectResourceDatabase::ResourceMark MblCloudConnectResourceDatabase::GetResourceMark(
+    const AppHandle app) const
+{
+    assert(app < apps_.size() && apps_[app].in_use);
+    return ResourceMark{apps_[app].resources.size()};
+}
+
+void MblCloudConnectResourceDatabase::RemoveResourcesSince(const AppHandle app, const ResourceMark& mark)
+{
+    assert(app < apps_.size() && apps_[app].in_use);
+    Application& owner = apps_[app];
+    assert(mark.resource_count <= owner.resources.size());
+
+    for (size_t i = mark.resource_count; i < owner.resources.size(); ++i) {
+        const size_t slot = FindSlot(owner.resources[i].path);
+        assert(index_[slot].path == owner.resources[i].path);
+        index_[slot].path = deleted_path;
+        ++deleted_count_;
+    }
+    resource_count_ -= owner.resources.size() - mark.resource_count;
+    owner.resources.resize(mark.resource_count);
+}
+
+} // namespace mbl
@@ -0,0 +1,307 @@
+/*
+ * Copyright (c) 2020 Arm Limited and Contributors. All rights reserved.
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ * Licensed under the Apache License, Version 2.0 (the License); you may
+ * not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an AS IS BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#ifndef MblCloudConnectResourceDatabase_h_
+#define MblCloudConnectResourceDatabase_h_
+
+#include "MblArena.h"
+#include "MblError.h"
+#include "MblStringPool.h"
+
+#include <cstddef>
+#include <memory>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+namespace mbl {
+
+/*! \file MblCloudConnectResourceDatabase.h
+ *  \brief MblCloudConnectResourceDatabase.
+ *  Database of the LwM2M resources registered by each application, and the
+ *  operations allowed on them.
+ */
+
+/**
+ * An interned LwM2M resource path ("/object/instance/resource"). LwM2M IDs
+ * are 16 bit, so the canonical form of a path is the three IDs packed into
+ * one integer. Bit 48 is always set so that no valid path is 0.
+ */
+typedef uint64_t ResourcePath;
+
+inline ResourcePath MakeResourcePath(const uint16_t object_id, const uint16_t instance_id, const uint16_t resource_id)
+{
+    return (1ULL << 48) | (static_cast<uint64_t>(object_id) << 32) |
+           (static_cast<uint64_t>(instance_id) << 16) | resource_id;
+}
+
+inline uint16_t ResourcePathObjectId(const ResourcePath path) { return static_cast<uint16_t>(path >> 32); }
+inline uint16_t ResourcePathInstanceId(const ResourcePath path) { return static_cast<uint16_t>(path >> 16); }
+inline uint16_t ResourcePathResourceId(const ResourcePath path) { return static_cast<uint16_t>(path); }
+
+/**
+ * Hash of a path for open-addressing tables indexed by the low bits.
+ */
+inline size_t ResourcePathHash(ResourcePath path)
+{
+    // MurmurHash3's 64 bit finalizer: the IDs in a path differ only in a few
+    // low bits, so they need mixing before masking
+    path ^= path >> 33;
+    path *= 0xff51afd7ed558ccdULL;
+    path ^= path >> 33;
+    path *= 0xc4ceb9fe1a85ec53ULL;
+    path ^= path >> 33;
+    return static_cast<size_t>(path);
+}
+
+/**
+ * Parse a path of the form "/object/instance/resource" (the leading slash is
+ * optional).
+ *
+ * @return Error::None on success, or Error::CCRBInvalidResourcePath.
+ */
+MblError ResourcePathFromString(const char* str, size_t length, ResourcePath& path);
+
+/**
+ * Description of one registered LwM2M resource. Kept small so that an
+ * application's resources pack densely into one array.
+ */
+struct ResourceDescriptor
+{
+    enum Operation
+    {
+        Operation_Get = 0x01,
+        Operation_Put = 0x02,
+        Operation_Post = 0x04,
+        Operation_Delete = 0x08
+    };
+
+    enum Type
+    {
+        Type_String,
+        Type_Integer,
+        Type_Float,
+        Type_Boolean,
+        Type_Opaque,
+        Type_Time,
+        Type_ObjectLink
+    };
+
+    enum Flag
+    {
+        // Value is provided by the application rather than stored by the
+        // client ("mode": "dynamic")
+        Flag_Dynamic = 0x01,
+        Flag_MultipleInstance = 0x02,
+        Flag_Observable = 0x04
+    };
+
+    ResourcePath path;
+    // NUL-terminated strings in the owning application's arena, valid until
+    // it is removed
+    const char* resource_type;
+    const char* value;
+    uint8_t type;
+    uint8_t operations;
+    uint8_t flags;
+};
+
+/**
+ * Per-application database of LwM2M resources.
+ *
+ * Each application's descriptors are kept in one contiguous array. A flat
+ * open-addressing hash index maps every resource path to its owner and
+ * position, so FindResource() is O(1) and never allocates. Memory is only
+ * allocated when applications or resources are added.
+ *
+ * Each application's descriptors and strings are allocated from its own
+ * MblArena, which limits how much memory it can use and is freed as a whole
+ * when the application is removed. The heap memory each resource takes in
+ * the index, and in other tables kept per resource, is charged to the same
+ * quota.
+ *
+ * Not thread safe.
+ */
+class MblCloudConnectResourceDatabase {
+
+public:
+
+    typedef uint32_t AppHandle;
+    static const AppHandle invalid_app = UINT32_MAX;
+
+    typedef std::vector<ResourceDescriptor, MblArenaAllocator<ResourceDescriptor>> ResourceList;
+
+    // How much an application had registered at some point (see
+    // GetResourceMark())
+    struct ResourceMark
+    {
+        size_t resource_count;
+    };
+
+    /**
+     * @param app_quota most memory each application's resources may use,
+     *        or MblArena::no_quota.
+     * @param resource_heap_bytes memory other tables keep per resource,
+     *        which is charged to the owner's quota with the resource.
+     */
+    explicit MblCloudConnectResourceDatabase(
+        size_t app_quota = MblArena::no_quota,
+        size_t resource_heap_bytes = 0);
+
+    /**
+     * Register an application.
+     *
+     * @param app_name unique application name (see MblStringPool).
+     * @param app set to the new application's handle.
+     * @return Error::None or Error::CCRBApplicationAlreadyExists.
+     */
+    MblError AddApplication(StringHandle app_name, AppHandle& app);
+
+    /**
+     * Remove an application and all of its resources. Its handle may be reused
+     * by a later AddApplication().
+     *
+     * @return Error::None or Error::CCRBApplicationNotFound.
+     */
+    MblError RemoveApplication(AppHandle app);
+
+    /**
+     * @return the handle of the application with the given name, or
+     *         invalid_app.
+     */
+    AppHandle FindApplication(StringHandle app_name) const;
+
+    /**
+     * @return the name an application was added with.
+     */
+    StringHandle GetApplicationName(AppHandle app) const;
+
+    /**
+     * @return one more than the highest handle in use, so that handles
+     *         index arrays of this size.
+     */
+    AppHandle GetApplicationLimit() const { return static_cast<AppHandle>(apps_.size()); }
+
+    /**
+     * @return whether a handle belongs to an application.
+     */
+    bool IsApplication(AppHandle app) const { return app < apps_.size() && apps_[app].in_use; }
+
+    /**
+     * Add a resource for an application. The descriptor's resource_type and
+     * value fields are ignored; they are filled in from the given strings.
+     *
+     * @return Error::None, Error::CCRBApplicationNotFound,
+     *         Error::CCRBResourceAlreadyExists (if any application already
+     *         registered the path) or Error::CCRBQuotaExceeded.
+     */
+    MblError AddResource(
+        AppHandle app,
+        const ResourceDescriptor& descriptor,
+        const char* resource_type,
+        const char* value);
+
+    /**
+     * @return a mark that RemoveResourcesSince() can later roll an
+     *         application's resources back to.
+     */
+    ResourceMark GetResourceMark(AppHandle app) const;
+
+    /**
+     * Remove the resources an application added after a mark was taken.
+     * Their memory stays counted against the application's quota until it
+     * is removed.
+     */
+    void RemoveResourcesSince(AppHandle app, const ResourceMark& mark);
+
+    /**
+     * Look up a resource by path.
+     *
+     * @param owner if not null, set to the owning application's handle.
+     * @return the resource's descriptor or nullptr. Valid until the next
+     *         change to the database.
+     */
+    const ResourceDescriptor* FindResource(ResourcePath path, AppHandle* owner = nullptr) const;
+
+    /**
+     * @return all resources of an application, in the order they were added.
+     */
+    const ResourceList& GetResources(AppHandle app) const;
+
+    /**
+     * @return the memory an application's resources use, which counts
+     *         against its quota.
+     */
+    size_t GetApplicationFootprint(AppHandle app) const;
+
+    size_t GetResourceCount() const { return resource_count_; }
+
+    /**
+     * Size the index for at least this many resources so that adding them
+     * won't need to rehash.
+     */
+    void ReserveResources(size_t count);
+
+private:
+
+    struct Application
+    {
+        bool in_use;
+        StringHandle name;
+        // Holds resources and the strings they reference. Null when not in
+        // use.
+        std::unique_ptr<MblArena> arena;
+        ResourceList resources;
+    };
+
+    // One slot of the index: 16 bytes, so four slots share a cache line
+    struct IndexSlot
+    {
+        ResourcePath path;
+        uint32_t app;
+        uint32_t position;
+    };
+
+    // Special values of IndexSlot::path. Neither is a valid ResourcePath.
+    static const ResourcePath empty_path = 0;
+    static const ResourcePath deleted_path = UINT64_MAX;
+
+    size_t FindSlot(ResourcePath path) const;
+    void InsertIntoIndex(ResourcePath path, uint32_t app, uint32_t position);
+    void Rehash(size_t capacity);
+
+    const size_t app_quota_;
+    // Charged to an application's quota for each resource it adds
+    const size_t resource_charge_;
+    std::vector<Application> apps_;
+    std::vector<IndexSlot> index_;
+    // index_.size() - 1; index_.size() is always a power of two
+    size_t index_mask_;
+    size_t resource_count_;
+    size_t deleted_count_;
+
+    // No copying or moving (see https://github.com/isocpp/CppCoreGuidelines/blob/master/CppCoreGuidelines.md#cdefop-default-operations)
+    MblCloudConnectResourceDatabase(const MblCloudConnectResourceDatabase&) = delete;
+    MblCloudConnectResourceDatabase & operator = (const MblCloudConnectResourceDatabase&) = delete;
+    MblCloudConnectResourceDatabase(MblCloudConnectResourceDatabase&&) = delete;
+    MblCloudConnectResourceDatabase& operator = (MblCloudConnectResourceDatabase&&) = delete;
+};
+
+} // namespace mbl
+
+#endif // MblCloudConnectResourceDatabase_h_
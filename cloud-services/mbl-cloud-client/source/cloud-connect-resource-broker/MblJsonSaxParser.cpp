@@ -0,0 +1,395 @@
+/*
+ * Copyright (c) 2020 Arm Limited and Contributors. All rights reserved.
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ * Licensed under the Apache License, Version 2.0 (the License); you may
+ * not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an AS IS BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include "MblJsonSaxParser.h"
+
+#include <cstring>
+#include <stdint.h>
+
+namespace mbl {
+
+const size_t MblJsonSaxParser::max_depth;
+
+static bool is_digit(const char c)
+{
+    return c >= '0' && c <= '9';
+}
+
+static int hex_value(const char c)
+{
+    if (c >= '0' && c <= '9') {
+        return c - '0';
+    }
+    if (c >= 'a' && c <= 'f') {
+        return c - 'a' + 10;
+    }
+    if (c >= 'A' && c <= 'F') {
+        return c - 'A' + 10;
+    }
+    return -1;
+}
+
+static void append_utf8(std::string& out, const uint32_t code_point)
+{
+    if (code_point < 0x80) {
+        out += static_cast<char>(code_point);
+    }
+    else if (code_point < 0x800) {
+        out += static_cast<char>(0xc0 | (code_point >> 6));
+        out += static_cast<char>(0x80 | (code_point & 0x3f));
+    }
+    else if (code_point < 0x10000) {
+        out += static_cast<char>(0xe0 | (code_point >> 12));
+        out += static_cast<char>(0x80 | ((code_point >> 6) & 0x3f));
+        out += static_cast<char>(0x80 | (code_point & 0x3f));
+    }
+    else {
+        out += static_cast<char>(0xf0 | (code_point >> 18));
+        out += static_cast<char>(0x80 | ((code_point >> 12) & 0x3f));
+        out += static_cast<char>(0x80 | ((code_point >> 6) & 0x3f));
+        out += static_cast<char>(0x80 | (code_point & 0x3f));
+    }
+}
+
+MblJsonSaxParser::MblJsonSaxParser(MblJsonSaxHandler& handler)
+    : handler_(handler)
+    , begin_(nullptr)
+    , pos_(nullptr)
+    , end_(nullptr)
+    , error_message_("")
+    , scratch_()
+    , in_array_()
+    , depth_(0)
+{
+}
+
+MblError MblJsonSaxParser::Parse(const char* const json, const size_t length)
+{
+    begin_ = json;
+    pos_ = json;
+    end_ = json + length;
+    error_message_ = "";
+    depth_ = 0;
+
+    // Iterative rather than recursive so that deeply nested input can't
+    // exhaust the stack
+    bool is_container = false;
+    SkipWhitespace();
+    MblError err = ParseValue(is_container);
+    if (err != Error::None) {
+        return err;
+    }
+
+    while (depth_ > 0) {
+        SkipWhitespace();
+        if (pos_ == end_) {
+            return SyntaxError("Unexpected end of input");
+        }
+
+        // Just after a container was opened, it may be closed straight away
+        const bool first = is_container;
+        is_container = false;
+
+        const char close = in_array_[depth_ - 1] ? ']' : '}';
+        if (*pos_ == close) {
+            ++pos_;
+            --depth_;
+            err = (close == ']') ? handler_.EndArray() : handler_.EndObject();
+            if (err != Error::None) {
+                return err;
+            }
+            continue;
+        }
+
+        if (!first) {
+            if (*pos_ != ',') {
+                return SyntaxError(in_array_[depth_ - 1] ? "Expected ',' or ']'" : "Expected ',' or '}'");
+            }
+            ++pos_;
+            SkipWhitespace();
+        }
+
+        if (!in_array_[depth_ - 1]) {
+            if (pos_ == end_ || *pos_ != '"') {
+                return SyntaxError("Expected a string key");
+            }
+            const char* key = nullptr;
+            size_t key_length = 0;
+            err = ParseString(key, key_length);
+            if (err != Error::None) {
+                return err;
+            }
+            err = handler_.Key(key, key_length);
+            if (err != Error::None) {
+                return err;
+            }
+            SkipWhitespace();
+            if (pos_ == end_ || *pos_ != ':') {
+                return SyntaxError("Expected ':'");
+            }
+            ++pos_;
+            SkipWhitespace();
+        }
+
+        err = ParseValue(is_container);
+        if (err != Error::None) {
+            return err;
+        }
+    }
+
+    SkipWhitespace();
+    if (pos_ != end_) {
+        return SyntaxError("Unexpected data after the end of the document");
+    }
+    return Error::None;
+}
+
+MblError MblJsonSaxParser::SyntaxError(const char* const message)
+{
+    error_message_ = message;
+    return Error::CCRBInvalidJson;
+}
+
+void MblJsonSaxParser::SkipWhitespace()
+{
+    while (pos_ != end_ && (*pos_ == ' ' || *pos_ == '\t' || *pos_ == '\n' || *pos_ == '\r')) {
+        ++pos_;
+    }
+}
+
+MblError MblJsonSaxParser::ParseValue(bool& is_container)
+{
+    is_container = false;
+    if (pos_ == end_) {
+        return SyntaxError("Expected a value");
+    }
+
+    switch (*pos_) {
+        case '{':
+        case '[':
+        {
+            if (depth_ == max_depth) {
+                return SyntaxError("Nested too deeply");
+            }
+            const bool is_array = (*pos_ == '[');
+            ++pos_;
+            in_array_[depth_++] = is_array;
+            is_container = true;
+            return is_array ? handler_.StartArray() : handler_.StartObject();
+        }
+
+        case '"':
+        {
+            const char* str = nullptr;
+            size_t length = 0;
+            const MblError err = ParseString(str, length);
+            if (err != Error::None) {
+                return err;
+            }
+            return handler_.String(str, length);
+        }
+
+        case 't':
+        {
+            const MblError err = ParseLiteral("true", 4);
+            return (err != Error::None) ? err : handler_.Boolean(true);
+        }
+
+        case 'f':
+        {
+            const MblError err = ParseLiteral("false", 5);
+            return (err != Error::None) ? err : handler_.Boolean(false);
+        }
+
+        case 'n':
+        {
+            const MblError err = ParseLiteral("null", 4);
+            return (err != Error::None) ? err : handler_.Null();
+        }
+
+        default:
+        {
+            const char* const start = pos_;
+            const MblError err = ParseNumber();
+            if (err != Error::None) {
+                return err;
+            }
+            return handler_.Number(start, static_cast<size_t>(pos_ - start));
+        }
+    }
+}
+
+MblError MblJsonSaxParser::ParseString(const char*& str, size_t& length)
+{
+    // pos_ is at the opening quote
+    ++pos_;
+    const char* const start = pos_;
+
+    // Fast path: strings without escapes are passed straight from the input
+    while (pos_ != end_ && *pos_ != '"' && *pos_ != '\\') {
+        if (static_cast<unsigned char>(*pos_) < 0x20) {
+            return SyntaxError("Control character in string");
+        }
+        ++pos_;
+    }
+    if (pos_ == end_) {
+        return SyntaxError("Unterminated string");
+    }
+    if (*pos_ == '"') {
+        str = start;
+        length = static_cast<size_t>(pos_ - start);
+        ++pos_;
+        return Error::None;
+    }
+
+    scratch_.assign(start, pos_);
+    while (pos_ != end_ && *pos_ != '"') {
+        if (*pos_ == '\\') {
+            const MblError err = ParseEscape();
+            if (err != Error::None) {
+                return err;
+            }
+            continue;
+        }
+        if (static_cast<unsigned char>(*pos_) < 0x20) {
+            return SyntaxError("Control character in string");
+        }
+        scratch_ += *pos_++;
+    }
+    if (pos_ == end_) {
+        return SyntaxError("Unterminated string");
+    }
+    ++pos_;
+    str = scratch_.data();
+    length = scratch_.size();
+    return Error::None;
+}
+
+MblError MblJsonSaxParser::ParseEscape()
+{
+    // pos_ is at the backslash
+    ++pos_;
+    if (pos_ == end_) {
+        return SyntaxError("Unterminated string");
+    }
+
+    const char c = *pos_++;
+    switch (c) {
+        case '"': scratch_ += '"'; return Error::None;
+        case '\\': scratch_ += '\\'; return Error::None;
+        case '/': scratch_ += '/'; return Error::None;
+        case 'b': scratch_ += '\b'; return Error::None;
+        case 'f': scratch_ += '\f'; return Error::None;
+        case 'n': scratch_ += '\n'; return Error::None;
+        case 'r': scratch_ += '\r'; return Error::None;
+        case 't': scratch_ += '\t'; return Error::None;
+        case 'u': break;
+        default: return SyntaxError("Invalid escape sequence");
+    }
+
+    const auto read_hex4 = [this](uint32_t& value) {
+        if (end_ - pos_ < 4) {
+            return false;
+        }
+        value = 0;
+        for (size_t i = 0; i < 4; ++i) {
+            const int digit = hex_value(*pos_++);
+            if (digit < 0) {
+                return false;
+            }
+            value = (value << 4) | static_cast<uint32_t>(digit);
+        }
+        return true;
+    };
+
+    uint32_t code_point = 0;
+    if (!read_hex4(code_point)) {
+        return SyntaxError("Invalid \\u escape");
+    }
+    if (code_point >= 0xd800 && code_point <= 0xdbff) {
+        // A high surrogate must be followed by an escaped low surrogate
+        uint32_t low = 0;
+        if (end_ - pos_ < 2 || pos_[0] != '\\' || pos_[1] != 'u') {
+            return SyntaxError("Unpaired surrogate in \\u escape");
+        }
+        pos_ += 2;
+        if (!read_hex4(low) || low < 0xdc00 || low > 0xdfff) {
+            return SyntaxError("Unpaired surrogate in \\u escape");
+        }
+        code_point = 0x10000 + ((code_point - 0xd800) << 10) + (low - 0xdc00);
+    }
+    else if (code_point >= 0xdc00 && code_point <= 0xdfff) {
+        return SyntaxError("Unpaired surrogate in \\u escape");
+    }
+    append_utf8(scratch_, code_point);
+    return Error::None;
+}
+
+MblError MblJsonSaxParser::ParseNumber()
+{
+    // -?(0|[1-9][0-9]*)(\.[0-9]+)?([eE][+-]?[0-9]+)?
+    if (pos_ != end_ && *pos_ == '-') {
+        ++pos_;
+    }
+    if (pos_ == end_ || !is_digit(*pos_)) {
+        return SyntaxError("Expected a value");
+    }
+    if (*pos_ == '0') {
+        ++pos_;
+    }
+    else {
+        while (pos_ != end_ && is_digit(*pos_)) {
+            ++pos_;
+        }
+    }
+
+    if (pos_ != end_ && *pos_ == '.') {
+        ++pos_;
+        if (pos_ == end_ || !is_digit(*pos_)) {
+            return SyntaxError("Expected a digit after the decimal point");
+        }
+        while (pos_ != end_ && is_digit(*pos_)) {
+            ++pos_;
+        }
+    }
+
+    if (pos_ != end_ && (*pos_ == 'e' || *pos_ == 'E')) {
+        ++pos_;
+        if (pos_ != end_ && (*pos_ == '+' || *pos_ == '-')) {
+            ++pos_;
+        }
+        if (pos_ == end_ || !is_digit(*pos_)) {
+            return SyntaxError("Expected a digit in the exponent");
+        }
+        while (pos_ != end_ && is_digit(*pos_)) {
+            ++pos_;
+        }
+    }
+    return Error::None;
+}
+
+MblError MblJsonSaxParser::ParseLiteral(const char* const literal, const size_t length)
+{
+    if (static_cast<size_t>(end_ - pos_) < length || std::memcmp(pos_, literal, length) != 0) {
+        return SyntaxError("Invalid literal");
+    }
+    pos_ += length;
+    return Error::None;
+}
+
+} // namespace mbl
@@ -0,0 +1,132 @@
+/*
+ * Copyright (c) 2020 Arm Limited and Contributors. All rights reserved.
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ * Licensed under the Apache License, Version 2.0 (the License); you may
+ * not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an AS IS BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#ifndef MblJsonSaxParser_h_
+#define MblJsonSaxParser_h_
+
+#include "MblError.h"
+
+#include <cstddef>
+#include <string>
+
+namespace mbl {
+
+/*! \file MblJsonSaxParser.h
+ *  \brief MblJsonSaxParser.
+ *  Event based ("SAX style") JSON parser. The parser reports each token to a
+ *  handler as it is read and never builds a document tree, so memory use is
+ *  independent of the size of the document.
+ */
+
+/**
+ * Receives JSON parse events. Returning anything other than Error::None from
+ * a callback stops parsing, and MblJsonSaxParser::Parse() returns that error.
+ *
+ * Strings are passed as (pointer, length) pairs with escapes already decoded.
+ * They are only valid during the callback. Numbers are passed as their
+ * (validated) source text.
+ */
+class MblJsonSaxHandler {
+
+public:
+
+    MblJsonSaxHandler() = default;
+    virtual ~MblJsonSaxHandler() = default;
+
+    virtual MblError StartObject() = 0;
+    virtual MblError Key(const char* str, size_t length) = 0;
+    virtual MblError EndObject() = 0;
+    virtual MblError StartArray() = 0;
+    virtual MblError EndArray() = 0;
+    virtual MblError String(const char* str, size_t length) = 0;
+    virtual MblError Number(const char* str, size_t length) = 0;
+    virtual MblError Boolean(bool value) = 0;
+    virtual MblError Null() = 0;
+
+private:
+
+    // No copying or moving (see https://github.com/isocpp/CppCoreGuidelines/blob/master/CppCoreGuidelines.md#cdefop-default-operations)
+    MblJsonSaxHandler(const MblJsonSaxHandler&) = delete;
+    MblJsonSaxHandler & operator = (const MblJsonSaxHandler&) = delete;
+    MblJsonSaxHandler(MblJsonSaxHandler&&) = delete;
+    MblJsonSaxHandler& operator = (MblJsonSaxHandler&&) = delete;
+};
+
+class MblJsonSaxParser {
+
+public:
+
+    // Deepest nesting of objects and arrays that is accepted
+    static const size_t max_depth = 64;
+
+    explicit MblJsonSaxParser(MblJsonSaxHandler& handler);
+
+    /**
+     * Parse a complete JSON document (RFC 8259), reporting it to the handler.
+     *
+     * @return Error::None, Error::CCRBInvalidJson for malformed JSON (see
+     *         GetErrorOffset() and GetErrorMessage()), or the error returned
+     *         by a handler callback.
+     */
+    MblError Parse(const char* json, size_t length);
+
+    /**
+     * Byte offset in the document at which parsing stopped.
+     */
+    size_t GetErrorOffset() const { return static_cast<size_t>(pos_ - begin_); }
+
+    /**
+     * Description of the syntax error if Parse() returned
+     * Error::CCRBInvalidJson.
+     */
+    const char* GetErrorMessage() const { return error_message_; }
+
+private:
+
+    MblError SyntaxError(const char* message);
+    void SkipWhitespace();
+    MblError ParseValue(bool& is_container);
+    MblError ParseString(const char*& str, size_t& length);
+    MblError ParseEscape();
+    MblError ParseNumber();
+    MblError ParseLiteral(const char* literal, size_t length);
+
+    MblJsonSaxHandler& handler_;
+    const char* begin_;
+    const char* pos_;
+    const char* end_;
+    const char* error_message_;
+
+    // Strings with escapes are decoded into this buffer. It is reused so that
+    // parsing allocates only when a longer escaped string turns up.
+    std::string scratch_;
+
+    // Whether each open container is an array (rather than an object)
+    bool in_array_[max_depth];
+    size_t depth_;
+
+    // No copying or moving (see https://github.com/isocpp/CppCoreGuidelines/blob/master/CppCoreGuidelines.md#cdefop-default-operations)
+    MblJsonSaxParser(const MblJsonSaxParser&) = delete;
+    MblJsonSaxParser & operator = (const MblJsonSaxParser&) = delete;
+    MblJsonSaxParser(MblJsonSaxParser&&) = delete;
+    MblJsonSaxParser& operator = (MblJsonSaxParser&&) = delete;
+};
+
+} // namespace mbl
+
+#endif // MblJsonSaxParser_h_
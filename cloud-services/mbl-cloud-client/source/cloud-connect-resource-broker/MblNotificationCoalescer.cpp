@@ -0,0 +1,281 @@
+/*
+ * Copyright (c) 2020 Arm Limited and Contributors. All rights reserved.
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ * Licensed under the Apache License, Version 2.0 (the License); you may
+ * not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an AS IS BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include "MblNotificationCoalescer.h"
+#include "MblScopedLock.h"
+
+#include "log_trace.h"
+#include "metrics.h"
+#include "monotonic_time.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cerrno>
+#include <cstring>
+#include <sys/timerfd.h>
+#include <unistd.h>
+
+#define TRACE_GROUP "CCRB"
+
+static mbl::metrics::Counter g_notifications_received("ccrb_notifications_received");
+static mbl::metrics::Counter g_notifications_merged("ccrb_notifications_merged");
+static mbl::metrics::Counter g_notifications_sent("ccrb_notifications_sent");
+static mbl::metrics::Counter g_notifications_pmax_resent("ccrb_notifications_pmax_resent");
+static mbl::metrics::Counter g_notification_batches("ccrb_notification_batches");
+
+namespace mbl {
+
+// The entries_ node and its bucket, and the resource's places in the lists
+// of paths (pending_paths_, still_pending_, pmax_paths_, with room for their
+// growth) and in batch_
+const size_t MblNotificationCoalescer::bytes_per_entry =
+    sizeof(std::pair<const ResourcePath, MblNotificationCoalescer::Entry>) + 2 * sizeof(void*) +
+    4 * sizeof(ResourcePath) + sizeof(ResourceValue);
+
+MblNotificationCoalescer::MblNotificationCoalescer(
+    MblCloudConnectCloudClientInterface& cloud_client,
+    const uint32_t tick_ms,
+    const uint32_t default_pmin_ms)
+    : cloud_client_(cloud_client)
+    , tick_ms_(tick_ms)
+    , default_pmin_ms_(default_pmin_ms)
+    , timer_fd_(-1)
+    , mutex_("ccrb_notifications")
+    , timer_deadline_ms_(-1)
+    , polling_(false)
+{
+    assert(tick_ms_ > 0);
+}
+
+MblNotificationCoalescer::~MblNotificationCoalescer()
+{
+    if (timer_fd_ != -1) {
+        close(timer_fd_);
+    }
+}
+
+MblError MblNotificationCoalescer::Init()
+{
+    assert(timer_fd_ == -1);
+
+    timer_fd_ = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    if (timer_fd_ == -1) {
+        tr_error("Failed to create notification timerfd: %s", std::strerror(errno));
+        return Error::CCRBIpcInitFailed;
+    }
+    return Error::None;
+}
+
+void MblNotificationCoalescer::HandleTimer()
+{
+    uint64_t expirations = 0;
+    if (read(timer_fd_, &expirations, sizeof(expirations)) != sizeof(expirations)) {
+        return;
+    }
+    Flush(get_monotonic_time_ms());
+}
+
+void MblNotificationCoalescer::Update(const ResourcePath path, const char* const value, const size_t length)
+{
+    g_notifications_received.add();
+
+    MblScopedLock l(mutex_);
+
+    auto it = entries_.find(path);
+    if (it == entries_.end()) {
+        it = entries_.emplace(path, Entry{std::string(), -1, default_pmin_ms_, 0, false, false}).first;
+    }
+    Entry& entry = it->second;
+
+    // Last value wins: a value that hasn't been sent yet is simply replaced
+    entry.value.assign(value, length);
+    if (entry.pending) {
+        g_notifications_merged.add();
+        return;
+    }
+    entry.pending = true;
+    pending_paths_.push_back(path);
+
+    const int64_t now_ms = get_monotonic_time_ms();
+    int64_t deadline_ms = now_ms + tick_ms_;
+    if (entry.last_sent_ms >= 0) {
+        deadline_ms = std::max(deadline_ms, entry.last_sent_ms + entry.pmin_ms);
+    }
+    ArmTimer(deadline_ms, now_ms);
+}
+
+void MblNotificationCoalescer::SetPeriods(const ResourcePath path, const uint32_t pmin_ms, const uint32_t pmax_ms)
+{
+    MblScopedLock l(mutex_);
+
+    auto it = entries_.find(path);
+    if (it == entries_.end()) {
+        it = entries_.emplace(path, Entry{std::string(), -1, default_pmin_ms_, 0, false, false}).first;
+    }
+    Entry& entry = it->second;
+
+    entry.pmin_ms = pmin_ms;
+    entry.pmax_ms = pmax_ms;
+    if (pmax_ms != 0 && !entry.in_pmax_paths) {
+        entry.in_pmax_paths = true;
+        pmax_paths_.push_back(path);
+    }
+
+    // The new periods may make the resource due sooner
+    if (entry.last_sent_ms >= 0) {
+        const int64_t now_ms = get_monotonic_time_ms();
+        if (entry.pending) {
+            ArmTimer(std::max(now_ms, entry.last_sent_ms + pmin_ms), now_ms);
+        }
+        else if (pmax_ms != 0) {
+            ArmTimer(std::max(now_ms, entry.last_sent_ms + pmax_ms), now_ms);
+        }
+    }
+}
+
+void MblNotificationCoalescer::Remove(const MblCloudConnectResourceDatabase::ResourceList& resources)
+{
+    MblScopedLock l(mutex_);
+
+    bool listed = false;
+    for (const ResourceDescriptor& resource : resources) {
+        const auto it = entries_.find(resource.path);
+        if (it != entries_.end()) {
+            listed = listed || it->second.pending || it->second.in_pmax_paths;
+            entries_.erase(it);
+        }
+    }
+
+    // One pass over each list however many resources went
+    if (listed) {
+        const auto removed = [this](const ResourcePath path) { return entries_.count(path) == 0; };
+        pending_paths_.erase(
+            std::remove_if(pending_paths_.begin(), pending_paths_.end(), removed),
+            pending_paths_.end());
+        pmax_paths_.erase(
+            std::remove_if(pmax_paths_.begin(), pmax_paths_.end(), removed),
+            pmax_paths_.end());
+    }
+}
+
+void MblNotificationCoalescer::SetPolling(const bool polling)
+{
+    MblScopedLock l(mutex_);
+
+    polling_ = polling;
+    if (polling_) {
+        const int64_t now_ms = get_monotonic_time_ms();
+        ArmTimer(now_ms + tick_ms_, now_ms);
+    }
+}
+
+void MblNotificationCoalescer::Flush(const int64_t now_ms)
+{
+    batch_.clear();
+    still_pending_.clear();
+    uint64_t pmax_resent = 0;
+    {
+        MblScopedLock l(mutex_);
+
+        // The earliest time anything is due after this flush
+        int64_t next_ms = polling_ ? now_ms + tick_ms_ : -1;
+        const auto next = [&next_ms](const int64_t deadline_ms) {
+            if (next_ms == -1 || deadline_ms < next_ms) {
+                next_ms = deadline_ms;
+            }
+        };
+
+        for (const ResourcePath path : pending_paths_) {
+            Entry& entry = entries_.find(path)->second;
+            assert(entry.pending);
+            if (entry.last_sent_ms >= 0 && now_ms - entry.last_sent_ms < entry.pmin_ms) {
+                still_pending_.push_back(path);
+                next(entry.last_sent_ms + entry.pmin_ms);
+                continue;
+            }
+            entry.pending = false;
+            entry.last_sent_ms = now_ms;
+            batch_.push_back(ResourceValue{path, entry.value});
+        }
+        pending_paths_.swap(still_pending_);
+
+        size_t kept = 0;
+        for (const ResourcePath path : pmax_paths_) {
+            Entry& entry = entries_.find(path)->second;
+            if (entry.pmax_ms == 0) {
+                entry.in_pmax_paths = false;
+                continue;
+            }
+            pmax_paths_[kept++] = path;
+
+            // Only resend a value that has been sent and hasn't changed since
+            if (!entry.pending && entry.last_sent_ms >= 0 && now_ms - entry.last_sent_ms >= entry.pmax_ms) {
+                entry.last_sent_ms = now_ms;
+                batch_.push_back(ResourceValue{path, entry.value});
+                ++pmax_resent;
+            }
+            if (!entry.pending && entry.last_sent_ms >= 0) {
+                next(entry.last_sent_ms + entry.pmax_ms);
+            }
+        }
+        pmax_paths_.resize(kept);
+
+        SetTimer(next_ms, now_ms);
+    }
+
+    if (batch_.empty()) {
+        return;
+    }
+
+    g_notifications_sent.add(batch_.size());
+    g_notifications_pmax_resent.add(pmax_resent);
+    g_notification_batches.add();
+    cloud_client_.SendResourceValues(batch_);
+}
+
+void MblNotificationCoalescer::ArmTimer(const int64_t deadline_ms, const int64_t now_ms)
+{
+    if (timer_deadline_ms_ != -1 && timer_deadline_ms_ <= deadline_ms) {
+        return;
+    }
+    SetTimer(deadline_ms, now_ms);
+}
+
+void MblNotificationCoalescer::SetTimer(const int64_t deadline_ms, const int64_t now_ms)
+{
+    if (timer_fd_ == -1 || (deadline_ms == -1 && timer_deadline_ms_ == -1)) {
+        return;
+    }
+
+    // One-shot: an it_value of zero would disarm the timer, so a deadline
+    // that has passed fires after 1 ms
+    struct itimerspec spec;
+    std::memset(&spec, 0, sizeof(spec));
+    if (deadline_ms != -1) {
+        const int64_t delay_ms = std::max<int64_t>(deadline_ms - now_ms, 1);
+        spec.it_value.tv_sec = static_cast<time_t>(delay_ms / 1000);
+        spec.it_value.tv_nsec = static_cast<long>(delay_ms % 1000) * 1000000;
+    }
+    if (timerfd_settime(timer_fd_, 0, &spec, 0) != 0) {
+        tr_error("Failed to set notification timer: %s", std::strerror(errno));
+        return;
+    }
+    timer_deadline_ms_ = deadline_ms;
+}
+
+} // namespace mbl
@@ -0,0 +1,176 @@
+/*
+ * Copyright (c) 2020 Arm Limited and Contributors. All rights reserved.
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ * Licensed under the Apache License, Version 2.0 (the License); you may
+ * not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an AS IS BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#ifndef MblNotificationCoalescer_h_
+#define MblNotificationCoalescer_h_
+
+#include "MblCloudConnectCloudClientInterface.h"
+#include "MblCloudConnectResourceDatabase.h"
+#include "MblError.h"
+#include "MblMutex.h"
+
+#include <cstddef>
+#include <stdint.h>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace mbl {
+
+/*! \file MblNotificationCoalescer.h
+ *  \brief MblNotificationCoalescer.
+ *  Collects resource value changes made by applications and passes them to
+ *  the cloud client in batches, rather than one CoAP send per change.
+ *
+ *  Changes are coalesced per resource: only the latest value is kept, so a
+ *  resource that changes many times between sends is sent once. A new value
+ *  is sent one tick after it arrives, together with everything else that is
+ *  due by then, and no sooner than the resource's minimum period (LwM2M pmin)
+ *  after its last send. A resource with a maximum period (LwM2M pmax) has its
+ *  last value sent again if it hasn't changed for that long.
+ *
+ *  The timer is a one-shot timerfd, that the mbl-cloud-client event loop
+ *  waits on, armed for the earliest of these deadlines. It is disarmed while
+ *  nothing is due, unless the owner is polling for values (see
+ *  SetPolling()), when it fires at least once per tick.
+ */
+class MblNotificationCoalescer {
+
+public:
+
+    // Most heap memory kept per resource, not counting its value, which the
+    // broker counts against each application's quota
+    static const size_t bytes_per_entry;
+
+    /**
+     * @param tick_ms how long a new value waits for others to batch with.
+     * @param default_pmin_ms minimum period of resources without one of
+     *        their own.
+     */
+    MblNotificationCoalescer(
+        MblCloudConnectCloudClientInterface& cloud_client,
+        uint32_t tick_ms,
+        uint32_t default_pmin_ms);
+    ~MblNotificationCoalescer();
+
+    /**
+     * Create the timer.
+     *
+     * @return Error::None or Error::CCRBIpcInitFailed.
+     */
+    MblError Init();
+
+    /**
+     * @return the timerfd. When it is readable, call HandleTimer().
+     */
+    int GetFd() const { return timer_fd_; }
+
+    /**
+     * Send all values that are due to the cloud client. Called on the event
+     * loop thread.
+     */
+    void HandleTimer();
+
+    /**
+     * Record a new value for a resource, replacing any value that hasn't been
+     * sent yet. Thread safe.
+     */
+    void Update(ResourcePath path, const char* value, size_t length);
+
+    /**
+     * Set a resource's notification periods, e.g. when the LwM2M server
+     * writes its pmin and pmax attributes. Thread safe.
+     *
+     * @param pmax_ms 0 for no maximum period.
+     */
+    void SetPeriods(ResourcePath path, uint32_t pmin_ms, uint32_t pmax_ms);
+
+    /**
+     * Forget resources, e.g. of an application that deregistered, dropping
+     * any of their values that haven't been sent. Thread safe.
+     */
+    void Remove(const MblCloudConnectResourceDatabase::ResourceList& resources);
+
+    /**
+     * Keep the timer firing at least once per tick while nothing is due, so
+     * that the owner can poll for new values (e.g. in application value
+     * stores) before each HandleTimer(). Thread safe.
+     */
+    void SetPolling(bool polling);
+
+    /**
+     * Send all values that are due at now_ms (monotonic), and arm the timer
+     * for the next deadline. HandleTimer() calls this with the current time.
+     */
+    void Flush(int64_t now_ms);
+
+private:
+
+    struct Entry
+    {
+        // Latest value, sent or not
+        std::string value;
+        // -1 until the first send
+        int64_t last_sent_ms;
+        uint32_t pmin_ms;
+        uint32_t pmax_ms;
+        // value hasn't been sent yet; the path is in pending_paths_
+        bool pending;
+        // The path is in pmax_paths_
+        bool in_pmax_paths;
+    };
+
+    // Make the timer fire by deadline_ms, unless it already will. Called
+    // with mutex_ held.
+    void ArmTimer(int64_t deadline_ms, int64_t now_ms);
+
+    // Set the timer to fire at deadline_ms, or disarm it if that is -1.
+    // Called with mutex_ held.
+    void SetTimer(int64_t deadline_ms, int64_t now_ms);
+
+    MblCloudConnectCloudClientInterface& cloud_client_;
+    const uint32_t tick_ms_;
+    const uint32_t default_pmin_ms_;
+
+    int timer_fd_;
+
+    // Protects everything below except batch_ and still_pending_
+    MblMutex mutex_;
+    std::unordered_map<ResourcePath, Entry> entries_;
+    // Paths with a value to send, in the order they first changed
+    std::vector<ResourcePath> pending_paths_;
+    // Paths with a maximum period
+    std::vector<ResourcePath> pmax_paths_;
+    // When the timer fires (monotonic), or -1 while it is disarmed
+    int64_t timer_deadline_ms_;
+    bool polling_;
+
+    // Only used by Flush(); kept to reuse their memory
+    std::vector<ResourcePath> still_pending_;
+    std::vector<ResourceValue> batch_;
+
+    // No copying or moving (see https://github.com/isocpp/CppCoreGuidelines/blob/master/CppCoreGuidelines.md#cdefop-default-operations)
+    MblNotificationCoalescer(const MblNotificationCoalescer&) = delete;
+    MblNotificationCoalescer & operator = (const MblNotificationCoalescer&) = delete;
+    MblNotificationCoalescer(MblNotificationCoalescer&&) = delete;
+    MblNotificationCoalescer& operator = (MblNotificationCoalescer&&) = delete;
+};
+
+} // namespace mbl
+
+#endif // MblNotificationCoalescer_h_
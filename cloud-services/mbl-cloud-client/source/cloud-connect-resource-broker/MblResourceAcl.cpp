@@ -0,0 +1,85 @@
+/*
+ * Copyright (c) 2020 Arm Limited and Contributors. All rights reserved.
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ * Licensed under the Apache License, Version 2.0 (the License); you may
+ * not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an AS IS BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include "MblResourceAcl.h"
+
+#include "log_trace.h"
+
+#define TRACE_GROUP "CCRB"
+
+// Smallest index size. Like the database's index, it is kept at most half
+// full.
+static const size_t g_min_index_capacity = 16;
+
+namespace mbl {
+
+// Up to four index slots per resource, as in the database
+const size_t MblResourceAcl::bytes_per_resource =
+    4 * sizeof(IndexSlot) + sizeof(MblCloudConnectResourceDatabase::AppHandle) + sizeof(uint8_t);
+
+const MblResourceAcl::ResourceId MblResourceAcl::invalid_resource;
+
+std::shared_ptr<const MblResourceAcl> MblResourceAcl::Build(const MblCloudConnectResourceDatabase& db)
+{
+    std::shared_ptr<MblResourceAcl> acl(new MblResourceAcl());
+
+    const size_t resource_count = db.GetResourceCount();
+    size_t capacity = g_min_index_capacity;
+    while (capacity < 2 * resource_count) {
+        capacity *= 2;
+    }
+    acl->index_.assign(capacity, IndexSlot{0, invalid_resource});
+    acl->index_mask_ = capacity - 1;
+
+    acl->owners_.reserve(resource_count);
+    acl->methods_.reserve(resource_count);
+
+    const MblCloudConnectResourceDatabase::AppHandle app_limit = db.GetApplicationLimit();
+    for (MblCloudConnectResourceDatabase::AppHandle app = 0; app < app_limit; ++app) {
+        if (!db.IsApplication(app)) {
+            continue;
+        }
+        acl->apps_.emplace(db.GetApplicationName(app), app);
+
+        for (const ResourceDescriptor& resource : db.GetResources(app)) {
+            const ResourceId id = static_cast<ResourceId>(acl->methods_.size());
+            uint8_t methods = resource.operations;
+            if (resource.flags & ResourceDescriptor::Flag_Observable) {
+                methods |= Method_Observe;
+            }
+            acl->methods_.push_back(methods);
+            acl->owners_.push_back(app);
+
+            // Paths are unique in the database, so this only looks for an
+            // empty slot
+            size_t slot = ResourcePathHash(resource.path) & acl->index_mask_;
+            while (acl->index_[slot].path != 0) {
+                slot = (slot + 1) & acl->index_mask_;
+            }
+            acl->index_[slot] = IndexSlot{resource.path, id};
+        }
+    }
+
+    tr_debug(
+        "Built access rights of %zu resources and %zu applications",
+        acl->methods_.size(),
+        acl->apps_.size());
+    return acl;
+}
+
+} // namespace mbl
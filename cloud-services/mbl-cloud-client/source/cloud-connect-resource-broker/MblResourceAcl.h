@@ -0,0 +1,147 @@
+/*
+ * Copyright (c) 2020 Arm Limited and Contributors. All rights reserved.
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ * Licensed under the Apache License, Version 2.0 (the License); you may
+ * not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an AS IS BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#ifndef MblResourceAcl_h_
+#define MblResourceAcl_h_
+
+#include "MblCloudConnectResourceDatabase.h"
+
+#include <cstddef>
+#include <memory>
+#include <stdint.h>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace mbl {
+
+/*! \file MblResourceAcl.h
+ *  \brief MblResourceAcl.
+ *  Access rights of every registered resource, compiled from the resource
+ *  database so that checking a request doesn't touch the database.
+ *
+ *  Each resource gets a dense ID, indexing the resource's owner and a mask of
+ *  the methods the cloud may use on it. A check is a hash lookup of the path
+ *  followed by one comparison. The memory used grows linearly with the
+ *  number of resources (see bytes_per_resource).
+ *
+ *  An MblResourceAcl never changes once built. The broker builds a new one
+ *  whenever registrations change and swaps it in atomically, so readers use
+ *  whichever snapshot they loaded without taking a lock.
+ */
+class MblResourceAcl {
+
+public:
+
+    typedef uint32_t ResourceId;
+    static const ResourceId invalid_resource = UINT32_MAX;
+
+    // Methods, matching the ResourceDescriptor::Operation bits
+    enum Method
+    {
+        Method_Get = ResourceDescriptor::Operation_Get,
+        Method_Put = ResourceDescriptor::Operation_Put,
+        Method_Post = ResourceDescriptor::Operation_Post,
+        Method_Delete = ResourceDescriptor::Operation_Delete,
+        Method_Observe = 0x10
+    };
+
+    // Most heap memory a snapshot uses per resource, which the broker
+    // counts against each application's quota
+    static const size_t bytes_per_resource;
+
+    /**
+     * Compile the access rights of everything in a database.
+     */
+    static std::shared_ptr<const MblResourceAcl> Build(const MblCloudConnectResourceDatabase& db);
+
+    /**
+     * @return the application with the given name, or
+     *         MblCloudConnectResourceDatabase::invalid_app.
+     */
+    MblCloudConnectResourceDatabase::AppHandle FindApplication(const StringHandle app_name) const
+    {
+        const auto it = apps_.find(app_name);
+        return (it == apps_.end()) ? MblCloudConnectResourceDatabase::invalid_app : it->second;
+    }
+
+    /**
+     * @return a resource's ID, or invalid_resource if it isn't registered.
+     */
+    ResourceId FindResource(const ResourcePath path) const
+    {
+        // Linear probing; the index is never full
+        size_t slot = ResourcePathHash(path) & index_mask_;
+        while (index_[slot].path != path) {
+            if (index_[slot].path == 0) {
+                return invalid_resource;
+            }
+            slot = (slot + 1) & index_mask_;
+        }
+        return index_[slot].id;
+    }
+
+    /**
+     * @return whether an application owns a resource. app may be
+     *         invalid_app.
+     */
+    bool IsOwner(const MblCloudConnectResourceDatabase::AppHandle app, const ResourceId id) const
+    {
+        return owners_[id] == app;
+    }
+
+    /**
+     * @return whether the cloud may use a method (one of Method) on a
+     *         resource.
+     */
+    bool IsAllowed(const ResourceId id, const uint8_t method) const
+    {
+        return (methods_[id] & method) != 0;
+    }
+
+    size_t GetResourceCount() const { return methods_.size(); }
+
+private:
+
+    struct IndexSlot
+    {
+        // 0 for an empty slot
+        ResourcePath path;
+        ResourceId id;
+    };
+
+    MblResourceAcl() = default;
+
+    std::unordered_map<StringHandle, MblCloudConnectResourceDatabase::AppHandle> apps_;
+    std::vector<IndexSlot> index_;
+    size_t index_mask_;
+    // Owner of each resource, indexed by resource ID
+    std::vector<MblCloudConnectResourceDatabase::AppHandle> owners_;
+    // Method mask of each resource, indexed by resource ID
+    std::vector<uint8_t> methods_;
+
+    // No copying or moving (see https://github.com/isocpp/CppCoreGuidelines/blob/master/CppCoreGuidelines.md#cdefop-default-operations)
+    MblResourceAcl(const MblResourceAcl&) = delete;
+    MblResourceAcl & operator = (const MblResourceAcl&) = delete;
+    MblResourceAcl(MblResourceAcl&&) = delete;
+    MblResourceAcl& operator = (MblResourceAcl&&) = delete;
+};
+
+} // namespace mbl
+
+#endif // MblResourceAcl_h_
@@ -0,0 +1,411 @@
+/*
+ * Copyright (c) 2020 Arm Limited and Contributors. All rights reserved.
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ * Licensed under the Apache License, Version 2.0 (the License); you may
+ * not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an AS IS BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include "MblResourceDefinitionParser.h"
+#include "log_trace.h"
+
+#include <cassert>
+#include <cstring>
+
+#define TRACE_GROUP "CCRB"
+
+namespace mbl {
+
+namespace {
+
+struct NamedValue
+{
+    const char* name;
+    uint8_t value;
+};
+
+const NamedValue g_types[] = {
+    {"string", ResourceDescriptor::Type_String},
+    {"integer", ResourceDescriptor::Type_Integer},
+    {"float", ResourceDescriptor::Type_Float},
+    {"boolean", ResourceDescriptor::Type_Boolean},
+    {"opaque", ResourceDescriptor::Type_Opaque},
+    {"time", ResourceDescriptor::Type_Time},
+    {"objlink", ResourceDescriptor::Type_ObjectLink},
+};
+
+const NamedValue g_operations[] = {
+    {"get", ResourceDescriptor::Operation_Get},
+    {"put", ResourceDescriptor::Operation_Put},
+    {"post", ResourceDescriptor::Operation_Post},
+    {"delete", ResourceDescriptor::Operation_Delete},
+};
+
+bool equals(const char* const str, const size_t length, const char* const literal)
+{
+    return std::strlen(literal) == length && std::memcmp(str, literal, length) == 0;
+}
+
+template <size_t N>
+bool find_named_value(const NamedValue (&table)[N], const char* const str, const size_t length, uint8_t& value)
+{
+    for (const NamedValue& entry : table) {
+        if (equals(str, length, entry.name)) {
+            value = entry.value;
+            return true;
+        }
+    }
+    return false;
+}
+
+bool parse_id(const char* const str, const size_t length, uint16_t& id)
+{
+    if (length == 0 || length > 5) {
+        return false;
+    }
+    uint32_t value = 0;
+    for (size_t i = 0; i < length; ++i) {
+        if (str[i] < '0' || str[i] > '9') {
+            return false;
+        }
+        value = value * 10 + static_cast<uint32_t>(str[i] - '0');
+    }
+    if (value > UINT16_MAX) {
+        return false;
+    }
+    id = static_cast<uint16_t>(value);
+    return true;
+}
+
+} // namespace
+
+MblResourceDefinitionParser::MblResourceDefinitionParser(
+    MblCloudConnectResourceDatabase& db,
+    const MblCloudConnectResourceDatabase::AppHandle app)
+    : db_(db)
+    , app_(app)
+    , level_(Level_Document)
+    , property_(Property_None)
+    , ids_()
+    , descriptor_()
+    , resource_type_()
+    , value_()
+    , value_kind_(ValueKind_None)
+    , have_mode_(false)
+    , have_type_(false)
+{
+}
+
+MblError MblResourceDefinitionParser::Parse(const char* const json, const size_t length)
+{
+    level_ = Level_Document;
+    property_ = Property_None;
+
+    MblJsonSaxParser parser(*this);
+    const MblError ret = parser.Parse(json, length);
+    if (ret == Error::CCRBInvalidJson) {
+        tr_error(
+            "Invalid resource definition JSON at offset %zu: %s",
+            parser.GetErrorOffset(),
+            parser.GetErrorMessage());
+    }
+    return ret;
+}
+
+MblError MblResourceDefinitionParser::SchemaError(const char* const message)
+{
+    switch (level_) {
+        case Level_Properties:
+        case Level_Operations:
+            tr_error(
+                "Invalid definition of resource /%u/%u/%u: %s",
+                static_cast<unsigned>(ids_[0]),
+                static_cast<unsigned>(ids_[1]),
+                static_cast<unsigned>(ids_[2]),
+                message);
+            break;
+        default:
+            tr_error("Invalid resource definition: %s", message);
+            break;
+    }
+    return Error::CCRBInvalidResourceDefinition;
+}
+
+MblError MblResourceDefinitionParser::UnexpectedValue()
+{
+    switch (level_) {
+        case Level_Document: return SchemaError("expected an object of LwM2M objects");
+        case Level_Objects: return SchemaError("expected an object of object instances");
+        case Level_Instances: return SchemaError("expected an object of resources");
+        case Level_Resources: return SchemaError("expected an object of resource properties");
+        case Level_Properties: return SchemaError("wrong kind of value for property");
+        case Level_Operations: return SchemaError("operations must be strings");
+    }
+    assert(false);
+    return Error::CCRBInvalidResourceDefinition;
+}
+
+MblError MblResourceDefinitionParser::StartObject()
+{
+    switch (level_) {
+        case Level_Document: level_ = Level_Objects; return Error::None;
+        case Level_Objects: level_ = Level_Instances; return Error::None;
+        case Level_Instances: level_ = Level_Resources; return Error::None;
+        case Level_Resources: level_ = Level_Properties; return StartResource();
+        default: return UnexpectedValue();
+    }
+}
+
+MblError MblResourceDefinitionParser::Key(const char* const str, const size_t length)
+{
+    switch (level_) {
+        case Level_Objects:
+        case Level_Instances:
+        case Level_Resources:
+        {
+            const size_t index = static_cast<size_t>(level_ - Level_Objects);
+            if (!parse_id(str, length, ids_[index])) {
+                static const char* const messages[] = {
+                    "invalid object ID", "invalid object instance ID", "invalid resource ID"};
+                return SchemaError(messages[index]);
+            }
+            return Error::None;
+        }
+
+        case Level_Properties:
+            if (equals(str, length, "mode")) {
+                property_ = Property_Mode;
+            }
+            else if (equals(str, length, "resource_type")) {
+                property_ = Property_ResourceType;
+            }
+            else if (equals(str, length, "type")) {
+                property_ = Property_Type;
+            }
+            else if (equals(str, length, "value")) {
+                property_ = Property_Value;
+            }
+            else if (equals(str, length, "operations")) {
+                property_ = Property_Operations;
+            }
+            else if (equals(str, length, "multiple_instance")) {
+                property_ = Property_MultipleInstance;
+            }
+            else if (equals(str, length, "observable")) {
+                property_ = Property_Observable;
+            }
+            else {
+                return SchemaError("unknown property");
+            }
+            return Error::None;
+
+        default:
+            // The JSON parser only reports keys inside objects
+            assert(false);
+            return Error::CCRBInvalidResourceDefinition;
+    }
+}
+
+MblError MblResourceDefinitionParser::EndObject()
+{
+    switch (level_) {
+        case Level_Objects: level_ = Level_Document; return Error::None;
+        case Level_Instances: level_ = Level_Objects; return Error::None;
+        case Level_Resources: level_ = Level_Instances; return Error::None;
+        case Level_Properties: return EndResource();
+        default:
+            assert(false);
+            return Error::CCRBInvalidResourceDefinition;
+    }
+}
+
+MblError MblResourceDefinitionParser::StartArray()
+{
+    if (level_ != Level_Properties || property_ != Property_Operations) {
+        return UnexpectedValue();
+    }
+    level_ = Level_Operations;
+    descriptor_.operations = 0;
+    return Error::None;
+}
+
+MblError MblResourceDefinitionParser::EndArray()
+{
+    assert(level_ == Level_Operations);
+    level_ = Level_Properties;
+    return Error::None;
+}
+
+MblError MblResourceDefinitionParser::String(const char* const str, const size_t length)
+{
+    if (level_ == Level_Operations) {
+        uint8_t operation = 0;
+        if (!find_named_value(g_operations, str, length, operation)) {
+            return SchemaError("unknown operation");
+        }
+        descriptor_.operations |= operation;
+        return Error::None;
+    }
+    if (level_ != Level_Properties) {
+        return UnexpectedValue();
+    }
+
+    switch (property_) {
+        case Property_Mode:
+            if (equals(str, length, "dynamic")) {
+                descriptor_.flags |= ResourceDescriptor::Flag_Dynamic;
+            }
+            else if (equals(str, length, "static")) {
+                descriptor_.flags &= static_cast<uint8_t>(~ResourceDescriptor::Flag_Dynamic);
+            }
+            else {
+                return SchemaError("mode must be \"static\" or \"dynamic\"");
+            }
+            have_mode_ = true;
+            return Error::None;
+
+        case Property_ResourceType:
+            resource_type_.assign(str, length);
+            return Error::None;
+
+        case Property_Type:
+            if (!find_named_value(g_types, str, length, descriptor_.type)) {
+                return SchemaError("unknown type");
+            }
+            have_type_ = true;
+            return Error::None;
+
+        case Property_Value:
+            value_.assign(str, length);
+            value_kind_ = ValueKind_String;
+            return Error::None;
+
+        default:
+            return UnexpectedValue();
+    }
+}
+
+MblError MblResourceDefinitionParser::Number(const char* const str, const size_t length)
+{
+    if (level_ != Level_Properties || property_ != Property_Value) {
+        return UnexpectedValue();
+    }
+    // Kept as text: the JSON parser has already checked its syntax
+    value_.assign(str, length);
+    value_kind_ = ValueKind_Number;
+    return Error::None;
+}
+
+MblError MblResourceDefinitionParser::Boolean(const bool value)
+{
+    if (level_ != Level_Properties) {
+        return UnexpectedValue();
+    }
+
+    switch (property_) {
+        case Property_Value:
+            value_ = value ? "true" : "false";
+            value_kind_ = ValueKind_Boolean;
+            return Error::None;
+
+        case Property_MultipleInstance:
+            if (value) {
+                descriptor_.flags |= ResourceDescriptor::Flag_MultipleInstance;
+            }
+            else {
+                descriptor_.flags &= static_cast<uint8_t>(~ResourceDescriptor::Flag_MultipleInstance);
+            }
+            return Error::None;
+
+        case Property_Observable:
+            if (value) {
+                descriptor_.flags |= ResourceDescriptor::Flag_Observable;
+            }
+            else {
+                descriptor_.flags &= static_cast<uint8_t>(~ResourceDescriptor::Flag_Observable);
+            }
+            return Error::None;
+
+        default:
+            return UnexpectedValue();
+    }
+}
+
+MblError MblResourceDefinitionParser::Null()
+{
+    return UnexpectedValue();
+}
+
+MblError MblResourceDefinitionParser::StartResource()
+{
+    descriptor_ = ResourceDescriptor();
+    descriptor_.path = MakeResourcePath(ids_[0], ids_[1], ids_[2]);
+    resource_type_.clear();
+    value_.clear();
+    value_kind_ = ValueKind_None;
+    have_mode_ = false;
+    have_type_ = false;
+    property_ = Property_None;
+    return Error::None;
+}
+
+MblError MblResourceDefinitionParser::EndResource()
+{
+    if (!have_mode_) {
+        return SchemaError("missing \"mode\"");
+    }
+    if (!have_type_) {
+        return SchemaError("missing \"type\"");
+    }
+
+    if (value_kind_ != ValueKind_None) {
+        ValueKind expected = ValueKind_String;
+        switch (descriptor_.type) {
+            case ResourceDescriptor::Type_Integer:
+            case ResourceDescriptor::Type_Float:
+            case ResourceDescriptor::Type_Time:
+                expected = ValueKind_Number;
+                break;
+            case ResourceDescriptor::Type_Boolean:
+                expected = ValueKind_Boolean;
+                break;
+            default:
+                break;
+        }
+        if (value_kind_ != expected) {
+            return SchemaError("value does not match type");
+        }
+        if ((descriptor_.type == ResourceDescriptor::Type_Integer ||
+             descriptor_.type == ResourceDescriptor::Type_Time) &&
+            value_.find_first_of(".eE") != std::string::npos)
+        {
+            return SchemaError("value of an integer resource must be an integer");
+        }
+    }
+
+    const MblError ret = db_.AddResource(app_, descriptor_, resource_type_.c_str(), value_.c_str());
+    if (ret != Error::None) {
+        tr_error(
+            "Adding resource /%u/%u/%u failed with error %s",
+            static_cast<unsigned>(ids_[0]),
+            static_cast<unsigned>(ids_[1]),
+            static_cast<unsigned>(ids_[2]),
+            MblError_to_str(ret));
+        return ret;
+    }
+
+    level_ = Level_Resources;
+    return Error::None;
+}
+
+} // namespace mbl
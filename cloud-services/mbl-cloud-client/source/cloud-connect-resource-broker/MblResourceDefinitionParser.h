@@ -0,0 +1,153 @@
+/*
+ * Copyright (c) 2020 Arm Limited and Contributors. All rights reserved.
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ * Licensed under the Apache License, Version 2.0 (the License); you may
+ * not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an AS IS BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#ifndef MblResourceDefinitionParser_h_
+#define MblResourceDefinitionParser_h_
+
+#include "MblCloudConnectResourceDatabase.h"
+#include "MblJsonSaxParser.h"
+
+#include <string>
+
+namespace mbl {
+
+/*! \file MblResourceDefinitionParser.h
+ *  \brief MblResourceDefinitionParser.
+ *  Streaming parser for the resource definition JSON that an application
+ *  sends with a RegisterResources request. Resources are added to the
+ *  database as soon as each one has been read; no document tree is built.
+ *
+ *  The definition is an object of LwM2M objects, each an object of object
+ *  instances, each an object of resources. IDs are decimal strings:
+ *
+ *  {
+ *      "3303": {
+ *          "0": {
+ *              "5700": {
+ *                  "mode": "dynamic",
+ *                  "resource_type": "temperature",
+ *                  "type": "float",
+ *                  "value": 21.5,
+ *                  "operations": ["get"],
+ *                  "multiple_instance": false,
+ *                  "observable": true
+ *              }
+ *          }
+ *      }
+ *  }
+ *
+ *  "mode" ("static" or "dynamic") and "type" ("string", "integer", "float",
+ *  "boolean", "opaque", "time" or "objlink") are required. Other properties
+ *  are optional; unknown properties are rejected.
+ */
+
+class MblResourceDefinitionParser : private MblJsonSaxHandler {
+
+public:
+
+    MblResourceDefinitionParser(MblCloudConnectResourceDatabase& db, MblCloudConnectResourceDatabase::AppHandle app);
+    ~MblResourceDefinitionParser() override = default;
+
+    /**
+     * Parse a resource definition and add its resources to the database.
+     * On failure, resources read before the error remain in the database;
+     * the caller is expected to remove the application.
+     *
+     * @return Error::None, Error::CCRBInvalidJson,
+     *         Error::CCRBInvalidResourceDefinition, or an error from
+     *         MblCloudConnectResourceDatabase::AddResource().
+     */
+    MblError Parse(const char* json, size_t length);
+
+private:
+
+    // Position in the definition: the level whose keys are being read
+    enum Level
+    {
+        Level_Document,
+        Level_Objects,
+        Level_Instances,
+        Level_Resources,
+        Level_Properties,
+        Level_Operations
+    };
+
+    enum Property
+    {
+        Property_None,
+        Property_Mode,
+        Property_ResourceType,
+        Property_Type,
+        Property_Value,
+        Property_Operations,
+        Property_MultipleInstance,
+        Property_Observable
+    };
+
+    // Kind of JSON value given for "value"
+    enum ValueKind
+    {
+        ValueKind_None,
+        ValueKind_String,
+        ValueKind_Number,
+        ValueKind_Boolean
+    };
+
+    // MblJsonSaxHandler
+    MblError StartObject() override;
+    MblError Key(const char* str, size_t length) override;
+    MblError EndObject() override;
+    MblError StartArray() override;
+    MblError EndArray() override;
+    MblError String(const char* str, size_t length) override;
+    MblError Number(const char* str, size_t length) override;
+    MblError Boolean(bool value) override;
+    MblError Null() override;
+
+    MblError SchemaError(const char* message);
+    MblError UnexpectedValue();
+    MblError StartResource();
+    MblError EndResource();
+
+    MblCloudConnectResourceDatabase& db_;
+    const MblCloudConnectResourceDatabase::AppHandle app_;
+    Level level_;
+    Property property_;
+
+    // IDs of the object, instance and resource being read
+    uint16_t ids_[3];
+
+    // The resource being read. The strings are reused between resources to
+    // avoid allocating for each one.
+    ResourceDescriptor descriptor_;
+    std::string resource_type_;
+    std::string value_;
+    ValueKind value_kind_;
+    bool have_mode_;
+    bool have_type_;
+
+    // No copying or moving (see https://github.com/isocpp/CppCoreGuidelines/blob/master/CppCoreGuidelines.md#cdefop-default-operations)
+    MblResourceDefinitionParser(const MblResourceDefinitionParser&) = delete;
+    MblResourceDefinitionParser & operator = (const MblResourceDefinitionParser&) = delete;
+    MblResourceDefinitionParser(MblResourceDefinitionParser&&) = delete;
+    MblResourceDefinitionParser& operator = (MblResourceDefinitionParser&&) = delete;
+};
+
+} // namespace mbl
+
+#endif // MblResourceDefinitionParser_h_
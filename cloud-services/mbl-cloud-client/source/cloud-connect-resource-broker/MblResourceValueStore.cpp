@@ -0,0 +1,187 @@
+/*
+ * Copyright (c) 2020 Arm Limited and Contributors. All rights reserved.
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ * Licensed under the Apache License, Version 2.0 (the License); you may
+ * not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an AS IS BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include "MblResourceValueStore.h"
+
+#include "log_trace.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <sched.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#define TRACE_GROUP "CCRB-VALUES"
+
+namespace mbl {
+
+using namespace ccrb_value_store;
+
+// Reads of a slot that is being written spin this many times, then yield
+// until max_read_attempts
+static const unsigned g_read_spins = 64;
+static const unsigned g_max_read_attempts = 1024;
+
+MblResourceValueStore::MblResourceValueStore()
+    : fd_(-1)
+    , region_(MAP_FAILED)
+    , region_size_(0)
+    , slot_count_(0)
+{
+}
+
+MblResourceValueStore::~MblResourceValueStore()
+{
+    if (region_ != MAP_FAILED) {
+        munmap(region_, region_size_);
+    }
+    if (fd_ != -1) {
+        close(fd_);
+    }
+}
+
+MblError MblResourceValueStore::Init(const MblCloudConnectResourceDatabase::ResourceList& resources)
+{
+    assert(fd_ == -1);
+
+    slot_count_ = resources.size();
+    region_size_ = RegionSize(slot_count_);
+    paths_.resize(slot_count_);
+    read_sequences_.assign(slot_count_, 0);
+
+    fd_ = memfd_create("mbl-cloud-connect-values", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+    if (fd_ == -1) {
+        tr_error("memfd_create failed: %s", std::strerror(errno));
+        return Error::CCRBValueStoreFailed;
+    }
+    if (ftruncate(fd_, static_cast<off_t>(region_size_)) != 0) {
+        tr_error("Failed to size value store: %s", std::strerror(errno));
+        return Error::CCRBValueStoreFailed;
+    }
+
+    // The application gets the same file, so stop it from shrinking the
+    // region under the broker's mapping or unsealing it
+    if (fcntl(fd_, F_ADD_SEALS, F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_SEAL) != 0) {
+        tr_error("Failed to seal value store: %s", std::strerror(errno));
+        return Error::CCRBValueStoreFailed;
+    }
+
+    region_ = mmap(nullptr, region_size_, PROT_READ | PROT_WRITE, MAP_SHARED, fd_, 0);
+    if (region_ == MAP_FAILED) {
+        tr_error("Failed to map value store: %s", std::strerror(errno));
+        return Error::CCRBValueStoreFailed;
+    }
+
+    // A new memfd is zero filled, so every sequence number starts at 0
+    Header* const header = static_cast<Header*>(region_);
+    header->magic = magic;
+    header->version = version;
+    header->slot_count = static_cast<uint32_t>(slot_count_);
+    header->slot_size = static_cast<uint32_t>(slot_size);
+
+    Slot* const slots = GetSlots(region_);
+    for (size_t i = 0; i < slot_count_; ++i) {
+        slots[i].object_id = ResourcePathObjectId(resources[i].path);
+        slots[i].instance_id = ResourcePathInstanceId(resources[i].path);
+        slots[i].resource_id = ResourcePathResourceId(resources[i].path);
+        paths_[i] = resources[i].path;
+    }
+
+    tr_debug("Created value store with %zu slots", slot_count_);
+    return Error::None;
+}
+
+int MblResourceValueStore::DupFd() const
+{
+    const int fd = fcntl(fd_, F_DUPFD_CLOEXEC, 0);
+    if (fd == -1) {
+        tr_error("Failed to duplicate value store fd: %s", std::strerror(errno));
+    }
+    return fd;
+}
+
+MblError MblResourceValueStore::Read(const size_t slot, std::string& value, bool& written) const
+{
+    assert(slot < slot_count_);
+    Slot& s = GetSlots(region_)[slot];
+
+    char buffer[max_value_length];
+    for (unsigned attempt = 0; attempt < g_max_read_attempts; ++attempt) {
+        const uint32_t before = s.sequence.load(std::memory_order_acquire);
+        if (before == 0) {
+            written = false;
+            return Error::None;
+        }
+        if (before & 1) {
+            if (attempt >= g_read_spins) {
+                sched_yield();
+            }
+            continue;
+        }
+
+        // Read the length exactly once so that it can't change between the
+        // check and the copy
+        const size_t length = std::min<size_t>(
+            *static_cast<const volatile uint16_t*>(&s.length),
+            max_value_length);
+        std::memcpy(buffer, s.value, length);
+
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (s.sequence.load(std::memory_order_relaxed) == before) {
+            value.assign(buffer, length);
+            written = true;
+            return Error::None;
+        }
+    }
+
+    tr_warn("Gave up reading value store slot %zu: it is always being written", slot);
+    return Error::CCRBValueStoreBusy;
+}
+
+size_t MblResourceValueStore::ReadChanged(std::vector<ResourceValue>& values)
+{
+    Slot* const slots = GetSlots(region_);
+    char buffer[max_value_length];
+    size_t count = 0;
+    for (size_t i = 0; i < slot_count_; ++i) {
+        Slot& s = slots[i];
+        const uint32_t before = s.sequence.load(std::memory_order_acquire);
+        if (before == read_sequences_[i] || (before & 1)) {
+            continue;
+        }
+
+        const size_t length = std::min<size_t>(
+            *static_cast<const volatile uint16_t*>(&s.length),
+            max_value_length);
+        std::memcpy(buffer, s.value, length);
+
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (s.sequence.load(std::memory_order_relaxed) != before) {
+            continue;
+        }
+        read_sequences_[i] = before;
+        values.push_back(ResourceValue{paths_[i], std::string(buffer, length)});
+        ++count;
+    }
+    return count;
+}
+
+} // namespace mbl
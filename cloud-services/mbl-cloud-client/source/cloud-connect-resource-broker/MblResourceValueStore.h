@@ -0,0 +1,108 @@
+/*
+ * Copyright (c) 2020 Arm Limited and Contributors. All rights reserved.
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ * Licensed under the Apache License, Version 2.0 (the License); you may
+ * not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an AS IS BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#ifndef MblResourceValueStore_h_
+#define MblResourceValueStore_h_
+
+#include "MblCloudConnectCloudClientInterface.h"
+#include "MblCloudConnectResourceDatabase.h"
+#include "MblError.h"
+#include "MblResourceValueStoreLayout.h"
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+namespace mbl {
+
+/*! \file MblResourceValueStore.h
+ *  \brief MblResourceValueStore.
+ *  The broker's side of an application's shared memory value store (see
+ *  MblResourceValueStoreLayout.h).
+ *
+ *  The application can write anything to the region, so reads never trust
+ *  its contents: lengths are clamped, and a slot that is never stable gives
+ *  up rather than spin forever. The memfd is sealed against resizing, so the
+ *  application can't make the broker's mapping fault either. Slot resource
+ *  IDs are only written for the application's benefit: the broker keeps its
+ *  own copy of each slot's path.
+ *
+ *  ReadChanged() must only be called by one thread at a time, but may run
+ *  alongside Read().
+ */
+class MblResourceValueStore {
+
+public:
+
+    MblResourceValueStore();
+    ~MblResourceValueStore();
+
+    /**
+     * Create the region, with one slot for each resource in the order given.
+     *
+     * @return Error::None or Error::CCRBValueStoreFailed.
+     */
+    MblError Init(const MblCloudConnectResourceDatabase::ResourceList& resources);
+
+    /**
+     * @return a new close-on-exec descriptor for the region, which the caller
+     *         must close, or -1 on failure.
+     */
+    int DupFd() const;
+
+    /**
+     * Read a snapshot of the value in a slot.
+     *
+     * @param written set to false if the application hasn't written the slot
+     *        yet, in which case value is left unchanged.
+     * @return Error::None, or Error::CCRBValueStoreBusy if the application
+     *         kept writing the slot for the whole time the broker tried to
+     *         read it.
+     */
+    MblError Read(size_t slot, std::string& value, bool& written) const;
+
+    /**
+     * Append the value of each slot written since the last call. Never
+     * waits: a slot that is being written is left for the next call.
+     *
+     * @return the number of values appended.
+     */
+    size_t ReadChanged(std::vector<ResourceValue>& values);
+
+private:
+
+    int fd_;
+    void* region_;
+    size_t region_size_;
+    size_t slot_count_;
+
+    // Path of each slot
+    std::vector<ResourcePath> paths_;
+    // Sequence number of each slot when ReadChanged() last read it
+    std::vector<uint32_t> read_sequences_;
+
+    // No copying or moving (see https://github.com/isocpp/CppCoreGuidelines/blob/master/CppCoreGuidelines.md#cdefop-default-operations)
+    MblResourceValueStore(const MblResourceValueStore&) = delete;
+    MblResourceValueStore & operator = (const MblResourceValueStore&) = delete;
+    MblResourceValueStore(MblResourceValueStore&&) = delete;
+    MblResourceValueStore& operator = (MblResourceValueStore&&) = delete;
+};
+
+} // namespace mbl
+
+#endif // MblResourceValueStore_h_
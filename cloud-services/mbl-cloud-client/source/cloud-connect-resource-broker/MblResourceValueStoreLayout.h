@@ -0,0 +1,142 @@
+/*
+ * Copyright (c) 2020 Arm Limited and Contributors. All rights reserved.
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ * Licensed under the Apache License, Version 2.0 (the License); you may
+ * not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an AS IS BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#ifndef MblResourceValueStoreLayout_h_
+#define MblResourceValueStoreLayout_h_
+
+#include <atomic>
+#include <cstddef>
+#include <cstring>
+#include <stdint.h>
+
+namespace mbl {
+
+/*! \file MblResourceValueStoreLayout.h
+ *  \brief Layout of the shared memory value store of an application.
+ *
+ *  An application that updates resource values very often can ask the
+ *  resource broker for a value store (OpenValueStore on either IPC backend)
+ *  instead of calling SetResourceValue for every change. The broker replies
+ *  with a sealed memfd that the application maps read/write with MAP_SHARED.
+ *
+ *  The region is a Header followed by Header::slot_count Slots, one for each
+ *  of the application's resources. The broker fills in each slot's resource
+ *  IDs; use FindSlot() to look one up. The application writes values with
+ *  WriteValue(). On each notification tick the broker sends the latest value
+ *  of every slot written since the last tick to the cloud, so a value can
+ *  change any number of times between ticks at no IPC cost.
+ *
+ *  Each slot is a seqlock: its sequence number is odd while a write is in
+ *  progress, and a reader retries if the number changed while it copied the
+ *  value. Only one thread may write a given slot at a time.
+ */
+namespace ccrb_value_store {
+
+static const uint32_t magic = 0x53564342; // "BCVS"
+static const uint32_t version = 1;
+
+static const size_t slot_size = 128;
+static const size_t max_value_length = slot_size - 16;
+
+struct Header
+{
+    uint32_t magic;
+    uint32_t version;
+    uint32_t slot_count;
+    uint32_t slot_size;
+    uint8_t reserved[48];
+};
+
+struct Slot
+{
+    // 0 until the value is first written; odd while it is being written
+    std::atomic<uint32_t> sequence;
+    uint16_t object_id;
+    uint16_t instance_id;
+    uint16_t resource_id;
+    // Length of value in bytes. There is no terminating NUL.
+    uint16_t length;
+    uint32_t reserved;
+    char value[max_value_length];
+};
+
+static_assert(sizeof(Header) == 64, "Slots must start on a cache line");
+static_assert(sizeof(Slot) == slot_size, "Unexpected Slot padding");
+static_assert(ATOMIC_INT_LOCK_FREE == 2, "Shared memory sequence numbers must be lock free");
+
+inline size_t RegionSize(const size_t slot_count)
+{
+    return sizeof(Header) + slot_count * slot_size;
+}
+
+inline Slot* GetSlots(void* const region)
+{
+    return reinterpret_cast<Slot*>(static_cast<uint8_t*>(region) + sizeof(Header));
+}
+
+/**
+ * @return the slot of a resource, or nullptr if it has none.
+ */
+inline Slot* FindSlot(
+    void* const region,
+    const uint16_t object_id,
+    const uint16_t instance_id,
+    const uint16_t resource_id)
+{
+    const Header* const header = static_cast<const Header*>(region);
+    Slot* const slots = GetSlots(region);
+    for (uint32_t i = 0; i < header->slot_count; ++i) {
+        if (slots[i].object_id == object_id &&
+            slots[i].instance_id == instance_id &&
+            slots[i].resource_id == resource_id)
+        {
+            return &slots[i];
+        }
+    }
+    return nullptr;
+}
+
+/**
+ * Write a value to a slot. Never blocks.
+ *
+ * @return false if the value is longer than max_value_length.
+ */
+inline bool WriteValue(Slot& slot, const char* const value, const size_t length)
+{
+    if (length > max_value_length) {
+        return false;
+    }
+
+    const uint32_t sequence = slot.sequence.load(std::memory_order_relaxed);
+    slot.sequence.store(sequence + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+
+    std::memcpy(slot.value, value, length);
+    slot.length = static_cast<uint16_t>(length);
+
+    // Skip 0 when the sequence number wraps: it means "never written"
+    const uint32_t next = (sequence + 2 == 0) ? 2 : sequence + 2;
+    slot.sequence.store(next, std::memory_order_release);
+    return true;
+}
+
+} // namespace ccrb_value_store
+
+} // namespace mbl
+
+#endif // MblResourceValueStoreLayout_h_
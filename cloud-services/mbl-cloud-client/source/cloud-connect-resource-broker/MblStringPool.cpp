@@ -0,0 +1,330 @@
+/*
+ * Copyright (c) 2020 Arm Limited and Contributors. All rights reserved.
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ * Licensed under the Apache License, Version 2.0 (the License); you may
+ * not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an AS IS BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include "MblStringPool.h"
+#include "MblMutex.h"
+#include "MblScopedLock.h"
+
+#include "log_trace.h"
+#include "metrics.h"
+
+#include <atomic>
+#include <cassert>
+#include <cstring>
+#include <vector>
+
+#define TRACE_GROUP "CCRB"
+
+namespace mbl {
+
+const StringHandle MblStringPool::invalid_handle;
+const size_t MblStringPool::max_length;
+
+// A handle is a chunk number in the high 20 bits and an offset in the chunk
+// in the low 12 bits. Each string is stored as a uint32_t length and a
+// uint32_t reference count, then its characters and a NUL, padded to a
+// multiple of 4 bytes.
+static const unsigned g_chunk_shift = 12;
+static const size_t g_chunk_size = size_t(1) << g_chunk_shift;
+static const size_t g_max_chunks = 4096;
+static const size_t g_header_size = 2 * sizeof(uint32_t);
+static const size_t g_max_entry_size = (g_header_size + MblStringPool::max_length + 1 + 3) & ~size_t(3);
+
+// Reference count of a string added with Intern(), which is never removed
+static const uint32_t g_pinned = UINT32_MAX;
+
+// Smallest index size. The index is kept at most half full.
+static const size_t g_min_index_capacity = 64;
+
+// Chunks are published with a release store before any handle in them is
+// returned, so Get() can read them without the lock
+static std::atomic<char*> g_chunks[g_max_chunks];
+
+// Protects everything below
+static MblMutex g_mutex("ccrb_string_pool");
+static size_t g_chunk_count = 0;
+// Bytes used in the last chunk
+static size_t g_chunk_used = 0;
+// Handles of removed entries whose space can be reused, by entry size / 4
+static std::vector<StringHandle> g_free_entries[g_max_entry_size / 4 + 1];
+// Open-addressing hash index of every string's handle
+static std::vector<StringHandle> g_index;
+static size_t g_string_count = 0;
+static size_t g_data_bytes = 0;
+static size_t g_naive_bytes = 0;
+
+static metrics::Gauge g_pool_strings("ccrb_string_pool_strings");
+static metrics::Gauge g_pool_bytes("ccrb_string_pool_bytes");
+static metrics::Gauge g_pool_saved_bytes("ccrb_string_pool_saved_bytes");
+
+static size_t entry_size(const size_t length)
+{
+    return (g_header_size + length + 1 + 3) & ~size_t(3);
+}
+
+static size_t hash_string(const char* const str, const size_t length)
+{
+    // FNV-1a
+    uint64_t hash = 0xcbf29ce484222325ULL;
+    for (size_t i = 0; i < length; ++i) {
+        hash ^= static_cast<uint8_t>(str[i]);
+        hash *= 0x100000001b3ULL;
+    }
+    return static_cast<size_t>(hash);
+}
+
+static const char* get_entry(const StringHandle handle)
+{
+    const char* const chunk = g_chunks[handle >> g_chunk_shift].load(std::memory_order_acquire);
+    return chunk + (handle & (g_chunk_size - 1));
+}
+
+static uint32_t get_entry_length(const char* const entry)
+{
+    uint32_t length = 0;
+    std::memcpy(&length, entry, sizeof(length));
+    return length;
+}
+
+// The reference count is only used with g_mutex held
+static uint32_t* get_entry_refs(const StringHandle handle)
+{
+    char* const chunk = g_chunks[handle >> g_chunk_shift].load(std::memory_order_relaxed);
+    return reinterpret_cast<uint32_t*>(chunk + (handle & (g_chunk_size - 1)) + sizeof(uint32_t));
+}
+
+// Estimated size of one entry of a std::unordered_map<std::string,
+// StringHandle> holding a string of this length: the node (key, value, next
+// pointer and cached hash, plus malloc overhead), a bucket pointer and the
+// key's heap buffer if it is too long for the small string optimisation
+static size_t naive_entry_size(const size_t length)
+{
+    size_t size = sizeof(std::string) + sizeof(StringHandle) + 4 * sizeof(void*) + sizeof(void*);
+    if (length > 15) {
+        size += length + 1;
+    }
+    return size;
+}
+
+// Find the index slot holding str, or the empty slot where it would go.
+// Called with g_mutex held.
+static size_t find_slot(const char* const str, const size_t length)
+{
+    const size_t mask = g_index.size() - 1;
+    size_t slot = hash_string(str, length) & mask;
+    while (g_index[slot] != MblStringPool::invalid_handle) {
+        const char* const entry = get_entry(g_index[slot]);
+        if (get_entry_length(entry) == length && std::memcmp(entry + g_header_size, str, length) == 0) {
+            break;
+        }
+        slot = (slot + 1) & mask;
+    }
+    return slot;
+}
+
+// Remove the handle in an index slot, moving later entries of its probe
+// sequence back so that lookups still find them. Called with g_mutex held.
+static void erase_slot(size_t hole)
+{
+    const size_t mask = g_index.size() - 1;
+    for (size_t slot = (hole + 1) & mask; g_index[slot] != MblStringPool::invalid_handle; slot = (slot + 1) & mask) {
+        const char* const entry = get_entry(g_index[slot]);
+        const size_t home = hash_string(entry + g_header_size, get_entry_length(entry)) & mask;
+        // Move the entry into the hole unless its home slot lies after the
+        // hole (cyclically), where a lookup would start past the hole
+        if (((slot - home) & mask) >= ((slot - hole) & mask)) {
+            g_index[hole] = g_index[slot];
+            hole = slot;
+        }
+    }
+    g_index[hole] = MblStringPool::invalid_handle;
+}
+
+static void grow_index()
+{
+    std::vector<StringHandle> old_index(g_index.empty() ? g_min_index_capacity : g_index.size() * 2);
+    old_index.swap(g_index);
+    for (const StringHandle handle : old_index) {
+        if (handle != MblStringPool::invalid_handle) {
+            const char* const entry = get_entry(handle);
+            g_index[find_slot(entry + g_header_size, get_entry_length(entry))] = handle;
+        }
+    }
+}
+
+static void update_metrics()
+{
+    const size_t pool_bytes = g_data_bytes + g_index.size() * sizeof(StringHandle);
+    g_pool_strings.set(static_cast<int64_t>(g_string_count));
+    g_pool_bytes.set(static_cast<int64_t>(pool_bytes));
+    g_pool_saved_bytes.set(static_cast<int64_t>(g_naive_bytes) - static_cast<int64_t>(pool_bytes));
+}
+
+// Intern() and Acquire(): find or add a string, and pin it or count a
+// reference to it
+static StringHandle intern(const char* const str, const size_t length, const bool pin)
+{
+    if (length > MblStringPool::max_length) {
+        tr_error("Can't intern a string of %zu bytes", length);
+        return MblStringPool::invalid_handle;
+    }
+
+    MblScopedLock l(g_mutex);
+
+    if ((g_string_count + 1) * 2 > g_index.size()) {
+        grow_index();
+    }
+    const size_t slot = find_slot(str, length);
+    if (g_index[slot] != MblStringPool::invalid_handle) {
+        uint32_t* const refs = get_entry_refs(g_index[slot]);
+        if (pin) {
+            *refs = g_pinned;
+        }
+        else if (*refs != g_pinned) {
+            ++*refs;
+        }
+        return g_index[slot];
+    }
+
+    // Reuse the space of a removed string of the same entry size if there
+    // is one, otherwise append
+    const size_t size = entry_size(length);
+    std::vector<StringHandle>& free_entries = g_free_entries[size / 4];
+    StringHandle handle = MblStringPool::invalid_handle;
+    if (!free_entries.empty()) {
+        handle = free_entries.back();
+        free_entries.pop_back();
+    }
+    else {
+        if (g_chunk_count == 0 || g_chunk_used + size > g_chunk_size) {
+            if (g_chunk_count == g_max_chunks) {
+                tr_error("String pool is full");
+                return MblStringPool::invalid_handle;
+            }
+            char* const chunk = new char[g_chunk_size];
+            g_chunks[g_chunk_count].store(chunk, std::memory_order_release);
+            ++g_chunk_count;
+            // Offset 0 of the first chunk would be invalid_handle
+            g_chunk_used = (g_chunk_count == 1) ? g_header_size : 0;
+            g_data_bytes += g_chunk_size;
+        }
+        handle = static_cast<StringHandle>(((g_chunk_count - 1) << g_chunk_shift) | g_chunk_used);
+        g_chunk_used += size;
+    }
+
+    char* const entry = g_chunks[handle >> g_chunk_shift].load(std::memory_order_relaxed) + (handle & (g_chunk_size - 1));
+    const uint32_t stored_length = static_cast<uint32_t>(length);
+    const uint32_t refs = pin ? g_pinned : 1;
+    std::memcpy(entry, &stored_length, sizeof(stored_length));
+    std::memcpy(entry + sizeof(stored_length), &refs, sizeof(refs));
+    std::memcpy(entry + g_header_size, str, length);
+    entry[g_header_size + length] = '\0';
+
+    g_index[slot] = handle;
+    ++g_string_count;
+    g_naive_bytes += naive_entry_size(length);
+    update_metrics();
+    return handle;
+}
+
+StringHandle MblStringPool::Intern(const char* const str, const size_t length)
+{
+    return intern(str, length, true);
+}
+
+StringHandle MblStringPool::Acquire(const char* const str, const size_t length)
+{
+    return intern(str, length, false);
+}
+
+void MblStringPool::AddRef(const StringHandle handle)
+{
+    assert(handle != invalid_handle);
+
+    MblScopedLock l(g_mutex);
+
+    uint32_t* const refs = get_entry_refs(handle);
+    assert(*refs > 0);
+    if (*refs != g_pinned) {
+        ++*refs;
+    }
+}
+
+void MblStringPool::Release(const StringHandle handle)
+{
+    if (handle == invalid_handle) {
+        return;
+    }
+
+    MblScopedLock l(g_mutex);
+
+    uint32_t* const refs = get_entry_refs(handle);
+    assert(*refs > 0);
+    if (*refs == g_pinned || --*refs > 0) {
+        return;
+    }
+
+    const char* const entry = get_entry(handle);
+    const size_t length = get_entry_length(entry);
+    const size_t mask = g_index.size() - 1;
+    size_t slot = hash_string(entry + g_header_size, length) & mask;
+    while (g_index[slot] != handle) {
+        assert(g_index[slot] != invalid_handle);
+        slot = (slot + 1) & mask;
+    }
+    erase_slot(slot);
+
+    g_free_entries[entry_size(length) / 4].push_back(handle);
+    --g_string_count;
+    g_naive_bytes -= naive_entry_size(length);
+    update_metrics();
+}
+
+StringHandle MblStringPool::Find(const char* const str, const size_t length)
+{
+    MblScopedLock l(g_mutex);
+
+    if (g_index.empty()) {
+        return invalid_handle;
+    }
+    return g_index[find_slot(str, length)];
+}
+
+const char* MblStringPool::Get(const StringHandle handle)
+{
+    if (handle == invalid_handle) {
+        return "";
+    }
+    return get_entry(handle) + g_header_size;
+}
+
+size_t MblStringPool::GetLength(const StringHandle handle)
+{
+    if (handle == invalid_handle) {
+        return 0;
+    }
+    return get_entry_length(get_entry(handle));
+}
+
+MblStringPool::Stats MblStringPool::GetStats()
+{
+    MblScopedLock l(g_mutex);
+    return Stats{g_string_count, g_data_bytes + g_index.size() * sizeof(StringHandle), g_naive_bytes};
+}
+
+} // namespace mbl
@@ -0,0 +1,126 @@
+/*
+ * Copyright (c) 2020 Arm Limited and Contributors. All rights reserved.
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ * Licensed under the Apache License, Version 2.0 (the License); you may
+ * not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an AS IS BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#ifndef MblStringPool_h_
+#define MblStringPool_h_
+
+#include <cstddef>
+#include <stdint.h>
+#include <string>
+
+namespace mbl {
+
+/**
+ * Handle of a string in MblStringPool. Equal strings have equal handles, so
+ * handles can be compared, hashed and copied instead of the strings.
+ */
+typedef uint32_t StringHandle;
+
+/*! \file MblStringPool.h
+ *  \brief MblStringPool.
+ *  Global pool of interned strings, such as application names, that the
+ *  resource broker would otherwise copy into every request, notification and
+ *  table entry.
+ *
+ *  Strings are packed into 4 KiB chunks that are never freed or moved, so
+ *  Get() needs no lock. Interning looks the string up in a hash index, under
+ *  a mutex.
+ *
+ *  Strings added with Intern() stay for the life of the process, so only
+ *  intern strings from a set that grows slowly. Strings that are unique to
+ *  something short-lived, such as the name of one connection, are added with
+ *  Acquire() instead and counted: when the last reference is released, the
+ *  string is removed and its space reused. Its handle, and anything Get()
+ *  returned for it, must not be used after that.
+ */
+class MblStringPool {
+
+public:
+
+    // Never returned for an interned string
+    static const StringHandle invalid_handle = 0;
+
+    // Longest string that can be interned
+    static const size_t max_length = 1024;
+
+    /**
+     * Intern a string, adding it to the pool if it isn't there already.
+     *
+     * @return its handle, or invalid_handle if it is longer than max_length
+     *         or the pool is full.
+     */
+    static StringHandle Intern(const char* str, size_t length);
+    static StringHandle Intern(const std::string& str) { return Intern(str.data(), str.size()); }
+
+    /**
+     * Like Intern(), but counts a reference to the string that Release()
+     * drops. A string that has also been added with Intern() is never
+     * removed.
+     */
+    static StringHandle Acquire(const char* str, size_t length);
+    static StringHandle Acquire(const std::string& str) { return Acquire(str.data(), str.size()); }
+
+    /**
+     * Count another reference to a string, which the caller must already
+     * hold a reference to (or which was added with Intern()).
+     */
+    static void AddRef(StringHandle handle);
+
+    /**
+     * Drop a reference counted by Acquire() or AddRef(), removing the string
+     * if it was the last one. Does nothing for invalid_handle.
+     */
+    static void Release(StringHandle handle);
+
+    /**
+     * @return the handle of a string if it has been interned, otherwise
+     *         invalid_handle. Never adds to the pool.
+     */
+    static StringHandle Find(const char* str, size_t length);
+
+    /**
+     * @return the NUL-terminated string with the given handle, or "" for
+     *         invalid_handle. Thread safe without locking.
+     */
+    static const char* Get(StringHandle handle);
+
+    /**
+     * @return the length of the string with the given handle.
+     */
+    static size_t GetLength(StringHandle handle);
+
+    struct Stats
+    {
+        size_t strings;
+        // Memory used by the pool: string data and the hash index
+        size_t pool_bytes;
+        // Estimated memory the same strings would take as the keys of a
+        // std::unordered_map<std::string, StringHandle>
+        size_t naive_bytes;
+    };
+
+    static Stats GetStats();
+
+private:
+
+    MblStringPool() = delete;
+};
+
+} // namespace mbl
+
+#endif // MblStringPool_h_
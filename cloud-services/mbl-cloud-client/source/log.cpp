@@ -17,93 +17,99 @@
 
 #include "log.h"
 
-#include "mbed-trace/mbed_trace.h"
+#include "MblLogWriter.h"
+#include "log_time_prefix.h"
+#include "log_trace.h"
+
 #include "mbed-trace-helper/mbed-trace-helper.h"
 
+#ifdef MBL_MUTEX_PROFILING
+#include "MblMutex.h"
+#endif
+
 #include <cassert>
-#include <cerrno>
-#include <cmath>
-#include <cstdio>
-#include <cstring>
-#include <sys/time.h>
-#include <csignal>
-#include <ctime>
 
 #define TRACE_GROUP "mbl"
 
-static const char g_log_path[] = "/var/log/mbl-cloud-client.log";
-static FILE* g_log_stream = 0;
-static volatile sig_atomic_t g_log_need_reopen = 0;
-
-// Format the time prefix strings like "YYYY-mm-DDTHH:MM:ss+HHMM " (one of the
-// ISO 8601 formats). That's 25 chars + nul.
-static const char g_time_prefix_format[] = "%FT%T%z ";
-static const size_t g_time_prefix_buffer_size = 26;
-
-extern "C" void mbl_log_reopen_signal_handler(int)
+// Maximum number of log lines waiting to be written to the log file and what
+// to do when there are more. Set with the MBL_LOG_QUEUE_CAPACITY and
+// MBL_LOG_OVERFLOW_POLICY CMake options.
+#ifndef MBL_LOG_QUEUE_CAPACITY
+#define MBL_LOG_QUEUE_CAPACITY 512
+#endif
+
+#ifdef MBL_LOG_OVERFLOW_BLOCK
+static const mbl::MblLogWriter::OverflowPolicy g_log_overflow_policy =
+    mbl::MblLogWriter::OverflowPolicy_Block;
+#else
+static const mbl::MblLogWriter::OverflowPolicy g_log_overflow_policy =
+    mbl::MblLogWriter::OverflowPolicy_DropOldest;
+#endif
+
+// Repeat suppression and per-group rate limiting of log lines. Set with the
+// MBL_LOG_RATE_LIMIT, MBL_LOG_RATE_BURST and MBL_LOG_REPEAT_WINDOW_MS CMake
+// options.
+#ifndef MBL_LOG_RATE_LIMIT
+#define MBL_LOG_RATE_LIMIT 50
+#endif
+
+#ifndef MBL_LOG_RATE_BURST
+#define MBL_LOG_RATE_BURST 200
+#endif
+
+#ifndef MBL_LOG_REPEAT_WINDOW_MS
+#define MBL_LOG_REPEAT_WINDOW_MS 10000
+#endif
+
+static const mbl::MblLogRateLimiter::Config g_log_rate_limit = {
+    MBL_LOG_RATE_LIMIT,
+    MBL_LOG_RATE_BURST,
+    MBL_LOG_REPEAT_WINDOW_MS
+};
+
+#ifdef MBL_MUTEX_PROFILING
+// Used by mbed-trace instead of mbed-trace-helper's mutex so that it is
+// profiled. mbed-trace takes it recursively, like mbed-trace-helper's.
+static mbl::MblMutex g_trace_mutex("mbed_trace", mbl::MblMutex::Type_Recursive);
+
+static void trace_mutex_wait()
 {
-    g_log_need_reopen = 1;
+    g_trace_mutex.lock();
 }
 
-static void strncpy_with_nul(char* const dest, const char* const src, const size_t n)
+static void trace_mutex_release()
 {
-    assert(n >= 1);
-    strncpy(dest, src, n - 1);
-    dest[n - 1] = '\0';
+    g_trace_mutex.unlock();
 }
+#endif
+
+// Set with the MBL_LOG_SINK and MBL_LOG_BINARY CMake options
+#if defined(MBL_LOG_JOURNALD)
+static const mbl::MblLogWriter::Format g_log_format = mbl::MblLogWriter::Format_Journald;
+static const char g_log_path[] = "";
+#elif defined(MBL_LOG_BINARY)
+static const mbl::MblLogWriter::Format g_log_format = mbl::MblLogWriter::Format_Binary;
+static const char g_log_path[] = "/var/log/mbl-cloud-client.blog";
+#else
+static const mbl::MblLogWriter::Format g_log_format = mbl::MblLogWriter::Format_Text;
+static const char g_log_path[] = "/var/log/mbl-cloud-client.log";
+#endif
 
-static char* make_time_prefix(char* const buffer, const size_t buffer_size)
-{
-    assert(buffer_size >= g_time_prefix_buffer_size);
-
-    static const char fail_str[] = "TIME UNAVAILABLE ";
-
-    struct timeval tv;
-    if (gettimeofday(&tv, 0) != 0) {
-        strncpy_with_nul(buffer, fail_str, buffer_size);
-        return buffer;
-    }
-
-    struct tm time_info;
-    if (!localtime_r(&tv.tv_sec, &time_info)) {
-        strncpy_with_nul(buffer, fail_str, buffer_size);
-        return buffer;
-    }
+// Never deleted: other threads may still be logging while the process exits.
+static mbl::MblLogWriter* g_log_writer = 0;
 
-    if (strftime(buffer, buffer_size, g_time_prefix_format, &time_info) == 0) {
-        strncpy_with_nul(buffer, fail_str, buffer_size);
-    }
-    return buffer;
-}
+// The error that log lines from this thread are reporting (see
+// MblLogErrorScope)
+thread_local static mbl::MblError t_log_error = mbl::Error::None;
 
 /**
- * Callback for printing lines generated by the mbed-trace library. Writes to
- * our log file.
+ * Callback for printing lines generated by the mbed-trace library. Queues the
+ * line to be written to our log file by the log writer thread.
  */
 extern "C" void mbl_trace_print_handler(const char* const str)
 {
-    // Assuming that mbed-trace will synchronize calls to this function.
-
-    if (!g_log_stream || g_log_need_reopen) {
-        if (g_log_stream) {
-            std::fclose(g_log_stream);
-        }
-        g_log_stream = std::fopen(g_log_path, "a");
-        g_log_need_reopen = 0;
-        if (g_log_stream) {
-            // We can't use mbed-trace to log here because it doesn't expect to
-            // be used from within its own print handler
-            char buffer[g_time_prefix_buffer_size];
-            std::fprintf(
-                g_log_stream,
-                "%s[INFO][mbl ]: Log file reopened\n",
-                make_time_prefix(buffer, sizeof(buffer)));
-        }
-    }
-
-    if (g_log_stream) {
-        std::fprintf(g_log_stream, "%s\n", str);
-        std::fflush(g_log_stream);
+    if (g_log_writer) {
+        g_log_writer->write_line(str, t_log_error);
     }
 }
 
@@ -113,40 +119,91 @@ extern "C" void mbl_trace_print_handler(const char* const str)
  */
 extern "C" char* mbl_trace_prefix_handler(size_t)
 {
+#if defined(MBL_LOG_BINARY) || defined(MBL_LOG_JOURNALD)
+    // Binary log records and journal entries are timestamped by the log
+    // writer or journald
+    static char empty[] = "";
+    return empty;
+#else
     // The mbed-trace library requires a function that allocates its own buffer
     // and returns a pointer to it. Use "thread_local" to make it thread safe.
-    thread_local static char buffer[g_time_prefix_buffer_size];
-    return make_time_prefix(buffer, sizeof(buffer));
+    thread_local static char buffer[mbl::log_time_prefix_buffer_size];
+    return mbl::make_time_prefix(buffer, sizeof(buffer));
+#endif
 }
 
 namespace mbl {
 
 MblError log_init()
 {
-    assert(g_log_stream == 0);
-    g_log_stream = std::fopen(g_log_path, "a");
-    if (!g_log_stream) {
-        std::perror("log_init: fopen");
-        return Error::LogInitFopen;
+    assert(g_log_writer == 0);
+    g_log_writer = new MblLogWriter(
+        g_log_path, MBL_LOG_QUEUE_CAPACITY, g_log_overflow_policy, g_log_format, g_log_rate_limit);
+    const MblError writer_err = g_log_writer->start();
+    if (writer_err != Error::None) {
+        delete g_log_writer;
+        g_log_writer = 0;
+        return writer_err;
     }
 
     mbed_trace_init();
 
-    // No colors, no carriage returns, print all log levels
-    mbed_trace_config_set(TRACE_ACTIVE_LEVEL_INFO);
-
     mbed_trace_print_function_set(mbl_trace_print_handler);
     mbed_trace_cmdprint_function_set(mbl_trace_print_handler);
     mbed_trace_prefix_function_set(mbl_trace_prefix_handler);
 
+    // Set the per-group log levels (this also sets mbed-trace's active level)
+    log_trace::load_levels_file();
+
+#ifdef MBL_MUTEX_PROFILING
+    mbed_trace_mutex_wait_function_set(trace_mutex_wait);
+    mbed_trace_mutex_release_function_set(trace_mutex_release);
+#else
     if(!mbed_trace_helper_create_mutex()) {
         return Error::LogInitMutexCreate;
     }
 
     mbed_trace_mutex_wait_function_set(mbed_trace_helper_mutex_wait);
     mbed_trace_mutex_release_function_set(mbed_trace_helper_mutex_release);
+#endif
 
     return Error::None;
 }
 
+void log_shutdown()
+{
+    if (g_log_writer) {
+        g_log_writer->stop();
+    }
+}
+
+void log_request_reopen()
+{
+    if (g_log_writer) {
+        g_log_writer->request_reopen();
+    }
+}
+
+MblLogErrorScope::MblLogErrorScope(const MblError error)
+    : previous_error_(t_log_error)
+{
+    t_log_error = error;
+}
+
+MblLogErrorScope::~MblLogErrorScope()
+{
+    t_log_error = previous_error_;
+}
+
+namespace log_binary {
+
+void write_trace(const Site& site, const uint8_t* const args, const size_t args_length)
+{
+    if (g_log_writer) {
+        g_log_writer->write_trace(site, args, args_length);
+    }
+}
+
+} // namespace log_binary
+
 } // namespace mbl
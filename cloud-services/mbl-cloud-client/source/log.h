@@ -20,13 +20,6 @@
 
 #include "MblError.h"
 
-
-/**
- * A signal handler to tell us to reopen the log file. Intended to be
- * invoked when the log file is rotated (by e.g. logrotate).
- */
-extern "C" void mbl_log_reopen_signal_handler(int signal);
-
 namespace mbl {
 
 /**
@@ -35,6 +28,41 @@ namespace mbl {
  */
 MblError log_init();
 
+/**
+ * Write out any queued log lines and stop the log writer thread. Lines logged
+ * after this are discarded.
+ */
+void log_shutdown();
+
+/**
+ * Tell the log to reopen its file before writing the next line. Intended to be
+ * called when the log file is rotated (by e.g. logrotate).
+ */
+void log_request_reopen();
+
+/**
+ * Class to tag log lines written by the current thread with an error code
+ * until the end of the scope. When logging to journald the code is recorded
+ * in the MBL_ERROR field; other log formats ignore it.
+ */
+class MblLogErrorScope
+{
+public:
+    explicit MblLogErrorScope(MblError error);
+
+    /**
+     * Destructor - restores the previous error code.
+     */
+    ~MblLogErrorScope();
+
+private:
+    // No copying
+    MblLogErrorScope(const MblLogErrorScope&);
+    MblLogErrorScope& operator=(const MblLogErrorScope&);
+
+    const MblError previous_error_;
+};
+
 } // namespace mbl
 
 #endif // mbl_log_h_
@@ -0,0 +1,39 @@
+/*
+ * Copyright (c) 2020 Arm Limited and Contributors. All rights reserved.
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ * Licensed under the Apache License, Version 2.0 (the License); you may
+ * not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an AS IS BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "log_binary.h"
+
+// ID 0 means "not assigned yet"
+static std::atomic<uint32_t> g_next_site_id(1);
+
+namespace mbl {
+namespace log_binary {
+
+void register_site(Site& site, const char* const signature)
+{
+    // Every thread that gets here for the same site stores the same
+    // signature. The release CAS below publishes it with the ID.
+    site.signature.store(signature, std::memory_order_relaxed);
+
+    const uint32_t id = g_next_site_id.fetch_add(1, std::memory_order_relaxed);
+    uint32_t expected = 0;
+    site.id.compare_exchange_strong(expected, id, std::memory_order_release, std::memory_order_relaxed);
+    // If another thread won the race then its ID is used and ours is wasted.
+}
+
+} // namespace log_binary
+} // namespace mbl
@@ -0,0 +1,288 @@
+/*
+ * Copyright (c) 2020 Arm Limited and Contributors. All rights reserved.
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ * Licensed under the Apache License, Version 2.0 (the License); you may
+ * not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an AS IS BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef mbl_log_binary_h_
+#define mbl_log_binary_h_
+
+/*! \file log_binary.h
+ *  \brief Binary structured log records.
+ *
+ *  When mbl-cloud-client is built with MBL_LOG_BINARY, tr_* traces are not
+ *  formatted on the device. Instead each trace is written to the log file as
+ *  a compact record holding a format string ID, a timestamp delta and the raw
+ *  argument values. The format string itself, with the trace group, level
+ *  and argument type signature, is written only once per log file. The
+ *  tools/mbl-cloud-client-log-decode.py script turns a binary log back into
+ *  the usual text lines.
+ *
+ *  File layout (integers are little endian; "varint" is an unsigned LEB128
+ *  integer and "svarint" is a zigzag-encoded varint):
+ *
+ *      header:  "MBLB" u8:version i64:base_time_us i32:utc_offset_s
+ *      format:  u8:0x01 varint:id u8:level string:group string:format
+ *               string:signature
+ *      trace:   u8:0x02 varint:id svarint:time_delta_us arguments...
+ *      text:    u8:0x03 svarint:time_delta_us string:line
+ *      offset:  u8:0x04 svarint:utc_offset_s
+ *
+ *  where "string" is a varint length followed by that many bytes. Time deltas
+ *  are relative to the previous trace or text record (or the header's base
+ *  time). Each character of a format's signature gives the encoding of one
+ *  argument: 'i' svarint, 'u' varint, 'd' 8 byte IEEE 754 double, 's' string,
+ *  'p' varint (a pointer).
+ *
+ *  Text records hold lines that didn't come from mbl-cloud-client's own
+ *  tr_* macros (e.g. traces from the mbed-cloud-client libraries), already
+ *  formatted but without a time prefix.
+ *
+ *  Times are UTC. The header's UTC offset gives local time when the file was
+ *  opened; an offset record is written before the first record after local
+ *  time's offset changes (e.g. for daylight saving time), and applies to the
+ *  records that follow it.
+ */
+
+#include <atomic>
+#include <cstddef>
+#include <cstring>
+#include <stdint.h>
+#include <type_traits>
+
+namespace mbl {
+namespace log_binary {
+
+const uint8_t file_format_version = 2;
+
+enum RecordType
+{
+    RecordType_Format = 0x01,
+    RecordType_Trace = 0x02,
+    RecordType_Text = 0x03,
+    RecordType_UtcOffset = 0x04
+};
+
+/**
+ * Write value as a varint to out (which must have room for 10 bytes).
+ *
+ * @return the number of bytes written.
+ */
+inline size_t encode_varint(uint8_t* const out, uint64_t value)
+{
+    size_t length = 0;
+    while (value >= 0x80) {
+        out[length++] = static_cast<uint8_t>(value | 0x80);
+        value >>= 7;
+    }
+    out[length++] = static_cast<uint8_t>(value);
+    return length;
+}
+
+/**
+ * Write value as a zigzag-encoded varint to out (which must have room for 10
+ * bytes).
+ *
+ * @return the number of bytes written.
+ */
+inline size_t encode_svarint(uint8_t* const out, const int64_t value)
+{
+    return encode_varint(out, (static_cast<uint64_t>(value) << 1) ^ static_cast<uint64_t>(value >> 63));
+}
+
+/**
+ * A call site of a tr_* macro. Each call site has its own statically
+ * allocated Site; its ID is assigned the first time it is used.
+ */
+struct Site
+{
+    const char* format;
+    const char* group;
+    uint8_t level;
+    std::atomic<const char*> signature;
+    std::atomic<uint32_t> id;
+};
+
+/**
+ * Assign an ID to a Site (if it doesn't have one yet) and remember its
+ * argument signature.
+ */
+void register_site(Site& site, const char* signature);
+
+/**
+ * Queue a trace record with already encoded arguments. Implemented in
+ * log.cpp, which owns the log writer.
+ */
+void write_trace(const Site& site, const uint8_t* args, size_t args_length);
+
+// Largest encoded argument list for a single trace. Longer string arguments
+// are truncated to fit.
+const size_t max_args_length = 384;
+
+// Worst case encoded size of a single non-string argument.
+const size_t max_scalar_length = 10;
+
+/**
+ * Serializes arguments into a fixed-size buffer.
+ */
+class ArgEncoder
+{
+public:
+    ArgEncoder()
+        : length_(0)
+    {
+    }
+
+    void put_varint(const uint64_t value)
+    {
+        length_ += encode_varint(buffer_ + length_, value);
+    }
+
+    void put_svarint(const int64_t value)
+    {
+        length_ += encode_svarint(buffer_ + length_, value);
+    }
+
+    void put_double(const double value)
+    {
+        std::memcpy(buffer_ + length_, &value, sizeof(value));
+        length_ += sizeof(value);
+    }
+
+    /**
+     * Put a string, leaving room for reserve more bytes after it.
+     */
+    void put_string(const char* const str, const size_t reserve)
+    {
+        const char* const safe_str = str ? str : "(null)";
+        size_t str_length = std::strlen(safe_str);
+        const size_t used = length_ + reserve + max_scalar_length;
+        const size_t room = (used < max_args_length) ? max_args_length - used : 0;
+        if (str_length > room) {
+            str_length = room;
+        }
+        put_varint(str_length);
+        std::memcpy(buffer_ + length_, safe_str, str_length);
+        length_ += str_length;
+    }
+
+    const uint8_t* data() const { return buffer_; }
+    size_t length() const { return length_; }
+
+private:
+    uint8_t buffer_[max_args_length];
+    size_t length_;
+};
+
+// Signature character and encoding for each kind of argument
+template <typename T, typename Enable = void>
+struct ArgTraits;
+
+template <typename T>
+struct ArgTraits<T, typename std::enable_if<std::is_integral<T>::value && std::is_signed<T>::value>::type>
+{
+    static constexpr char signature = 'i';
+    static void encode(ArgEncoder& enc, const T value, size_t) { enc.put_svarint(value); }
+};
+
+template <typename T>
+struct ArgTraits<T, typename std::enable_if<std::is_integral<T>::value && !std::is_signed<T>::value>::type>
+{
+    static constexpr char signature = 'u';
+    static void encode(ArgEncoder& enc, const T value, size_t) { enc.put_varint(value); }
+};
+
+template <typename T>
+struct ArgTraits<T, typename std::enable_if<std::is_enum<T>::value>::type>
+{
+    static constexpr char signature = 'i';
+    static void encode(ArgEncoder& enc, const T value, size_t) { enc.put_svarint(static_cast<int64_t>(value)); }
+};
+
+template <typename T>
+struct ArgTraits<T, typename std::enable_if<std::is_floating_point<T>::value>::type>
+{
+    static constexpr char signature = 'd';
+    static void encode(ArgEncoder& enc, const T value, size_t) { enc.put_double(static_cast<double>(value)); }
+};
+
+template <>
+struct ArgTraits<const char*>
+{
+    static constexpr char signature = 's';
+    static void encode(ArgEncoder& enc, const char* const value, const size_t reserve)
+    {
+        enc.put_string(value, reserve);
+    }
+};
+
+template <>
+struct ArgTraits<char*> : ArgTraits<const char*>
+{
+};
+
+template <typename T>
+struct ArgTraits<T*, typename std::enable_if<!std::is_same<typename std::remove_cv<T>::type, char>::value>::type>
+{
+    static constexpr char signature = 'p';
+    static void encode(ArgEncoder& enc, const T* const value, size_t)
+    {
+        enc.put_varint(reinterpret_cast<uintptr_t>(value));
+    }
+};
+
+/**
+ * The signature string for a list of argument types, built at compile time.
+ */
+template <typename... Args>
+struct Signature
+{
+    static constexpr char value[] = {ArgTraits<Args>::signature..., '\0'};
+};
+
+template <typename... Args>
+constexpr char Signature<Args...>::value[];
+
+inline void encode_args(ArgEncoder&)
+{
+}
+
+template <typename Arg, typename... Rest>
+void encode_args(ArgEncoder& enc, const Arg& arg, const Rest&... rest)
+{
+    ArgTraits<Arg>::encode(enc, arg, sizeof...(Rest) * max_scalar_length);
+    encode_args(enc, rest...);
+}
+
+/**
+ * Entry point for the tr_* macros in binary mode. The format string is
+ * already stored in the Site, so only the arguments are encoded. Arguments
+ * are taken by value so that arrays decay to pointers.
+ */
+template <typename... Args>
+void trace(Site& site, const char*, const Args... args)
+{
+    if (site.id.load(std::memory_order_acquire) == 0) {
+        register_site(site, Signature<Args...>::value);
+    }
+
+    ArgEncoder enc;
+    encode_args(enc, args...);
+    write_trace(site, enc.data(), enc.length());
+}
+
+} // namespace log_binary
+} // namespace mbl
+
+#endif // mbl_log_binary_h_
@@ -0,0 +1,159 @@
+/*
+ * Copyright (c) 2020 Arm Limited and Contributors. All rights reserved.
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ * Licensed under the Apache License, Version 2.0 (the License); you may
+ * not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an AS IS BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "log_time_prefix.h"
+
+#include <cassert>
+#include <cstring>
+#include <ctime>
+#include <sys/time.h>
+
+// The prefix is built from three parts: the date and time (%FT%T, always 19
+// chars for years 1000-9999), optionally ".sss" for milliseconds, then the
+// UTC offset and a space ("%z ", 6 chars).
+static const char g_date_time_format[] = "%FT%T";
+static const char g_utc_offset_format[] = "%z ";
+static const size_t g_date_time_length = 19;
+static const size_t g_seconds_offset = 17;
+#ifdef MBL_LOG_TIMESTAMP_MS
+static const size_t g_millis_offset = g_date_time_length + 1;
+static const size_t g_millis_length = 4;
+#else
+static const size_t g_millis_length = 0;
+#endif
+static const size_t g_prefix_length = g_date_time_length + g_millis_length + 6;
+
+static const char g_fail_str[] = "TIME UNAVAILABLE ";
+
+namespace {
+
+// Per-thread cache of the prefix for one minute of local time.
+struct TimePrefixCache
+{
+    time_t minute;
+    bool valid;
+    char text[mbl::log_time_prefix_buffer_size];
+};
+
+} // anonymous namespace
+
+static void strncpy_with_nul(char* const dest, const char* const src, const size_t n)
+{
+    assert(n >= 1);
+    strncpy(dest, src, n - 1);
+    dest[n - 1] = '\0';
+}
+
+static void write_two_digits(char* const dest, const unsigned value)
+{
+    dest[0] = static_cast<char>('0' + value / 10);
+    dest[1] = static_cast<char>('0' + value % 10);
+}
+
+/**
+ * Fill the cache for the minute containing time_s. Returns false if the time
+ * can't be formatted in the expected layout.
+ */
+static bool fill_cache(TimePrefixCache& cache, const time_t time_s)
+{
+    cache.valid = false;
+
+    struct tm time_info;
+    if (!localtime_r(&time_s, &time_info)) {
+        return false;
+    }
+
+    char* const text = cache.text;
+    const size_t dt_len = strftime(text, sizeof(cache.text), g_date_time_format, &time_info);
+    if (dt_len != g_date_time_length) {
+        return false;
+    }
+
+#ifdef MBL_LOG_TIMESTAMP_MS
+    std::memcpy(text + g_date_time_length, ".000", g_millis_length);
+#endif
+
+    const size_t offset_pos = g_date_time_length + g_millis_length;
+    const size_t offset_len = strftime(
+        text + offset_pos, sizeof(cache.text) - offset_pos, g_utc_offset_format, &time_info);
+    if (offset_pos + offset_len != g_prefix_length) {
+        return false;
+    }
+
+    // Local minutes start on UTC minute boundaries for every UTC offset in
+    // use, so the cached text is good until time_s / 60 changes.
+    cache.minute = time_s / 60;
+    cache.valid = true;
+    return true;
+}
+
+/**
+ * Patch the seconds (and milliseconds) of tv into the cached text and copy it
+ * into buffer.
+ */
+static char* write_prefix(TimePrefixCache& cache, const struct timeval& tv, char* const buffer)
+{
+    write_two_digits(cache.text + g_seconds_offset, static_cast<unsigned>(tv.tv_sec % 60));
+#ifdef MBL_LOG_TIMESTAMP_MS
+    const unsigned millis = static_cast<unsigned>(tv.tv_usec / 1000);
+    cache.text[g_millis_offset] = static_cast<char>('0' + millis / 100);
+    write_two_digits(cache.text + g_millis_offset + 1, millis % 100);
+#endif
+
+    std::memcpy(buffer, cache.text, g_prefix_length + 1);
+    return buffer;
+}
+
+namespace mbl {
+
+char* make_time_prefix(char* const buffer, const size_t buffer_size)
+{
+    assert(buffer_size >= log_time_prefix_buffer_size);
+
+    thread_local static TimePrefixCache cache = {0, false, {0}};
+
+    struct timeval tv;
+    if (gettimeofday(&tv, 0) != 0) {
+        strncpy_with_nul(buffer, g_fail_str, buffer_size);
+        return buffer;
+    }
+
+    if (!cache.valid || cache.minute != tv.tv_sec / 60) {
+        if (!fill_cache(cache, tv.tv_sec)) {
+            strncpy_with_nul(buffer, g_fail_str, buffer_size);
+            return buffer;
+        }
+    }
+
+    return write_prefix(cache, tv, buffer);
+}
+
+char* make_time_prefix_uncached(char* const buffer, const size_t buffer_size)
+{
+    assert(buffer_size >= log_time_prefix_buffer_size);
+
+    TimePrefixCache cache = {0, false, {0}};
+
+    struct timeval tv;
+    if (gettimeofday(&tv, 0) != 0 || !fill_cache(cache, tv.tv_sec)) {
+        strncpy_with_nul(buffer, g_fail_str, buffer_size);
+        return buffer;
+    }
+    return write_prefix(cache, tv, buffer);
+}
+
+} // namespace mbl
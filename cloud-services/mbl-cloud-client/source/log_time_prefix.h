@@ -0,0 +1,56 @@
+/*
+ * Copyright (c) 2020 Arm Limited and Contributors. All rights reserved.
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ * Licensed under the Apache License, Version 2.0 (the License); you may
+ * not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an AS IS BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef mbl_log_time_prefix_h_
+#define mbl_log_time_prefix_h_
+
+#include <cstddef>
+
+namespace mbl {
+
+#ifdef MBL_LOG_TIMESTAMP_MS
+// Time prefix strings look like "YYYY-mm-DDTHH:MM:ss.sss+HHMM " (one of the
+// ISO 8601 formats). That's 29 chars + nul.
+const size_t log_time_prefix_buffer_size = 30;
+#else
+// Time prefix strings look like "YYYY-mm-DDTHH:MM:ss+HHMM " (one of the ISO
+// 8601 formats). That's 25 chars + nul.
+const size_t log_time_prefix_buffer_size = 26;
+#endif
+
+/**
+ * Write the current local time into buffer, formatted as a log line prefix.
+ *
+ * Each thread caches the prefix for the current minute, so localtime_r and
+ * strftime only run when the minute changes; otherwise just the seconds (and
+ * milliseconds) digits are patched in.
+ *
+ * @return buffer.
+ */
+char* make_time_prefix(char* buffer, size_t buffer_size);
+
+/**
+ * Like make_time_prefix(), but runs localtime_r and strftime on every call.
+ * The baseline for mbl-log-time-prefix-benchmark.
+ *
+ * @return buffer.
+ */
+char* make_time_prefix_uncached(char* buffer, size_t buffer_size);
+
+} // namespace mbl
+
+#endif // mbl_log_time_prefix_h_
@@ -0,0 +1,186 @@
+/*
+ * Copyright (c) 2020 Arm Limited and Contributors. All rights reserved.
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ * Licensed under the Apache License, Version 2.0 (the License); you may
+ * not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an AS IS BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "log_trace.h"
+
+#include <cctype>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+
+#define TRACE_GROUP "mbl"
+
+// File from which per-group log levels are read at startup and on SIGHUP.
+// Set with the MBL_LOG_LEVELS_FILE CMake option.
+#ifndef MBL_LOG_LEVELS_FILE
+#define MBL_LOG_LEVELS_FILE "/config/user/mbl-cloud-client/log-levels"
+#endif
+
+static const uint8_t g_default_level = TRACE_LEVEL_INFO;
+
+static const char* const g_group_names[mbl::log_trace::Group_Count] = {
+    "mbl",
+    "main",
+    "CCRB",
+    "CCRB-IPCDBUS",
+    "CCRB-IPCSOCK",
+    "CCRB-IPCLOOP",
+    "CCRB-VALUES",
+    "other"
+};
+
+static char* trim(char* str)
+{
+    while (std::isspace(static_cast<unsigned char>(*str))) {
+        ++str;
+    }
+    char* end = str + std::strlen(str);
+    while (end > str && std::isspace(static_cast<unsigned char>(end[-1]))) {
+        --end;
+    }
+    *end = '\0';
+    return str;
+}
+
+namespace mbl {
+namespace log_trace {
+
+std::atomic<uint8_t> g_group_levels[Group_Count] = {
+    {g_default_level},
+    {g_default_level},
+    {g_default_level},
+    {g_default_level},
+    {g_default_level},
+    {g_default_level},
+    {g_default_level},
+    {g_default_level}
+};
+
+const char* group_name(const Group group)
+{
+    return g_group_names[group];
+}
+
+/**
+ * mbed-trace filters every trace by its own active level before calling our
+ * print handler, so it must let through the most verbose level of any group.
+ * Traces from groups without their own level (i.e. the mbed-cloud-client
+ * libraries) get through at that level too; the log writer thread then
+ * filters them against the "other" level.
+ */
+static void update_mbed_trace_level()
+{
+    uint8_t max_level = 0;
+    for (size_t i = 0; i < Group_Count; ++i) {
+        const uint8_t level = g_group_levels[i].load(std::memory_order_relaxed);
+        if (level > max_level) {
+            max_level = level;
+        }
+    }
+
+    // TRACE_ACTIVE_LEVEL_* masks have the bit for their level and all less
+    // verbose levels set. No colors, no carriage returns.
+    const uint8_t active_level =
+        (max_level == 0) ? TRACE_ACTIVE_LEVEL_NONE : static_cast<uint8_t>((max_level << 1) - 1);
+    mbed_trace_config_set(active_level);
+}
+
+static bool group_from_config_name(const char* const name, Group& group)
+{
+    for (size_t i = 0; i < Group_Count; ++i) {
+        if (std::strcmp(name, g_group_names[i]) == 0) {
+            group = static_cast<Group>(i);
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+ * Parse a level name ("none", "cmd", "error", "warn", "info" or "debug").
+ *
+ * @return true on success, with the TRACE_LEVEL_* value (or 0 for "none") in
+ *         level.
+ */
+static bool level_from_name(const char* const name, uint8_t& level)
+{
+    if (std::strcmp(name, "none") == 0) { level = 0; return true; }
+    if (std::strcmp(name, "cmd") == 0) { level = TRACE_LEVEL_CMD; return true; }
+    if (std::strcmp(name, "error") == 0) { level = TRACE_LEVEL_ERROR; return true; }
+    if (std::strcmp(name, "warn") == 0) { level = TRACE_LEVEL_WARN; return true; }
+    if (std::strcmp(name, "info") == 0) { level = TRACE_LEVEL_INFO; return true; }
+    if (std::strcmp(name, "debug") == 0) { level = TRACE_LEVEL_DEBUG; return true; }
+    return false;
+}
+
+void load_levels_file()
+{
+    // Only the groups the file mentions change, so a SIGHUP from log
+    // rotation doesn't undo levels that were set earlier
+    uint8_t levels[Group_Count];
+    for (size_t i = 0; i < Group_Count; ++i) {
+        levels[i] = g_group_levels[i].load(std::memory_order_relaxed);
+    }
+
+    FILE* const file = std::fopen(MBL_LOG_LEVELS_FILE, "r");
+    if (file) {
+        char line[128];
+        unsigned line_num = 0;
+        while (std::fgets(line, sizeof(line), file)) {
+            ++line_num;
+
+            char* const comment = std::strchr(line, '#');
+            if (comment) {
+                *comment = '\0';
+            }
+            char* const equals = std::strchr(line, '=');
+            if (!equals) {
+                if (*trim(line) != '\0') {
+                    tr_warn("%s:%u: expected \"<group> = <level>\"", MBL_LOG_LEVELS_FILE, line_num);
+                }
+                continue;
+            }
+            *equals = '\0';
+
+            const char* const group_name = trim(line);
+            const char* const level_name = trim(equals + 1);
+            Group group;
+            uint8_t level;
+            if (!group_from_config_name(group_name, group)) {
+                tr_warn("%s:%u: unknown trace group \"%s\"", MBL_LOG_LEVELS_FILE, line_num, group_name);
+            }
+            else if (!level_from_name(level_name, level)) {
+                tr_warn("%s:%u: unknown log level \"%s\"", MBL_LOG_LEVELS_FILE, line_num, level_name);
+            }
+            else {
+                levels[group] = level;
+            }
+        }
+        std::fclose(file);
+    }
+    else if (errno != ENOENT) {
+        tr_warn("Failed to open %s: %s", MBL_LOG_LEVELS_FILE, std::strerror(errno));
+    }
+
+    for (size_t i = 0; i < Group_Count; ++i) {
+        g_group_levels[i].store(levels[i], std::memory_order_relaxed);
+    }
+    update_mbed_trace_level();
+}
+
+} // namespace log_trace
+} // namespace mbl
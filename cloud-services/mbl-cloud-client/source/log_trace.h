@@ -0,0 +1,197 @@
+/*
+ * Copyright (c) 2020 Arm Limited and Contributors. All rights reserved.
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ * Licensed under the Apache License, Version 2.0 (the License); you may
+ * not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an AS IS BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef mbl_log_trace_h_
+#define mbl_log_trace_h_
+
+/*! \file log_trace.h
+ *  \brief Filtered versions of the mbed-trace tr_* macros.
+ *
+ *  mbl-cloud-client code should include this header instead of
+ *  mbed-trace/mbed_trace.h. It replaces the tr_* macros with versions that
+ *  filter in two stages before any arguments are evaluated:
+ *
+ *  1. At build time: levels more verbose than MBL_LOG_MAX_LEVEL are stripped,
+ *     so no code at all is emitted for them.
+ *  2. At run time: each TRACE_GROUP has its own level, checked with a single
+ *     relaxed atomic load. Levels can be changed while running by
+ *     editing the log levels file and sending SIGHUP.
+ *
+ *  When built with MBL_LOG_BINARY, traces that pass both stages are written
+ *  as binary records (see log_binary.h) instead of being formatted by
+ *  mbed-trace.
+ */
+
+#include "mbed-trace/mbed_trace.h"
+
+#ifdef MBL_LOG_BINARY
+#include "log_binary.h"
+#endif
+
+#include <atomic>
+#include <stdint.h>
+
+// Most verbose level that is compiled in at all (one of the mbed-trace
+// TRACE_LEVEL_* values). Set with the MBL_LOG_MAX_LEVEL CMake option.
+#ifndef MBL_LOG_MAX_LEVEL
+#define MBL_LOG_MAX_LEVEL TRACE_LEVEL_DEBUG
+#endif
+
+namespace mbl {
+namespace log_trace {
+
+/**
+ * Trace groups with their own runtime level. Traces from any other group
+ * (including those from the mbed-cloud-client libraries) use Group_Other.
+ */
+enum Group
+{
+    Group_mbl,
+    Group_main,
+    Group_CCRB,
+    Group_CCRB_IPCDBUS,
+    Group_CCRB_IPCSOCK,
+    Group_CCRB_IPCLOOP,
+    Group_CCRB_VALUES,
+    Group_Other,
+    Group_Count
+};
+
+constexpr uint8_t max_compiled_level = MBL_LOG_MAX_LEVEL;
+
+// The current level of each group: one of the mbed-trace TRACE_LEVEL_* values
+// (the most verbose level that is printed), or 0 to print nothing. mbed-trace
+// levels are ordered so that more verbose levels have larger values.
+extern std::atomic<uint8_t> g_group_levels[Group_Count];
+
+constexpr bool str_equal(const char* const a, const char* const b)
+{
+    return *a == *b && (*a == '\0' || str_equal(a + 1, b + 1));
+}
+
+/**
+ * Map a TRACE_GROUP string to its Group. Intended to be evaluated at compile
+ * time.
+ */
+constexpr Group group_from_name(const char* const name)
+{
+    return str_equal(name, "mbl") ? Group_mbl
+         : str_equal(name, "main") ? Group_main
+         : str_equal(name, "CCRB") ? Group_CCRB
+         : str_equal(name, "CCRB-IPCDBUS") ? Group_CCRB_IPCDBUS
+         : str_equal(name, "CCRB-IPCSOCK") ? Group_CCRB_IPCSOCK
+         : str_equal(name, "CCRB-IPCLOOP") ? Group_CCRB_IPCLOOP
+         : str_equal(name, "CCRB-VALUES") ? Group_CCRB_VALUES
+         : Group_Other;
+}
+
+// Declared but never defined: only used in unevaluated operands so that the
+// arguments of stripped traces still count as used.
+template <typename... Args>
+int unused(const Args&... args);
+
+/**
+ * The name of a Group as used in the log levels file, e.g. "CCRB".
+ */
+const char* group_name(Group group);
+
+inline bool enabled(const Group group, const uint8_t level)
+{
+    return level <= g_group_levels[group].load(std::memory_order_relaxed);
+}
+
+/**
+ * Read per-group levels from the log levels file. Each line of the file
+ * looks like "<group> = <level>", e.g. "CCRB = debug". Groups not mentioned
+ * in the file keep their current level, which is info until the file sets
+ * it. A missing file is not an error.
+ */
+void load_levels_file();
+
+} // namespace log_trace
+} // namespace mbl
+
+#ifdef MBL_LOG_BINARY
+
+#define MBL_TRACE_FIRST_(first, ...) first
+#define MBL_TRACE_FIRST_ARG(...) MBL_TRACE_FIRST_(__VA_ARGS__, 0)
+
+#define MBL_TRACE_FILTERED(level, ...)                                                  \
+    do {                                                                                \
+        constexpr ::mbl::log_trace::Group mbl_trace_group_ =                            \
+            ::mbl::log_trace::group_from_name(TRACE_GROUP);                             \
+        if (::mbl::log_trace::enabled(mbl_trace_group_, level)) {                       \
+            static ::mbl::log_binary::Site mbl_trace_site_ = {                          \
+                MBL_TRACE_FIRST_ARG(__VA_ARGS__), TRACE_GROUP, level, {nullptr}, {0}};  \
+            ::mbl::log_binary::trace(mbl_trace_site_, __VA_ARGS__);                     \
+        }                                                                               \
+    } while (0)
+
+#else
+
+#define MBL_TRACE_FILTERED(level, ...)                                                  \
+    do {                                                                                \
+        constexpr ::mbl::log_trace::Group mbl_trace_group_ =                            \
+            ::mbl::log_trace::group_from_name(TRACE_GROUP);                             \
+        if (::mbl::log_trace::enabled(mbl_trace_group_, level)) {                       \
+            mbed_tracef(level, TRACE_GROUP, __VA_ARGS__);                               \
+        }                                                                               \
+    } while (0)
+
+#endif
+
+#define MBL_TRACE_STRIPPED(...)                                                         \
+    do {                                                                                \
+        static_cast<void>(sizeof(::mbl::log_trace::unused(__VA_ARGS__)));              \
+    } while (0)
+
+#undef tr_debug
+#undef tr_info
+#undef tr_warning
+#undef tr_warn
+#undef tr_error
+#undef tr_err
+
+#if MBL_LOG_MAX_LEVEL >= TRACE_LEVEL_DEBUG
+#define tr_debug(...) MBL_TRACE_FILTERED(TRACE_LEVEL_DEBUG, __VA_ARGS__)
+#else
+#define tr_debug(...) MBL_TRACE_STRIPPED(__VA_ARGS__)
+#endif
+
+#if MBL_LOG_MAX_LEVEL >= TRACE_LEVEL_INFO
+#define tr_info(...) MBL_TRACE_FILTERED(TRACE_LEVEL_INFO, __VA_ARGS__)
+#else
+#define tr_info(...) MBL_TRACE_STRIPPED(__VA_ARGS__)
+#endif
+
+#if MBL_LOG_MAX_LEVEL >= TRACE_LEVEL_WARN
+#define tr_warning(...) MBL_TRACE_FILTERED(TRACE_LEVEL_WARN, __VA_ARGS__)
+#define tr_warn(...) MBL_TRACE_FILTERED(TRACE_LEVEL_WARN, __VA_ARGS__)
+#else
+#define tr_warning(...) MBL_TRACE_STRIPPED(__VA_ARGS__)
+#define tr_warn(...) MBL_TRACE_STRIPPED(__VA_ARGS__)
+#endif
+
+#if MBL_LOG_MAX_LEVEL >= TRACE_LEVEL_ERROR
+#define tr_error(...) MBL_TRACE_FILTERED(TRACE_LEVEL_ERROR, __VA_ARGS__)
+#define tr_err(...) MBL_TRACE_FILTERED(TRACE_LEVEL_ERROR, __VA_ARGS__)
+#else
+#define tr_error(...) MBL_TRACE_STRIPPED(__VA_ARGS__)
+#define tr_err(...) MBL_TRACE_STRIPPED(__VA_ARGS__)
+#endif
+
+#endif // mbl_log_trace_h_
@@ -0,0 +1,169 @@
+/*
+ * Copyright (c) 2020 Arm Limited and Contributors. All rights reserved.
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ * Licensed under the Apache License, Version 2.0 (the License); you may
+ * not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an AS IS BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "metrics.h"
+
+#include "log_trace.h"
+
+#include <inttypes.h>
+
+#define TRACE_GROUP "mbl"
+
+// Metrics are registered during static initialization, which is single
+// threaded, and the list is only read afterwards, so it needs no lock.
+static mbl::metrics::Metric* g_metrics = 0;
+
+namespace mbl {
+namespace metrics {
+
+Metric::Metric(const char* const name)
+    : name_(name)
+    , next_(g_metrics)
+{
+    g_metrics = this;
+}
+
+Metric::Metric()
+    : name_(0)
+    , next_(0)
+{
+}
+
+Counter::Counter(const char* const name)
+    : Metric(name)
+    , value_(0)
+{
+}
+
+void Counter::log() const
+{
+    tr_info("Metric %s = %" PRIu64, name(), get());
+}
+
+Gauge::Gauge(const char* const name)
+    : Metric(name)
+    , value_(0)
+{
+}
+
+void Gauge::log() const
+{
+    tr_info("Metric %s = %" PRId64, name(), get());
+}
+
+Histogram::Histogram(const char* const name)
+    : Metric(name)
+    , count_(0)
+    , max_(0)
+{
+    for (std::atomic<uint64_t>& bucket : buckets_) {
+        bucket.store(0, std::memory_order_relaxed);
+    }
+}
+
+Histogram::Histogram()
+    : count_(0)
+    , max_(0)
+{
+    for (std::atomic<uint64_t>& bucket : buckets_) {
+        bucket.store(0, std::memory_order_relaxed);
+    }
+}
+
+size_t Histogram::bucket_index(const uint64_t value)
+{
+    // Values below 4 have a bucket each. Above that, the top bit picks a
+    // group of four buckets and the two bits below it pick one of them.
+    if (value < 4) {
+        return static_cast<size_t>(value);
+    }
+    const unsigned top_bit = 63 - static_cast<unsigned>(__builtin_clzll(value));
+    const size_t sub_bucket = static_cast<size_t>(value >> (top_bit - 2)) & 3;
+    return (top_bit - 1) * 4 + sub_bucket;
+}
+
+uint64_t Histogram::bucket_upper_bound(const size_t index)
+{
+    if (index < 4) {
+        return index;
+    }
+    const unsigned top_bit = static_cast<unsigned>(index / 4 + 1);
+    const uint64_t lower = static_cast<uint64_t>(4 + index % 4) << (top_bit - 2);
+    return lower + (1ULL << (top_bit - 2)) - 1;
+}
+
+void Histogram::record(const uint64_t value)
+{
+    buckets_[bucket_index(value)].fetch_add(1, std::memory_order_relaxed);
+    count_.fetch_add(1, std::memory_order_relaxed);
+
+    uint64_t max = max_.load(std::memory_order_relaxed);
+    while (value > max && !max_.compare_exchange_weak(max, value, std::memory_order_relaxed)) {
+    }
+}
+
+uint64_t Histogram::percentile(const double p) const
+{
+    const uint64_t total = count();
+    if (total == 0) {
+        return 0;
+    }
+
+    // Rank of the value wanted, counting from 1
+    uint64_t rank = static_cast<uint64_t>(p * static_cast<double>(total) + 0.5);
+    if (rank == 0) {
+        rank = 1;
+    }
+
+    uint64_t seen = 0;
+    for (size_t i = 0; i < bucket_count; ++i) {
+        seen += buckets_[i].load(std::memory_order_relaxed);
+        if (seen >= rank) {
+            // The bucket's bound can be above anything actually recorded
+            const uint64_t bound = bucket_upper_bound(i);
+            return bound < max() ? bound : max();
+        }
+    }
+    return max();
+}
+
+void Histogram::log() const
+{
+    log_as(name());
+}
+
+void Histogram::log_as(const char* const name) const
+{
+    tr_info(
+        "Metric %s: count %" PRIu64 ", p50 %" PRIu64 ", p99 %" PRIu64 ", p99.9 %" PRIu64 ", max %" PRIu64,
+        name,
+        count(),
+        percentile(0.5),
+        percentile(0.99),
+        percentile(0.999),
+        max());
+}
+
+void log_all()
+{
+    for (const Metric* metric = g_metrics; metric; metric = metric->next_) {
+        metric->log();
+    }
+}
+
+} // namespace metrics
+} // namespace mbl
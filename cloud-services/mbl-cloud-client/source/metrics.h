@@ -0,0 +1,149 @@
+/*
+ * Copyright (c) 2020 Arm Limited and Contributors. All rights reserved.
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ * Licensed under the Apache License, Version 2.0 (the License); you may
+ * not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an AS IS BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef mbl_metrics_h_
+#define mbl_metrics_h_
+
+/*! \file metrics.h
+ *  \brief Named runtime metrics.
+ *
+ *  Metrics are statically allocated objects that register themselves by name
+ *  when they are constructed. Updating a metric is a single relaxed atomic
+ *  operation, so metrics can be updated from any thread. All metrics are
+ *  written to the log when mbl-cloud-client receives SIGUSR1.
+ */
+
+#include <atomic>
+#include <cstddef>
+#include <stdint.h>
+
+namespace mbl {
+namespace metrics {
+
+/**
+ * Base class for metrics. Metrics must have static storage duration: they
+ * are never unregistered.
+ */
+class Metric
+{
+public:
+    const char* name() const { return name_; }
+
+    /**
+     * Write the metric's value(s) to the log.
+     */
+    virtual void log() const = 0;
+
+protected:
+    explicit Metric(const char* name);
+    // A metric that isn't registered, so has no name and isn't logged by
+    // log_all(), for use inside other metrics
+    Metric();
+    ~Metric() {}
+
+private:
+    // No copying
+    Metric(const Metric&);
+    Metric& operator=(const Metric&);
+
+    friend void log_all();
+
+    const char* const name_;
+    Metric* next_;
+};
+
+/**
+ * A value that only goes up, e.g. a number of events.
+ */
+class Counter : public Metric
+{
+public:
+    explicit Counter(const char* name);
+
+    void add(const uint64_t n = 1) { value_.fetch_add(n, std::memory_order_relaxed); }
+    uint64_t get() const { return value_.load(std::memory_order_relaxed); }
+
+    void log() const override;
+
+private:
+    std::atomic<uint64_t> value_;
+};
+
+/**
+ * A value that can go up and down, e.g. a current rate.
+ */
+class Gauge : public Metric
+{
+public:
+    explicit Gauge(const char* name);
+
+    void set(const int64_t value) { value_.store(value, std::memory_order_relaxed); }
+    int64_t get() const { return value_.load(std::memory_order_relaxed); }
+
+    void log() const override;
+
+private:
+    std::atomic<int64_t> value_;
+};
+
+/**
+ * A distribution of values, e.g. latencies. Values are counted in buckets
+ * four to each power of two, so percentiles are reported to within 25%.
+ */
+class Histogram : public Metric
+{
+public:
+    explicit Histogram(const char* name);
+    // An unregistered histogram, for use inside other metrics
+    Histogram();
+
+    void record(uint64_t value);
+
+    uint64_t count() const { return count_.load(std::memory_order_relaxed); }
+    uint64_t max() const { return max_.load(std::memory_order_relaxed); }
+
+    /**
+     * @return an upper bound of the p-th quantile (0 <= p <= 1) of the values
+     *         recorded, or 0 if there are none.
+     */
+    uint64_t percentile(double p) const;
+
+    void log() const override;
+
+    // Write the histogram to the log under the given name
+    void log_as(const char* name) const;
+
+private:
+    static const size_t bucket_count = 252;
+
+    static size_t bucket_index(uint64_t value);
+    static uint64_t bucket_upper_bound(size_t index);
+
+    std::atomic<uint64_t> buckets_[bucket_count];
+    std::atomic<uint64_t> count_;
+    std::atomic<uint64_t> max_;
+};
+
+/**
+ * Write all registered metrics to the log.
+ */
+void log_all();
+
+} // namespace metrics
+} // namespace mbl
+
+#endif // mbl_metrics_h_
@@ -29,4 +29,20 @@ time_t get_monotonic_time_s()
     return ts.tv_sec;
 }
 
+int64_t get_monotonic_time_ms()
+{
+    struct timespec ts;
+    const int cg_ret = clock_gettime(CLOCK_MONOTONIC, &ts);
+    assert(cg_ret == 0);
+    return static_cast<int64_t>(ts.tv_sec) * 1000 + ts.tv_nsec / 1000000;
+}
+
+int64_t get_monotonic_time_us()
+{
+    struct timespec ts;
+    const int cg_ret = clock_gettime(CLOCK_MONOTONIC, &ts);
+    assert(cg_ret == 0);
+    return static_cast<int64_t>(ts.tv_sec) * 1000000 + ts.tv_nsec / 1000;
+}
+
 } // namespace mbl
@@ -18,12 +18,17 @@
 #ifndef mbl_monotonic_time_h_
 #define mbl_monotonic_time_h_
 
+#include <stdint.h>
 #include <time.h>
 
 namespace mbl {
 
 time_t get_monotonic_time_s();
 
+int64_t get_monotonic_time_ms();
+
+int64_t get_monotonic_time_us();
+
 } // namespace mbl
 
 #endif // mbl_monotonic_time_h_
@@ -17,46 +17,84 @@
 
 #include "signals.h"
 
-#include "log.h"
-#include "MblCloudClient.h"
-
-#include "mbed-trace/mbed_trace.h"
+#include "log_trace.h"
 
+#include <cassert>
 #include <cerrno>
 #include <cstring>
 #include <signal.h>
+#include <sys/signalfd.h>
+#include <unistd.h>
 
 #define TRACE_GROUP "mbl"
 
+static int g_signal_fd = -1;
+
 namespace mbl {
 
 MblError signals_init()
 {
-    // Shutdown
-    struct sigaction shutdown_sa;
-    std::memset(&shutdown_sa, 0, sizeof(shutdown_sa));
-    shutdown_sa.sa_handler = mbl_shutdown_handler;
-    shutdown_sa.sa_flags = 0;
-    if (sigaction(SIGTERM, &shutdown_sa, 0) != 0) {
-        tr_error("Failed to set SIGTERM signal handler: %s", std::strerror(errno));
-        return Error::SignalsInitSigaction;
-    }
-    if (sigaction(SIGINT, &shutdown_sa, 0) != 0) {
-        tr_error("Failed to set SIGINT signal handler: %s", std::strerror(errno));
-        return Error::SignalsInitSigaction;
+    assert(g_signal_fd == -1);
+
+    // SIGTERM and SIGINT request a shutdown; SIGHUP asks us to reopen the log
+    // file; SIGUSR1 asks us to log our metrics. Rather than installing
+    // asynchronous handlers, block these signals and have the main loop read
+    // them from a signalfd.
+    sigset_t mask;
+    sigemptyset(&mask);
+    sigaddset(&mask, SIGTERM);
+    sigaddset(&mask, SIGINT);
+    sigaddset(&mask, SIGHUP);
+    sigaddset(&mask, SIGUSR1);
+
+    const int mask_err = pthread_sigmask(SIG_BLOCK, &mask, 0);
+    if (mask_err != 0) {
+        tr_error("Failed to block signals: %s", std::strerror(mask_err));
+        return Error::SignalsInitSigprocmask;
     }
 
-    // Log reopen
-    struct sigaction log_sa;
-    std::memset(&log_sa, 0, sizeof(log_sa));
-    log_sa.sa_handler = mbl_log_reopen_signal_handler;
-    log_sa.sa_flags = SA_RESTART;
-    if (sigaction(SIGHUP, &log_sa, 0) != 0) {
-        tr_error("Failed to set SIGHUP signal handler: %s", std::strerror(errno));
-        return Error::SignalsInitSigaction;
+    g_signal_fd = signalfd(-1, &mask, SFD_NONBLOCK | SFD_CLOEXEC);
+    if (g_signal_fd == -1) {
+        tr_error("Failed to create signalfd: %s", std::strerror(errno));
+        return Error::SignalsInitSignalfd;
     }
 
     return Error::None;
 }
 
+int signals_get_fd()
+{
+    return g_signal_fd;
+}
+
+int signals_read()
+{
+    assert(g_signal_fd != -1);
+
+    struct signalfd_siginfo info;
+    const ssize_t ret = read(g_signal_fd, &info, sizeof(info));
+    if (ret != static_cast<ssize_t>(sizeof(info))) {
+        if (ret == -1 && errno != EAGAIN) {
+            tr_error("Failed to read from signalfd: %s", std::strerror(errno));
+        }
+        return 0;
+    }
+    return static_cast<int>(info.ssi_signo);
+}
+
+int create_thread_with_signals_blocked(
+    pthread_t* const thread,
+    void* (*const start_routine)(void*),
+    void* const arg)
+{
+    // The new thread inherits our signal mask
+    sigset_t all_signals;
+    sigset_t old_signals;
+    sigfillset(&all_signals);
+    pthread_sigmask(SIG_BLOCK, &all_signals, &old_signals);
+    const int create_err = pthread_create(thread, 0, start_routine, arg);
+    pthread_sigmask(SIG_SETMASK, &old_signals, 0);
+    return create_err;
+}
+
 } // namespace mbl
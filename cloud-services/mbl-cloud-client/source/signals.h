@@ -20,10 +20,42 @@
 
 #include "MblError.h"
 
+#include <pthread.h>
+
 namespace mbl {
 
+/**
+ * Block the signals we care about and create a signalfd from which they can
+ * be read instead. SIGTERM and SIGINT request a shutdown. SIGHUP reopens the
+ * log file and reloads the log levels. SIGUSR1 logs the metrics, firmware
+ * download progress and each application's resource broker footprint.
+ * Must be called before any other threads are created so that they inherit
+ * the blocked signal mask.
+ */
 MblError signals_init();
 
+/**
+ * Get the signalfd created by signals_init(). The fd becomes readable when
+ * one of the blocked signals is pending.
+ */
+int signals_get_fd();
+
+/**
+ * Read a pending signal from the signalfd.
+ *
+ * @return the number of the signal that was read, or 0 if no signal was
+ * pending.
+ */
+int signals_read();
+
+/**
+ * Create a thread with every signal blocked. Signals are read from the
+ * signalfd by the main thread, so no other thread may handle them.
+ *
+ * @return 0, or the error number from pthread_create().
+ */
+int create_thread_with_signals_blocked(pthread_t* thread, void* (*start_routine)(void*), void* arg);
+
 } // namespace mbl
 
 #endif // mbl_signals_h_
@@ -18,13 +18,89 @@
 #include "update_handlers.h"
 
 #include "MblCloudClient.h"
+#include "MblDownloadProgressTracker.h"
+#include "MblMutex.h"
+#include "MblScopedLock.h"
+#include "log_trace.h"
+#include "metrics.h"
+#include "monotonic_time.h"
 
-#include "mbed-trace/mbed_trace.h"
-
+#include <cerrno>
+#include <cstring>
 #include <inttypes.h>
+#include <sys/timerfd.h>
+#include <unistd.h>
 
 #define TRACE_GROUP "mbl"
 
+// Log download progress every MBL_UPDATE_PROGRESS_STEP_PERCENT percent, and
+// at least every MBL_UPDATE_PROGRESS_STEP_S seconds while data is arriving.
+// Set with the CMake options of the same names.
+#ifndef MBL_UPDATE_PROGRESS_STEP_PERCENT
+#define MBL_UPDATE_PROGRESS_STEP_PERCENT 10
+#endif
+
+#ifndef MBL_UPDATE_PROGRESS_STEP_S
+#define MBL_UPDATE_PROGRESS_STEP_S 30
+#endif
+
+// Gaps between progress updates longer than this are logged as stalls
+static const uint32_t g_download_stall_ms = 30000;
+
+// While a download is in progress, the tracker is re-checked this often
+// between progress updates, or every MBL_UPDATE_PROGRESS_STEP_S seconds once
+// it has stalled
+static const uint32_t g_download_check_ms = 1000;
+
+static const mbl::MblDownloadProgressTracker::Config g_download_config = {
+    MBL_UPDATE_PROGRESS_STEP_PERCENT,
+    MBL_UPDATE_PROGRESS_STEP_S * 1000,
+    g_download_stall_ms
+};
+
+// Updated by the mbed event loop thread and checked by the main thread
+static mbl::MblMutex g_download_mutex("mbl_download_progress");
+static mbl::MblDownloadProgressTracker g_download_tracker(g_download_config);
+
+// timerfd on which the main thread checks g_download_tracker
+static int g_download_check_fd = -1;
+
+static mbl::metrics::Gauge g_download_bytes("update_download_bytes");
+static mbl::metrics::Gauge g_download_total_bytes("update_download_total_bytes");
+static mbl::metrics::Gauge g_download_bytes_per_second("update_download_bytes_per_second");
+static mbl::metrics::Gauge g_download_eta_s("update_download_eta_s");
+static mbl::metrics::Gauge g_download_stalled_s("update_download_stalled_s");
+static mbl::metrics::Counter g_download_stalls("update_download_stalls");
+
+/**
+ * Make g_download_check_fd expire every interval_ms, or disarm it if
+ * interval_ms is 0. Called with g_download_mutex locked.
+ */
+static void arm_download_check_timer(const uint32_t interval_ms)
+{
+    if (g_download_check_fd == -1) {
+        return;
+    }
+    struct itimerspec spec;
+    std::memset(&spec, 0, sizeof(spec));
+    spec.it_interval.tv_sec = static_cast<time_t>(interval_ms / 1000);
+    spec.it_interval.tv_nsec = static_cast<long>(interval_ms % 1000) * 1000000;
+    spec.it_value = spec.it_interval;
+    timerfd_settime(g_download_check_fd, 0, &spec, 0);
+}
+
+static void set_download_metrics(const mbl::MblDownloadProgressTracker::Status& status)
+{
+    g_download_bytes.set(status.progress);
+    g_download_total_bytes.set(status.total);
+    g_download_bytes_per_second.set(static_cast<int64_t>(status.bytes_per_second));
+    g_download_eta_s.set(status.eta_s);
+    g_download_stalled_s.set(status.stalled_ms / 1000);
+    if (status.stall_started) {
+        g_download_stalls.add();
+    }
+}
+
 namespace mbl {
 namespace update_handlers {
 
@@ -42,15 +118,96 @@ static bool handle_install_request()
     return true;
 }
 
-void handle_download_progress(const uint32_t progress, const uint32_t total)
+MblError download_check_init()
+{
+    g_download_check_fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    if (g_download_check_fd == -1) {
+        tr_err("Failed to create download check timerfd: %s", std::strerror(errno));
+        return Error::EventLoopInitTimerfd;
+    }
+    return Error::None;
+}
+
+int get_download_check_fd()
 {
-    const unsigned percent = static_cast<unsigned>(progress * 100ULL / total);
+    return g_download_check_fd;
+}
 
-    tr_info("Downloading: %u %%", percent);
+void check_download_progress()
+{
+    uint64_t expirations;
+    const ssize_t read_ret = read(g_download_check_fd, &expirations, sizeof(expirations));
+    static_cast<void>(read_ret);
 
-    if (progress == total)
+    MblDownloadProgressTracker::Status status;
     {
-        tr_info("Download completed");
+        MblScopedLock lock(g_download_mutex);
+        if (!g_download_tracker.check(get_monotonic_time_ms(), status)) {
+            arm_download_check_timer(0);
+            return;
+        }
+        if (status.stall_started) {
+            arm_download_check_timer(MBL_UPDATE_PROGRESS_STEP_S * 1000);
+        }
+    }
+
+    set_download_metrics(status);
+    if (status.should_log) {
+        tr_warn(
+            "Download stalled at %u %%: no progress for %" PRId64 " s",
+            status.percent,
+            status.stalled_ms / 1000);
+    }
+}
+
+void handle_download_progress(const uint32_t progress, const uint32_t total)
+{
+    MblDownloadProgressTracker::Status status;
+    {
+        MblScopedLock lock(g_download_mutex);
+        status = g_download_tracker.update(progress, total, get_monotonic_time_ms());
+        if (status.completed) {
+            arm_download_check_timer(0);
+        }
+        else if (status.started || status.stalled_ms != 0) {
+            arm_download_check_timer(g_download_check_ms);
+        }
+    }
+
+    set_download_metrics(status);
+
+    if (status.stalled_ms != 0) {
+        tr_warn("Download resumed after no progress for %" PRId64 " s", status.stalled_ms / 1000);
+    }
+
+    if (!status.should_log) {
+        return;
+    }
+
+    if (status.completed) {
+        const int64_t elapsed_ms = status.elapsed_ms > 0 ? status.elapsed_ms : 1;
+        tr_info(
+            "Download completed: %" PRIu32 " bytes in %" PRId64 ".%03" PRId64 " s (%" PRIu64 " bytes/s)",
+            status.total,
+            elapsed_ms / 1000,
+            elapsed_ms % 1000,
+            static_cast<uint64_t>(status.total) * 1000 / static_cast<uint64_t>(elapsed_ms));
+    }
+    else if (status.eta_s >= 0) {
+        tr_info(
+            "Downloading: %u %% (%" PRIu32 "/%" PRIu32 " bytes, %" PRIu64 " bytes/s, ETA %" PRId64 " s)",
+            status.percent,
+            status.progress,
+            status.total,
+            status.bytes_per_second,
+            status.eta_s);
+    }
+    else {
+        tr_info(
+            "Downloading: %u %% (%" PRIu32 "/%" PRIu32 " bytes)",
+            status.percent,
+            status.progress,
+            status.total);
     }
 }
 
@@ -18,6 +18,8 @@
 #ifndef update_handlers_h_
 #define update_handlers_h_
 
+#include "MblError.h"
+
 #include <stdint.h>
 
 namespace mbl {
@@ -36,6 +38,25 @@ bool handle_authorize(int32_t request);
  */
 void handle_download_progress(uint32_t progress, uint32_t total);
 
+/**
+ * Create the timerfd returned by get_download_check_fd(). Must be called
+ * before the mbed event loop can report download progress.
+ */
+MblError download_check_init();
+
+/**
+ * Get the timerfd created by download_check_init(). It expires periodically
+ * while a download is in progress.
+ */
+int get_download_check_fd();
+
+/**
+ * Re-check the progress of the current download, so that the download rate
+ * metrics fall and a stall is reported while no progress arrives. Call when
+ * get_download_check_fd() is readable and before logging metrics.
+ */
+void check_download_progress();
+
 } // namespace update_handlers
 } // namespace mbl
 
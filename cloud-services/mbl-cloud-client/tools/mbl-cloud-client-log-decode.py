@@ -0,0 +1,239 @@
+#!/usr/bin/env python3
+# Copyright (c) 2020 Arm Limited and Contributors. All rights reserved.
+#
+# SPDX-License-Identifier: Apache-2.0
+
+"""Decode a binary mbl-cloud-client log into text log lines.
+
+mbl-cloud-client writes a binary log (/var/log/mbl-cloud-client.blog) when
+it is built with the MBL_LOG_BINARY CMake option. See source/log_binary.h for
+the file format.
+"""
+
+import argparse
+import datetime
+import re
+import struct
+import sys
+
+RECORD_FORMAT = 0x01
+RECORD_TRACE = 0x02
+RECORD_TEXT = 0x03
+RECORD_UTC_OFFSET = 0x04
+
+MAGIC = b"MBLB"
+# Version 2 added UTC offset records
+SUPPORTED_VERSIONS = (1, 2)
+
+# mbed-trace level values and the names used in text log lines
+LEVEL_NAMES = {0x01: "CMD ", 0x02: "ERR ", 0x04: "WARN", 0x08: "INFO", 0x10: "DBG "}
+
+# A printf conversion specification
+SPEC_RE = re.compile(
+    r"%(?P<flags>[-+ #0]*)(?P<width>\*|\d+)?(?:\.(?P<precision>\*|\d+))?"
+    r"(?P<length>hh|h|ll|l|L|q|j|z|t)?(?P<conversion>[diouxXeEfFgGaAcspn%])"
+)
+
+
+class DecodeError(Exception):
+    """The binary log is malformed."""
+
+
+class Reader:
+    """Reads primitive values from a binary log."""
+
+    def __init__(self, data):
+        """Create a reader for the given bytes."""
+        self.data = data
+        self.pos = 0
+
+    def at_end(self):
+        """Return True if all data has been read."""
+        return self.pos >= len(self.data)
+
+    def read_bytes(self, length):
+        """Read length raw bytes."""
+        if self.pos + length > len(self.data):
+            raise DecodeError("unexpected end of file")
+        value = self.data[self.pos : self.pos + length]
+        self.pos += length
+        return value
+
+    def read_u8(self):
+        """Read a single byte."""
+        return self.read_bytes(1)[0]
+
+    def read_varint(self):
+        """Read an unsigned LEB128 integer."""
+        value = 0
+        shift = 0
+        while True:
+            byte = self.read_u8()
+            value |= (byte & 0x7F) << shift
+            if not byte & 0x80:
+                return value
+            shift += 7
+
+    def read_svarint(self):
+        """Read a zigzag-encoded LEB128 integer."""
+        value = self.read_varint()
+        return (value >> 1) ^ -(value & 1)
+
+    def read_string(self):
+        """Read a length-prefixed string."""
+        length = self.read_varint()
+        return self.read_bytes(length).decode("utf-8", errors="replace")
+
+    def read_double(self):
+        """Read a little endian IEEE 754 double."""
+        return struct.unpack("<d", self.read_bytes(8))[0]
+
+
+class Format:
+    """A trace format: the format string of one tr_* call site."""
+
+    def __init__(self, level, group, fmt, signature):
+        """Create a trace format."""
+        self.level = level
+        self.group = group
+        self.fmt = fmt
+        self.signature = signature
+        self.python_fmt = _convert_format(fmt)
+
+    def read_args(self, reader):
+        """Read the arguments of a trace record with this format."""
+        args = []
+        for kind in self.signature:
+            if kind == "i":
+                args.append(reader.read_svarint())
+            elif kind in ("u", "p"):
+                args.append(reader.read_varint())
+            elif kind == "d":
+                args.append(reader.read_double())
+            elif kind == "s":
+                args.append(reader.read_string())
+            else:
+                raise DecodeError(
+                    "unknown argument type '{}'".format(kind)
+                )
+        return args
+
+    def render(self, args):
+        """Format a trace message from its arguments."""
+        try:
+            return self.python_fmt % tuple(args)
+        except (TypeError, ValueError):
+            return "{} {}".format(self.fmt, args)
+
+
+def _convert_format(fmt):
+    """Convert a C printf format string to a Python % format string."""
+
+    def convert(match):
+        conversion = match.group("conversion")
+        if conversion == "%":
+            return "%%"
+        if conversion == "p":
+            return "0x%x"
+        if conversion == "u":
+            conversion = "d"
+        if conversion in ("n", "a", "A"):
+            return ""
+        return "%{}{}{}{}".format(
+            match.group("flags"),
+            match.group("width") or "",
+            "." + match.group("precision")
+            if match.group("precision") is not None
+            else "",
+            conversion,
+        )
+
+    return SPEC_RE.sub(convert, fmt)
+
+
+def _time_prefix(time_us, utc_offset):
+    """Return the time prefix used in text log lines."""
+    tz = datetime.timezone(datetime.timedelta(seconds=utc_offset))
+    when = datetime.datetime.fromtimestamp(time_us / 1e6, tz)
+    return when.strftime("%Y-%m-%dT%H:%M:%S%z ")
+
+
+def decode(data, out):
+    """Decode a binary log, writing text lines to out."""
+    reader = Reader(data)
+    formats = {}
+    time_us = 0
+    utc_offset = 0
+    while not reader.at_end():
+        # A reopened or rotated file may contain several headers
+        if data.startswith(MAGIC, reader.pos):
+            reader.read_bytes(len(MAGIC))
+            version = reader.read_u8()
+            if version not in SUPPORTED_VERSIONS:
+                raise DecodeError(
+                    "unsupported file format version {}".format(version)
+                )
+            time_us, utc_offset = struct.unpack("<qi", reader.read_bytes(12))
+            formats = {}
+            continue
+
+        record_type = reader.read_u8()
+        if record_type == RECORD_FORMAT:
+            format_id = reader.read_varint()
+            level = reader.read_u8()
+            group = reader.read_string()
+            fmt = reader.read_string()
+            signature = reader.read_string()
+            formats[format_id] = Format(level, group, fmt, signature)
+        elif record_type == RECORD_TRACE:
+            format_id = reader.read_varint()
+            time_us += reader.read_svarint()
+            if format_id not in formats:
+                raise DecodeError("unknown format ID {}".format(format_id))
+            fmt = formats[format_id]
+            message = fmt.render(fmt.read_args(reader))
+            out.write(
+                "{}[{}][{:<4}]: {}\n".format(
+                    _time_prefix(time_us, utc_offset),
+                    LEVEL_NAMES.get(fmt.level, "????"),
+                    fmt.group,
+                    message,
+                )
+            )
+        elif record_type == RECORD_TEXT:
+            time_us += reader.read_svarint()
+            text = reader.read_string()
+            out.write("{}{}\n".format(_time_prefix(time_us, utc_offset), text))
+        elif record_type == RECORD_UTC_OFFSET:
+            utc_offset = reader.read_svarint()
+        else:
+            raise DecodeError(
+                "unknown record type 0x{:02x} at offset {}".format(
+                    record_type, reader.pos - 1
+                )
+            )
+
+
+def main():
+    """Decode the binary log named on the command line."""
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument(
+        "log_file",
+        nargs="?",
+        default="/var/log/mbl-cloud-client.blog",
+        help="binary log file to decode (default: %(default)s)",
+    )
+    args = parser.parse_args()
+
+    with open(args.log_file, "rb") as log_file:
+        data = log_file.read()
+    try:
+        decode(data, sys.stdout)
+    except DecodeError as error:
+        print("{}: {}".format(args.log_file, error), file=sys.stderr)
+        return 1
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,209 @@
+/*
+ * Copyright (c) 2020 Arm Limited and Contributors. All rights reserved.
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ * Licensed under the Apache License, Version 2.0 (the License); you may
+ * not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an AS IS BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Measure the latency of resource broker D-Bus calls.
+//
+// Usage: mbl-cloud-connect-dbus-benchmark [CALLS]
+//
+// Runs a resource broker with its D-Bus backend in this process, connects to
+// it as an application over the "system" bus and makes CALLS (default 10000)
+// synchronous SetResourceValue calls, then has the broker send CALLS
+// resource updates to the application. Run it against a private bus rather
+// than the real system bus:
+//
+//   dbus-daemon --session --fork --print-address
+//   DBUS_SYSTEM_BUS_ADDRESS=<printed address> mbl-cloud-connect-dbus-benchmark
+
+#include "cloud-connect-resource-broker/MblCloudConnectResourceBroker.h"
+
+#include <systemd/sd-bus.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdarg>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+namespace {
+
+const char* const g_service_name = "com.mbed.Cloud";
+const char* const g_object_path = "/com/mbed/Cloud/Connect1";
+const char* const g_interface_name = "com.mbed.Cloud.Connect1";
+
+const char* const g_definition =
+    "{\"3303\": {\"0\": {\"5700\": {\"mode\": \"dynamic\", \"type\": \"float\", \"operations\": [\"get\"]}}}}";
+
+// Values set by the application go nowhere
+class NullCloudClient : public mbl::MblCloudConnectCloudClientInterface
+{
+public:
+    void SendResourceValues(const std::vector<mbl::ResourceValue>& /*values*/) override {}
+};
+
+struct UpdateCounts
+{
+    size_t signals;
+    size_t updates;
+};
+
+int handle_resources_updated(sd_bus_message* const m, void* const userdata, sd_bus_error* const /*ret_error*/)
+{
+    UpdateCounts* const counts = static_cast<UpdateCounts*>(userdata);
+    ++counts->signals;
+
+    int r = sd_bus_message_enter_container(m, 'a', "(ss)");
+    const char* path = nullptr;
+    const char* value = nullptr;
+    while (r >= 0 && (r = sd_bus_message_read(m, "(ss)", &path, &value)) > 0) {
+        ++counts->updates;
+    }
+    return 0;
+}
+
+int call(sd_bus* const bus, const char* const member, uint32_t& status, const char* const types, ...)
+{
+    sd_bus_message* request = nullptr;
+    sd_bus_message* reply = nullptr;
+    sd_bus_error error = SD_BUS_ERROR_NULL;
+
+    int r = sd_bus_message_new_method_call(bus, &request, g_service_name, g_object_path, g_interface_name, member);
+    if (r >= 0 && types) {
+        va_list args;
+        va_start(args, types);
+        r = sd_bus_message_appendv(request, types, args);
+        va_end(args);
+    }
+    if (r >= 0) {
+        r = sd_bus_call(bus, request, 0, &error, &reply);
+    }
+    if (r >= 0) {
+        r = sd_bus_message_read(reply, "u", &status);
+    }
+    if (r < 0) {
+        std::fprintf(stderr, "%s failed: %s\n", member, error.message ? error.message : std::strerror(-r));
+    }
+
+    sd_bus_error_free(&error);
+    sd_bus_message_unref(reply);
+    sd_bus_message_unref(request);
+    return r;
+}
+
+double percentile(const std::vector<double>& sorted, const double p)
+{
+    const size_t index = static_cast<size_t>(p * static_cast<double>(sorted.size() - 1) + 0.5);
+    return sorted[index];
+}
+
+} // namespace
+
+int main(const int argc, const char* const argv[])
+{
+    const size_t calls = (argc > 1) ? std::strtoul(argv[1], nullptr, 10) : 10000;
+    if (calls == 0) {
+        std::fprintf(stderr, "Usage: %s [CALLS]\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    NullCloudClient cloud_client;
+    mbl::MblCloudConnectResourceBroker broker(cloud_client);
+    if (broker.Init() != mbl::Error::None) {
+        std::fprintf(stderr, "Failed to start the resource broker; is DBUS_SYSTEM_BUS_ADDRESS set?\n");
+        return EXIT_FAILURE;
+    }
+
+    sd_bus* bus = nullptr;
+    int r = sd_bus_open_system(&bus);
+    if (r < 0) {
+        std::fprintf(stderr, "Failed to connect to the bus: %s\n", std::strerror(-r));
+        return EXIT_FAILURE;
+    }
+
+    UpdateCounts counts = {0, 0};
+    r = sd_bus_match_signal(
+        bus, nullptr, nullptr, g_object_path, g_interface_name, "ResourcesUpdated",
+        &handle_resources_updated, &counts);
+    if (r < 0) {
+        std::fprintf(stderr, "Failed to add match: %s\n", std::strerror(-r));
+        return EXIT_FAILURE;
+    }
+
+    uint32_t status = 0;
+    if (call(bus, "RegisterResources", status, "s", g_definition) < 0 || status != mbl::Error::None) {
+        std::fprintf(stderr, "RegisterResources returned %u\n", static_cast<unsigned>(status));
+        return EXIT_FAILURE;
+    }
+
+    // Synchronous calls: each waits for its reply, so this measures round
+    // trip latency through dbus-daemon and the broker's thread
+    std::vector<double> latencies_us;
+    latencies_us.reserve(calls);
+    const auto calls_start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < calls; ++i) {
+        const std::string value = std::to_string(i);
+        const auto start = std::chrono::steady_clock::now();
+        if (call(bus, "SetResourceValue", status, "ss", "/3303/0/5700", value.c_str()) < 0 ||
+            status != mbl::Error::None)
+        {
+            return EXIT_FAILURE;
+        }
+        const auto end = std::chrono::steady_clock::now();
+        latencies_us.push_back(std::chrono::duration<double, std::micro>(end - start).count());
+    }
+    const double calls_s =
+        std::chrono::duration<double>(std::chrono::steady_clock::now() - calls_start).count();
+
+    std::sort(latencies_us.begin(), latencies_us.end());
+    std::printf("SetResourceValue: %zu calls in %.3f s, %.0f calls/s\n", calls, calls_s, static_cast<double>(calls) / calls_s);
+    std::printf(
+        "  latency us: p50 %.1f  p99 %.1f  max %.1f\n",
+        percentile(latencies_us, 0.5),
+        percentile(latencies_us, 0.99),
+        latencies_us.back());
+
+    // Cloud updates are sent to the application as batched signals
+    const auto updates_start = std::chrono::steady_clock::now();
+    const mbl::ResourcePath path = mbl::MakeResourcePath(3303, 0, 5700);
+    for (size_t i = 0; i < calls; ++i) {
+        broker.ResourceUpdatedByCloud(path, std::to_string(i));
+    }
+    while (counts.updates < calls) {
+        r = sd_bus_process(bus, nullptr);
+        if (r < 0) {
+            std::fprintf(stderr, "Failed to process bus: %s\n", std::strerror(-r));
+            return EXIT_FAILURE;
+        }
+        if (r == 0) {
+            sd_bus_wait(bus, UINT64_MAX);
+        }
+    }
+    const double updates_s =
+        std::chrono::duration<double>(std::chrono::steady_clock::now() - updates_start).count();
+    std::printf(
+        "ResourcesUpdated: %zu updates in %zu signals in %.3f s, %.0f updates/s\n",
+        counts.updates,
+        counts.signals,
+        updates_s,
+        static_cast<double>(counts.updates) / updates_s);
+
+    call(bus, "DeregisterResources", status, nullptr);
+    sd_bus_flush_close_unref(bus);
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,426 @@
+/*
+ * Copyright (c) 2020 Arm Limited and Contributors. All rights reserved.
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ * Licensed under the Apache License, Version 2.0 (the License); you may
+ * not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an AS IS BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Load generator for the resource broker, with no IPC or cloud in the way.
+//
+// Usage: mbl-cloud-connect-load-generator [-a APPS] [-r RESOURCES]
+//            [-s SETS_PER_S] [-c CLOUD_UPDATES_PER_S] [-d SECONDS]
+//
+// Runs a resource broker in this process with APPS (default 10) applications
+// connected through an MblCloudConnectIpcLoopback, each with RESOURCES
+// (default 100) resources. Each application has a thread that sets its
+// resources' values in turn, SETS_PER_S times a second (default 1000; 0 for
+// as fast as possible). The broker's notification ticks send the values to
+// a simulated cloud client that only records them. The main thread also
+// makes CLOUD_UPDATES_PER_S cloud updates a second (default 0), spread over
+// all resources, which the broker passes back to the applications.
+//
+// After SECONDS (default 10) it reports throughput, latency percentiles and
+// heap allocations per message:
+// - set latency: the SetResourceValue call, in the application's thread
+// - delivery latency: from the call to the value reaching the cloud client,
+//   which includes waiting for a notification tick
+// - cloud update latency: from the cloud update to the application's
+//   notification
+
+#include "cloud-connect-resource-broker/MblCloudConnectIpcLoopback.h"
+#include "cloud-connect-resource-broker/MblCloudConnectResourceBroker.h"
+#include "monotonic_time.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cinttypes>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <new>
+#include <poll.h>
+#include <string>
+#include <thread>
+#include <time.h>
+#include <unistd.h>
+#include <vector>
+
+namespace {
+
+// Heap allocations counted while measuring
+std::atomic<bool> g_counting(false);
+std::atomic<uint64_t> g_allocations(0);
+
+void* counted_alloc(const size_t size)
+{
+    if (g_counting.load(std::memory_order_relaxed)) {
+        g_allocations.fetch_add(1, std::memory_order_relaxed);
+    }
+    void* const block = std::malloc(size ? size : 1);
+    if (!block) {
+        throw std::bad_alloc();
+    }
+    return block;
+}
+
+} // namespace
+
+void* operator new(const size_t size) { return counted_alloc(size); }
+void* operator new[](const size_t size) { return counted_alloc(size); }
+void operator delete(void* const ptr) noexcept { std::free(ptr); }
+void operator delete[](void* const ptr) noexcept { std::free(ptr); }
+void operator delete(void* const ptr, size_t) noexcept { std::free(ptr); }
+void operator delete[](void* const ptr, size_t) noexcept { std::free(ptr); }
+
+namespace {
+
+// Latency samples kept per thread. Samples after this many are counted but
+// not recorded, so that recording never allocates.
+const size_t g_max_samples = 1 << 20;
+
+struct Options
+{
+    unsigned apps;
+    unsigned resources;
+    unsigned sets_per_s;
+    unsigned cloud_updates_per_s;
+    unsigned seconds;
+};
+
+// Latencies in microseconds, preallocated
+class Samples
+{
+public:
+    Samples() : count_(0) { samples_.reserve(g_max_samples); }
+
+    void Record(const int64_t latency_us)
+    {
+        ++count_;
+        if (samples_.size() < samples_.capacity()) {
+            samples_.push_back(static_cast<uint32_t>(std::max<int64_t>(latency_us, 0)));
+        }
+    }
+
+    void Merge(const Samples& other)
+    {
+        count_ += other.count_;
+        samples_.insert(samples_.end(), other.samples_.begin(), other.samples_.end());
+    }
+
+    uint64_t GetCount() const { return count_; }
+
+    void Print(const char* const name)
+    {
+        if (samples_.empty()) {
+            std::printf("  %s latency us: no samples\n", name);
+            return;
+        }
+        std::sort(samples_.begin(), samples_.end());
+        std::printf(
+            "  %s latency us: p50 %u  p99 %u  p99.9 %u  max %u\n",
+            name,
+            Percentile(0.5),
+            Percentile(0.99),
+            Percentile(0.999),
+            samples_.back());
+    }
+
+private:
+    uint32_t Percentile(const double p) const
+    {
+        return samples_[static_cast<size_t>(p * static_cast<double>(samples_.size() - 1) + 0.5)];
+    }
+
+    uint64_t count_;
+    std::vector<uint32_t> samples_;
+};
+
+// Values are the time they were set at, so the receiving side can work out
+// their latency without looking anything up
+void format_time(char* const buffer, const size_t size, const int64_t time_us)
+{
+    std::snprintf(buffer, size, "%" PRId64, time_us);
+}
+
+int64_t parse_time(const char* const value)
+{
+    return std::strtoll(value, nullptr, 10);
+}
+
+// Stands in for MbedCloudClient: records when values arrive. Only called on
+// the main thread.
+class SimulatedCloudClient : public mbl::MblCloudConnectCloudClientInterface
+{
+public:
+    SimulatedCloudClient() : batches_(0) {}
+
+    void SendResourceValues(const std::vector<mbl::ResourceValue>& values) override
+    {
+        const int64_t now_us = mbl::get_monotonic_time_us();
+        ++batches_;
+        for (const mbl::ResourceValue& value : values) {
+            delivery_.Record(now_us - parse_time(value.value.c_str()));
+        }
+    }
+
+    uint64_t batches_;
+    Samples delivery_;
+};
+
+// Stands in for the applications' side of notifications. Called on the
+// main thread, which makes the cloud updates.
+class Applications : public mbl::MblCloudConnectIpcLoopback::Listener
+{
+public:
+    void ResourcesUpdated(mbl::StringHandle /*app_name*/, const std::vector<mbl::ResourceValue>& values) override
+    {
+        const int64_t now_us = mbl::get_monotonic_time_us();
+        for (const mbl::ResourceValue& value : values) {
+            cloud_updates_.Record(now_us - parse_time(value.value.c_str()));
+        }
+    }
+
+    Samples cloud_updates_;
+};
+
+std::string make_definition(const unsigned object_id, const unsigned resources)
+{
+    std::string json = "{\"" + std::to_string(object_id) + "\": {";
+    for (unsigned i = 0; i < resources; ++i) {
+        json += (i == 0) ? "\"" : ", \"";
+        json += std::to_string(i);
+        json += "\": {\"1\": {\"mode\": \"dynamic\", \"type\": \"string\", \"operations\": [\"get\", \"put\"]}}";
+    }
+    return json + "}}";
+}
+
+void sleep_until_us(const int64_t time_us)
+{
+    struct timespec ts;
+    ts.tv_sec = static_cast<time_t>(time_us / 1000000);
+    ts.tv_nsec = static_cast<long>(time_us % 1000000) * 1000;
+    while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, nullptr) != 0) {
+    }
+}
+
+// One application: sets its resources' values in turn until end_us
+void run_application(
+    mbl::MblCloudConnectIpcLoopback& loopback,
+    const mbl::StringHandle app_name,
+    const std::vector<std::string>& paths,
+    const Options& options,
+    const int64_t start_us,
+    const int64_t end_us,
+    Samples& samples,
+    uint64_t& failures)
+{
+    const int64_t period_us = options.sets_per_s ? 1000000 / options.sets_per_s : 0;
+    int64_t next_us = start_us;
+    char value[24];
+    for (size_t i = 0;; ++i) {
+        if (period_us) {
+            sleep_until_us(next_us);
+            next_us += period_us;
+        }
+        const int64_t set_us = mbl::get_monotonic_time_us();
+        if (set_us >= end_us) {
+            return;
+        }
+
+        format_time(value, sizeof(value), set_us);
+        if (loopback.SetResourceValue(app_name, paths[i % paths.size()].c_str(), value) != mbl::Error::None) {
+            ++failures;
+        }
+        samples.Record(mbl::get_monotonic_time_us() - set_us);
+    }
+}
+
+bool parse_options(const int argc, char* const argv[], Options& options)
+{
+    options = Options{10, 100, 1000, 0, 10};
+    int opt = 0;
+    while ((opt = getopt(argc, argv, "a:r:s:c:d:")) != -1) {
+        const unsigned long value = std::strtoul(optarg, nullptr, 10);
+        switch (opt) {
+            case 'a': options.apps = static_cast<unsigned>(value); break;
+            case 'r': options.resources = static_cast<unsigned>(value); break;
+            case 's': options.sets_per_s = static_cast<unsigned>(value); break;
+            case 'c': options.cloud_updates_per_s = static_cast<unsigned>(value); break;
+            case 'd': options.seconds = static_cast<unsigned>(value); break;
+            default: return false;
+        }
+    }
+    return optind == argc && options.apps > 0 && options.apps <= 50000 && options.resources > 0 &&
+           options.resources <= 65536 && options.seconds > 0;
+}
+
+} // namespace
+
+int main(const int argc, char* argv[])
+{
+    Options options;
+    if (!parse_options(argc, argv, options)) {
+        std::fprintf(
+            stderr,
+            "Usage: %s [-a APPS] [-r RESOURCES] [-s SETS_PER_S] [-c CLOUD_UPDATES_PER_S] [-d SECONDS]\n",
+            argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    SimulatedCloudClient cloud_client;
+    Applications applications;
+    mbl::MblCloudConnectResourceBroker broker(cloud_client);
+    if (broker.Init("") != mbl::Error::None) {
+        std::fprintf(stderr, "Failed to start the resource broker\n");
+        return EXIT_FAILURE;
+    }
+    mbl::MblCloudConnectIpcLoopback loopback(broker, applications);
+
+    // Each application gets an object of its own
+    const unsigned first_object_id = 10000;
+    std::vector<mbl::StringHandle> app_names(options.apps);
+    std::vector<std::vector<std::string>> paths(options.apps);
+    std::vector<mbl::ResourcePath> all_paths;
+    for (unsigned app = 0; app < options.apps; ++app) {
+        app_names[app] = mbl::MblStringPool::Intern("loopback:" + std::to_string(app));
+        const std::string definition = make_definition(first_object_id + app, options.resources);
+        const mbl::MblError status = loopback.RegisterResources(app_names[app], definition.c_str(), definition.size());
+        if (status != mbl::Error::None) {
+            std::fprintf(stderr, "RegisterResources failed: %s\n", mbl::MblError_to_str(status));
+            return EXIT_FAILURE;
+        }
+        for (unsigned i = 0; i < options.resources; ++i) {
+            paths[app].push_back("/" + std::to_string(first_object_id + app) + "/" + std::to_string(i) + "/1");
+            all_paths.push_back(mbl::MakeResourcePath(
+                static_cast<uint16_t>(first_object_id + app), static_cast<uint16_t>(i), 1));
+        }
+    }
+
+    std::vector<std::unique_ptr<Samples>> set_samples;
+    std::vector<uint64_t> failures(options.apps, 0);
+    for (unsigned app = 0; app < options.apps; ++app) {
+        set_samples.emplace_back(new Samples());
+    }
+    std::vector<mbl::ResourceValue> cloud_updates(1);
+    cloud_updates[0].value.reserve(32);
+    std::vector<mbl::MblError> cloud_statuses;
+    cloud_statuses.reserve(1);
+
+    std::printf(
+        "%u applications x %u resources, %u sets/s each%s, %u cloud updates/s, %u s\n",
+        options.apps,
+        options.resources,
+        options.sets_per_s,
+        options.sets_per_s ? "" : " (unpaced)",
+        options.cloud_updates_per_s,
+        options.seconds);
+
+    // Start everything a little in the future so that the threads start
+    // together
+    const int64_t start_us = mbl::get_monotonic_time_us() + 100000;
+    const int64_t end_us = start_us + static_cast<int64_t>(options.seconds) * 1000000;
+    std::vector<std::thread> threads;
+    for (unsigned app = 0; app < options.apps; ++app) {
+        threads.emplace_back(
+            run_application,
+            std::ref(loopback),
+            app_names[app],
+            std::cref(paths[app]),
+            std::cref(options),
+            start_us,
+            end_us,
+            std::ref(*set_samples[app]),
+            std::ref(failures[app]));
+    }
+
+    // The event loop: notification ticks and cloud updates
+    sleep_until_us(start_us);
+    g_counting = true;
+    const int64_t cloud_period_us = options.cloud_updates_per_s ? 1000000 / options.cloud_updates_per_s : 0;
+    int64_t next_cloud_us = start_us;
+    size_t next_cloud_path = 0;
+    struct pollfd poll_fd = {broker.GetNotificationFd(), POLLIN, 0};
+    for (;;) {
+        const int64_t now_us = mbl::get_monotonic_time_us();
+        if (now_us >= end_us) {
+            break;
+        }
+        int64_t wait_us = end_us - now_us;
+        if (cloud_period_us) {
+            if (now_us >= next_cloud_us) {
+                cloud_updates[0].path = all_paths[next_cloud_path++ % all_paths.size()];
+                char value[24];
+                format_time(value, sizeof(value), now_us);
+                cloud_updates[0].value = value;
+                broker.ResourcesUpdatedByCloud(cloud_updates, cloud_statuses);
+                next_cloud_us += cloud_period_us;
+                continue;
+            }
+            wait_us = std::min(wait_us, next_cloud_us - now_us);
+        }
+        if (poll(&poll_fd, 1, static_cast<int>((wait_us + 999) / 1000)) > 0) {
+            broker.HandleNotificationTimer();
+        }
+    }
+    for (std::thread& thread : threads) {
+        thread.join();
+    }
+    g_counting = false;
+    const uint64_t allocations = g_allocations;
+
+    // Let the last values through
+    for (int i = 0; i < 2; ++i) {
+        if (poll(&poll_fd, 1, 1000) > 0) {
+            broker.HandleNotificationTimer();
+        }
+    }
+
+    Samples all_sets;
+    uint64_t total_failures = 0;
+    for (unsigned app = 0; app < options.apps; ++app) {
+        all_sets.Merge(*set_samples[app]);
+        total_failures += failures[app];
+    }
+    const double seconds = static_cast<double>(options.seconds);
+    const uint64_t messages = all_sets.GetCount() + applications.cloud_updates_.GetCount();
+
+    std::printf(
+        "SetResourceValue: %" PRIu64 " calls, %.0f calls/s, %" PRIu64 " failed\n",
+        all_sets.GetCount(),
+        static_cast<double>(all_sets.GetCount()) / seconds,
+        total_failures);
+    all_sets.Print("set");
+    std::printf(
+        "Cloud client: %" PRIu64 " values in %" PRIu64 " batches, %.0f values/s (the rest were replaced before being sent)\n",
+        cloud_client.delivery_.GetCount(),
+        cloud_client.batches_,
+        static_cast<double>(cloud_client.delivery_.GetCount()) / seconds);
+    cloud_client.delivery_.Print("delivery");
+    if (options.cloud_updates_per_s) {
+        std::printf(
+            "Cloud updates: %" PRIu64 " delivered to applications, %.0f/s\n",
+            applications.cloud_updates_.GetCount(),
+            static_cast<double>(applications.cloud_updates_.GetCount()) / seconds);
+        applications.cloud_updates_.Print("cloud update");
+    }
+    std::printf(
+        "Allocations: %" PRIu64 " while measuring, %.2f per message\n",
+        allocations,
+        messages ? static_cast<double>(allocations) / static_cast<double>(messages) : 0.0);
+
+    for (unsigned app = 0; app < options.apps; ++app) {
+        loopback.DeregisterResources(app_names[app]);
+    }
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,128 @@
+/*
+ * Copyright (c) 2020 Arm Limited and Contributors. All rights reserved.
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ * Licensed under the Apache License, Version 2.0 (the License); you may
+ * not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an AS IS BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Compare the per-thread cached log line time prefix with formatting it from
+// scratch on every line.
+//
+// Usage: mbl-log-time-prefix-benchmark [-n CALLS] [TIMEZONE...]
+//
+// For each TIMEZONE (default UTC, Europe/London and Asia/Kolkata) it checks
+// that both produce the same prefix, then prints the mean time per call of
+// CALLS (default 2000000) calls to each. Build with MBL_LOG_TIMESTAMP_MS to
+// measure the prefix with milliseconds.
+
+#include "log_time_prefix.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <thread>
+#include <time.h>
+#include <unistd.h>
+
+namespace {
+
+typedef char* (*MakePrefix)(char* buffer, size_t buffer_size);
+
+// Keeps the prefixes from being optimized away
+volatile unsigned g_sink = 0;
+
+int64_t get_time_ns()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return static_cast<int64_t>(ts.tv_sec) * 1000000000 + ts.tv_nsec;
+}
+
+double ns_per_call(const MakePrefix make_prefix, const unsigned long calls)
+{
+    char buffer[mbl::log_time_prefix_buffer_size];
+    const int64_t start_ns = get_time_ns();
+    for (unsigned long i = 0; i < calls; ++i) {
+        make_prefix(buffer, sizeof(buffer));
+        g_sink = g_sink + static_cast<unsigned char>(buffer[18]);
+    }
+    return static_cast<double>(get_time_ns() - start_ns) / static_cast<double>(calls);
+}
+
+bool prefixes_match()
+{
+    // The two calls can straddle a change of the last digit, so retry a few
+    // times before calling it a mismatch
+    char cached[mbl::log_time_prefix_buffer_size];
+    char uncached[mbl::log_time_prefix_buffer_size];
+    for (int attempt = 0; attempt < 10; ++attempt) {
+        mbl::make_time_prefix(cached, sizeof(cached));
+        mbl::make_time_prefix_uncached(uncached, sizeof(uncached));
+        if (std::strcmp(cached, uncached) == 0) {
+            return true;
+        }
+    }
+    std::printf("  mismatch: cached \"%s\", uncached \"%s\"\n", cached, uncached);
+    return false;
+}
+
+bool run_time_zone(const char* const time_zone, const unsigned long calls)
+{
+    setenv("TZ", time_zone, 1);
+    tzset();
+
+    char prefix[mbl::log_time_prefix_buffer_size];
+    std::printf("%s (%s)\n", time_zone, mbl::make_time_prefix_uncached(prefix, sizeof(prefix)));
+    if (!prefixes_match()) {
+        return false;
+    }
+
+    const double uncached_ns = ns_per_call(&mbl::make_time_prefix_uncached, calls);
+    const double cached_ns = ns_per_call(&mbl::make_time_prefix, calls);
+    std::printf("  uncached %7.1f ns per call\n", uncached_ns);
+    std::printf("  cached   %7.1f ns per call (%.1fx)\n", cached_ns, uncached_ns / cached_ns);
+    return true;
+}
+
+} // namespace
+
+int main(const int argc, char* argv[])
+{
+    unsigned long calls = 2000000;
+    int opt = 0;
+    while ((opt = getopt(argc, argv, "n:")) != -1) {
+        if (opt != 'n' || (calls = std::strtoul(optarg, nullptr, 10)) == 0) {
+            std::fprintf(stderr, "Usage: %s [-n CALLS] [TIMEZONE...]\n", argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+
+    static const char* const default_time_zones[] = {"UTC", "Europe/London", "Asia/Kolkata"};
+    const char* const* time_zones = default_time_zones;
+    size_t num_time_zones = sizeof(default_time_zones) / sizeof(default_time_zones[0]);
+    if (optind < argc) {
+        time_zones = argv + optind;
+        num_time_zones = static_cast<size_t>(argc - optind);
+    }
+
+    // The cache is per thread and only notices a new time zone when the
+    // minute changes, so start each time zone on a new thread
+    bool ok = true;
+    for (size_t i = 0; i < num_time_zones; ++i) {
+        bool zone_ok = false;
+        std::thread thread([&] { zone_ok = run_time_zone(time_zones[i], calls); });
+        thread.join();
+        ok = ok && zone_ok;
+    }
+    return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
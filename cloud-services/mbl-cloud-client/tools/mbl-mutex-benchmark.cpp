@@ -0,0 +1,212 @@
+/*
+ * Copyright (c) 2020 Arm Limited and Contributors. All rights reserved.
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ * Licensed under the Apache License, Version 2.0 (the License); you may
+ * not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an AS IS BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Compare MblFutexMutex with the pthread mutex that MblMutex uses by
+// default, on critical sections as short as the ones mbl-cloud-client has.
+//
+// Usage: mbl-mutex-benchmark [-t THREADS] [-d SECONDS] [-w WORK]
+//
+// Each workload runs for SECONDS (default 2) with each mutex:
+// - uncontended: one thread locking and unlocking
+// - shared: THREADS threads (default 4, one per core of a Cortex-A53
+//   cluster) each flipping a shared state and reading a shared pointer under
+//   the mutex, with WORK iterations (default 50) of private work between
+//   locks
+// - oversubscribed: the same with twice as many threads as THREADS
+//
+// For each it prints lock/unlock pairs per second, the mean time each thread
+// took per pair and its private work, context switches per thousand pairs (how often the mutex went to the
+// kernel and slept) and the fewest and most pairs any thread managed (its
+// fairness).
+
+#include "MblFutexMutex.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cinttypes>
+#include <cstdio>
+#include <cstdlib>
+#include <pthread.h>
+#include <sys/resource.h>
+#include <thread>
+#include <time.h>
+#include <unistd.h>
+#include <vector>
+
+namespace {
+
+struct Options
+{
+    unsigned threads;
+    unsigned seconds;
+    unsigned work;
+};
+
+class PthreadMutex
+{
+public:
+    PthreadMutex() { pthread_mutex_init(&mutex_, nullptr); }
+    ~PthreadMutex() { pthread_mutex_destroy(&mutex_); }
+
+    void lock() { pthread_mutex_lock(&mutex_); }
+    void unlock() { pthread_mutex_unlock(&mutex_); }
+
+private:
+    pthread_mutex_t mutex_;
+};
+
+// What the mutex protects: like MblCloudClient's state_ and cloud_client_
+struct Shared
+{
+    int state;
+    const void* pointer;
+    uint64_t reads;
+};
+
+int64_t get_time_ns()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return static_cast<int64_t>(ts.tv_sec) * 1000000000 + ts.tv_nsec;
+}
+
+uint64_t get_context_switches()
+{
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return static_cast<uint64_t>(usage.ru_nvcsw + usage.ru_nivcsw);
+}
+
+// Keeps the private work from being optimized away
+std::atomic<uint32_t> g_sink(0);
+
+// Work done outside the mutex, which the compiler can't remove
+uint32_t private_work(uint32_t seed, const unsigned iterations)
+{
+    for (unsigned i = 0; i < iterations; ++i) {
+        seed = seed * 1664525 + 1013904223;
+        __asm__ __volatile__("" : "+r"(seed));
+    }
+    return seed;
+}
+
+template <typename Mutex>
+void run_workload(
+    const char* const mutex_name,
+    const char* const workload_name,
+    const unsigned thread_count,
+    const Options& options)
+{
+    Mutex mutex;
+    Shared shared = {0, &shared, 0};
+    std::atomic<bool> start(false);
+    std::atomic<bool> stop(false);
+    std::vector<uint64_t> counts(thread_count, 0);
+
+    std::vector<std::thread> threads;
+    for (unsigned t = 0; t < thread_count; ++t) {
+        threads.emplace_back([&, t] {
+            while (!start.load(std::memory_order_acquire)) {
+                std::this_thread::yield();
+            }
+            uint32_t seed = t;
+            uint64_t count = 0;
+            while (!stop.load(std::memory_order_relaxed)) {
+                mutex.lock();
+                shared.state = !shared.state;
+                if (shared.pointer) {
+                    ++shared.reads;
+                }
+                mutex.unlock();
+                ++count;
+                seed = private_work(seed, options.work);
+            }
+            counts[t] = count;
+            g_sink.fetch_add(seed, std::memory_order_relaxed);
+        });
+    }
+
+    const uint64_t switches_before = get_context_switches();
+    const int64_t start_ns = get_time_ns();
+    start.store(true, std::memory_order_release);
+    std::this_thread::sleep_for(std::chrono::seconds(options.seconds));
+    stop = true;
+    for (std::thread& thread : threads) {
+        thread.join();
+    }
+    const int64_t elapsed_ns = get_time_ns() - start_ns;
+    const uint64_t switches = get_context_switches() - switches_before;
+
+    uint64_t total = 0;
+    for (const uint64_t count : counts) {
+        total += count;
+    }
+    const auto minmax = std::minmax_element(counts.begin(), counts.end());
+    std::printf(
+        "%-15s %-7s %2u threads: %8.2f M/s  %7.1f ns per loop  %7.2f switches/1000  per thread %" PRIu64 "..%" PRIu64 "\n",
+        workload_name,
+        mutex_name,
+        thread_count,
+        static_cast<double>(total) * 1000.0 / static_cast<double>(elapsed_ns),
+        static_cast<double>(elapsed_ns) * thread_count / static_cast<double>(total ? total : 1),
+        static_cast<double>(switches) * 1000.0 / static_cast<double>(total ? total : 1),
+        *minmax.first,
+        *minmax.second);
+}
+
+void run_workloads(const char* const workload_name, const unsigned thread_count, const Options& options)
+{
+    run_workload<PthreadMutex>("pthread", workload_name, thread_count, options);
+    run_workload<mbl::MblFutexMutex>("futex", workload_name, thread_count, options);
+}
+
+bool parse_options(const int argc, char* const argv[], Options& options)
+{
+    options = Options{4, 2, 50};
+    int opt = 0;
+    while ((opt = getopt(argc, argv, "t:d:w:")) != -1) {
+        const unsigned long value = std::strtoul(optarg, nullptr, 10);
+        switch (opt) {
+            case 't': options.threads = static_cast<unsigned>(value); break;
+            case 'd': options.seconds = static_cast<unsigned>(value); break;
+            case 'w': options.work = static_cast<unsigned>(value); break;
+            default: return false;
+        }
+    }
+    return optind == argc && options.threads > 0 && options.threads <= 256 && options.seconds > 0;
+}
+
+} // namespace
+
+int main(const int argc, char* argv[])
+{
+    Options options;
+    if (!parse_options(argc, argv, options)) {
+        std::fprintf(stderr, "Usage: %s [-t THREADS] [-d SECONDS] [-w WORK]\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    std::printf(
+        "%ld CPUs online, %u iterations of work between locks\n",
+        sysconf(_SC_NPROCESSORS_ONLN),
+        options.work);
+    run_workloads("uncontended", 1, options);
+    run_workloads("shared", options.threads, options);
+    run_workloads("oversubscribed", 2 * options.threads, options);
+    return EXIT_SUCCESS;
+}
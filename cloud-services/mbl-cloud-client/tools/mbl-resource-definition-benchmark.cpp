@@ -0,0 +1,211 @@
+/*
+ * Copyright (c) 2020 Arm Limited and Contributors. All rights reserved.
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ * Licensed under the Apache License, Version 2.0 (the License); you may
+ * not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an AS IS BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Compare the streaming resource definition parser used by the resource
+// broker with building a jsoncpp DOM of the same definition.
+//
+// Usage: mbl-resource-definition-benchmark [FILE...]
+//
+// With no files, definitions of several sizes are generated. For each
+// definition the best time of several runs and the peak heap use are
+// printed. The jsoncpp figures are for parsing only; a DOM based
+// implementation would still have to walk the tree to fill the database.
+
+#include "cloud-connect-resource-broker/MblCloudConnectResourceDatabase.h"
+#include "cloud-connect-resource-broker/MblResourceDefinitionParser.h"
+
+#include <json/json.h>
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <memory>
+#include <new>
+#include <sstream>
+#include <string>
+
+namespace {
+
+// Heap accounting. Each allocation is prefixed with its size.
+size_t g_heap_current = 0;
+size_t g_heap_peak = 0;
+const size_t g_header_size = alignof(std::max_align_t);
+
+void* counted_alloc(const size_t size)
+{
+    unsigned char* const block = static_cast<unsigned char*>(std::malloc(size + g_header_size));
+    if (!block) {
+        throw std::bad_alloc();
+    }
+    *reinterpret_cast<size_t*>(static_cast<void*>(block)) = size;
+    g_heap_current += size;
+    if (g_heap_current > g_heap_peak) {
+        g_heap_peak = g_heap_current;
+    }
+    return block + g_header_size;
+}
+
+void counted_free(void* const ptr)
+{
+    if (!ptr) {
+        return;
+    }
+    unsigned char* const block = static_cast<unsigned char*>(ptr) - g_header_size;
+    g_heap_current -= *reinterpret_cast<size_t*>(static_cast<void*>(block));
+    std::free(block);
+}
+
+} // namespace
+
+void* operator new(const size_t size) { return counted_alloc(size); }
+void* operator new[](const size_t size) { return counted_alloc(size); }
+void operator delete(void* const ptr) noexcept { counted_free(ptr); }
+void operator delete[](void* const ptr) noexcept { counted_free(ptr); }
+void operator delete(void* const ptr, size_t) noexcept { counted_free(ptr); }
+void operator delete[](void* const ptr, size_t) noexcept { counted_free(ptr); }
+
+namespace {
+
+const int g_runs = 5;
+
+struct Result
+{
+    bool ok;
+    double best_ms;
+    size_t peak_bytes;
+};
+
+std::string generate_definition(const unsigned objects, const unsigned instances, const unsigned resources)
+{
+    static const char* const templates[] = {
+        "{\"mode\": \"dynamic\", \"resource_type\": \"temperature\", \"type\": \"float\", "
+        "\"value\": 21.5, \"operations\": [\"get\"], \"observable\": true}",
+        "{\"mode\": \"static\", \"resource_type\": \"name\", \"type\": \"string\", "
+        "\"value\": \"sensor \\\"outdoor\\\"\", \"operations\": [\"get\", \"put\"]}",
+        "{\"mode\": \"dynamic\", \"type\": \"integer\", \"value\": 0, "
+        "\"operations\": [\"get\", \"put\", \"post\"], \"multiple_instance\": false}",
+        "{\"mode\": \"static\", \"type\": \"boolean\", \"value\": true, \"operations\": [\"get\"]}",
+    };
+
+    std::ostringstream json;
+    json << "{\n";
+    for (unsigned o = 0; o < objects; ++o) {
+        json << (o ? ",\n" : "") << "  \"" << 10000 + o << "\": {\n";
+        for (unsigned i = 0; i < instances; ++i) {
+            json << (i ? ",\n" : "") << "    \"" << i << "\": {\n";
+            for (unsigned r = 0; r < resources; ++r) {
+                json << (r ? ",\n" : "") << "      \"" << 5000 + r << "\": "
+                     << templates[(o + i + r) % (sizeof(templates) / sizeof(templates[0]))];
+            }
+            json << "\n    }";
+        }
+        json << "\n  }";
+    }
+    json << "\n}\n";
+    return json.str();
+}
+
+template <typename Parse>
+Result measure(Parse parse)
+{
+    Result result = {true, 0.0, 0};
+    for (int run = 0; run < g_runs; ++run) {
+        const size_t heap_before = g_heap_current;
+        g_heap_peak = heap_before;
+
+        const auto start = std::chrono::steady_clock::now();
+        result.ok = parse() && result.ok;
+        const auto end = std::chrono::steady_clock::now();
+
+        const double ms = std::chrono::duration<double, std::milli>(end - start).count();
+        if (run == 0 || ms < result.best_ms) {
+            result.best_ms = ms;
+        }
+        result.peak_bytes = g_heap_peak - heap_before;
+    }
+    return result;
+}
+
+Result measure_streaming(const std::string& json, size_t& resources)
+{
+    return measure([&json, &resources]() {
+        mbl::MblCloudConnectResourceDatabase db;
+        mbl::MblCloudConnectResourceDatabase::AppHandle app = mbl::MblCloudConnectResourceDatabase::invalid_app;
+        if (db.AddApplication(mbl::MblStringPool::Intern(std::string("benchmark")), app) != mbl::Error::None) {
+            return false;
+        }
+        mbl::MblResourceDefinitionParser parser(db, app);
+        const bool ok = parser.Parse(json.data(), json.size()) == mbl::Error::None;
+        resources = db.GetResourceCount();
+        return ok;
+    });
+}
+
+Result measure_jsoncpp(const std::string& json)
+{
+    return measure([&json]() {
+        Json::CharReaderBuilder builder;
+        const std::unique_ptr<Json::CharReader> reader(builder.newCharReader());
+        Json::Value root;
+        std::string errors;
+        return reader->parse(json.data(), json.data() + json.size(), &root, &errors);
+    });
+}
+
+void benchmark(const char* const name, const std::string& json)
+{
+    size_t resources = 0;
+    const Result streaming = measure_streaming(json, resources);
+    const Result dom = measure_jsoncpp(json);
+
+    std::printf("%s: %zu bytes, %zu resources\n", name, json.size(), resources);
+    std::printf(
+        "  streaming into database: %9.3f ms  peak heap %9zu bytes%s\n",
+        streaming.best_ms,
+        streaming.peak_bytes,
+        streaming.ok ? "" : "  (FAILED)");
+    std::printf(
+        "  jsoncpp DOM parse only:  %9.3f ms  peak heap %9zu bytes%s\n",
+        dom.best_ms,
+        dom.peak_bytes,
+        dom.ok ? "" : "  (FAILED)");
+}
+
+} // namespace
+
+int main(const int argc, const char* const argv[])
+{
+    if (argc > 1) {
+        for (int i = 1; i < argc; ++i) {
+            std::ifstream file(argv[i], std::ios::binary);
+            if (!file) {
+                std::fprintf(stderr, "Failed to open %s\n", argv[i]);
+                return EXIT_FAILURE;
+            }
+            std::ostringstream contents;
+            contents << file.rdbuf();
+            benchmark(argv[i], contents.str());
+        }
+        return EXIT_SUCCESS;
+    }
+
+    benchmark("generated small", generate_definition(4, 2, 8));
+    benchmark("generated medium", generate_definition(20, 10, 20));
+    benchmark("generated large", generate_definition(100, 20, 50));
+    return EXIT_SUCCESS;
+}